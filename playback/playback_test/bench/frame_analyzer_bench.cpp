@@ -0,0 +1,96 @@
+// Time FrameAnalyzer::analyze() takes per frame, for every kernel set the CPU supports.
+// Frames are synthetic YUV 4:2:0 with a moving textured luma plane, so every frame has
+// a previous one to diff against, like the frames of a decoded segment.
+//
+// Usage: frame_analyzer_bench [frames]
+
+#include "frame_analyzer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace playback;
+
+namespace
+{
+    struct Resolution
+    {
+        const char *name;
+        int width;
+        int height;
+    };
+
+    // Noise texture scrolled by a few pixels per frame, rows padded like decoder output
+    std::vector<std::vector<uint8_t>> makeLumaPlanes(int width, int height, int stride, size_t frames)
+    {
+        std::mt19937 random(42);
+        std::vector<uint8_t> texture(static_cast<size_t>(stride) * height * 2);
+        for (uint8_t &value : texture)
+        {
+            value = static_cast<uint8_t>(16 + random() % 220);
+        }
+        std::vector<std::vector<uint8_t>> planes(frames, std::vector<uint8_t>(static_cast<size_t>(stride) * height));
+        for (size_t i = 0; i < frames; i++)
+        {
+            size_t shift = (i * 3) % (static_cast<size_t>(stride) * height);
+            std::copy(texture.begin() + shift, texture.begin() + shift + planes[i].size(), planes[i].begin());
+        }
+        return planes;
+    }
+
+    // Sorted per-frame times in us
+    std::vector<double> measure(const Resolution &resolution, size_t frames)
+    {
+        int stride = (resolution.width + 63) / 64 * 64;
+        std::vector<std::vector<uint8_t>> planes = makeLumaPlanes(resolution.width, resolution.height, stride, frames);
+        AVFrame frame = {};
+        frame.format = AV_PIX_FMT_YUV420P;
+        frame.width = resolution.width;
+        frame.height = resolution.height;
+        frame.linesize[0] = stride;
+
+        FrameAnalyzer analyzer;
+        FrameMetrics metrics;
+        std::vector<double> times;
+        times.reserve(frames);
+        for (size_t i = 0; i < frames; i++)
+        {
+            frame.data[0] = planes[i].data();
+            auto start = std::chrono::steady_clock::now();
+            analyzer.analyze(&frame, static_cast<long>(i * 40), metrics);
+            times.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::sort(times.begin(), times.end());
+        return times;
+    }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    size_t frames = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 300;
+    if (frames < 2)
+    {
+        std::fprintf(stderr, "Usage: %s [frames]\n", argv[0]);
+        return 1;
+    }
+    const Resolution resolutions[] = {{"720p", 1280, 720}, {"1080p", 1920, 1080}};
+    for (const char *kernels : {"avx2", "sse4.1", "scalar"})
+    {
+        if (!FrameAnalyzer::useKernels(kernels))
+        {
+            std::printf("%-7s not supported by this CPU\n", kernels);
+            continue;
+        }
+        for (const Resolution &resolution : resolutions)
+        {
+            std::vector<double> times = measure(resolution, frames);
+            std::printf("%-7s %-6s median %8.1f us, p99 %8.1f us per frame (%zu frames)\n", kernels, resolution.name,
+                        times[times.size() / 2], times[times.size() * 99 / 100], frames);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,187 @@
+// Parse time of a large live playlist with PlaylistTokenizer, next to the
+// istringstream/regex approach the manifest parser used before.
+//
+// Usage: playlist_tokenizer_bench [segments] [iterations]
+
+#include "playlist_tokenizer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace playback;
+
+namespace
+{
+    // Live LL-HLS media playlist: every segment has 4 parts listed next to its EXTINF
+    std::string makePlaylist(size_t segments)
+    {
+        std::ostringstream playlist;
+        playlist << "#EXTM3U\n#EXT-X-VERSION:9\n#EXT-X-TARGETDURATION:4\n"
+                 << "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=3.012\n"
+                 << "#EXT-X-PART-INF:PART-TARGET=1.004\n#EXT-X-MEDIA-SEQUENCE:100000\n";
+        for (size_t i = 0; i < segments; i++)
+        {
+            long sequence = 100000 + static_cast<long>(i);
+            if (i % 500 == 499)
+            {
+                playlist << "#EXT-X-DISCONTINUITY\n";
+            }
+            for (int part = 0; part < 4; part++)
+            {
+                playlist << "#EXT-X-PART:DURATION=1.00100,URI=\"segment-" << sequence << ".part" << part << ".ts\""
+                         << (part == 0 ? ",INDEPENDENT=YES" : "") << "\n";
+            }
+            playlist << "#EXTINF:4.00400,\nsegment-" << sequence << ".ts\n";
+        }
+        playlist << "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"segment-" << 100000 + segments << ".part0.ts\"\n";
+        return playlist.str();
+    }
+
+    struct Result
+    {
+        size_t segments = 0;
+        size_t parts = 0;
+        double duration = 0;
+        long last_sequence = 0;
+    };
+
+    Result parseWithTokenizer(const std::string &manifest)
+    {
+        Result result;
+        PlaylistTokenizer tokenizer(manifest);
+        PlaylistTokenizer::Line line;
+        while (tokenizer.next(line))
+        {
+            if (line.isUri())
+            {
+                result.segments++;
+                result.last_sequence = parse_uri_sequence_number(line.value);
+            }
+            else if (line.tag == "#EXTINF")
+            {
+                double duration = 0;
+                if (parse_double(line.value, duration))
+                {
+                    result.duration += duration;
+                }
+            }
+            else if (line.tag == "#EXT-X-PART")
+            {
+                AttributeList attributes(line.value);
+                std::string_view key;
+                std::string_view value;
+                while (attributes.next(key, value))
+                {
+                    if (key == "URI")
+                    {
+                        result.parts++;
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    std::string trim(const std::string &str)
+    {
+        size_t start = str.find_first_not_of(" \t\r\n");
+        size_t end = str.find_last_not_of(" \t\r\n");
+        return (start == std::string::npos || end == std::string::npos) ? "" : str.substr(start, end - start + 1);
+    }
+
+    // The line handling of the original parser: getline, trimmed copies, a regex per uri
+    Result parseWithStreams(const std::string &manifest)
+    {
+        Result result;
+        std::istringstream stream(manifest);
+        std::string line;
+        while (std::getline(stream, line))
+        {
+            line = trim(line);
+            if (line.rfind("#EXTINF:", 0) == 0)
+            {
+                result.duration += std::stod(line.substr(8));
+            }
+            else if (line.rfind("#EXT-X-PART:", 0) == 0)
+            {
+                std::istringstream tagStream(line.substr(12));
+                std::string token;
+                while (std::getline(tagStream, token, ','))
+                {
+                    auto pos = token.find('=');
+                    if (pos != std::string::npos && trim(token.substr(0, pos)) == "URI")
+                    {
+                        result.parts++;
+                    }
+                }
+            }
+            else if (!line.empty() && line[0] != '#')
+            {
+                result.segments++;
+                if (!std::regex_match(line, std::regex(R"(https?://.*)")))
+                {
+                    std::smatch match;
+                    if (std::regex_search(line, match, std::regex(R"(-(\d+)\.ts$)")))
+                    {
+                        result.last_sequence = std::stol(match[1]);
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    // Median time of one parse in us
+    template <typename Parse>
+    double measure(const std::string &manifest, size_t iterations, Parse parse, Result &result)
+    {
+        std::vector<double> times;
+        for (size_t i = 0; i < iterations; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            result = parse(manifest);
+            auto end = std::chrono::steady_clock::now();
+            times.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+        }
+        std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+        return times[times.size() / 2];
+    }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    size_t segments = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+    size_t iterations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 50;
+    if (segments == 0 || iterations == 0)
+    {
+        std::fprintf(stderr, "Usage: %s [segments] [iterations]\n", argv[0]);
+        return 1;
+    }
+    std::string manifest = makePlaylist(segments);
+
+    Result tokenized;
+    Result streamed;
+    double tokenizer_us = measure(manifest, iterations, parseWithTokenizer, tokenized);
+    double streams_us = measure(manifest, iterations, parseWithStreams, streamed);
+    if (tokenized.segments != streamed.segments || tokenized.parts != streamed.parts ||
+        tokenized.last_sequence != streamed.last_sequence)
+    {
+        std::fprintf(stderr, "Parsers disagree: %zu/%zu segments, %zu/%zu parts\n", tokenized.segments, streamed.segments,
+                     tokenized.parts, streamed.parts);
+        return 1;
+    }
+
+    size_t entries = tokenized.segments + tokenized.parts;
+    std::printf("Playlist: %zu segments, %zu parts, %zu bytes, median of %zu runs\n", tokenized.segments, tokenized.parts,
+                manifest.size(), iterations);
+    std::printf("  tokenizer:          %10.1f us (%6.1f ns/entry)\n", tokenizer_us, tokenizer_us * 1000 / entries);
+    std::printf("  istringstream/regex:%10.1f us (%6.1f ns/entry)\n", streams_us, streams_us * 1000 / entries);
+    std::printf("  speedup: %.1fx\n", streams_us / tokenizer_us);
+    return 0;
+}
@@ -0,0 +1,121 @@
+// Throughput and hand-off latency of RingQueue next to the mutex based Queue it replaces.
+//
+// Usage: ring_queue_bench [items] [round_trips]
+
+#include "queue.hpp"
+#include "ring_queue.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace playback;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr size_t CAPACITY = 1024;
+
+    // Queue only has blocking push()/pop(), RingQueue is driven through the same two calls
+    template <typename Q>
+    double measureThroughput(size_t producers, size_t consumers, size_t items)
+    {
+        Q queue(CAPACITY);
+        std::vector<int> values(items);
+        size_t per_producer = items / producers;
+        size_t per_consumer = items / consumers;
+        auto start = Clock::now();
+        std::vector<std::thread> threads;
+        for (size_t p = 0; p < producers; p++)
+        {
+            threads.emplace_back([&queue, &values, p, per_producer]()
+                                 {
+                                     for (size_t i = 0; i < per_producer; i++)
+                                     {
+                                         queue.push(&values[p * per_producer + i]);
+                                     } });
+        }
+        for (size_t c = 0; c < consumers; c++)
+        {
+            threads.emplace_back([&queue, per_consumer]()
+                                 {
+                                     for (size_t i = 0; i < per_consumer; i++)
+                                     {
+                                         queue.pop();
+                                     } });
+        }
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        return per_producer * producers / seconds / 1e6;
+    }
+
+    struct Latency
+    {
+        double median_us = 0;
+        double p99_us = 0;
+    };
+
+    // Ping-pong between two threads, half a round trip is the time from push() to the woken pop()
+    template <typename Q>
+    Latency measureLatency(size_t round_trips)
+    {
+        Q ping(CAPACITY);
+        Q pong(CAPACITY);
+        int token = 0;
+        std::thread echo([&ping, &pong, round_trips]()
+                         {
+                             for (size_t i = 0; i < round_trips; i++)
+                             {
+                                 pong.push(ping.pop());
+                             } });
+        std::vector<double> times;
+        times.reserve(round_trips);
+        for (size_t i = 0; i < round_trips; i++)
+        {
+            auto start = Clock::now();
+            ping.push(&token);
+            pong.pop();
+            times.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count() / 2);
+        }
+        echo.join();
+        std::sort(times.begin(), times.end());
+        return {times[times.size() / 2], times[times.size() * 99 / 100]};
+    }
+
+    template <typename Q>
+    void report(const char *name, size_t items, size_t round_trips)
+    {
+        std::printf("%s\n", name);
+        for (size_t threads : {1, 2, 4})
+        {
+            std::printf("  %zu producer(s) x %zu consumer(s): %7.2f M items/s\n", threads, threads,
+                        measureThroughput<Q>(threads, threads, items));
+        }
+        Latency latency = measureLatency<Q>(round_trips);
+        std::printf("  hand-off latency: median %.2f us, p99 %.2f us\n", latency.median_us, latency.p99_us);
+    }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    size_t items = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+    size_t round_trips = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 20000;
+    if (items < 4 || round_trips == 0)
+    {
+        std::fprintf(stderr, "Usage: %s [items] [round_trips]\n", argv[0]);
+        return 1;
+    }
+    std::printf("Queue capacity %zu, %zu items, %zu round trips, %u hardware threads\n", CAPACITY, items, round_trips,
+                std::thread::hardware_concurrency());
+    report<Queue<int *>>("Queue (mutex + condition variable)", items, round_trips);
+    report<RingQueue<int *>>("RingQueue (lock-free ring + futex)", items, round_trips);
+    return 0;
+}
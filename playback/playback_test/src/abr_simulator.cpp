@@ -0,0 +1,381 @@
+#include "abr_simulator.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <future>
+#include <stdexcept>
+#include <algorithm>
+
+using namespace playback;
+
+// ---- AbrTrace ----
+
+void AbrTrace::save(const std::string &path) const
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to write ABR trace: " + path);
+    }
+    file << "# playback ABR trace\n";
+    file << "latency " << latency << "\n";
+    file << "bitrates";
+    for (long bitrate : bitrates)
+    {
+        file << " " << bitrate;
+    }
+    file << "\n";
+    for (const AbrSegment &segment : segments)
+    {
+        file << "segment " << segment.duration;
+        for (size_t size : segment.sizes)
+        {
+            file << " " << size;
+        }
+        file << "\n";
+    }
+    for (const NetworkSample &sample : network)
+    {
+        file << "network " << sample.duration << " " << sample.kbps << "\n";
+    }
+}
+
+AbrTrace AbrTrace::load(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to open ABR trace: " + path);
+    }
+    AbrTrace trace;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(file, line))
+    {
+        line_number++;
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string record;
+        fields >> record;
+        bool ok = true;
+        if (record == "latency")
+        {
+            ok = static_cast<bool>(fields >> trace.latency);
+        }
+        else if (record == "bitrates")
+        {
+            long bitrate;
+            while (fields >> bitrate)
+            {
+                trace.bitrates.push_back(bitrate);
+            }
+        }
+        else if (record == "segment")
+        {
+            AbrSegment segment;
+            size_t size;
+            ok = static_cast<bool>(fields >> segment.duration);
+            while (ok && fields >> size)
+            {
+                segment.sizes.push_back(size);
+            }
+            ok = ok && segment.sizes.size() == trace.bitrates.size();
+            trace.segments.push_back(segment);
+        }
+        else if (record == "network")
+        {
+            NetworkSample sample;
+            ok = static_cast<bool>(fields >> sample.duration >> sample.kbps);
+            trace.network.push_back(sample);
+        }
+        else
+        {
+            ok = false;
+        }
+        if (!ok)
+        {
+            throw std::runtime_error("Malformed ABR trace " + path + ", line " + std::to_string(line_number) + ": " + line);
+        }
+    }
+    return trace;
+}
+
+// ---- Policies ----
+
+size_t ThroughputPolicy::choose(const AbrContext &context)
+{
+    const std::vector<long> &bitrates = context.trace->bitrates;
+    if (context.throughput->getSamples() == 0)
+    {
+        return 0;
+    }
+    double budget = context.throughput->getEstimateKbps() * 1000 * safety_factor;
+    size_t quality = 0;
+    for (size_t i = 0; i < bitrates.size(); i++)
+    {
+        if (bitrates[i] <= budget)
+        {
+            quality = i;
+        }
+    }
+    return quality;
+}
+
+size_t BolaPolicy::choose(const AbrContext &context)
+{
+    const std::vector<long> &bitrates = context.trace->bitrates;
+    if (bitrates.size() < 2)
+    {
+        return 0;
+    }
+    // Utilities ln(bitrate / lowest) + 1, gp and V chosen so the top variant wins at buffer_target
+    double highest_utility = std::log(static_cast<double>(bitrates.back()) / bitrates.front()) + 1;
+    double gp = (highest_utility - 1) / (buffer_target / minimum_buffer - 1);
+    double v = minimum_buffer / gp;
+
+    size_t quality = 0;
+    double best = -INFINITY;
+    for (size_t i = 0; i < bitrates.size(); i++)
+    {
+        double utility = std::log(static_cast<double>(bitrates[i]) / bitrates.front()) + 1;
+        double score = (v * (utility + gp) - context.buffer_level) / bitrates[i];
+        if (score >= best)
+        {
+            best = score;
+            quality = i;
+        }
+    }
+    return quality;
+}
+
+size_t HybridPolicy::choose(const AbrContext &context)
+{
+    if (use_bola && context.buffer_level < switch_off)
+    {
+        use_bola = false;
+    }
+    else if (!use_bola && context.buffer_level >= switch_on)
+    {
+        use_bola = true;
+    }
+    return use_bola ? bola.choose(context) : throughput.choose(context);
+}
+
+// ---- AbrSimulator ----
+
+namespace
+{
+    // Replays the recorded link throughput, looping when the simulation outlasts the recording
+    class NetworkReplay
+    {
+    public:
+        explicit NetworkReplay(const std::vector<NetworkSample> &samples) : samples(samples)
+        {
+            for (const NetworkSample &sample : samples)
+            {
+                total += sample.duration;
+            }
+        }
+
+        // Time to receive `bytes` starting at `time`, in ms
+        double transferTime(size_t bytes, double time) const
+        {
+            double remaining = bytes * 8.0; // bits, kbps is bits per ms
+            double start = time;
+            double offset = std::fmod(time, total);
+            size_t index = 0;
+            while (index < samples.size() && offset >= samples[index].duration)
+            {
+                offset -= samples[index].duration;
+                index++;
+            }
+            while (remaining > 0)
+            {
+                const NetworkSample &sample = samples[index % samples.size()];
+                double available = sample.duration - offset;
+                if (sample.kbps * available >= remaining)
+                {
+                    time += remaining / sample.kbps;
+                    break;
+                }
+                remaining -= sample.kbps * available;
+                time += available;
+                offset = 0;
+                index++;
+            }
+            return time - start;
+        }
+
+    private:
+        const std::vector<NetworkSample> &samples;
+        double total = 0;
+    };
+} // namespace
+
+AbrSimulator::AbrSimulator(AbrSimulationOptions options) : options(options)
+{
+}
+
+std::vector<std::unique_ptr<AbrPolicy>> AbrSimulator::makeDefaultPolicies()
+{
+    std::vector<std::unique_ptr<AbrPolicy>> policies;
+    policies.push_back(std::make_unique<ThroughputPolicy>());
+    policies.push_back(std::make_unique<BolaPolicy>());
+    policies.push_back(std::make_unique<HybridPolicy>());
+    return policies;
+}
+
+std::vector<AbrResult> AbrSimulator::run(const AbrTrace &trace, std::vector<std::unique_ptr<AbrPolicy>> &policies) const
+{
+    // Invalid traces throw from simulate(), future::get() rethrows on this thread
+    std::vector<std::future<AbrResult>> futures;
+    for (auto &policy : policies)
+    {
+        AbrPolicy *current = policy.get();
+        futures.push_back(std::async(std::launch::async, [this, &trace, current]()
+                                     { return simulate(trace, *current); }));
+    }
+    std::vector<AbrResult> results;
+    for (auto &future : futures)
+    {
+        results.push_back(future.get());
+    }
+    return results;
+}
+
+AbrResult AbrSimulator::simulate(const AbrTrace &trace, AbrPolicy &policy) const
+{
+    // Zero-length or dead samples would never deliver a byte
+    std::vector<NetworkSample> link;
+    for (const NetworkSample &sample : trace.network)
+    {
+        if (sample.duration > 0 && sample.kbps > 0)
+        {
+            link.push_back(sample);
+        }
+    }
+    if (trace.bitrates.empty() || trace.segments.empty())
+    {
+        throw std::invalid_argument("ABR trace has no variants or segments.");
+    }
+    for (const AbrSegment &segment : trace.segments)
+    {
+        if (segment.sizes.size() != trace.bitrates.size())
+        {
+            throw std::invalid_argument("ABR trace segment sizes do not match the variants.");
+        }
+    }
+    if (link.empty())
+    {
+        throw std::invalid_argument("ABR trace has no network samples.");
+    }
+    policy.reset();
+    NetworkReplay network(link);
+    ThroughputEstimator throughput;
+    double top_mbps = trace.bitrates.back() / 1e6;
+    double rebuffer_penalty = options.rebuffer_penalty < 0 ? top_mbps : options.rebuffer_penalty;
+
+    AbrResult result;
+    result.policy = policy.getName();
+    double time = 0;   // ms
+    double buffer = 0; // s
+    bool playing = false;
+    bool started = false;
+    double stall_begin = 0; // ms
+    double utility = 0;     // Sum of bitrates in Mbps
+    double switch_cost = 0; // Sum of bitrate changes in Mbps
+    double bitrate_sum = 0; // kbps
+
+    // Plays out `elapsed` ms of buffer, stalls if it runs dry
+    auto play = [&](double elapsed)
+    {
+        if (playing)
+        {
+            double seconds = elapsed / 1000;
+            if (buffer >= seconds)
+            {
+                buffer -= seconds;
+            }
+            else
+            {
+                stall_begin = time + buffer * 1000;
+                buffer = 0;
+                playing = false;
+                result.stalls++;
+            }
+        }
+        time += elapsed;
+    };
+
+    size_t last_quality = 0;
+    for (size_t k = 0; k < trace.segments.size(); k++)
+    {
+        const AbrSegment &segment = trace.segments[k];
+        AbrContext context;
+        context.trace = &trace;
+        context.segment = k;
+        context.buffer_level = buffer;
+        context.last_quality = last_quality;
+        context.playing = playing;
+        context.throughput = &throughput;
+        size_t quality = std::min(policy.choose(context), segment.sizes.size() - 1);
+
+        size_t bytes = segment.sizes[quality];
+        double download = trace.latency + network.transferTime(bytes, time + trace.latency);
+        play(download);
+        throughput.add(bytes, static_cast<long>(download * 1000));
+        buffer += segment.duration;
+
+        if (!playing && buffer >= (started ? options.rebuffer_buffer : options.startup_buffer))
+        {
+            playing = true;
+            if (!started)
+            {
+                started = true;
+                result.startup_delay = time / 1000;
+            }
+            else
+            {
+                result.stall_time += (time - stall_begin) / 1000;
+            }
+        }
+        if (playing && buffer > options.max_buffer)
+        {
+            play((buffer - options.max_buffer) * 1000);
+        }
+
+        double mbps = trace.bitrates[quality] / 1e6;
+        utility += mbps;
+        bitrate_sum += trace.bitrates[quality] / 1000.0;
+        if (k > 0 && quality != last_quality)
+        {
+            double change = std::fabs(mbps - trace.bitrates[last_quality] / 1e6);
+            switch_cost += change;
+            result.switches++;
+            result.average_switch += change * 1000;
+        }
+        last_quality = quality;
+        result.qualities.push_back(quality);
+    }
+    if (!started)
+    {
+        result.startup_delay = time / 1000;
+    }
+    else if (!playing)
+    {
+        // The end of the media ends a stall even below the rebuffer threshold
+        result.stall_time += (time - stall_begin) / 1000;
+    }
+
+    result.segments = trace.segments.size();
+    result.average_bitrate = bitrate_sum / result.segments;
+    result.average_switch = result.switches > 0 ? result.average_switch / result.switches : 0;
+    result.duration = time / 1000 + buffer;
+    double penalty = switch_cost * options.switch_penalty + (result.stall_time + result.startup_delay) * rebuffer_penalty;
+    result.qoe = (utility - penalty) / result.segments;
+    return result;
+}
@@ -0,0 +1,182 @@
+#ifndef ABR_SIMULATOR_HPP
+#define ABR_SIMULATOR_HPP
+
+#include "throughput_estimator.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+namespace playback
+{
+
+    // One media sequence of a recorded trace
+    struct AbrSegment
+    {
+        double duration = 0;       // s
+        std::vector<size_t> sizes; // Bytes per variant, in ladder order
+    };
+
+    // Link throughput over one stretch of the recording
+    struct NetworkSample
+    {
+        double duration = 0; // ms
+        double kbps = 0;
+    };
+
+    /**
+     * @brief Segment sizes of every rendition and the link throughput they were fetched at.
+     *
+     * Recorded by VariantMonitor::getTrace() while all renditions are monitored, saved and loaded
+     * as text so a trace from a constrained link can be replayed offline.
+     */
+    struct AbrTrace
+    {
+        std::vector<long> bitrates; // Declared BANDWIDTH per variant in bps, ascending
+        std::vector<AbrSegment> segments;
+        std::vector<NetworkSample> network;
+        double latency = 0; // Median time to first byte of the recorded requests, ms
+
+        /**
+         * @brief Writes the trace as text, one line per record.
+         *
+         * @throws std::runtime_error if the file cannot be written.
+         */
+        void save(const std::string &path) const;
+
+        /**
+         * @brief Reads a trace written by save().
+         *
+         * @throws std::runtime_error if the file cannot be read or is malformed.
+         */
+        static AbrTrace load(const std::string &path);
+    };
+
+    // What a policy sees before requesting the next segment
+    struct AbrContext
+    {
+        const AbrTrace *trace = nullptr;
+        size_t segment = 0;        // Index of the segment to request
+        double buffer_level = 0;   // s
+        size_t last_quality = 0;   // Variant of the previous segment
+        bool playing = false;      // false during startup and stalls
+        const ThroughputEstimator *throughput = nullptr; // Fed with the simulated downloads
+    };
+
+    // Bitrate selection rule of a player
+    class AbrPolicy
+    {
+    public:
+        virtual ~AbrPolicy() = default;
+        virtual const char *getName() const = 0;
+        // Index of the variant to request, in ladder order
+        virtual size_t choose(const AbrContext &context) = 0;
+        // Forgets the state of the previous simulation
+        virtual void reset() {}
+    };
+
+    // Highest bitrate under a safety fraction of the throughput estimate (hls.js/Shaka style)
+    class ThroughputPolicy : public AbrPolicy
+    {
+    public:
+        explicit ThroughputPolicy(double safety_factor = 0.9) : safety_factor(safety_factor) {}
+        const char *getName() const override { return "throughput"; }
+        size_t choose(const AbrContext &context) override;
+
+    private:
+        double safety_factor;
+    };
+
+    /**
+     * @brief BOLA-BASIC (Spiteri et al. 2016) with the dash.js parameters: the variant that
+     * maximizes (V * (utility + gp) - buffer) / bitrate, utilities are log bitrates.
+     */
+    class BolaPolicy : public AbrPolicy
+    {
+    public:
+        explicit BolaPolicy(double buffer_target = 12, double minimum_buffer = 10)
+            : buffer_target(buffer_target), minimum_buffer(minimum_buffer) {}
+        const char *getName() const override { return "bola"; }
+        size_t choose(const AbrContext &context) override;
+
+    private:
+        double buffer_target;  // s
+        double minimum_buffer; // s
+    };
+
+    // Throughput rule while the buffer is low, BOLA once it is full enough (dash.js DYNAMIC)
+    class HybridPolicy : public AbrPolicy
+    {
+    public:
+        HybridPolicy(double switch_on = 10, double switch_off = 6) : switch_on(switch_on), switch_off(switch_off) {}
+        const char *getName() const override { return "hybrid"; }
+        size_t choose(const AbrContext &context) override;
+        void reset() override { use_bola = false; }
+
+    private:
+        ThroughputPolicy throughput;
+        BolaPolicy bola;
+        double switch_on;  // Buffer level that hands over to BOLA, s
+        double switch_off; // Buffer level that hands back to the throughput rule, s
+        bool use_bola = false;
+    };
+
+    struct AbrSimulationOptions
+    {
+        double startup_buffer = 2;   // s of media before playback starts
+        double rebuffer_buffer = 1;  // s of media before a stall ends
+        double max_buffer = 30;      // s, requests pause while the buffer is full
+        double switch_penalty = 1;   // QoE weight of a bitrate change, per Mbps
+        double rebuffer_penalty = -1; // QoE weight per s of stall, < 0 uses the top bitrate in Mbps
+    };
+
+    // Quality of experience of one policy over one trace
+    struct AbrResult
+    {
+        std::string policy;
+        size_t segments = 0;
+        double average_bitrate = 0; // kbps
+        size_t switches = 0;
+        double average_switch = 0; // kbps per switch
+        size_t stalls = 0;
+        double stall_time = 0;    // s
+        double startup_delay = 0; // s
+        double duration = 0;      // Wall time of the simulated session, s
+        double qoe = 0;           // Linear QoE (Yin et al. 2015) per segment
+        std::vector<size_t> qualities; // Variant chosen per segment
+    };
+
+    /**
+     * @brief Replays recorded traces against ABR policies faster than real time.
+     *
+     * Each policy runs a simulated player on its own thread: it picks a variant per segment,
+     * downloads the recorded size of that variant through the recorded link throughput, and
+     * plays the buffer out in simulated time. A simulation costs microseconds per segment.
+     */
+    class AbrSimulator
+    {
+    public:
+        explicit AbrSimulator(AbrSimulationOptions options = AbrSimulationOptions());
+
+        // Throughput, BOLA and hybrid policies
+        static std::vector<std::unique_ptr<AbrPolicy>> makeDefaultPolicies();
+
+        /**
+         * @brief Simulates every policy over the trace, one thread per policy.
+         *
+         * @return One result per policy, in the order given.
+         * @throws std::invalid_argument if the trace has no variants, segments or network samples.
+         */
+        std::vector<AbrResult> run(const AbrTrace &trace, std::vector<std::unique_ptr<AbrPolicy>> &policies) const;
+
+        // Simulates one policy on the calling thread, throws like run()
+        AbrResult simulate(const AbrTrace &trace, AbrPolicy &policy) const;
+
+    private:
+        AbrSimulationOptions options;
+    };
+
+} // namespace playback
+
+#endif // ABR_SIMULATOR_HPP
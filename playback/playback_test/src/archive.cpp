@@ -0,0 +1,286 @@
+#include "archive.hpp"
+#include "constants.hpp"
+#include "logger.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+using namespace playback;
+
+constexpr const char *ARCHIVE_TAG = "Archive";
+
+constexpr char ARCHIVE_MAGIC[8] = {'P', 'B', 'A', 'R', 'C', 'H', 'V', '1'};
+constexpr uint32_t ARCHIVE_VERSION = 1;
+constexpr uint32_t RECORD_MAGIC = 0x52425043; // "CPBR" little endian, marks the start of a record
+constexpr size_t RECORD_ALIGNMENT = 8;
+
+namespace
+{
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+    };
+
+    struct RecordHeader
+    {
+        uint32_t magic;
+        uint16_t type;
+        uint16_t reserved;
+        int64_t time;
+        int64_t last_modified;
+        int64_t ttfb;
+        int64_t total_time;
+        uint32_t uri_size;
+        uint32_t body_size;
+    };
+
+    static_assert(sizeof(FileHeader) == 16, "Archive file header layout");
+    static_assert(sizeof(RecordHeader) == 48, "Archive record header layout");
+
+    size_t padding(size_t size)
+    {
+        return (RECORD_ALIGNMENT - size % RECORD_ALIGNMENT) % RECORD_ALIGNMENT;
+    }
+} // namespace
+
+// ---- ArchiveRecord ----
+
+HttpTransferInfo ArchiveRecord::getTransferInfo() const
+{
+    HttpTransferInfo info;
+    info.response_code = 200;
+    info.last_modified = last_modified;
+    info.starttransfer_time = ttfb;
+    info.total_time = total_time;
+    info.bytes = body.size();
+    return info;
+}
+
+// ---- ArchiveWriter ----
+
+ArchiveWriter::ArchiveWriter(const std::string &path) : path(path)
+{
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to open archive: " + path + ", " + std::strerror(errno));
+    }
+    struct stat status;
+    FileHeader header{};
+    bool valid = ::fstat(fd, &status) == 0;
+    if (valid && status.st_size == 0)
+    {
+        std::memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+        header.version = ARCHIVE_VERSION;
+        valid = ::write(fd, &header, sizeof(header)) == static_cast<ssize_t>(sizeof(header));
+    }
+    else if (valid)
+    {
+        valid = ::pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) &&
+                std::memcmp(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) == 0 && header.version == ARCHIVE_VERSION;
+    }
+    if (!valid)
+    {
+        ::close(fd);
+        throw std::runtime_error("Not a playback archive: " + path);
+    }
+    size_t file_size = std::max(static_cast<size_t>(status.st_size), sizeof(header));
+    end = findEnd(file_size);
+    if (end < file_size)
+    {
+        // Appended records would follow the torn one and never be read
+        Logger::getInstance().log("Dropping " + std::to_string(file_size - end) + " bytes of a torn record at the end of " + path,
+                                  Logger::Severity::WARNING, ARCHIVE_TAG);
+        if (::ftruncate(fd, static_cast<off_t>(end)) != 0)
+        {
+            int error = errno;
+            ::close(fd);
+            throw std::runtime_error("Failed to truncate archive: " + path + ", " + std::strerror(error));
+        }
+    }
+}
+
+ArchiveWriter::~ArchiveWriter()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+}
+
+void ArchiveWriter::append(ArchiveRecordType type, const std::string &uri, std::string_view body, long time, const HttpTransferInfo &info)
+{
+    RecordHeader header{};
+    header.magic = RECORD_MAGIC;
+    header.type = static_cast<uint16_t>(type);
+    header.time = time;
+    header.last_modified = info.last_modified;
+    header.ttfb = info.starttransfer_time;
+    header.total_time = info.total_time;
+    header.uri_size = static_cast<uint32_t>(uri.size());
+    header.body_size = static_cast<uint32_t>(body.size());
+
+    static const uint8_t zeros[RECORD_ALIGNMENT] = {};
+    struct iovec parts[5] = {
+        {&header, sizeof(header)},
+        {const_cast<char *>(uri.data()), uri.size()},
+        {const_cast<uint8_t *>(zeros), padding(uri.size())},
+        {const_cast<char *>(body.data()), body.size()},
+        {const_cast<uint8_t *>(zeros), padding(body.size())}};
+    size_t size = 0;
+    for (const struct iovec &part : parts)
+    {
+        size += part.iov_len;
+    }
+
+    std::lock_guard<std::mutex> lock(writeMutex);
+    if (!recording)
+    {
+        return;
+    }
+    ssize_t written = ::writev(fd, parts, 5);
+    if (written != static_cast<ssize_t>(size))
+    {
+        std::string reason = written < 0 ? std::strerror(errno) : "short write";
+        Logger::getInstance().log("Failed to record " + uri + " in " + path + ": " + reason, Logger::Severity::ERROR, ARCHIVE_TAG);
+        if (written != 0)
+        {
+            truncate(reason);
+        }
+        return;
+    }
+    end += size;
+    records++;
+    bytes += size;
+}
+
+size_t ArchiveWriter::findEnd(size_t file_size) const
+{
+    size_t position = sizeof(FileHeader);
+    RecordHeader header;
+    while (file_size - position >= sizeof(header) &&
+           ::pread(fd, &header, sizeof(header), static_cast<off_t>(position)) == static_cast<ssize_t>(sizeof(header)) &&
+           header.magic == RECORD_MAGIC)
+    {
+        size_t record_end = position + sizeof(header) + header.uri_size + padding(header.uri_size) + header.body_size + padding(header.body_size);
+        if (record_end > file_size)
+        {
+            break;
+        }
+        position = record_end;
+    }
+    return position;
+}
+
+void ArchiveWriter::truncate(const std::string &reason)
+{
+    // A partial record may have reached the file (ENOSPC, EIO), the next one has to start at `end`
+    if (::ftruncate(fd, static_cast<off_t>(end)) != 0)
+    {
+        recording = false;
+        Logger::getInstance().log("Failed to remove a torn record from " + path + " (" + reason + "): " + std::strerror(errno) + ", recording stopped",
+                                  Logger::Severity::ERROR, ARCHIVE_TAG);
+    }
+}
+
+size_t ArchiveWriter::getRecords() const
+{
+    std::lock_guard<std::mutex> lock(writeMutex);
+    return records;
+}
+
+size_t ArchiveWriter::getBytes() const
+{
+    std::lock_guard<std::mutex> lock(writeMutex);
+    return bytes;
+}
+
+// ---- ArchiveReader ----
+
+ArchiveReader::ArchiveReader(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to open archive: " + path + ", " + std::strerror(errno));
+    }
+    struct stat status;
+    if (::fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) < sizeof(FileHeader))
+    {
+        ::close(fd);
+        throw std::runtime_error("Not a playback archive: " + path);
+    }
+    size = static_cast<size_t>(status.st_size);
+    void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping keeps the file
+    if (mapping == MAP_FAILED)
+    {
+        throw std::runtime_error("Failed to map archive: " + path + ", " + std::strerror(errno));
+    }
+    data = static_cast<const uint8_t *>(mapping);
+    ::madvise(mapping, size, MADV_SEQUENTIAL);
+
+    FileHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0 || header.version != ARCHIVE_VERSION)
+    {
+        ::munmap(mapping, size);
+        throw std::runtime_error("Not a playback archive: " + path);
+    }
+    rewind();
+}
+
+ArchiveReader::~ArchiveReader()
+{
+    ::munmap(const_cast<uint8_t *>(data), size);
+}
+
+bool ArchiveReader::next(ArchiveRecord &record)
+{
+    if (size - position < sizeof(RecordHeader))
+    {
+        return false;
+    }
+    RecordHeader header;
+    std::memcpy(&header, data + position, sizeof(header));
+    size_t uri_start = position + sizeof(header);
+    size_t body_start = uri_start + header.uri_size + padding(header.uri_size);
+    size_t end = body_start + header.body_size + padding(header.body_size);
+    if (header.magic != RECORD_MAGIC || end > size)
+    {
+        if (header.magic != RECORD_MAGIC)
+        {
+            Logger::getInstance().log("Corrupted archive record at offset " + std::to_string(position), Logger::Severity::ERROR, ARCHIVE_TAG);
+        }
+        return false;
+    }
+    record.type = static_cast<ArchiveRecordType>(header.type);
+    record.time = static_cast<long>(header.time);
+    record.last_modified = static_cast<long>(header.last_modified);
+    record.ttfb = static_cast<long>(header.ttfb);
+    record.total_time = static_cast<long>(header.total_time);
+    record.uri = std::string_view(reinterpret_cast<const char *>(data + uri_start), header.uri_size);
+    record.body = std::string_view(reinterpret_cast<const char *>(data + body_start), header.body_size);
+    position = end;
+    return true;
+}
+
+void ArchiveReader::rewind()
+{
+    position = sizeof(FileHeader);
+}
+
+size_t ArchiveReader::getSize() const
+{
+    return size;
+}
@@ -0,0 +1,116 @@
+#ifndef ARCHIVE_HPP
+#define ARCHIVE_HPP
+
+#include "http_client.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <mutex>
+
+namespace playback
+{
+
+    enum class ArchiveRecordType : uint16_t
+    {
+        PLAYLIST = 1, // Playlist body, uri is the stream uri
+        SEGMENT = 2   // Segment or LL-HLS part body, uri is the fetched uri
+    };
+
+    // One recorded arrival, views point into the mapped archive
+    struct ArchiveRecord
+    {
+        ArchiveRecordType type = ArchiveRecordType::PLAYLIST;
+        long time = 0;           // Arrival, UTC ms
+        long last_modified = -1; // Last-Modified of the response, UTC ms
+        long ttfb = 0;           // us
+        long total_time = 0;     // us
+        std::string_view uri;
+        std::string_view body;
+
+        // Transfer metadata as the recording saw it, without the progress curve
+        HttpTransferInfo getTransferInfo() const;
+    };
+
+    /**
+     * @brief Appends playlist and segment arrivals to an archive file.
+     *
+     * The file is a 16 byte header followed by records of a fixed 48 byte header, the uri and
+     * the body, each padded to 8 bytes so the archive can be mapped and read in place. A record
+     * is written with a single writev() on a file opened with O_APPEND. A failed or short write
+     * is truncated away again, and an existing archive whose last record was cut short by a
+     * crash is truncated to its last complete record before it is extended, so records always
+     * follow each other. When the file cannot be truncated the writer stops recording.
+     */
+    class ArchiveWriter
+    {
+    public:
+        /**
+         * @brief Opens or creates the archive.
+         *
+         * @throws std::runtime_error if the file cannot be opened or is not an archive.
+         */
+        explicit ArchiveWriter(const std::string &path);
+        ~ArchiveWriter();
+
+        // Thread safe, write errors are logged and the record is lost
+        void append(ArchiveRecordType type, const std::string &uri, std::string_view body, long time, const HttpTransferInfo &info);
+
+        // Records and bytes written by this writer
+        size_t getRecords() const;
+        size_t getBytes() const;
+
+        // Disable copy constructor and assignment operator
+        ArchiveWriter(const ArchiveWriter &) = delete;
+        ArchiveWriter &operator=(const ArchiveWriter &) = delete;
+
+    private:
+        // Offset after the last complete record of an existing archive
+        size_t findEnd(size_t file_size) const;
+        // Cuts the file back to `end` after a failed write
+        void truncate(const std::string &reason);
+
+    private:
+        std::string path;
+        int fd = -1;
+        mutable std::mutex writeMutex;
+        size_t end = 0; // File size up to the last complete record
+        bool recording = true; // false once a torn record could not be removed
+        size_t records = 0;
+        size_t bytes = 0;
+    };
+
+    // Maps an archive read-only and iterates its records without copying them
+    class ArchiveReader
+    {
+    public:
+        /**
+         * @brief Maps the archive.
+         *
+         * @throws std::runtime_error if the file cannot be mapped or is not an archive.
+         */
+        explicit ArchiveReader(const std::string &path);
+        ~ArchiveReader();
+
+        // Next record in file order, false at the end or at a truncated record
+        bool next(ArchiveRecord &record);
+
+        // Back to the first record
+        void rewind();
+
+        size_t getSize() const;
+
+        // Disable copy constructor and assignment operator
+        ArchiveReader(const ArchiveReader &) = delete;
+        ArchiveReader &operator=(const ArchiveReader &) = delete;
+
+    private:
+        const uint8_t *data = nullptr;
+        size_t size = 0;
+        size_t position = 0;
+    };
+
+} // namespace playback
+
+#endif // ARCHIVE_HPP
@@ -0,0 +1,146 @@
+#include "archive_replay.hpp"
+#include "ts_validator.hpp"
+#include "logger.hpp"
+
+#include <chrono>
+#include <thread>
+#include <stdexcept>
+
+using namespace playback;
+
+constexpr const char *REPLAY_TAG = "ArchiveReplayer";
+// Replaying faster than real time waits for the decode queue instead of letting it drop segments
+constexpr size_t MAX_REPLAY_QUEUE_DEPTH = DEFAULT_DOWNLOAD_QUEUE_SIZE / 2;
+constexpr std::chrono::milliseconds REPLAY_POLL_INTERVAL(5);
+
+ArchiveReplayer::ArchiveReplayer(const std::string &path, ArchiveReplayOptions options)
+    : reader(path), options(options)
+{
+    std::string stream_uri;
+    ArchiveRecord record;
+    while (reader.next(record))
+    {
+        if (record.type == ArchiveRecordType::PLAYLIST)
+        {
+            stream_uri = std::string(record.uri);
+            break;
+        }
+    }
+    reader.rewind();
+    if (stream_uri.empty())
+    {
+        throw std::runtime_error("Archive holds no playlist: " + path);
+    }
+
+    pool = std::make_shared<SegmentDownloadPool>(options.max_concurrent_decodes, DEFAULT_DOWNLOAD_QUEUE_SIZE, options.decoder_options);
+    parser = std::make_unique<HLSManifestParser>(stream_uri, pool, 3, options.history_size);
+    // Called from onPlaylist() on the replay thread
+    parser->setSegmentFetcher([this](const std::shared_ptr<HLSSegment> &segment, const std::string &part_uri)
+                              { requested[part_uri.empty() ? segment->getUri() : part_uri] = {segment, part_uri}; });
+}
+
+ArchiveReplayer::~ArchiveReplayer()
+{
+    stop();
+    pool->stop();
+}
+
+HLSManifestParser &ArchiveReplayer::getParser()
+{
+    return *parser;
+}
+
+void ArchiveReplayer::run()
+{
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point start = Clock::now();
+    long first_arrival = -1;
+    ArchiveRecord record;
+    while (!stopping && reader.next(record))
+    {
+        if (first_arrival < 0)
+        {
+            first_arrival = record.time;
+        }
+        if (options.speed > 0)
+        {
+            auto offset = std::chrono::duration<double, std::milli>((record.time - first_arrival) / options.speed);
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(offset));
+        }
+        if (record.type == ArchiveRecordType::PLAYLIST)
+        {
+            playlists++;
+            try
+            {
+                parser->onPlaylist(record.body, record.time, record.getTransferInfo());
+            }
+            catch (const std::exception &ex)
+            {
+                Logger::getInstance().log("Error: " + std::string(ex.what()) + ", replayed playlist at " + std::to_string(record.time), Logger::Severity::ERROR, REPLAY_TAG);
+                parser->onPlaylistError();
+            }
+        }
+        else if (record.type == ArchiveRecordType::SEGMENT)
+        {
+            replaySegment(record);
+        }
+    }
+
+    // The recording ended before these were fetched
+    for (auto &entry : requested)
+    {
+        missing_segments++;
+        Logger::getInstance().log("Segment not in the archive: " + entry.first, Logger::Severity::WARNING, REPLAY_TAG);
+        entry.second.first->download_failed();
+    }
+    requested.clear();
+    while (!stopping && (pool->getQueueDepth() > 0 || pool->getActiveDownloads() > 0))
+    {
+        std::this_thread::sleep_for(REPLAY_POLL_INTERVAL);
+    }
+}
+
+void ArchiveReplayer::replaySegment(const ArchiveRecord &record)
+{
+    auto it = requested.find(std::string(record.uri));
+    if (it == requested.end())
+    {
+        return; // Fetched by the recording for a segment this replay does not follow
+    }
+    std::shared_ptr<HLSSegment> segment = std::move(it->second.first);
+    std::string part_uri = std::move(it->second.second);
+    requested.erase(it);
+
+    while (!stopping && pool->getQueueDepth() >= MAX_REPLAY_QUEUE_DEPTH)
+    {
+        std::this_thread::sleep_for(REPLAY_POLL_INTERVAL);
+    }
+    segments++;
+    std::shared_ptr<std::string> payload = pool->acquireBuffer();
+    payload->assign(record.body);
+    parser->onSegmentTransfer(segment, record.getTransferInfo());
+    TsValidator validator = segment->takeTsValidator();
+    validator.feed(reinterpret_cast<const uint8_t *>(payload->data()), payload->size());
+    segment->putTsValidator(std::move(validator));
+    pool->submit(segment, part_uri, std::move(payload));
+}
+
+void ArchiveReplayer::stop()
+{
+    stopping = true;
+}
+
+size_t ArchiveReplayer::getPlaylists() const
+{
+    return playlists;
+}
+
+size_t ArchiveReplayer::getSegments() const
+{
+    return segments;
+}
+
+size_t ArchiveReplayer::getMissingSegments() const
+{
+    return missing_segments;
+}
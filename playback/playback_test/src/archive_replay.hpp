@@ -0,0 +1,82 @@
+#ifndef ARCHIVE_REPLAY_HPP
+#define ARCHIVE_REPLAY_HPP
+
+#include "archive.hpp"
+#include "hls_parser.hpp"
+#include "download_pool.hpp"
+
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <atomic>
+
+namespace playback
+{
+
+    struct ArchiveReplayOptions
+    {
+        double speed = 1; // Multiple of the original pace, 0 replays as fast as possible
+        size_t max_concurrent_decodes = DEFAULT_DOWNLOAD_WORKERS;
+        DecoderOptions decoder_options;
+        size_t history_size = DEFAULT_SEGMENT_HISTORY_SIZE;
+    };
+
+    /**
+     * @brief Feeds a recorded archive to a parser instead of the network.
+     *
+     * Playlists are handed to HLSManifestParser::onPlaylist() with their recorded arrival time,
+     * segment bodies are matched to the segments the parser asked for and decoded from memory
+     * with their recorded transfer timings, so a run can be repeated deterministically and the
+     * analysis pipeline benchmarked offline.
+     */
+    class ArchiveReplayer
+    {
+    public:
+        /**
+         * @brief Maps the archive and creates the parser of the recorded stream.
+         *
+         * @throws std::runtime_error if the archive cannot be read or holds no playlist.
+         */
+        ArchiveReplayer(const std::string &path, ArchiveReplayOptions options = ArchiveReplayOptions());
+        ~ArchiveReplayer();
+
+        // Parser fed by run(), subscribe to it before running
+        HLSManifestParser &getParser();
+
+        // Replays the whole archive on the calling thread, returns once every segment is decoded
+        void run();
+
+        // Makes run() return early, callable from any thread
+        void stop();
+
+        // Records replayed so far
+        size_t getPlaylists() const;
+        size_t getSegments() const;
+
+        // Segments the parser asked for that the archive does not hold, marked as failed
+        size_t getMissingSegments() const;
+
+        // Disable copy constructor and assignment operator
+        ArchiveReplayer(const ArchiveReplayer &) = delete;
+        ArchiveReplayer &operator=(const ArchiveReplayer &) = delete;
+
+    private:
+        void replaySegment(const ArchiveRecord &record);
+
+    private:
+        ArchiveReader reader;
+        ArchiveReplayOptions options;
+        std::shared_ptr<SegmentDownloadPool> pool;
+        std::unique_ptr<HLSManifestParser> parser;
+        // Fetched uri -> (segment, part uri) requested by the parser and not replayed yet
+        std::unordered_map<std::string, std::pair<std::shared_ptr<HLSSegment>, std::string>> requested;
+        std::atomic<bool> stopping{false};
+        std::atomic<size_t> playlists{0};
+        std::atomic<size_t> segments{0};
+        std::atomic<size_t> missing_segments{0};
+    };
+
+} // namespace playback
+
+#endif // ARCHIVE_REPLAY_HPP
@@ -0,0 +1,104 @@
+#ifndef AV_POOL_HPP
+#define AV_POOL_HPP
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+namespace playback
+{
+
+    /**
+     * @brief Recycles FFmpeg packets or frames instead of allocating one per use.
+     *
+     * release() only drops the data references of the object (av_packet_unref/av_frame_unref)
+     * and keeps the struct for the next acquire(), so a decoder that keeps its pool for its
+     * whole lifetime stops allocating after the first segment. At most `max_idle` objects are
+     * kept, extra releases are freed.
+     */
+    template <typename T, T *(*Alloc)(), void (*Unref)(T *), void (*Free)(T **)>
+    class AVObjectPool
+    {
+    public:
+        explicit AVObjectPool(size_t max_idle = 8) : max_idle(max_idle)
+        {
+        }
+
+        ~AVObjectPool()
+        {
+            for (T *object : idle)
+            {
+                Free(&object);
+            }
+        }
+
+        // Returns a blank object, nullptr if the allocation failed
+        T *acquire()
+        {
+            {
+                std::lock_guard<std::mutex> lock(poolMutex);
+                if (!idle.empty())
+                {
+                    T *object = idle.back();
+                    idle.pop_back();
+                    reuses++;
+                    return object;
+                }
+            }
+            allocations++;
+            return Alloc();
+        }
+
+        void release(T *object)
+        {
+            if (!object)
+            {
+                return;
+            }
+            Unref(object);
+            {
+                std::lock_guard<std::mutex> lock(poolMutex);
+                if (idle.size() < max_idle)
+                {
+                    idle.push_back(object);
+                    return;
+                }
+            }
+            Free(&object);
+        }
+
+        // Number of objects allocated by the pool
+        size_t getAllocations() const
+        {
+            return allocations;
+        }
+
+        // Number of acquire() calls served without an allocation
+        size_t getReuses() const
+        {
+            return reuses;
+        }
+
+        // Disable copy constructor and assignment operator
+        AVObjectPool(const AVObjectPool &) = delete;
+        AVObjectPool &operator=(const AVObjectPool &) = delete;
+
+    private:
+        std::mutex poolMutex; // Frames handed out through the output queue come back from other threads
+        std::vector<T *> idle;
+        size_t max_idle;
+        std::atomic<size_t> allocations{0};
+        std::atomic<size_t> reuses{0};
+    };
+
+    using PacketPool = AVObjectPool<AVPacket, av_packet_alloc, av_packet_unref, av_packet_free>;
+    using FramePool = AVObjectPool<AVFrame, av_frame_alloc, av_frame_unref, av_frame_free>;
+
+} // namespace playback
+
+#endif // AV_POOL_HPP
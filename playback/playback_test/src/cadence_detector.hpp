@@ -0,0 +1,215 @@
+#ifndef CADENCE_DETECTOR_HPP
+#define CADENCE_DETECTOR_HPP
+
+#include <cstddef>
+
+namespace playback
+{
+
+    enum class AnomalyType
+    {
+        GAP,          // Presentation stopped for several frame intervals, a visible freeze
+        REWIND,       // PTS went back in time
+        CADENCE_DROP, // One or two frame intervals missing
+        DUPLICATE_PTS // Same PTS as the previous frame
+    };
+
+    inline const char *anomalyTypeToString(AnomalyType type)
+    {
+        switch (type)
+        {
+        case AnomalyType::GAP:
+            return "gap";
+        case AnomalyType::REWIND:
+            return "rewind";
+        case AnomalyType::CADENCE_DROP:
+            return "cadence drop";
+        case AnomalyType::DUPLICATE_PTS:
+            return "duplicate pts";
+        default:
+            return "unknown";
+        }
+    }
+
+    struct AnomalyEvent
+    {
+        AnomalyType type = AnomalyType::GAP;
+        long pts = 0;          // ms, frame the anomaly was found at
+        long delta = 0;        // ms from the previous frame, or from the last frame of the previous segment
+        double expected = 0;   // Frame interval of the stream at that point, ms
+        long sequence = -1;    // Media sequence of the segment holding the frame
+        bool boundary = false; // Between the last frame of the previous segment and the first of this one
+    };
+
+    // Anomalies counted by type
+    struct AnomalyCounts
+    {
+        size_t gaps = 0;
+        size_t rewinds = 0;
+        size_t cadence_drops = 0;
+        size_t duplicates = 0;
+
+        void add(AnomalyType type)
+        {
+            switch (type)
+            {
+            case AnomalyType::GAP:
+                gaps++;
+                break;
+            case AnomalyType::REWIND:
+                rewinds++;
+                break;
+            case AnomalyType::CADENCE_DROP:
+                cadence_drops++;
+                break;
+            case AnomalyType::DUPLICATE_PTS:
+                duplicates++;
+                break;
+            }
+        }
+
+        void merge(const AnomalyCounts &other)
+        {
+            gaps += other.gaps;
+            rewinds += other.rewinds;
+            cadence_drops += other.cadence_drops;
+            duplicates += other.duplicates;
+        }
+
+        size_t total() const
+        {
+            return gaps + rewinds + cadence_drops + duplicates;
+        }
+    };
+
+    /**
+     * @brief Classifies frame timestamps against the frame interval of the stream as they arrive.
+     *
+     * Keeps the previous and the highest PTS and a running estimate of the nominal frame
+     * interval, so memory is constant however long the timeline is. A forward step of at least
+     * CADENCE_DROP_FACTOR intervals is a cadence drop, of GAP_FACTOR intervals a gap. After a
+     * rewind the next frames are measured from the highest PTS once they pass it again, so a
+     * single frame out of place is reported once. A sustained change of the frame rate is
+     * adopted after ADAPT_FRAMES consecutive off-nominal intervals.
+     */
+    class CadenceDetector
+    {
+    public:
+        static constexpr double CADENCE_DROP_FACTOR = 1.5;
+        static constexpr double GAP_FACTOR = 3;
+        static constexpr int ADAPT_FRAMES = 8;
+        static constexpr double INTERVAL_SMOOTHING = 0.1;
+
+        // `frame_interval` seeds the nominal interval (ms), 0 learns it from the first frames
+        explicit CadenceDetector(double frame_interval = 0) : frame_interval(frame_interval)
+        {
+        }
+
+        /**
+         * @brief Classifies the step from `reference` to `pts` against `frame_interval`.
+         *
+         * @return true and sets `type` if the step is an anomaly.
+         */
+        static bool classify(long pts, long reference, double frame_interval, AnomalyType &type)
+        {
+            long delta = pts - reference;
+            if (delta < 0)
+            {
+                type = AnomalyType::REWIND;
+                return true;
+            }
+            if (delta == 0)
+            {
+                type = AnomalyType::DUPLICATE_PTS;
+                return true;
+            }
+            if (frame_interval <= 0 || delta < frame_interval * CADENCE_DROP_FACTOR)
+            {
+                return false;
+            }
+            type = delta >= frame_interval * GAP_FACTOR ? AnomalyType::GAP : AnomalyType::CADENCE_DROP;
+            return true;
+        }
+
+        // Frames have to be added in presentation order, returns true and fills `event` for an anomaly
+        bool add(long pts, AnomalyEvent &event)
+        {
+            frames++;
+            if (frames == 1)
+            {
+                first_pts = last_pts = highest_pts = pts;
+                return false;
+            }
+            // Back on the timeline after a rewind, measure from where it was left
+            long reference = last_pts < highest_pts && pts > highest_pts ? highest_pts : last_pts;
+            AnomalyType type;
+            bool anomaly = classify(pts, reference, frame_interval, type);
+            event.type = type;
+            event.pts = pts;
+            event.delta = pts - reference;
+            event.expected = frame_interval;
+            event.boundary = false;
+            if (pts > reference)
+            {
+                learn(pts - reference);
+            }
+            last_pts = pts;
+            highest_pts = pts > highest_pts ? pts : highest_pts;
+            return anomaly;
+        }
+
+        // Nominal frame interval, ms, 0 until learned
+        double getFrameInterval() const
+        {
+            return frame_interval;
+        }
+
+        size_t getFrames() const
+        {
+            return frames;
+        }
+
+        // -1 until the first frame
+        long getFirstPts() const
+        {
+            return frames > 0 ? first_pts : -1;
+        }
+
+        // Highest PTS so far, where the next segment is expected to continue, -1 until the first frame
+        long getHighestPts() const
+        {
+            return frames > 0 ? highest_pts : -1;
+        }
+
+    private:
+        void learn(long delta)
+        {
+            bool nominal = frame_interval > 0 && delta > frame_interval / CADENCE_DROP_FACTOR && delta < frame_interval * CADENCE_DROP_FACTOR;
+            if (frame_interval <= 0)
+            {
+                frame_interval = static_cast<double>(delta);
+            }
+            else if (nominal)
+            {
+                frame_interval += (delta - frame_interval) * INTERVAL_SMOOTHING;
+            }
+            else if (++off_nominal >= ADAPT_FRAMES)
+            {
+                frame_interval = static_cast<double>(delta);
+            }
+            off_nominal = nominal ? 0 : off_nominal;
+            off_nominal = off_nominal >= ADAPT_FRAMES ? 0 : off_nominal;
+        }
+
+    private:
+        double frame_interval;
+        size_t frames = 0;
+        long first_pts = 0;
+        long last_pts = 0;
+        long highest_pts = 0;
+        int off_nominal = 0; // Consecutive intervals outside the nominal band
+    };
+
+} // namespace playback
+
+#endif // CADENCE_DETECTOR_HPP
@@ -10,6 +10,8 @@ extern "C"
 #include <regex>
 #include <chrono>
 
+#include "playlist_tokenizer.hpp"
+
 namespace playback
 {
 
@@ -22,7 +24,29 @@ namespace playback
 
     const static std::regex decimal_regex(R"(\b\d+\.\d+\b)");
     const static std::regex url_regex(R"((http[s]?:\/\/[^\s']+))");
-    const static std::regex numberRegex(R"(-(\d+)\.ts$)"); // Matches '-<number>.ts' at the end of the string
+
+    // Segment download pool defaults
+    const size_t DEFAULT_DOWNLOAD_WORKERS = 4;     // Segments opened/decoded concurrently
+    const size_t DEFAULT_DOWNLOAD_QUEUE_SIZE = 32; // Segments waiting for a free worker
+
+    // Recent segments kept per stream, older ones are only counted in the totals
+    const size_t DEFAULT_SEGMENT_HISTORY_SIZE = 1000;
+
+    // Multi-stream event loop defaults
+    const size_t DEFAULT_MAX_CONNECTIONS = 256; // Open HTTP connections across all streams
+
+    // Virtual player buffer defaults
+    const long DEFAULT_STARTUP_BUFFER_MS = 2000;     // Buffered media before playback starts
+    const long DEFAULT_REBUFFER_THRESHOLD_MS = 1000; // Buffered media before a stall ends
+    const size_t DEFAULT_BUFFER_SERIES_SIZE = 3600;  // Buffer level samples kept per stream
+
+    // Segments put back in media sequence order, a head that never finishes is given up on
+    const long DEFAULT_PENDING_SEGMENT_TIMEOUT_MS = 60000; // Listed until given up on
+    const size_t DEFAULT_MAX_PENDING_SEGMENTS = 256;       // Waiting behind the head, the oldest is given up on beyond
+
+    // Timeline anomaly detection defaults
+    const size_t MAX_SEGMENT_ANOMALIES = 16;       // Anomaly events kept per segment, the rest are only counted
+    const size_t DEFAULT_ANOMALY_HISTORY_SIZE = 64; // Recent anomaly events kept per stream
 
     /**
      * @brief Get the current UTC time in milliseconds since the epoch.
@@ -38,31 +62,35 @@ namespace playback
         return static_cast<long>(ms_since_epoch);
     }
 
-    inline double pts_to_ms(AVFrame *frame, AVRational time_base)
+    // Current UTC time in microseconds since the epoch
+    inline int64_t get_utc_us()
+    {
+        auto now = std::chrono::system_clock::now();
+        return std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+    }
+
+    inline double pts_to_ms(int64_t pts, AVRational time_base)
     {
         if (time_base.num == 0)
         {
-            return frame->pts;
+            return pts;
         }
-        return ((double)(frame->pts * 1000.0 * time_base.num) / (double)time_base.den);
+        return ((double)(pts * 1000.0 * time_base.num) / (double)time_base.den);
+    }
+
+    inline double pts_to_ms(AVFrame *frame, AVRational time_base)
+    {
+        return pts_to_ms(frame->pts, time_base);
     }
 
     inline int extract_sequence_number(std::string uri)
     {
-        std::smatch match;
-        if (std::regex_search(uri, match, numberRegex))
-        {
-            if (match.size() > 1)
-            { // The first capture group is the number
-                std::string number = match[1];
-                return std::stoi(number);
-            }
-        }
-        else
+        long number = parse_uri_sequence_number(uri);
+        if (number < 0)
         {
             throw std::runtime_error("Failed to find sequence number in segment uri: " + uri);
         }
-        return -1;
+        return number;
     }
 } // namespace playback
 
@@ -0,0 +1,141 @@
+#include "continuity_monitor.hpp"
+
+using namespace playback;
+
+ContinuityMonitor::ContinuityMonitor(size_t history_size) : history_size(history_size)
+{
+}
+
+void ContinuityMonitor::setListener(Listener listener)
+{
+    std::lock_guard<std::mutex> lock(dataMutex);
+    this->listener = std::move(listener);
+}
+
+void ContinuityMonitor::onSegmentAdded(long sequence_number)
+{
+    Listener notify;
+    Delivery delivered;
+    {
+        std::lock_guard<std::mutex> lock(dataMutex);
+        long now = get_utc();
+        pending.add(sequence_number, now);
+        // A head that never finished is given up on while the stream goes on
+        release(now, delivered);
+        notify = listener;
+    }
+    deliver(notify, delivered);
+}
+
+void ContinuityMonitor::onSegmentFinished(const std::shared_ptr<const SegmentSnapshot> &segment)
+{
+    Listener notify;
+    // (event, segment) pairs in timeline order, delivered after the lock is released
+    Delivery delivered;
+    {
+        std::lock_guard<std::mutex> lock(dataMutex);
+        if (!pending.finish(segment->sequence_number, segment))
+        {
+            return;
+        }
+        release(get_utc(), delivered);
+        notify = listener;
+    }
+    deliver(notify, delivered);
+}
+
+void ContinuityMonitor::release(long now, Delivery &delivered)
+{
+    // Segments finished ahead of an earlier one wait for it
+    long sequence_number;
+    bool finished;
+    std::shared_ptr<const SegmentSnapshot> next;
+    while (pending.pop(now, sequence_number, finished, next))
+    {
+        if (!finished)
+        {
+            previous_pts = -1; // Like a failed segment
+            continue;
+        }
+        std::vector<AnomalyEvent> events;
+        check(*next, events);
+        for (AnomalyEvent &event : events)
+        {
+            delivered.emplace_back(event, next);
+        }
+    }
+}
+
+void ContinuityMonitor::deliver(const Listener &notify, const Delivery &delivered)
+{
+    if (notify)
+    {
+        for (const auto &entry : delivered)
+        {
+            notify(entry.first, *entry.second);
+        }
+    }
+}
+
+void ContinuityMonitor::check(const SegmentSnapshot &segment, std::vector<AnomalyEvent> &events)
+{
+    if (segment.status != SegmentStatus::DOWNLOADED || segment.num_frames == 0)
+    {
+        previous_pts = -1;
+        return;
+    }
+    totals.segments++;
+    if (segment.discontinuity)
+    {
+        totals.discontinuities++;
+        previous_pts = -1;
+        frame_interval = 0; // The new timeline may have another frame rate
+    }
+
+    double interval = frame_interval > 0 ? frame_interval : segment.frame_interval;
+    AnomalyType type;
+    if (previous_pts >= 0 && CadenceDetector::classify(segment.first_pts, previous_pts, interval, type))
+    {
+        AnomalyEvent event;
+        event.type = type;
+        event.pts = segment.first_pts;
+        event.delta = segment.first_pts - previous_pts;
+        event.expected = interval;
+        event.sequence = segment.sequence_number;
+        event.boundary = true;
+        events.push_back(event);
+        totals.counts.add(type);
+        totals.boundary_anomalies++;
+    }
+    events.insert(events.end(), segment.anomalies.begin(), segment.anomalies.end());
+    totals.counts.merge(segment.anomaly_counts);
+
+    previous_pts = segment.last_pts;
+    if (segment.frame_interval > 0)
+    {
+        frame_interval = segment.frame_interval;
+    }
+    for (const AnomalyEvent &event : events)
+    {
+        recent.push_back(event);
+    }
+    while (recent.size() > history_size)
+    {
+        recent.pop_front();
+    }
+}
+
+double ContinuityMonitor::getFrameInterval()
+{
+    std::lock_guard<std::mutex> lock(dataMutex);
+    return frame_interval;
+}
+
+ContinuityReport ContinuityMonitor::getReport()
+{
+    std::lock_guard<std::mutex> lock(dataMutex);
+    ContinuityReport report = totals;
+    report.frame_interval = frame_interval;
+    report.recent.assign(recent.begin(), recent.end());
+    return report;
+}
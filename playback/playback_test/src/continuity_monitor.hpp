@@ -0,0 +1,86 @@
+#ifndef CONTINUITY_MONITOR_HPP
+#define CONTINUITY_MONITOR_HPP
+
+#include "hls_segment.hpp"
+#include "cadence_detector.hpp"
+#include "constants.hpp"
+#include "pending_order.hpp"
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <functional>
+
+namespace playback
+{
+
+    struct ContinuityReport
+    {
+        AnomalyCounts counts;             // Within and between segments
+        size_t boundary_anomalies = 0;    // Part of `counts` found between segments
+        size_t discontinuities = 0;       // #EXT-X-DISCONTINUITY boundaries, not checked
+        size_t segments = 0;              // Segments checked in media sequence order
+        double frame_interval = 0;        // ms
+        std::vector<AnomalyEvent> recent; // Oldest first
+    };
+
+    /**
+     * @brief Follows the PTS timeline of a stream across segment boundaries.
+     *
+     * Every segment classifies its own frames while it is decoded (CadenceDetector). Segments
+     * are decoded concurrently, so the monitor puts the finished ones back in media sequence
+     * order, checks the step from the last frame of a segment to the first frame of the next
+     * one with the same rules and hands the events of both kinds to the listener in timeline
+     * order. A segment after #EXT-X-DISCONTINUITY starts a new timeline, a failed segment
+     * breaks the chain without an event (it is reported as failed), and so does one that has
+     * not finished DEFAULT_PENDING_SEGMENT_TIMEOUT_MS after it was listed (see PendingOrder).
+     *
+     * The monitor keeps at most DEFAULT_MAX_PENDING_SEGMENTS segments in flight and
+     * `history_size` recent events. The events of a segment itself (up to
+     * MAX_SEGMENT_ANOMALIES) stay in the segment and its snapshot, for as long as the segment
+     * history or a subscriber holds them.
+     */
+    class ContinuityMonitor
+    {
+    public:
+        using Listener = std::function<void(const AnomalyEvent &event, const SegmentSnapshot &segment)>;
+
+        explicit ContinuityMonitor(size_t history_size = DEFAULT_ANOMALY_HISTORY_SIZE);
+
+        // Called outside the monitor lock, from the worker that finished the segment
+        void setListener(Listener listener);
+
+        // A segment was listed, later segments wait for it before their boundary is checked
+        void onSegmentAdded(long sequence_number);
+
+        // A segment finished downloading or failed, called once per segment
+        void onSegmentFinished(const std::shared_ptr<const SegmentSnapshot> &segment);
+
+        // Frame interval of the stream so far (ms), 0 until known
+        double getFrameInterval();
+
+        ContinuityReport getReport();
+
+    private:
+        using Delivery = std::vector<std::pair<AnomalyEvent, std::shared_ptr<const SegmentSnapshot>>>;
+
+        // Checks the segments that may go as of `now`, in sequence order
+        void release(long now, Delivery &delivered);
+        void check(const SegmentSnapshot &segment, std::vector<AnomalyEvent> &events);
+        void deliver(const Listener &notify, const Delivery &delivered);
+
+    private:
+        std::mutex dataMutex;
+        Listener listener;
+        size_t history_size;
+        // Listed segments not checked yet: sequence -> snapshot once finished
+        PendingOrder<std::shared_ptr<const SegmentSnapshot>> pending;
+        std::deque<AnomalyEvent> recent;
+        ContinuityReport totals;
+        long previous_pts = -1; // Highest PTS of the last checked segment, -1 if the chain is broken
+        double frame_interval = 0;
+    };
+
+} // namespace playback
+
+#endif // CONTINUITY_MONITOR_HPP
@@ -1,37 +1,179 @@
 #include <chrono>
 #include <thread>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
 
 #include "decoder.hpp"
+#include "sei_timestamp.hpp"
 #include "constants.hpp"
 #include "logger.hpp"
 
 using namespace playback;
 
 constexpr const char* TAG = "Decoder";
+// Consecutive demuxer errors tolerated before the segment is marked as failed
+constexpr int MAX_FAILED_READS = 20;
+// Packets held back to restore presentation order in demux-only mode, deeper than any B-frame pyramid
+constexpr size_t REORDER_DEPTH = 16;
+// Buffer of the AVIOContext that reads an in-memory payload
+constexpr int PAYLOAD_IO_BUFFER_SIZE = 32 * 1024;
 
-Decoder::Decoder(std::shared_ptr<HLSSegment> segment)
-    : segment(segment),
-      formatContext(nullptr), codecContext(nullptr),
-      videoStreamIndex(-1), decoded_frames(0),
-      received_packets(0), num_of_failed_frames_in_arrow(0),
+Decoder::Decoder(bool analyze_frames)
+    : formatContext(nullptr), ioContext(nullptr), payload_offset(0),
+      primingBuffer(std::make_shared<std::string>()), priming_size(0), codecContext(nullptr),
+      videoStreamIndex(-1), nal_length_size(-1), decoded_frames(0),
+      received_packets(0), num_of_failed_frames_in_arrow(0), full_decode(true),
+      openCodecId(AV_CODEC_ID_NONE), openWidth(0), openHeight(0), openFormat(-1),
+      codec_opens(0), codec_reuses(0), analyze_frames(analyze_frames),
       stopDecoding(false), outputQueue(1000), started_at(-1)
 {
-    // Open input file
-    Logger::getInstance().log("Attempting to connect: " + segment->getUri(), Logger::Severity::DEBUG, TAG);
-    if (avformat_open_input(&formatContext, segment->getUri().c_str(), nullptr, nullptr) < 0)
+}
+
+Decoder::~Decoder()
+{
+    stopDecoding = true;
+    closeInput();
+    releaseCodec();
+
+    // Free remaining frames in the queue
+    AVFrame *frame = nullptr;
+    while (outputQueue.try_pop(frame))
     {
-        Logger::getInstance().log("Failed to open input file: " + segment->getUri() + ", sleeping 3s", Logger::Severity::ERROR, TAG);
-        throw std::runtime_error("Failed to open input file: " + segment->getUri());
+        av_frame_free(&frame);
+    }
+}
+
+void Decoder::decode(std::shared_ptr<HLSSegment> segment, const std::string &part_uri, bool full_decode,
+                     std::shared_ptr<const std::string> payload)
+{
+    this->segment = segment;
+    this->full_decode = full_decode;
+    this->payload = std::move(payload);
+    payload_offset = 0;
+    uri = part_uri.empty() ? segment->getUri() : part_uri;
+    priming_size = 0;
+    primingPts.clear();
+    if (!part_uri.empty() && full_decode && this->payload)
+    {
+        preparePart(part_uri);
+    }
+    decoded_frames = 0;
+    received_packets = 0;
+    num_of_failed_frames_in_arrow = 0;
+    frameAnalyzer.reset();
+    if (!part_uri.empty())
+    {
+        // Parts of a segment are decoded one after another, the analysis continues across them
+        segment->swapPartAnalyzer(frameAnalyzer);
+    }
+    while (!reorderBuffer.empty())
+    {
+        reorderBuffer.pop();
+    }
+
+    try
+    {
+        openInput();
+        if (full_decode)
+        {
+            prepareCodec();
+        }
+    }
+    catch (...)
+    {
+        closeInput();
+        this->segment.reset();
+        throw;
+    }
+
+    started_at = get_utc();
+    demuxAndDecode();
+    closeInput();
+    if (!part_uri.empty())
+    {
+        segment->swapPartAnalyzer(frameAnalyzer);
+    }
+    // Retire the segment, the worker keeps only the codec context
+    this->segment.reset();
+}
+
+void Decoder::preparePart(const std::string &part_uri)
+{
+    std::vector<std::shared_ptr<const std::string>> priming = segment->addPartPayload(part_uri, payload);
+    if (priming.empty())
+    {
+        return;
+    }
+    // A dependent part does not start with a keyframe, it is decoded behind the parts it refers to
+    primingBuffer->clear();
+    for (const auto &part : priming)
+    {
+        primingBuffer->append(*part);
+    }
+    priming_size = primingBuffer->size();
+    primingBuffer->append(*payload);
+    payload = primingBuffer;
+    Logger::getInstance().log("Priming " + uri + " with " + std::to_string(priming.size()) + " earlier part(s)", Logger::Severity::DEBUG, TAG);
+}
+
+bool Decoder::takePrimingFrame(int64_t pts)
+{
+    auto it = std::find(primingPts.begin(), primingPts.end(), pts);
+    if (it == primingPts.end())
+    {
+        return false;
+    }
+    primingPts.erase(it);
+    return true;
+}
+
+void Decoder::stop()
+{
+    stopDecoding = true;
+}
+
+void Decoder::openInput()
+{
+    if (payload)
+    {
+        // Already fetched, demux straight from memory
+        formatContext = avformat_alloc_context();
+        unsigned char *buffer = static_cast<unsigned char *>(av_malloc(PAYLOAD_IO_BUFFER_SIZE));
+        if (!formatContext || !buffer)
+        {
+            av_free(buffer);
+            throw std::runtime_error("Failed to allocate input context: " + uri);
+        }
+        ioContext = avio_alloc_context(buffer, PAYLOAD_IO_BUFFER_SIZE, 0, this, &Decoder::readPayload, nullptr, &Decoder::seekPayload);
+        if (!ioContext)
+        {
+            av_free(buffer);
+            throw std::runtime_error("Failed to allocate IO context: " + uri);
+        }
+        formatContext->pb = ioContext;
+        formatContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+    else
+    {
+        Logger::getInstance().log("Attempting to connect: " + uri, Logger::Severity::DEBUG, TAG);
+    }
+
+    // Open input file, a custom IO context is left to us on failure
+    if (avformat_open_input(&formatContext, uri.c_str(), nullptr, nullptr) < 0)
+    {
+        Logger::getInstance().log("Failed to open input file: " + uri, Logger::Severity::ERROR, TAG);
+        throw std::runtime_error("Failed to open input file: " + uri);
     }
 
     // Retrieve stream information
     if (avformat_find_stream_info(formatContext, nullptr) < 0)
     {
-        avformat_close_input(&formatContext);
         throw std::runtime_error("Failed to retrieve stream information");
     }
 
     // Find the first video stream
+    videoStreamIndex = -1;
     for (unsigned int i = 0; i < formatContext->nb_streams; i++)
     {
         if (formatContext->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
@@ -43,16 +185,102 @@ Decoder::Decoder(std::shared_ptr<HLSSegment> segment)
 
     if (videoStreamIndex == -1)
     {
-        avformat_close_input(&formatContext);
         throw std::runtime_error("No video stream found");
     }
+    // Demux-only timestamps are read from the packets, which are avcC when the extradata is
+    const AVCodecParameters *parameters = formatContext->streams[videoStreamIndex]->codecpar;
+    nal_length_size = parameters->codec_id != AV_CODEC_ID_H264 ? -1
+                      : parameters->extradata ? nalLengthSize(parameters->extradata, static_cast<size_t>(parameters->extradata_size))
+                                              : 0;
+}
 
-    // Get codec parameters and find decoder
+void Decoder::closeInput()
+{
+    if (formatContext)
+    {
+        avformat_close_input(&formatContext);
+    }
+    if (ioContext)
+    {
+        av_freep(&ioContext->buffer);
+        avio_context_free(&ioContext);
+    }
+    payload.reset();
+}
+
+int Decoder::readPayload(void *opaque, uint8_t *buf, int buf_size)
+{
+    Decoder *decoder = static_cast<Decoder *>(opaque);
+    size_t remaining = decoder->payload->size() - decoder->payload_offset;
+    if (remaining == 0)
+    {
+        return AVERROR_EOF;
+    }
+    size_t size = std::min(remaining, static_cast<size_t>(buf_size));
+    std::memcpy(buf, decoder->payload->data() + decoder->payload_offset, size);
+    decoder->payload_offset += size;
+    return static_cast<int>(size);
+}
+
+int64_t Decoder::seekPayload(void *opaque, int64_t offset, int whence)
+{
+    Decoder *decoder = static_cast<Decoder *>(opaque);
+    int64_t size = static_cast<int64_t>(decoder->payload->size());
+    switch (whence & ~AVSEEK_FORCE)
+    {
+    case AVSEEK_SIZE:
+        return size;
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        offset += decoder->payload_offset;
+        break;
+    case SEEK_END:
+        offset += size;
+        break;
+    default:
+        return -1;
+    }
+    if (offset < 0 || offset > size)
+    {
+        return -1;
+    }
+    decoder->payload_offset = static_cast<size_t>(offset);
+    return offset;
+}
+
+bool Decoder::canReuseCodec(const AVCodecParameters *codecParams) const
+{
+    if (!codecContext)
+    {
+        return false;
+    }
+    if (codecParams->codec_id != openCodecId || codecParams->width != openWidth ||
+        codecParams->height != openHeight || codecParams->format != openFormat)
+    {
+        return false;
+    }
+    size_t extradata_size = codecParams->extradata ? codecParams->extradata_size : 0;
+    return extradata_size == openExtradata.size() &&
+           (extradata_size == 0 || std::memcmp(codecParams->extradata, openExtradata.data(), extradata_size) == 0);
+}
+
+void Decoder::prepareCodec()
+{
     AVCodecParameters *codecParams = formatContext->streams[videoStreamIndex]->codecpar;
+    if (canReuseCodec(codecParams))
+    {
+        // Same stream as the previous segment, drop the references to the old frames only
+        avcodec_flush_buffers(codecContext);
+        codec_reuses++;
+        return;
+    }
+    releaseCodec();
+
+    // Get codec parameters and find decoder
     const AVCodec *codec = avcodec_find_decoder(codecParams->codec_id);
     if (!codec)
     {
-        avformat_close_input(&formatContext);
         throw std::runtime_error("Unsupported codec");
     }
 
@@ -60,55 +288,45 @@ Decoder::Decoder(std::shared_ptr<HLSSegment> segment)
     codecContext = avcodec_alloc_context3(codec);
     if (!codecContext)
     {
-        avformat_close_input(&formatContext);
         throw std::runtime_error("Failed to allocate codec context");
     }
 
     if (avcodec_parameters_to_context(codecContext, codecParams) < 0)
     {
-        avcodec_free_context(&codecContext);
-        avformat_close_input(&formatContext);
+        releaseCodec();
         throw std::runtime_error("Failed to copy codec parameters to codec context");
     }
 
     // Open codec
     if (avcodec_open2(codecContext, codec, nullptr) < 0)
     {
-        avcodec_free_context(&codecContext);
-        avformat_close_input(&formatContext);
+        releaseCodec();
         throw std::runtime_error("Failed to open codec");
     }
 
-    // Start the decoding thread
-    started_at = get_utc();
-    decodingWorker = std::thread(&Decoder::decodingThread, this);
-}
-
-Decoder::~Decoder()
-{
-    // Stop decoding and wait for the thread to finish
-    stopDecoding = true;
-    if (decodingWorker.joinable())
+    openCodecId = codecParams->codec_id;
+    openWidth = codecParams->width;
+    openHeight = codecParams->height;
+    openFormat = codecParams->format;
+    if (codecParams->extradata && codecParams->extradata_size > 0)
     {
-        decodingWorker.join();
+        openExtradata.assign(codecParams->extradata, codecParams->extradata + codecParams->extradata_size);
     }
-
-    // Cleanup FFmpeg resources
-    if (codecContext)
+    else
     {
-        avcodec_free_context(&codecContext);
-    }
-    if (formatContext)
-    {
-        avformat_close_input(&formatContext);
+        openExtradata.clear();
     }
+    codec_opens++;
+}
 
-    // Free remaining packets in the queue
-    while (!outputQueue.empty())
+void Decoder::releaseCodec()
+{
+    if (codecContext)
     {
-        AVFrame *frame = outputQueue.pop();
-        av_frame_free(&frame);
+        avcodec_free_context(&codecContext);
     }
+    openCodecId = AV_CODEC_ID_NONE;
+    openExtradata.clear();
 }
 
 bool Decoder::isDecoding()
@@ -116,57 +334,145 @@ bool Decoder::isDecoding()
     return !stopDecoding;
 }
 
+size_t Decoder::getCodecOpens() const
+{
+    return codec_opens;
+}
+
+size_t Decoder::getCodecReuses() const
+{
+    return codec_reuses;
+}
+
+size_t Decoder::getAVAllocations() const
+{
+    return packetPool.getAllocations() + framePool.getAllocations();
+}
+
+size_t Decoder::getAVReuses() const
+{
+    return packetPool.getReuses() + framePool.getReuses();
+}
+
+void Decoder::releaseFrame(AVFrame *frame)
+{
+    framePool.release(frame);
+}
+
+void Decoder::setFrameOutput(bool enabled)
+{
+    frame_output = enabled;
+}
+
+size_t Decoder::getDroppedOutputFrames() const
+{
+    return dropped_output_frames;
+}
+
 AVFrame *Decoder::getFrame(long timeout_ms)
 {
-    auto start_time = std::chrono::steady_clock::now();
-    while (std::chrono::steady_clock::now() - start_time < std::chrono::milliseconds(timeout_ms))
+    // Sleeps until a frame is pushed instead of polling
+    AVFrame *frame = nullptr;
+    if (outputQueue.pop_for(frame, std::chrono::milliseconds(timeout_ms)))
     {
-        if (!outputQueue.empty())
-        {
-            return outputQueue.pop();
-        }
-        std::this_thread::sleep_for(std::chrono::milliseconds(10)); // Avoid busy-waiting
+        return frame;
     }
     return nullptr; // Return nullptr if timeout is reached
 }
 
-void Decoder::decodingThread()
+void Decoder::demuxAndDecode()
 {
+    int num_of_failed_reads_in_arrow = 0;
+    bool finished = false; // Segment has been marked as downloaded or failed
+    AVPacket *packet = packetPool.acquire();
+    if (!packet)
+    {
+        Logger::getInstance().log("Failed to allocate packet, uri: " + uri, Logger::Severity::ERROR, TAG);
+        segment->download_failed();
+        return;
+    }
     while (!stopDecoding)
     {
-        AVPacket *packet = av_packet_alloc();
         int ret = av_read_frame(formatContext, packet);
         if (ret >= 0)
         {
+            num_of_failed_reads_in_arrow = 0;
             if (packet->stream_index == videoStreamIndex)
             {
-                Logger::getInstance().log("Decoding a video packet: " + segment->getUri(), Logger::Severity::DEBUG, TAG);
-                decodeNextFrame(packet);
+                Logger::getInstance().log("Decoding a video packet: " + uri, Logger::Severity::DEBUG, TAG);
+                try
+                {
+                    if (full_decode)
+                    {
+                        decodeNextFrame(packet);
+                    }
+                    else
+                    {
+                        processPacketTimestamp(packet);
+                    }
+                }
+                catch (const std::exception &ex)
+                {
+                    Logger::getInstance().log("Failed to decode segment, uri: " + uri + ", error: " + ex.what(), Logger::Severity::ERROR, TAG);
+                    segment->download_failed();
+                    finished = true;
+                    break;
+                }
             }
             else
             {
-                Logger::getInstance().log("Ignoring a non video packet: " + segment->getUri(), Logger::Severity::DEBUG, TAG);
+                Logger::getInstance().log("Ignoring a non video packet: " + uri, Logger::Severity::DEBUG, TAG);
             }
         }
         else if (ret == AVERROR_EOF)
         {
-            Logger::getInstance().log("End of segment reached, uri: " + segment->getUri(), Logger::Severity::DEBUG, TAG);
-            if(segment->getNumFrames() == 0) {
-                Logger::getInstance().log("Failed to download segment, uri: " + segment->getUri(), Logger::Severity::ERROR, TAG);
+            Logger::getInstance().log("End of segment reached, uri: " + uri, Logger::Severity::DEBUG, TAG);
+            try
+            {
+                // Drain the frames still buffered in the decoder
+                if (full_decode)
+                {
+                    decodeNextFrame(nullptr);
+                }
+                else
+                {
+                    processPacketTimestamp(nullptr);
+                }
+            }
+            catch (const std::exception &ex)
+            {
+                Logger::getInstance().log("Failed to drain decoder, uri: " + uri + ", error: " + ex.what(), Logger::Severity::ERROR, TAG);
+            }
+            if(decoded_frames == 0) {
+                Logger::getInstance().log("Failed to download segment, uri: " + uri, Logger::Severity::ERROR, TAG);
                 segment->download_failed();
+                finished = true;
                 break;
             }
             segment->download_complete();
+            finished = true;
             break;
         }
         else
         {
-            // TODO: see what to do here exactly
-            Logger::getInstance().log("Failed to demux the packet for uri: " + segment->getUri() + ", error: " + std::to_string(ret) + segment->getUri(), Logger::Severity::ERROR, TAG);
+            Logger::getInstance().log("Failed to demux the packet for uri: " + uri + ", error: " + std::to_string(ret), Logger::Severity::ERROR, TAG);
+            if (++num_of_failed_reads_in_arrow > MAX_FAILED_READS)
+            {
+                // Give up so the download worker is released for the next segment
+                segment->download_failed();
+                finished = true;
+                break;
+            }
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
-        av_packet_free(&packet);
+        av_packet_unref(packet);
     }
+    if (!finished)
+    {
+        // Stopped before the end of the segment
+        segment->download_failed();
+    }
+    packetPool.release(packet);
 }
 
 void Decoder::decodeNextFrame(AVPacket *packet)
@@ -175,47 +481,98 @@ void Decoder::decodeNextFrame(AVPacket *packet)
     {
         return;
     }
-    // Allocate frame
-    AVFrame *frame = av_frame_alloc();
-    if (!frame)
+    if (packet)
     {
-        throw std::runtime_error("Failed to allocate frame");
+        received_packets++;
+        // Frames of the priming parts were already counted when those parts were decoded
+        if (packet->pos >= 0 && static_cast<size_t>(packet->pos) < priming_size)
+        {
+            primingPts.push_back(packet->pts);
+        }
     }
 
-    received_packets++;
+    if (avcodec_send_packet(codecContext, packet) < 0)
+    {
+        num_of_failed_frames_in_arrow++;
+        if (num_of_failed_frames_in_arrow > 20)
+        {
+            throw std::runtime_error("Failed to decode segment");
+        }
+        Logger::getInstance().log("Failed to decode packet" + uri, Logger::Severity::DEBUG, TAG);
+        return;
+    }
 
-    while (av_read_frame(formatContext, packet) >= 0)
+    // Recycled frame, only its buffer references are dropped between uses
+    AVFrame *frame = framePool.acquire();
+    if (!frame)
     {
-        if (packet->stream_index == videoStreamIndex)
+        throw std::runtime_error("Failed to allocate frame");
+    }
+    while (avcodec_receive_frame(codecContext, frame) == 0)
+    {
+        if (!primingPts.empty() && takePrimingFrame(frame->pts))
         {
-            if (avcodec_send_packet(codecContext, packet) == 0)
-            {
-                if (avcodec_receive_frame(codecContext, frame) == 0)
-                {
-                    decoded_frames++;
-                    num_of_failed_frames_in_arrow = 0;
-                    // outputQueue.push(frame);
-                    segment->calculateStatistics(frame, get_timebase());
-                    av_frame_free(&frame);
-                    return;
-                }
-            }
-            else
+            av_frame_unref(frame);
+            continue;
+        }
+        decoded_frames++;
+        num_of_failed_frames_in_arrow = 0;
+        if (frame_output)
+        {
+            // The consumer gets its own reference, this frame is reused for the next one
+            AVFrame *output = framePool.acquire();
+            if (!output || av_frame_ref(output, frame) < 0 || !outputQueue.try_push(output))
             {
-                num_of_failed_frames_in_arrow++;
-                if (num_of_failed_frames_in_arrow > 20)
-                {
-                    av_frame_free(&frame);
-                    throw std::runtime_error("Failed to decode segment");
-                }
-                else
-                {
-                    Logger::getInstance().log("Failed to decode packet" + segment->getUri(), Logger::Severity::DEBUG, TAG);
-                }
+                releaseFrame(output);
+                dropped_output_frames++;
             }
         }
+        segment->calculateStatistics(frame, get_timebase());
+        int64_t published_us;
+        if (findTimestampSei(frame, published_us))
+        {
+            segment->addLatency((get_utc_us() - published_us) / 1000.0);
+        }
+        FrameMetrics metrics;
+        if (analyze_frames && frame->pts != AV_NOPTS_VALUE &&
+            frameAnalyzer.analyze(frame, static_cast<long>(pts_to_ms(frame, get_timebase())), metrics))
+        {
+            segment->addFrameAnalysis(metrics);
+        }
+        av_frame_unref(frame);
+    }
+    framePool.release(frame);
+}
+
+void Decoder::processPacketTimestamp(AVPacket *packet)
+{
+    if (packet)
+    {
+        received_packets++;
+        if (packet->pts == AV_NOPTS_VALUE)
+        {
+            Logger::getInstance().log("Failed to obtain pts for packet: " + uri, Logger::Severity::ERROR, TAG);
+            return;
+        }
+        reorderBuffer.emplace(static_cast<long>(pts_to_ms(packet->pts, get_timebase())), (packet->flags & AV_PKT_FLAG_KEY) != 0);
+        // Not decoded, the latency is taken when the access unit is demuxed
+        int64_t published_us;
+        if (nal_length_size >= 0 && findTimestampSei(packet->data, static_cast<size_t>(packet->size), nal_length_size, published_us))
+        {
+            segment->addLatency((get_utc_us() - published_us) / 1000.0);
+        }
+        if (reorderBuffer.size() <= REORDER_DEPTH)
+        {
+            return;
+        }
+    }
+    // Release the lowest timestamp, or everything at the end of the segment
+    while (!reorderBuffer.empty() && (!packet || reorderBuffer.size() > REORDER_DEPTH))
+    {
+        decoded_frames++;
+        segment->addFrame(reorderBuffer.top().first, reorderBuffer.top().second);
+        reorderBuffer.pop();
     }
-    av_frame_free(&frame);
 }
 
 int Decoder::getWidth() const
@@ -236,4 +593,4 @@ AVPixelFormat Decoder::getPixelFormat() const
 AVRational Decoder::get_timebase() const
 {
     return formatContext->streams[videoStreamIndex]->time_base;
-}
\ No newline at end of file
+}
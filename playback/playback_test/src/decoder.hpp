@@ -2,6 +2,7 @@
 #define DECODER_HPP
 
 #include "hls_segment.hpp"
+#include "frame_analyzer.hpp"
 
 // FFmpeg headers
 extern "C"
@@ -13,28 +14,54 @@ extern "C"
 }
 
 #include <string>
+#include <vector>
 #include <stdexcept>
 #include <iostream>
 #include <thread>
 #include <condition_variable>
 #include <atomic>
+#include <queue>
+#include <functional>
 
-#include "queue.hpp"
+#include "ring_queue.hpp"
+#include "av_pool.hpp"
 
 namespace playback
 {
 
+    enum class DecodeMode
+    {
+        FULL_DECODE, // Every video frame is decoded
+        DEMUX_ONLY   // Statistics come from packet timestamps, the codec is not opened
+    };
+
+    struct DecoderOptions
+    {
+        DecodeMode mode = DecodeMode::FULL_DECODE;
+        // In DEMUX_ONLY mode every n-th segment is still fully decoded as a spot check, 0 disables
+        int spot_check_interval = 0;
+        // Freeze, black frame and SI/TI analysis of the decoded pictures, FULL_DECODE only
+        bool analyze_frames = true;
+    };
+
+    /**
+     * @brief Reusable segment decoder, owned by one download pool worker.
+     *
+     * Each call to decode() opens one segment (or LL-HLS part), demuxes and decodes it on the
+     * calling thread and feeds the frame timestamps to the segment statistics. The codec context
+     * is kept open between calls and only flushed with avcodec_flush_buffers when the next
+     * segment carries the same stream parameters, so a worker allocates a new codec context only
+     * when the stream changes.
+     */
     class Decoder
     {
     public:
         /**
          * @brief Constructor for Decoder.
          *
-         * @param segment The HLS segment to decode.
-         *
-         * @throws std::runtime_error if initialization fails.
+         * @param analyze_frames Feed the luma metrics of every decoded frame to the segment.
          */
-        explicit Decoder(std::shared_ptr<HLSSegment> segment);
+        explicit Decoder(bool analyze_frames = true);
 
         /**
          * @brief Destructor for Decoder.
@@ -43,6 +70,29 @@ namespace playback
          */
         ~Decoder();
 
+        /**
+         * @brief Opens, demuxes and decodes a segment, returns when it is done.
+         *
+         * Marks the segment as downloaded or failed.
+         *
+         * @param segment The HLS segment to decode.
+         * @param part_uri Uri of a partial segment (LL-HLS) to decode into `segment`,
+         *                 the segment uri is used when empty.
+         * @param full_decode Decode the frames, when false only the packets are demuxed and
+         *                    the statistics are computed from their pts and keyframe flags.
+         * @param payload Body of the segment (or part) when it was already fetched, the
+         *                decoder reads it through a custom AVIOContext instead of opening the uri.
+         *
+         * @throws std::runtime_error if the segment cannot be opened.
+         */
+        void decode(std::shared_ptr<HLSSegment> segment, const std::string &part_uri = "", bool full_decode = true,
+                    std::shared_ptr<const std::string> payload = nullptr);
+
+        /**
+         * @brief Aborts the segment being decoded, used on shutdown.
+         */
+        void stop();
+
         /**
          * @brief Gets the width of the video.
          *
@@ -64,19 +114,43 @@ namespace playback
          */
         AVPixelFormat getPixelFormat() const;
 
+        /**
+         * @brief Retrieves a decoded frame from the output queue.
+         *
+         * @param timeout_ms The maximum time to wait in milliseconds.
+         * @return A pointer to the decoded AVFrame, or nullptr if the timeout is reached.
+         */
         AVFrame *getFrame(long timeout_ms);
 
         AVRational get_timebase() const;
 
         bool isDecoding();
 
+        // Number of times a codec context was allocated and opened
+        size_t getCodecOpens() const;
+
+        // Number of segments that reused the already open codec context
+        size_t getCodecReuses() const;
+
+        // Packets and frames allocated by the decoder
+        size_t getAVAllocations() const;
+
+        // Packet and frame uses served from the recycling pools without an allocation
+        size_t getAVReuses() const;
+
+        // Returns a frame obtained from getFrame() to the frame pool
+        void releaseFrame(AVFrame *frame);
+
         /**
-         * @brief Retrieves a decoded frame from the output queue.
+         * @brief Hands a reference to every decoded frame to getFrame(), off by default.
          *
-         * @param timeout_ms The maximum time to wait in milliseconds.
-         * @return A pointer to the decoded AVFrame, or nullptr if the timeout is reached.
+         * The decoder never waits for the consumer, frames that do not fit in the output queue
+         * are dropped and counted.
          */
-        // AVFrame *getFrame(long timeout_ms);
+        void setFrameOutput(bool enabled);
+
+        // Frames dropped because the output queue was full
+        size_t getDroppedOutputFrames() const;
 
     public:
         int received_packets;
@@ -84,33 +158,97 @@ namespace playback
         long started_at;
 
     private:
-        void decodingThread(); // Worker thread for decoding
+        void openInput();
+        void closeInput();
+
+        /**
+         * @brief Hands the body of an LL-HLS part to the segment and, for a dependent part,
+         * replaces `payload` with the earlier parts of the segment followed by this one.
+         */
+        void preparePart(const std::string &part_uri);
+
+        // Whether a decoded frame came from the priming parts, each pts is matched once
+        bool takePrimingFrame(int64_t pts);
+
+        // AVIOContext callbacks reading the in-memory payload
+        static int readPayload(void *opaque, uint8_t *buf, int buf_size);
+        static int64_t seekPayload(void *opaque, int64_t offset, int whence);
 
         /**
-         * @brief Decodes the next video frame from the input file.
+         * @brief Opens the codec for the current video stream, or flushes and reuses the
+         * open one if the stream parameters did not change.
          *
-         * @param paclket The packet to decode.
+         * @throws std::runtime_error if the codec cannot be opened.
+         */
+        void prepareCodec();
+        void releaseCodec();
+        bool canReuseCodec(const AVCodecParameters *codecParams) const;
+
+        void demuxAndDecode(); // Reads the segment until EOF
+
+        /**
+         * @brief Sends a packet to the decoder and collects the decoded frames.
          *
-         * @return true if a frame was successfully decoded, false if end of file is reached.
+         * @param packet The packet to decode, nullptr drains the decoder.
          *
-         * @throws std::runtime_error if decoding fails.
+         * @throws std::runtime_error if decoding fails repeatedly.
          */
         void decodeNextFrame(AVPacket *packet);
 
+        /**
+         * @brief Demux-only path, queues the packet timestamp for the segment statistics.
+         *
+         * Packets are demuxed in decode order, timestamps pass through a small reorder buffer
+         * so they reach the statistics in presentation order like decoded frames do.
+         *
+         * @param packet The packet, nullptr flushes the reorder buffer.
+         */
+        void processPacketTimestamp(AVPacket *packet);
+
     private:
-        std::shared_ptr<HLSSegment> segment; ///< HLS segment to decode.
+        std::shared_ptr<HLSSegment> segment; ///< HLS segment being decoded.
+        std::string uri;                     ///< Uri of the segment or part being decoded.
         AVFormatContext *formatContext;      ///< FFmpeg format context.
-        AVCodecContext *codecContext;        ///< FFmpeg codec context.
+        AVIOContext *ioContext;              ///< Custom IO over `payload`, nullptr when the uri is opened.
+        std::shared_ptr<const std::string> payload; ///< Fetched body of the segment or part.
+        size_t payload_offset;               ///< Read position in `payload`.
+        std::shared_ptr<std::string> primingBuffer; ///< Earlier parts and the part being decoded, reused.
+        size_t priming_size;                 ///< Bytes of `payload` that only prime the decoder.
+        std::vector<int64_t> primingPts;     ///< Pts of the priming packets whose frames are not out yet.
+        AVCodecContext *codecContext;        ///< FFmpeg codec context, kept across segments.
         int videoStreamIndex;                ///< Index of the video stream.
+        int nal_length_size;                 ///< H.264 NAL length prefix size, 0 for Annex B, -1 for other codecs.
         int num_of_failed_frames_in_arrow;
+        bool full_decode;
+
+        // Demux-only: (pts in ms, keyframe) ordered by pts
+        using TimestampEntry = std::pair<long, bool>;
+        std::priority_queue<TimestampEntry, std::vector<TimestampEntry>, std::greater<TimestampEntry>> reorderBuffer;
+
+        // Parameters the open codec context was created with
+        AVCodecID openCodecId;
+        int openWidth;
+        int openHeight;
+        int openFormat;
+        std::vector<uint8_t> openExtradata;
+        std::atomic<size_t> codec_opens;
+        std::atomic<size_t> codec_reuses;
+
+        // Recycled across packets, frames and segments, allocations stop after the first segment
+        PacketPool packetPool;
+        FramePool framePool;
+
+        // Reset per segment, a worker decodes unrelated segments of any stream. Parts continue
+        // from the state the previous part of their segment left (HLSSegment::swapPartAnalyzer)
+        FrameAnalyzer frameAnalyzer;
+        bool analyze_frames;
 
-        // Thread-safe queue for packets
         std::atomic<bool> stopDecoding;
-        Queue<AVFrame *> outputQueue;
-
-        // Worker thread
-        std::thread decodingWorker;
+        RingQueue<AVFrame *> outputQueue;
+        std::atomic<bool> frame_output{false};
+        std::atomic<size_t> dropped_output_frames{0};
     };
 
+} // namespace playback
+
 #endif // DECODER_HPP
-}
\ No newline at end of file
@@ -0,0 +1,289 @@
+#include "download_pool.hpp"
+#include "decoder.hpp"
+#include "ts_validator.hpp"
+#include "logger.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+
+using namespace playback;
+
+constexpr const char *POOL_TAG = "SegmentDownloadPool";
+
+SegmentDownloadPool::SegmentDownloadPool(size_t max_concurrent, size_t max_pending, DecoderOptions options)
+    : max_pending(max_pending), options(options)
+{
+    if (max_concurrent == 0 || max_pending == 0)
+    {
+        throw std::invalid_argument("Download pool limits must be greater than zero.");
+    }
+    for (size_t i = 0; i < max_concurrent; i++)
+    {
+        decoders.push_back(std::make_unique<Decoder>(options.analyze_frames));
+    }
+    for (size_t i = 0; i < max_concurrent; i++)
+    {
+        workers.emplace_back(&SegmentDownloadPool::workerThread, this, decoders[i].get());
+    }
+}
+
+SegmentDownloadPool::~SegmentDownloadPool()
+{
+    stop();
+}
+
+void SegmentDownloadPool::stop()
+{
+    std::deque<Job> discarded;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+        discarded.swap(pending);
+    }
+    // Nothing else will finish the discarded segments, waiting consumers would stall on them
+    for (const Job &job : discarded)
+    {
+        job.segment->download_failed();
+    }
+    queueCondition.notify_all();
+    for (auto &decoder : decoders)
+    {
+        decoder->stop();
+    }
+    for (auto &worker : workers)
+    {
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+    }
+}
+
+void SegmentDownloadPool::submit(std::shared_ptr<HLSSegment> segment, const std::string &part_uri,
+                                 std::shared_ptr<const std::string> payload, SegmentFetch fetch)
+{
+    std::shared_ptr<HLSSegment> dropped;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (stopping)
+        {
+            return;
+        }
+        if (pending.size() >= max_pending)
+        {
+            dropped = pending.front().segment;
+            pending.pop_front();
+        }
+        bool full_decode = options.mode == DecodeMode::FULL_DECODE;
+        if (!full_decode && options.spot_check_interval > 0 && part_uri.empty())
+        {
+            full_decode = submitted_segments % options.spot_check_interval == 0;
+        }
+        if (part_uri.empty())
+        {
+            submitted_segments++;
+        }
+        pending.push_back({segment, part_uri, std::move(payload), std::move(fetch), full_decode});
+        peak_queue_depth = std::max(peak_queue_depth, pending.size());
+    }
+    queueCondition.notify_one();
+
+    if (dropped)
+    {
+        dropped_segments++;
+        Logger::getInstance().log("Download queue full, dropping segment: " + dropped->getUri(), Logger::Severity::WARNING, POOL_TAG);
+        dropped->download_failed();
+    }
+}
+
+void SegmentDownloadPool::workerThread(Decoder *decoder)
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            // First queued job whose segment has no other part in progress
+            auto next = pending.end();
+            queueCondition.wait(lock, [this, &next]()
+                                {
+                                    next = std::find_if(pending.begin(), pending.end(), [this](const Job &candidate)
+                                                        { return busySegments.count(candidate.segment.get()) == 0; });
+                                    return stopping || next != pending.end(); });
+            if (stopping)
+            {
+                return;
+            }
+            job = std::move(*next);
+            pending.erase(next);
+            busySegments.insert(job.segment.get());
+        }
+        active_downloads++;
+        download(*decoder, job);
+        active_downloads--;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            busySegments.erase(job.segment.get());
+        }
+        // A part of the same segment may be waiting for this one
+        queueCondition.notify_all();
+    }
+}
+
+std::shared_ptr<std::string> SegmentDownloadPool::acquireBuffer()
+{
+    return bufferPool.acquire();
+}
+
+void SegmentDownloadPool::setPayloadObserver(PayloadObserver observer)
+{
+    std::lock_guard<std::mutex> lock(observerMutex);
+    payloadObserver = std::move(observer);
+}
+
+void SegmentDownloadPool::download(Decoder &decoder, const Job &job)
+{
+    const std::string &uri = job.part_uri.empty() ? job.segment->getUri() : job.part_uri;
+    if (job.fetch.isReleased())
+    {
+        Logger::getInstance().log("Dropping segment of a released parser: " + uri, Logger::Severity::DEBUG, POOL_TAG);
+        job.segment->download_failed();
+        return;
+    }
+    try
+    {
+        HttpTransferInfo info;
+        std::shared_ptr<const std::string> payload = job.payload ? job.payload : fetchPayload(job, uri, info);
+        if (payload)
+        {
+            PayloadObserver observer;
+            {
+                std::lock_guard<std::mutex> lock(observerMutex);
+                observer = payloadObserver;
+            }
+            if (observer)
+            {
+                observer(job.segment, uri, payload, info);
+            }
+        }
+        decoder.decode(job.segment, job.part_uri, job.full_decode, std::move(payload));
+    }
+    catch (const std::exception &ex)
+    {
+        Logger::getInstance().log("Failed to download segment: " + uri + ", error: " + ex.what(), Logger::Severity::ERROR, POOL_TAG);
+        job.segment->download_failed();
+    }
+}
+
+std::shared_ptr<const std::string> SegmentDownloadPool::fetchPayload(const Job &job, const std::string &uri, HttpTransferInfo &info)
+{
+    // Local files and other protocols are still opened by FFmpeg
+    std::shared_ptr<HttpClient> client = job.fetch.client.lock();
+    if (!client || uri.compare(0, 4, "http") != 0)
+    {
+        return nullptr;
+    }
+    std::shared_ptr<std::string> body = bufferPool.acquire();
+    // Other workers fetch through the same client at the same time, each on its own handle
+    TsValidator validator = job.segment->takeTsValidator();
+    // Handed back as it was if the transfer fails, the bytes may be an error page
+    TsValidator previous = validator;
+    CURLcode result = client->fetch(uri, *body, &info, [&validator](const uint8_t *data, size_t size)
+                                  { validator.feed(data, size); });
+    bool ok = result == CURLE_OK && info.response_code < 400;
+    job.segment->putTsValidator(ok ? std::move(validator) : std::move(previous));
+    if (result != CURLE_OK)
+    {
+        throw std::runtime_error(curl_easy_strerror(result));
+    }
+    if (info.response_code >= 400)
+    {
+        throw std::runtime_error("HTTP " + std::to_string(info.response_code));
+    }
+    if (job.fetch.on_transfer)
+    {
+        job.fetch.on_transfer(job.segment, info);
+    }
+    else
+    {
+        job.segment->addTransfer(info);
+    }
+    return body;
+}
+
+size_t SegmentDownloadPool::getQueueDepth()
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return pending.size();
+}
+
+size_t SegmentDownloadPool::getPeakQueueDepth()
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return peak_queue_depth;
+}
+
+size_t SegmentDownloadPool::getActiveDownloads() const
+{
+    return active_downloads;
+}
+
+size_t SegmentDownloadPool::getDroppedSegments() const
+{
+    return dropped_segments;
+}
+
+size_t SegmentDownloadPool::getConcurrencyLimit() const
+{
+    return workers.size();
+}
+
+size_t SegmentDownloadPool::getCodecOpens() const
+{
+    size_t opens = 0;
+    for (const auto &decoder : decoders)
+    {
+        opens += decoder->getCodecOpens();
+    }
+    return opens;
+}
+
+size_t SegmentDownloadPool::getCodecReuses() const
+{
+    size_t reuses = 0;
+    for (const auto &decoder : decoders)
+    {
+        reuses += decoder->getCodecReuses();
+    }
+    return reuses;
+}
+
+size_t SegmentDownloadPool::getAVAllocations() const
+{
+    size_t allocations = 0;
+    for (const auto &decoder : decoders)
+    {
+        allocations += decoder->getAVAllocations();
+    }
+    return allocations;
+}
+
+size_t SegmentDownloadPool::getAVReuses() const
+{
+    size_t reuses = 0;
+    for (const auto &decoder : decoders)
+    {
+        reuses += decoder->getAVReuses();
+    }
+    return reuses;
+}
+
+size_t SegmentDownloadPool::getBufferAllocations() const
+{
+    return bufferPool.getAllocations();
+}
+
+size_t SegmentDownloadPool::getBufferReuses() const
+{
+    return bufferPool.getReuses();
+}
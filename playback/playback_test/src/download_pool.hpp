@@ -0,0 +1,199 @@
+#ifndef DOWNLOAD_POOL_HPP
+#define DOWNLOAD_POOL_HPP
+
+#include "hls_segment.hpp"
+#include "decoder.hpp"
+#include "http_client.hpp"
+#include "segment_buffer.hpp"
+#include "constants.hpp"
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <condition_variable>
+#include <functional>
+
+namespace playback
+{
+
+    // How a worker downloads a segment that was submitted without its body
+    struct SegmentFetch
+    {
+        // Held weakly so a submitter on a shared pool can go away with jobs queued, empty lets FFmpeg open the uri itself
+        std::weak_ptr<HttpClient> client;
+        // Receives the transfer metadata, HLSSegment::addTransfer() when empty. Must not capture the submitter.
+        std::function<void(const std::shared_ptr<HLSSegment> &segment, const HttpTransferInfo &info)> on_transfer;
+
+        // A client was set and its owner has released it since, nobody is left to receive the segment
+        bool isReleased() const
+        {
+            std::weak_ptr<HttpClient> none;
+            return client.expired() && (client.owner_before(none) || none.owner_before(client));
+        }
+    };
+
+    /**
+     * @brief Bounded pool of workers that open and decode HLS segments.
+     *
+     * The manifest parser hands new segments to the pool with submit(), which never blocks.
+     * At most `max_concurrent` segments are opened/decoded at the same time, the rest wait
+     * in a pending queue of at most `max_pending` entries. When the pending queue is full the
+     * oldest waiting segment is dropped and marked as failed, so a throttled link can never
+     * stall the manifest refresh loop.
+     *
+     * LL-HLS parts of one segment are decoded one after another, in submission order, so the
+     * frames reach the segment statistics in presentation order.
+     *
+     * Segments are downloaded by the workers through the submitter's HttpClient into recycled
+     * buffers (SegmentBufferPool) and demuxed from memory, the MPEG-TS check runs on the bytes
+     * as they arrive. Every payload is shown to the payload observer before it is decoded, so
+     * other consumers get the bytes without a second download.
+     *
+     * The workers call HttpClient::fetch() on the one client concurrently, without a lock of
+     * their own: each call runs on an easy handle of its own from the client's idle list and
+     * keeps its connections in that handle's cache, the CURLSH the handles have in common
+     * only holds the DNS cache and the TLS sessions, behind the client's share locks. Up to
+     * `max_concurrent` handles (and keep-alive connections per origin) are open at a time.
+     *
+     * Every worker owns one Decoder for its whole lifetime, so the number of threads and codec
+     * contexts stays constant no matter how many segments are processed. Finished segments are
+     * released by the worker as soon as they are decoded.
+     *
+     * A pool may be shared by many parsers and is stopped by whoever owns it. Queued jobs hold
+     * their submitter's client weakly, the job of a parser that was destroyed meanwhile is
+     * dropped and its segment marked as failed.
+     */
+    class SegmentDownloadPool
+    {
+    public:
+        /**
+         * @brief Constructor for SegmentDownloadPool.
+         *
+         * @param max_concurrent Maximum number of segments downloaded/decoded in parallel.
+         * @param max_pending Maximum number of segments waiting for a free worker.
+         * @param options How the workers decode the segments.
+         *
+         * @throws std::invalid_argument if any of the limits is zero.
+         */
+        SegmentDownloadPool(size_t max_concurrent = DEFAULT_DOWNLOAD_WORKERS,
+                            size_t max_pending = DEFAULT_DOWNLOAD_QUEUE_SIZE,
+                            DecoderOptions options = DecoderOptions());
+
+        /**
+         * @brief Destructor for SegmentDownloadPool.
+         *
+         * Stops accepting segments and waits for the running downloads to finish.
+         */
+        ~SegmentDownloadPool();
+
+        /**
+         * @brief Queues a segment for download, returns immediately.
+         *
+         * @param segment The HLS segment to open and decode.
+         * @param part_uri Uri of an LL-HLS part of `segment`, empty to download the whole segment.
+         * @param payload Body of the segment or part when it was fetched by the caller,
+         *                the worker then only demuxes and decodes it.
+         * @param fetch How the worker downloads the segment when `payload` is null.
+         */
+        void submit(std::shared_ptr<HLSSegment> segment, const std::string &part_uri = "",
+                    std::shared_ptr<const std::string> payload = nullptr, SegmentFetch fetch = SegmentFetch());
+
+        // Empty buffer from the pool's recycled segment buffers, for callers fetching themselves
+        std::shared_ptr<std::string> acquireBuffer();
+
+        /**
+         * Called on a worker with every segment or part body before it is decoded, must be thread
+         * safe. `info` is the transfer of a body fetched by the worker, empty (response_code 0)
+         * for a body submitted by the caller.
+         */
+        using PayloadObserver = std::function<void(const std::shared_ptr<HLSSegment> &segment, const std::string &uri,
+                                                   const std::shared_ptr<const std::string> &payload, const HttpTransferInfo &info)>;
+        void setPayloadObserver(PayloadObserver observer);
+
+        /**
+         * @brief Stops the workers, pending segments are discarded and marked as failed.
+         */
+        void stop();
+
+        // Number of segments waiting for a free worker
+        size_t getQueueDepth();
+
+        // Highest queue depth observed since start
+        size_t getPeakQueueDepth();
+
+        // Number of segments currently being downloaded/decoded
+        size_t getActiveDownloads() const;
+
+        // Number of segments dropped because the pending queue was full
+        size_t getDroppedSegments() const;
+
+        size_t getConcurrencyLimit() const;
+
+        // Number of codec contexts opened by the workers
+        size_t getCodecOpens() const;
+
+        // Number of segments that reused an already open codec context
+        size_t getCodecReuses() const;
+
+        // Packets and frames allocated by the workers
+        size_t getAVAllocations() const;
+
+        // Packet and frame allocations avoided by recycling
+        size_t getAVReuses() const;
+
+        // Segment buffers allocated / served recycled
+        size_t getBufferAllocations() const;
+        size_t getBufferReuses() const;
+
+        // Disable copy constructor and assignment operator
+        SegmentDownloadPool(const SegmentDownloadPool &) = delete;
+        SegmentDownloadPool &operator=(const SegmentDownloadPool &) = delete;
+
+    private:
+        struct Job
+        {
+            std::shared_ptr<HLSSegment> segment;
+            std::string part_uri;
+            std::shared_ptr<const std::string> payload; // Already fetched body, may be null
+            SegmentFetch fetch;
+            bool full_decode = true;
+        };
+
+        void workerThread(Decoder *decoder);
+        void download(Decoder &decoder, const Job &job);
+
+        /**
+         * @brief Downloads the body of a job into a recycled buffer.
+         *
+         * @return The body, nullptr when the uri is left to FFmpeg.
+         * @throws std::runtime_error if the request fails.
+         */
+        std::shared_ptr<const std::string> fetchPayload(const Job &job, const std::string &uri, HttpTransferInfo &info);
+
+    private:
+        std::deque<Job> pending;
+        std::unordered_set<HLSSegment *> busySegments; // Segments with a part being decoded
+        std::vector<std::unique_ptr<Decoder>> decoders; // One per worker
+        std::vector<std::thread> workers;
+        std::mutex queueMutex;
+        std::condition_variable queueCondition;
+        SegmentBufferPool bufferPool;
+        PayloadObserver payloadObserver;
+        std::mutex observerMutex;
+        bool stopping = false;
+        size_t max_pending;
+        DecoderOptions options;
+        size_t submitted_segments = 0; // Counts whole segments for the decode spot checks
+        size_t peak_queue_depth = 0;
+        std::atomic<size_t> active_downloads{0};
+        std::atomic<size_t> dropped_segments{0};
+    };
+
+} // namespace playback
+
+#endif // DOWNLOAD_POOL_HPP
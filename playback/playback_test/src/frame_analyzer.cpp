@@ -0,0 +1,475 @@
+#include "frame_analyzer.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <atomic>
+
+// The kernels use 64-bit lane extracts (_mm_extract_epi64, _mm_cvtsi128_si64), x86-64 only
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define FRAME_ANALYZER_X86 1
+#endif
+
+using namespace playback;
+
+namespace
+{
+    // Sum and sum of squares of the luma samples
+    using LumaSumsFn = void (*)(const uint8_t *src, ptrdiff_t stride, int width, int height,
+                                uint64_t &sum, uint64_t &sumsq);
+    // Sum of absolute, signed and squared differences between two luma planes
+    using DiffSumsFn = void (*)(const uint8_t *cur, ptrdiff_t cur_stride, const uint8_t *prev, ptrdiff_t prev_stride,
+                                int width, int height, uint64_t &sad, int64_t &sum, uint64_t &sumsq);
+    // Sum of the Sobel magnitude and of its square over the interior pixels
+    using SobelSumsFn = void (*)(const uint8_t *src, ptrdiff_t stride, int width, int height,
+                                 double &sum, uint64_t &sumsq);
+
+    struct Kernels
+    {
+        const char *name;
+        LumaSumsFn lumaSums;
+        DiffSumsFn diffSums;
+        SobelSumsFn sobelSums;
+    };
+
+    // Scalar kernels, also handle the row tails of the SIMD kernels
+
+    inline void lumaSumsRow(const uint8_t *row, int from, int width, uint64_t &sum, uint64_t &sumsq)
+    {
+        for (int x = from; x < width; x++)
+        {
+            sum += row[x];
+            sumsq += row[x] * row[x];
+        }
+    }
+
+    inline void diffSumsRow(const uint8_t *cur, const uint8_t *prev, int from, int width,
+                            uint64_t &sad, int64_t &sum, uint64_t &sumsq)
+    {
+        for (int x = from; x < width; x++)
+        {
+            int d = cur[x] - prev[x];
+            sad += std::abs(d);
+            sum += d;
+            sumsq += d * d;
+        }
+    }
+
+    inline void sobelSumsRow(const uint8_t *r0, const uint8_t *r1, const uint8_t *r2, int from, int width,
+                             double &sum, uint64_t &sumsq)
+    {
+        for (int x = from; x < width - 1; x++)
+        {
+            int gx = (r0[x + 1] + 2 * r1[x + 1] + r2[x + 1]) - (r0[x - 1] + 2 * r1[x - 1] + r2[x - 1]);
+            int gy = (r2[x - 1] + 2 * r2[x] + r2[x + 1]) - (r0[x - 1] + 2 * r0[x] + r0[x + 1]);
+            uint32_t magnitude2 = gx * gx + gy * gy;
+            sum += std::sqrt(static_cast<float>(magnitude2));
+            sumsq += magnitude2;
+        }
+    }
+
+    void lumaSumsScalar(const uint8_t *src, ptrdiff_t stride, int width, int height, uint64_t &sum, uint64_t &sumsq)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            lumaSumsRow(src + y * stride, 0, width, sum, sumsq);
+        }
+    }
+
+    void diffSumsScalar(const uint8_t *cur, ptrdiff_t cur_stride, const uint8_t *prev, ptrdiff_t prev_stride,
+                        int width, int height, uint64_t &sad, int64_t &sum, uint64_t &sumsq)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            diffSumsRow(cur + y * cur_stride, prev + y * prev_stride, 0, width, sad, sum, sumsq);
+        }
+    }
+
+    void sobelSumsScalar(const uint8_t *src, ptrdiff_t stride, int width, int height, double &sum, uint64_t &sumsq)
+    {
+        for (int y = 1; y < height - 1; y++)
+        {
+            const uint8_t *r1 = src + y * stride;
+            sobelSumsRow(r1 - stride, r1, r1 + stride, 1, width, sum, sumsq);
+        }
+    }
+
+#ifdef FRAME_ANALYZER_X86
+
+    // Per-row 32-bit lane accumulators are safe for rows up to 8K wide, Sobel squares included
+    // (at most 2 * 1020^2 per pixel, 4.0e9 per lane for an 8K row)
+
+    __attribute__((target("sse4.1"))) inline uint64_t hsum32(__m128i v)
+    {
+        alignas(16) uint32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(lanes), v);
+        return static_cast<uint64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    __attribute__((target("sse4.1"))) inline int64_t hsum32s(__m128i v)
+    {
+        alignas(16) int32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(lanes), v);
+        return static_cast<int64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    __attribute__((target("sse4.1"))) inline uint64_t hsum64(__m128i v)
+    {
+        return static_cast<uint64_t>(_mm_cvtsi128_si64(v)) + static_cast<uint64_t>(_mm_extract_epi64(v, 1));
+    }
+
+    __attribute__((target("sse4.1"))) inline float hsumps(__m128 v)
+    {
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, v);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    __attribute__((target("sse4.1"))) void lumaSumsSse41(const uint8_t *src, ptrdiff_t stride, int width, int height,
+                                                         uint64_t &sum, uint64_t &sumsq)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        for (int y = 0; y < height; y++)
+        {
+            const uint8_t *row = src + y * stride;
+            __m128i vsum = zero, vsq = zero;
+            int x = 0;
+            for (; x + 16 <= width; x += 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x));
+                vsum = _mm_add_epi64(vsum, _mm_sad_epu8(v, zero));
+                __m128i lo = _mm_unpacklo_epi8(v, zero);
+                __m128i hi = _mm_unpackhi_epi8(v, zero);
+                vsq = _mm_add_epi32(vsq, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+            }
+            sum += hsum64(vsum);
+            sumsq += hsum32(vsq);
+            lumaSumsRow(row, x, width, sum, sumsq);
+        }
+    }
+
+    __attribute__((target("sse4.1"))) void diffSumsSse41(const uint8_t *cur, ptrdiff_t cur_stride, const uint8_t *prev,
+                                                         ptrdiff_t prev_stride, int width, int height,
+                                                         uint64_t &sad, int64_t &sum, uint64_t &sumsq)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ones = _mm_set1_epi16(1);
+        for (int y = 0; y < height; y++)
+        {
+            const uint8_t *a = cur + y * cur_stride;
+            const uint8_t *b = prev + y * prev_stride;
+            __m128i vsad = zero, vsum = zero, vsq = zero;
+            int x = 0;
+            for (; x + 16 <= width; x += 16)
+            {
+                __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + x));
+                __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + x));
+                vsad = _mm_add_epi64(vsad, _mm_sad_epu8(va, vb));
+                __m128i dlo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+                __m128i dhi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+                vsum = _mm_add_epi32(vsum, _mm_add_epi32(_mm_madd_epi16(dlo, ones), _mm_madd_epi16(dhi, ones)));
+                vsq = _mm_add_epi32(vsq, _mm_add_epi32(_mm_madd_epi16(dlo, dlo), _mm_madd_epi16(dhi, dhi)));
+            }
+            sad += hsum64(vsad);
+            sum += hsum32s(vsum);
+            sumsq += hsum32(vsq);
+            diffSumsRow(a, b, x, width, sad, sum, sumsq);
+        }
+    }
+
+    __attribute__((target("sse4.1"))) inline __m128i load8(const uint8_t *p)
+    {
+        return _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+    }
+
+    __attribute__((target("sse4.1"))) void sobelSumsSse41(const uint8_t *src, ptrdiff_t stride, int width, int height,
+                                                          double &sum, uint64_t &sumsq)
+    {
+        for (int y = 1; y < height - 1; y++)
+        {
+            const uint8_t *r1 = src + y * stride;
+            const uint8_t *r0 = r1 - stride;
+            const uint8_t *r2 = r1 + stride;
+            __m128 vsum = _mm_setzero_ps();
+            __m128i vsq = _mm_setzero_si128();
+            int x = 1;
+            // 8 pixels per step, reads up to x + 8
+            for (; x + 9 <= width; x += 8)
+            {
+                __m128i r0m = load8(r0 + x - 1), r0c = load8(r0 + x), r0p = load8(r0 + x + 1);
+                __m128i r1m = load8(r1 + x - 1), r1p = load8(r1 + x + 1);
+                __m128i r2m = load8(r2 + x - 1), r2c = load8(r2 + x), r2p = load8(r2 + x + 1);
+                __m128i gx = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(r0p, r2p), _mm_slli_epi16(r1p, 1)),
+                                           _mm_add_epi16(_mm_add_epi16(r0m, r2m), _mm_slli_epi16(r1m, 1)));
+                __m128i gy = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(r2m, r2p), _mm_slli_epi16(r2c, 1)),
+                                           _mm_add_epi16(_mm_add_epi16(r0m, r0p), _mm_slli_epi16(r0c, 1)));
+                // Interleaved (gx, gy) pairs, madd gives gx^2 + gy^2 per 32-bit lane
+                __m128i lo = _mm_unpacklo_epi16(gx, gy);
+                __m128i hi = _mm_unpackhi_epi16(gx, gy);
+                __m128i m2lo = _mm_madd_epi16(lo, lo);
+                __m128i m2hi = _mm_madd_epi16(hi, hi);
+                vsq = _mm_add_epi32(vsq, _mm_add_epi32(m2lo, m2hi));
+                vsum = _mm_add_ps(vsum, _mm_add_ps(_mm_sqrt_ps(_mm_cvtepi32_ps(m2lo)), _mm_sqrt_ps(_mm_cvtepi32_ps(m2hi))));
+            }
+            sum += hsumps(vsum);
+            sumsq += hsum32(vsq);
+            sobelSumsRow(r0, r1, r2, x, width, sum, sumsq);
+        }
+    }
+
+    __attribute__((target("avx2"))) inline uint64_t hsum32(__m256i v)
+    {
+        return hsum32(_mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+    }
+
+    __attribute__((target("avx2"))) inline int64_t hsum32s(__m256i v)
+    {
+        return hsum32s(_mm256_castsi256_si128(v)) + hsum32s(_mm256_extracti128_si256(v, 1));
+    }
+
+    __attribute__((target("avx2"))) inline uint64_t hsum64(__m256i v)
+    {
+        return hsum64(_mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+    }
+
+    __attribute__((target("avx2"))) inline float hsumps(__m256 v)
+    {
+        return hsumps(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+    }
+
+    __attribute__((target("avx2"))) void lumaSumsAvx2(const uint8_t *src, ptrdiff_t stride, int width, int height,
+                                                      uint64_t &sum, uint64_t &sumsq)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        for (int y = 0; y < height; y++)
+        {
+            const uint8_t *row = src + y * stride;
+            __m256i vsum = zero, vsq = zero;
+            int x = 0;
+            for (; x + 32 <= width; x += 32)
+            {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + x));
+                vsum = _mm256_add_epi64(vsum, _mm256_sad_epu8(v, zero));
+                __m256i lo = _mm256_unpacklo_epi8(v, zero);
+                __m256i hi = _mm256_unpackhi_epi8(v, zero);
+                vsq = _mm256_add_epi32(vsq, _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi)));
+            }
+            sum += hsum64(vsum);
+            sumsq += hsum32(vsq);
+            lumaSumsRow(row, x, width, sum, sumsq);
+        }
+    }
+
+    __attribute__((target("avx2"))) void diffSumsAvx2(const uint8_t *cur, ptrdiff_t cur_stride, const uint8_t *prev,
+                                                      ptrdiff_t prev_stride, int width, int height,
+                                                      uint64_t &sad, int64_t &sum, uint64_t &sumsq)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i ones = _mm256_set1_epi16(1);
+        for (int y = 0; y < height; y++)
+        {
+            const uint8_t *a = cur + y * cur_stride;
+            const uint8_t *b = prev + y * prev_stride;
+            __m256i vsad = zero, vsum = zero, vsq = zero;
+            int x = 0;
+            for (; x + 32 <= width; x += 32)
+            {
+                __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + x));
+                __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + x));
+                vsad = _mm256_add_epi64(vsad, _mm256_sad_epu8(va, vb));
+                __m256i dlo = _mm256_sub_epi16(_mm256_unpacklo_epi8(va, zero), _mm256_unpacklo_epi8(vb, zero));
+                __m256i dhi = _mm256_sub_epi16(_mm256_unpackhi_epi8(va, zero), _mm256_unpackhi_epi8(vb, zero));
+                vsum = _mm256_add_epi32(vsum, _mm256_add_epi32(_mm256_madd_epi16(dlo, ones), _mm256_madd_epi16(dhi, ones)));
+                vsq = _mm256_add_epi32(vsq, _mm256_add_epi32(_mm256_madd_epi16(dlo, dlo), _mm256_madd_epi16(dhi, dhi)));
+            }
+            sad += hsum64(vsad);
+            sum += hsum32s(vsum);
+            sumsq += hsum32(vsq);
+            diffSumsRow(a, b, x, width, sad, sum, sumsq);
+        }
+    }
+
+    __attribute__((target("avx2"))) inline __m256i load16(const uint8_t *p)
+    {
+        return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+    }
+
+    __attribute__((target("avx2"))) void sobelSumsAvx2(const uint8_t *src, ptrdiff_t stride, int width, int height,
+                                                       double &sum, uint64_t &sumsq)
+    {
+        for (int y = 1; y < height - 1; y++)
+        {
+            const uint8_t *r1 = src + y * stride;
+            const uint8_t *r0 = r1 - stride;
+            const uint8_t *r2 = r1 + stride;
+            __m256 vsum = _mm256_setzero_ps();
+            __m256i vsq = _mm256_setzero_si256();
+            int x = 1;
+            // 16 pixels per step, reads up to x + 16
+            for (; x + 17 <= width; x += 16)
+            {
+                __m256i r0m = load16(r0 + x - 1), r0c = load16(r0 + x), r0p = load16(r0 + x + 1);
+                __m256i r1m = load16(r1 + x - 1), r1p = load16(r1 + x + 1);
+                __m256i r2m = load16(r2 + x - 1), r2c = load16(r2 + x), r2p = load16(r2 + x + 1);
+                __m256i gx = _mm256_sub_epi16(_mm256_add_epi16(_mm256_add_epi16(r0p, r2p), _mm256_slli_epi16(r1p, 1)),
+                                              _mm256_add_epi16(_mm256_add_epi16(r0m, r2m), _mm256_slli_epi16(r1m, 1)));
+                __m256i gy = _mm256_sub_epi16(_mm256_add_epi16(_mm256_add_epi16(r2m, r2p), _mm256_slli_epi16(r2c, 1)),
+                                              _mm256_add_epi16(_mm256_add_epi16(r0m, r0p), _mm256_slli_epi16(r0c, 1)));
+                __m256i lo = _mm256_unpacklo_epi16(gx, gy);
+                __m256i hi = _mm256_unpackhi_epi16(gx, gy);
+                __m256i m2lo = _mm256_madd_epi16(lo, lo);
+                __m256i m2hi = _mm256_madd_epi16(hi, hi);
+                vsq = _mm256_add_epi32(vsq, _mm256_add_epi32(m2lo, m2hi));
+                vsum = _mm256_add_ps(vsum, _mm256_add_ps(_mm256_sqrt_ps(_mm256_cvtepi32_ps(m2lo)), _mm256_sqrt_ps(_mm256_cvtepi32_ps(m2hi))));
+            }
+            sum += hsumps(vsum);
+            sumsq += hsum32(vsq);
+            sobelSumsRow(r0, r1, r2, x, width, sum, sumsq);
+        }
+    }
+
+#endif // FRAME_ANALYZER_X86
+
+    // Kernel sets this CPU can run, best first
+    const std::vector<Kernels> &supportedKernels()
+    {
+        static const std::vector<Kernels> kernels = []()
+        {
+            std::vector<Kernels> supported;
+#ifdef FRAME_ANALYZER_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+            {
+                supported.push_back({"avx2", lumaSumsAvx2, diffSumsAvx2, sobelSumsAvx2});
+            }
+            if (__builtin_cpu_supports("sse4.1"))
+            {
+                supported.push_back({"sse4.1", lumaSumsSse41, diffSumsSse41, sobelSumsSse41});
+            }
+#endif
+            supported.push_back({"scalar", lumaSumsScalar, diffSumsScalar, sobelSumsScalar});
+            return supported;
+        }();
+        return kernels;
+    }
+
+    std::atomic<const Kernels *> selectedKernels{nullptr};
+
+    const Kernels &selectKernels()
+    {
+        const Kernels *kernels = selectedKernels.load(std::memory_order_relaxed);
+        return kernels ? *kernels : supportedKernels().front();
+    }
+
+    // Pixel formats whose first plane is 8-bit luma
+    bool hasLuma8(int format)
+    {
+        switch (format)
+        {
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUVJ420P:
+        case AV_PIX_FMT_YUV422P:
+        case AV_PIX_FMT_YUVJ422P:
+        case AV_PIX_FMT_YUV444P:
+        case AV_PIX_FMT_YUVJ444P:
+        case AV_PIX_FMT_NV12:
+        case AV_PIX_FMT_NV21:
+        case AV_PIX_FMT_GRAY8:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    double stddev(double sum, double sumsq, double count)
+    {
+        double mean = sum / count;
+        return std::sqrt(std::max(0.0, sumsq / count - mean * mean));
+    }
+} // namespace
+
+FrameAnalyzer::FrameAnalyzer()
+{
+    selectKernels();
+}
+
+void FrameAnalyzer::reset()
+{
+    has_previous = false;
+}
+
+const char *FrameAnalyzer::getKernelName()
+{
+    return selectKernels().name;
+}
+
+bool FrameAnalyzer::useKernels(const std::string &name)
+{
+    for (const Kernels &kernels : supportedKernels())
+    {
+        if (name == kernels.name)
+        {
+            selectedKernels = &kernels;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FrameAnalyzer::analyze(const AVFrame *frame, long pts, FrameMetrics &metrics)
+{
+    if (!hasLuma8(frame->format) || frame->width < 3 || frame->height < 3 || !frame->data[0])
+    {
+        return false;
+    }
+    const Kernels &kernels = selectKernels();
+    const uint8_t *luma = frame->data[0];
+    ptrdiff_t stride = frame->linesize[0];
+    int width = frame->width;
+    int height = frame->height;
+    double pixels = static_cast<double>(width) * height;
+
+    metrics = FrameMetrics();
+    metrics.pts = pts;
+
+    // One pass over the rows, each row is read from memory once and used by every kernel while
+    // it is in cache: luma sums, the Sobel of the row above it, the difference to the previous
+    // frame and finally the copy that becomes the previous frame
+    bool diff = has_previous && previous_width == width && previous_height == height;
+    previous.resize(static_cast<size_t>(width) * height);
+    uint64_t sum = 0, sumsq = 0;
+    double sobel_sum = 0;
+    uint64_t sobel_sumsq = 0;
+    uint64_t sad = 0, diff_sumsq = 0;
+    int64_t diff_sum = 0;
+    for (int y = 0; y < height; y++)
+    {
+        const uint8_t *row = luma + y * stride;
+        uint8_t *previous_row = previous.data() + static_cast<size_t>(y) * width;
+        kernels.lumaSums(row, stride, width, 1, sum, sumsq);
+        if (y >= 2)
+        {
+            kernels.sobelSums(row - 2 * stride, stride, width, 3, sobel_sum, sobel_sumsq);
+        }
+        if (diff)
+        {
+            kernels.diffSums(row, stride, previous_row, width, width, 1, sad, diff_sum, diff_sumsq);
+        }
+        // Packed copy, the decoder reuses the frame buffers
+        std::memcpy(previous_row, row, width);
+    }
+    metrics.luma_mean = sum / pixels;
+    metrics.luma_variance = std::max(0.0, sumsq / pixels - metrics.luma_mean * metrics.luma_mean);
+    metrics.spatial_info = stddev(sobel_sum, static_cast<double>(sobel_sumsq), static_cast<double>(width - 2) * (height - 2));
+    if (diff)
+    {
+        metrics.frame_diff = sad / pixels;
+        metrics.temporal_info = stddev(static_cast<double>(diff_sum), static_cast<double>(diff_sumsq), pixels);
+    }
+
+    previous_width = width;
+    previous_height = height;
+    has_previous = true;
+    return true;
+}
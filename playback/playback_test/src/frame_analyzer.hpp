@@ -0,0 +1,166 @@
+#ifndef FRAME_ANALYZER_HPP
+#define FRAME_ANALYZER_HPP
+
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+
+namespace playback
+{
+
+    // Mean absolute luma difference below which a frame repeats the previous one
+    constexpr double FREEZE_DIFF_THRESHOLD = 0.5;
+    // Repeated frames lasting this long are reported as a freeze
+    constexpr long FREEZE_MIN_DURATION_MS = 1000;
+    // Frames darker and flatter than this are black (limited range black is 16)
+    constexpr double BLACK_LUMA_THRESHOLD = 32;
+    constexpr double BLACK_MAX_VARIANCE = 16;
+    // Black frames lasting this long are reported as a black screen
+    constexpr long BLACK_MIN_DURATION_MS = 500;
+
+    // Content metrics of one decoded frame, computed on the luma plane
+    struct FrameMetrics
+    {
+        long pts = 0; // ms
+        double luma_mean = 0;
+        double luma_variance = 0;
+        double frame_diff = -1;   // Mean absolute difference to the previous frame, -1 for the first
+        double spatial_info = 0;  // ITU-T P.910 SI: stddev of the Sobel magnitude
+        double temporal_info = -1; // ITU-T P.910 TI: stddev of the difference to the previous frame
+
+        bool isFrozen() const
+        {
+            return frame_diff >= 0 && frame_diff < FREEZE_DIFF_THRESHOLD;
+        }
+
+        bool isBlack() const
+        {
+            return luma_mean < BLACK_LUMA_THRESHOLD && luma_variance < BLACK_MAX_VARIANCE;
+        }
+    };
+
+    /**
+     * @brief Freeze/black event detection and P.910 aggregates over the frames of a segment.
+     *
+     * A freeze (black screen) event is raised once per run of frozen (black) frames, when the
+     * run reaches FREEZE_MIN_DURATION_MS (BLACK_MIN_DURATION_MS) of presentation time.
+     */
+    class VideoAnalysisStats
+    {
+    public:
+        void add(const FrameMetrics &metrics)
+        {
+            frames++;
+            luma_sum += metrics.luma_mean;
+            spatial_info = std::max(spatial_info, metrics.spatial_info);
+            temporal_info = std::max(temporal_info, metrics.temporal_info);
+
+            bool frozen = metrics.isFrozen();
+            frozen_frames += frozen;
+            updateRun(frozen, metrics.pts, freeze_run_start, freeze_run_reported, FREEZE_MIN_DURATION_MS, freeze_events, longest_freeze);
+
+            bool black = metrics.isBlack();
+            black_frames += black;
+            updateRun(black, metrics.pts, black_run_start, black_run_reported, BLACK_MIN_DURATION_MS, black_events, longest_black);
+        }
+
+        size_t getFrames() const { return frames; }
+        size_t getFrozenFrames() const { return frozen_frames; }
+        size_t getBlackFrames() const { return black_frames; }
+        size_t getFreezeEvents() const { return freeze_events; }
+        size_t getBlackEvents() const { return black_events; }
+        long getLongestFreeze() const { return longest_freeze; } // ms
+        long getLongestBlack() const { return longest_black; }   // ms
+        double getMeanLuma() const { return frames > 0 ? luma_sum / frames : 0; }
+        double getSpatialInfo() const { return spatial_info; }   // Max SI over the frames
+        double getTemporalInfo() const { return temporal_info; } // Max TI over the frames
+
+    private:
+        static void updateRun(bool active, long pts, long &run_start, bool &reported, long min_duration,
+                              size_t &events, long &longest)
+        {
+            if (!active)
+            {
+                run_start = -1;
+                reported = false;
+                return;
+            }
+            if (run_start < 0)
+            {
+                run_start = pts;
+            }
+            long duration = pts - run_start;
+            longest = std::max(longest, duration);
+            if (!reported && duration >= min_duration)
+            {
+                reported = true;
+                events++;
+            }
+        }
+
+    private:
+        size_t frames = 0;
+        size_t frozen_frames = 0;
+        size_t black_frames = 0;
+        size_t freeze_events = 0;
+        size_t black_events = 0;
+        long longest_freeze = 0;
+        long longest_black = 0;
+        double luma_sum = 0;
+        double spatial_info = 0;
+        double temporal_info = 0;
+        long freeze_run_start = -1;
+        bool freeze_run_reported = false;
+        long black_run_start = -1;
+        bool black_run_reported = false;
+    };
+
+    /**
+     * @brief Computes FrameMetrics from the 8-bit luma plane of decoded frames.
+     *
+     * The best kernel set the CPU supports is used (AVX2, SSE4.1 or scalar, x86-64 only for the
+     * SIMD ones) unless useKernels() picks another. All metrics come from one pass over the rows
+     * of the frame. The previous luma plane is kept for the frame difference and TI, call reset()
+     * between unrelated segments. bench/frame_analyzer_bench measures the cost per frame.
+     * Formats with an other than 8-bit luma plane are not analyzed.
+     */
+    class FrameAnalyzer
+    {
+    public:
+        FrameAnalyzer();
+
+        // Forgets the previous frame
+        void reset();
+
+        /**
+         * @brief Analyzes one frame.
+         *
+         * @param frame Decoded frame.
+         * @param pts Presentation time of the frame in ms.
+         * @param metrics Receives the metrics.
+         * @return false if the pixel format is not supported.
+         */
+        bool analyze(const AVFrame *frame, long pts, FrameMetrics &metrics);
+
+        // Name of the kernel set in use: "avx2", "sse4.1" or "scalar"
+        static const char *getKernelName();
+
+        // Switches every analyzer to a kernel set by name, false if this CPU does not support it
+        static bool useKernels(const std::string &name);
+
+    private:
+        std::vector<uint8_t> previous; // Packed luma plane of the previous frame
+        int previous_width = 0;
+        int previous_height = 0;
+        bool has_previous = false;
+    };
+
+} // namespace playback
+
+#endif // FRAME_ANALYZER_HPP
@@ -0,0 +1,262 @@
+#ifndef FRAME_STATS_HPP
+#define FRAME_STATS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <mutex>
+
+namespace playback
+{
+
+    /**
+     * @brief Streaming quantile estimator (P-square algorithm, Jain & Chlamtac 1985).
+     *
+     * Keeps five markers instead of the samples, so memory and per-sample cost are constant.
+     * Exact for the first five samples, an estimate afterwards.
+     */
+    class P2Quantile
+    {
+    public:
+        explicit P2Quantile(double quantile = 0.5) : p(quantile)
+        {
+            increments[0] = 0;
+            increments[1] = p / 2;
+            increments[2] = p;
+            increments[3] = (1 + p) / 2;
+            increments[4] = 1;
+        }
+
+        void add(double x)
+        {
+            if (count < 5)
+            {
+                heights[count++] = x;
+                if (count == 5)
+                {
+                    std::sort(heights, heights + 5);
+                    for (int i = 0; i < 5; i++)
+                    {
+                        positions[i] = i + 1;
+                    }
+                    desired[0] = 1;
+                    desired[1] = 1 + 2 * p;
+                    desired[2] = 1 + 4 * p;
+                    desired[3] = 3 + 2 * p;
+                    desired[4] = 5;
+                }
+                return;
+            }
+            count++;
+
+            // Find the cell k the sample falls in and adjust the extreme markers
+            int k;
+            if (x < heights[0])
+            {
+                heights[0] = x;
+                k = 0;
+            }
+            else if (x >= heights[4])
+            {
+                heights[4] = x;
+                k = 3;
+            }
+            else
+            {
+                k = 0;
+                while (x >= heights[k + 1])
+                {
+                    k++;
+                }
+            }
+            for (int i = k + 1; i < 5; i++)
+            {
+                positions[i]++;
+            }
+            for (int i = 0; i < 5; i++)
+            {
+                desired[i] += increments[i];
+            }
+
+            // Move the middle markers towards their desired positions
+            for (int i = 1; i < 4; i++)
+            {
+                double d = desired[i] - positions[i];
+                if ((d >= 1 && positions[i + 1] - positions[i] > 1) || (d <= -1 && positions[i - 1] - positions[i] < -1))
+                {
+                    int s = d >= 0 ? 1 : -1;
+                    double candidate = parabolic(i, s);
+                    if (heights[i - 1] < candidate && candidate < heights[i + 1])
+                    {
+                        heights[i] = candidate;
+                    }
+                    else
+                    {
+                        heights[i] = linear(i, s);
+                    }
+                    positions[i] += s;
+                }
+            }
+        }
+
+        double value() const
+        {
+            if (count == 0)
+            {
+                return 0;
+            }
+            if (count < 5)
+            {
+                double sorted[5];
+                std::copy(heights, heights + count, sorted);
+                std::sort(sorted, sorted + count);
+                size_t index = static_cast<size_t>(std::lround(p * (count - 1)));
+                return sorted[index];
+            }
+            return heights[2];
+        }
+
+        size_t getCount() const
+        {
+            return count;
+        }
+
+    private:
+        double parabolic(int i, int s) const
+        {
+            return heights[i] + (double)s / (positions[i + 1] - positions[i - 1]) *
+                                    ((positions[i] - positions[i - 1] + s) * (heights[i + 1] - heights[i]) / (positions[i + 1] - positions[i]) +
+                                     (positions[i + 1] - positions[i] - s) * (heights[i] - heights[i - 1]) / (positions[i] - positions[i - 1]));
+        }
+
+        double linear(int i, int s) const
+        {
+            return heights[i] + s * (heights[i + s] - heights[i]) / (positions[i + s] - positions[i]);
+        }
+
+    private:
+        double p;
+        size_t count = 0;
+        double heights[5] = {0, 0, 0, 0, 0};   // Marker heights (quantile estimates)
+        double positions[5] = {0, 0, 0, 0, 0}; // Actual marker positions
+        double desired[5] = {0, 0, 0, 0, 0};   // Desired marker positions
+        double increments[5];                  // Desired position increments per sample
+    };
+
+    /**
+     * @brief Online accumulator for frame interval (PTS delta) statistics.
+     *
+     * Every add() is O(1): running mean and variance (Welford), min/max gap,
+     * rewind/duplicate counters and P50/P95/P99 estimates of the frame interval.
+     */
+    class FrameIntervalStats
+    {
+    public:
+        void add(double delta)
+        {
+            count++;
+            double d = delta - mean;
+            mean += d / count;
+            m2 += d * (delta - mean);
+            min_gap = std::min(min_gap, delta);
+            max_gap = std::max(max_gap, delta);
+            if (delta < 0)
+            {
+                rewinds++;
+            }
+            else if (delta == 0)
+            {
+                duplicates++;
+            }
+            p50.add(delta);
+            p95.add(delta);
+            p99.add(delta);
+        }
+
+        size_t getCount() const { return count; }
+        double getMean() const { return mean; }
+        double getVariance() const { return count > 1 ? m2 / (count - 1) : 0; }
+        double getStdDev() const { return std::sqrt(getVariance()); }
+        double getMin() const { return count > 0 ? min_gap : 0; }
+        double getMax() const { return count > 0 ? max_gap : 0; }
+        double getP50() const { return p50.value(); }
+        double getP95() const { return p95.value(); }
+        double getP99() const { return p99.value(); }
+        // Number of deltas where the PTS went backwards
+        size_t getRewinds() const { return rewinds; }
+        // Number of deltas where the PTS did not advance
+        size_t getDuplicates() const { return duplicates; }
+
+    private:
+        size_t count = 0;
+        double mean = 0;
+        double m2 = 0;
+        double min_gap = std::numeric_limits<double>::max();
+        double max_gap = std::numeric_limits<double>::lowest();
+        size_t rewinds = 0;
+        size_t duplicates = 0;
+        P2Quantile p50{0.5};
+        P2Quantile p95{0.95};
+        P2Quantile p99{0.99};
+    };
+
+    /**
+     * @brief Running distribution of per frame latencies (ms), O(1) per sample.
+     */
+    class LatencyStats
+    {
+    public:
+        void add(double latency)
+        {
+            count++;
+            mean += (latency - mean) / count;
+            min_latency = std::min(min_latency, latency);
+            max_latency = std::max(max_latency, latency);
+            p50.add(latency);
+            p95.add(latency);
+            p99.add(latency);
+        }
+
+        size_t getCount() const { return count; }
+        double getMean() const { return mean; }
+        double getMin() const { return count > 0 ? min_latency : 0; }
+        double getMax() const { return count > 0 ? max_latency : 0; }
+        double getP50() const { return p50.value(); }
+        double getP95() const { return p95.value(); }
+        double getP99() const { return p99.value(); }
+
+    private:
+        size_t count = 0;
+        double mean = 0;
+        double min_latency = std::numeric_limits<double>::max();
+        double max_latency = std::numeric_limits<double>::lowest();
+        P2Quantile p50{0.5};
+        P2Quantile p95{0.95};
+        P2Quantile p99{0.99};
+    };
+
+    // LatencyStats of a whole stream, fed by the segments decoding on different workers
+    class LatencyRecorder
+    {
+    public:
+        void add(double latency)
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            stats.add(latency);
+        }
+
+        LatencyStats get() const
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return stats;
+        }
+
+    private:
+        mutable std::mutex dataMutex;
+        LatencyStats stats;
+    };
+
+} // namespace playback
+
+#endif // FRAME_STATS_HPP
@@ -0,0 +1,92 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <initializer_list>
+
+namespace playback
+{
+
+    /**
+     * @brief Fixed bucket histogram, bucket `i` counts values <= bounds[i],
+     * the last bucket counts everything above the highest bound.
+     */
+    class Histogram
+    {
+    public:
+        Histogram(std::initializer_list<long> upper_bounds) : bounds(upper_bounds), counts(upper_bounds.size() + 1, 0)
+        {
+            std::sort(bounds.begin(), bounds.end());
+        }
+
+        void record(long value)
+        {
+            size_t bucket = std::lower_bound(bounds.begin(), bounds.end(), value) - bounds.begin();
+            counts[bucket]++;
+            total++;
+            sum += value;
+            max_value = total == 1 ? value : std::max(max_value, value);
+        }
+
+        size_t getCount() const { return total; }
+        double getMean() const { return total > 0 ? (double)sum / total : 0; }
+        long getMax() const { return max_value; }
+
+        /**
+         * @brief Upper bound of the bucket that contains the given quantile (0..1).
+         */
+        long getQuantileBound(double quantile) const
+        {
+            if (total == 0)
+            {
+                return 0;
+            }
+            size_t rank = static_cast<size_t>(quantile * (total - 1)) + 1;
+            size_t seen = 0;
+            for (size_t i = 0; i < counts.size(); i++)
+            {
+                seen += counts[i];
+                if (seen >= rank)
+                {
+                    return i < bounds.size() ? bounds[i] : max_value;
+                }
+            }
+            return max_value;
+        }
+
+        // One line summary, e.g. "<=100: 3, <=200: 5, >200: 1"
+        std::string toString(const std::string &unit = "") const
+        {
+            std::ostringstream out;
+            for (size_t i = 0; i < counts.size(); i++)
+            {
+                if (i > 0)
+                {
+                    out << ", ";
+                }
+                if (i < bounds.size())
+                {
+                    out << "<=" << bounds[i] << unit << ": " << counts[i];
+                }
+                else
+                {
+                    out << ">" << bounds.back() << unit << ": " << counts[i];
+                }
+            }
+            return out.str();
+        }
+
+    private:
+        std::vector<long> bounds;
+        std::vector<size_t> counts;
+        size_t total = 0;
+        long sum = 0;
+        long max_value = 0;
+    };
+
+} // namespace playback
+
+#endif // HISTOGRAM_HPP
@@ -1,6 +1,7 @@
 #include "hls_parser.hpp"
 #include "constants.hpp"
 #include "logger.hpp"
+#include "playlist_tokenizer.hpp"
 
 #include <fstream>
 #include <sstream>
@@ -9,23 +10,106 @@
 #include <algorithm>
 #include <cctype>
 
-#include <curl/curl.h>
-
 using namespace playback;
 
 constexpr const char *MP_TAG = "HLSManifestParser";
 
-const std::string EXT_X_TARGETDURATION = "#EXT-X-TARGETDURATION:";
-const std::string EXT_X_MEDIA_SEQUENCE = "#EXT-X-MEDIA-SEQUENCE:";
-const std::string EXTINF = "#EXTINF:";
-const std::string EXT_X_DISCONTINUITY = "#EXT-X-DISCONTINUITY:";
-const std::string EXT_X_STREAM_INF = "#EXT-X-STREAM-INF:";
-const std::string EXTM3U = "#EXTM3U";
+constexpr std::string_view EXT_X_TARGETDURATION = "#EXT-X-TARGETDURATION";
+constexpr std::string_view EXT_X_MEDIA_SEQUENCE = "#EXT-X-MEDIA-SEQUENCE";
+constexpr std::string_view EXTINF = "#EXTINF";
+constexpr std::string_view EXT_X_DISCONTINUITY = "#EXT-X-DISCONTINUITY";
+constexpr std::string_view EXT_X_STREAM_INF = "#EXT-X-STREAM-INF";
+constexpr std::string_view EXTM3U = "#EXTM3U";
+// Low-Latency HLS
+constexpr std::string_view EXT_X_SERVER_CONTROL = "#EXT-X-SERVER-CONTROL";
+constexpr std::string_view EXT_X_PART_INF = "#EXT-X-PART-INF";
+constexpr std::string_view EXT_X_PART = "#EXT-X-PART";
+constexpr std::string_view EXT_X_PRELOAD_HINT = "#EXT-X-PRELOAD-HINT";
+
+// Number of recently submitted part uris remembered to avoid downloading a part twice
+constexpr size_t MAX_TRACKED_PARTS = 64;
+
+namespace
+{
+    // Attributes of an #EXT-X-STREAM-INF tag, the uri follows on the next line
+    HLSVariantStream parseStreamInf(std::string_view value)
+    {
+        HLSVariantStream variantStream;
+        AttributeList attributes(value);
+        std::string_view key, attribute;
+        while (attributes.next(key, attribute))
+        {
+            if (key == "BANDWIDTH")
+            {
+                long bandwidth = 0;
+                parse_long(attribute, bandwidth);
+                variantStream.bandwidth = bandwidth;
+            }
+            else if (key == "RESOLUTION")
+            {
+                // <width>x<height>
+                size_t separator = attribute.find('x');
+                long width = 0, height = 0;
+                if (separator != std::string_view::npos && parse_long(attribute.substr(0, separator), width) &&
+                    parse_long(attribute.substr(separator + 1), height))
+                {
+                    variantStream.res_width = width;
+                    variantStream.res_height = height;
+                }
+            }
+        }
+        return variantStream;
+    }
+
+    std::string baseOf(const std::string &uri)
+    {
+        auto lastSlash = uri.find_last_of('/');
+        return lastSlash != std::string::npos ? uri.substr(0, lastSlash + 1) : uri;
+    }
+
+    std::string resolveAgainst(const std::string &baseUri, std::string_view relative)
+    {
+        // Check if the URI is already absolute
+        if (starts_with(relative, "http://") || starts_with(relative, "https://"))
+        {
+            return std::string(relative);
+        }
+        // Otherwise, combine the base and relative URI
+        if (relative.empty())
+        {
+            return baseUri; // Handle edge case
+        }
+        std::string resolved;
+        resolved.reserve(baseUri.size() + relative.size() + 1);
+        resolved.append(baseUri);
+        if (!baseUri.empty() && baseUri.back() != '/' && relative.front() != '/')
+        {
+            resolved.push_back('/');
+        }
+        resolved.append(relative);
+        return resolved;
+    }
+} // namespace
 
 
-HLSManifestParser::HLSManifestParser(const std::string uri, int refresh_interval) : uri(uri), refresh_interval(refresh_interval)
+HLSManifestParser::HLSManifestParser(const std::string uri, int refresh_interval, size_t max_concurrent_downloads,
+                                     DecoderOptions decoder_options, size_t history_size)
+    : history(std::make_shared<SegmentHistory>(history_size)), publisher(std::make_shared<SegmentPublisher>()),
+      playerBuffer(std::make_shared<PlayerBufferModel>()), continuityMonitor(std::make_shared<ContinuityMonitor>()),
+      latencyRecorder(std::make_shared<LatencyRecorder>()), httpClient(std::make_shared<HttpClient>()),
+      transferThroughput(std::make_shared<TransferThroughput>()), uri(uri), refresh_interval(refresh_interval),
+      downloadPool(std::make_shared<SegmentDownloadPool>(max_concurrent_downloads, DEFAULT_DOWNLOAD_QUEUE_SIZE, decoder_options))
+{
+}
+
+HLSManifestParser::HLSManifestParser(const std::string uri, std::shared_ptr<SegmentDownloadPool> pool, int refresh_interval,
+                                     size_t history_size)
+    : history(std::make_shared<SegmentHistory>(history_size)), publisher(std::make_shared<SegmentPublisher>()),
+      playerBuffer(std::make_shared<PlayerBufferModel>()), continuityMonitor(std::make_shared<ContinuityMonitor>()),
+      latencyRecorder(std::make_shared<LatencyRecorder>()), httpClient(std::make_shared<HttpClient>()),
+      transferThroughput(std::make_shared<TransferThroughput>()), uri(uri), refresh_interval(refresh_interval),
+      downloadPool(std::move(pool))
 {
-    curl_global_init(CURL_GLOBAL_DEFAULT); // Initialize global state for libcurl
 }
 
 HLSManifestParser::~HLSManifestParser()
@@ -54,13 +138,6 @@ void HLSManifestParser::waitForCompletion()
     }
 }
 
-// Callback function for libcurl to write data into a string
-static size_t writeCallback(void *contents, size_t size, size_t nmemb, void *userp)
-{
-    ((std::string *)userp)->append((char *)contents, size * nmemb);
-    return size * nmemb;
-}
-
 void HLSManifestParser::parseFromURI(const std::string &uri)
 {
     int loops = 0;
@@ -68,17 +145,13 @@ void HLSManifestParser::parseFromURI(const std::string &uri)
     {
         try
         {
-            Logger::getInstance().log("Fetching main manifest: " + uri + ", loop: " + std::to_string(loops), Logger::Severity::DEBUG, MP_TAG);
-            std::string manifest = fetchContentFromURI(uri);
-            if (manifest.length() > 10)
-            {
-                if (started_timestamp == -1) {
-                    std::lock_guard<std::mutex> lock(dataMutex);
-                    started_timestamp = get_utc();
-                }
-                parse(manifest);
-            }
-            std::this_thread::sleep_for(std::chrono::seconds(refresh_interval));
+            std::string request_uri = getPlaylistRequestUri();
+            Logger::getInstance().log("Fetching main manifest: " + request_uri + ", loop: " + std::to_string(loops), Logger::Severity::DEBUG, MP_TAG);
+            HttpTransferInfo info;
+            std::string manifest = fetchContentFromURI(request_uri, &info);
+            std::chrono::milliseconds delay = manifest.length() > 10 ? onPlaylist(manifest, get_utc(), info) : onPlaylistError();
+            // Zero for a blocking reload, the origin holds it until the next part/segment exists
+            std::this_thread::sleep_for(delay);
             loops++;
         }
         catch (const std::exception &ex)
@@ -95,201 +168,557 @@ void HLSManifestParser::parseFromURI(const std::string &uri)
     parsingComplete.notify_all();
 }
 
-std::string HLSManifestParser::fetchContentFromURI(const std::string &uri)
+std::chrono::milliseconds HLSManifestParser::onPlaylist(std::string_view manifest, long fetch_time, const HttpTransferInfo &info)
 {
-    std::string response;
-    CURL *curl = curl_easy_init();
-    if (!curl)
+    if (started_timestamp == -1)
     {
-        throw std::runtime_error("Failed to initialize CURL");
+        std::lock_guard<std::mutex> lock(dataMutex);
+        started_timestamp = fetch_time;
     }
-    CURLcode res;
-    curl_easy_setopt(curl, CURLOPT_URL, uri.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    curl_easy_setopt(curl, CURLOPT_HTTPAUTH, CURLAUTH_NONE); // Ensure no auth is used
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
-    if (res != CURLE_OK)
-    {
-        Logger::getInstance().log("We got error: " + std::to_string(res) + ", fetching: " + uri, Logger::Severity::ERROR, MP_TAG);
-        return "";
+    if (recorder)
+    {
+        recorder->append(ArchiveRecordType::PLAYLIST, uri, manifest, fetch_time, info);
     }
-    // Save the base URI
-    auto lastSlash = uri.find_last_of('/');
-    if (lastSlash != std::string::npos)
+    if (baseUri.empty())
     {
-        baseUri = uri.substr(0, lastSlash + 1);
+        baseUri = baseOf(uri);
     }
-    else
+    parse(manifest);
+    {
+        std::lock_guard<std::mutex> lock(dataMutex);
+        refreshScheduler.setTargetDuration(target_duration);
+        refreshScheduler.onPlaylist(playlist_last_sequence, fetch_time, info.last_modified);
+    }
+    if (next_msn >= 0)
+    {
+        return std::chrono::milliseconds(0);
+    }
+    return refreshDelay();
+}
+
+std::chrono::milliseconds HLSManifestParser::onPlaylistError()
+{
+    // Do not spin on a failing blocking reload
+    next_msn = -1;
+    return refreshDelay();
+}
+
+void HLSManifestParser::setRecorder(std::shared_ptr<ArchiveWriter> recorder)
+{
+    this->recorder = recorder;
+    if (!recorder)
+    {
+        downloadPool->setPayloadObserver(nullptr);
+        return;
+    }
+    downloadPool->setPayloadObserver([recorder](const std::shared_ptr<HLSSegment> &, const std::string &uri,
+                                                const std::shared_ptr<const std::string> &payload, const HttpTransferInfo &info)
+                                     { recorder->append(ArchiveRecordType::SEGMENT, uri, *payload, get_utc(), info); });
+}
+
+void HLSManifestParser::setSegmentFetcher(SegmentFetcher fetcher)
+{
+    segmentFetcher = std::move(fetcher);
+}
+
+const std::string &HLSManifestParser::getUri() const
+{
+    return uri;
+}
+
+std::string HLSManifestParser::fetchContentFromURI(const std::string &uri, HttpTransferInfo *info)
+{
+    std::string response;
+    // Reuses a kept-alive connection to the origin when one is available
+    if (httpClient->fetch(uri, response, info) != CURLE_OK)
     {
-        baseUri = uri; // Handle edge case where URI has no '/'
+        return "";
     }
     return response;
 }
 
-// Parse the HLS manifest string
-void HLSManifestParser::parse(const std::string &manifest)
+// Parse the HLS manifest string in a single pass, lines are views into the manifest buffer
+void HLSManifestParser::parse(std::string_view manifest)
 {
     Logger::getInstance().log("Parsing manifest ...", Logger::Severity::DEBUG, MP_TAG);
-    std::istringstream stream(manifest);
-    std::string line;
-    std::shared_ptr<HLSSegment> currentSegment = std::make_shared<HLSSegment>();
-    while (std::getline(stream, line))
+    PlaylistTokenizer tokenizer(manifest);
+    PlaylistTokenizer::Line line;
+
+    std::vector<HLSVariantStream> variants;
+    std::optional<HLSVariantStream> pendingVariant;
+    std::optional<double> pendingDuration;
+    std::vector<PendingPart> parts; // #EXT-X-PART entries of the segment that follows them
+    std::string_view preloadHint;
+    bool hasMediaSequence = false;
+    bool discontinuity = false; // #EXT-X-DISCONTINUITY applies to the next segment
+    long playlistSequence = 0; // EXT-X-MEDIA-SEQUENCE of this playlist
+    long segmentIndex = 0;     // Position of the next segment in this playlist
+    int newSegments = 0;
+    int skippedSegments = 0;
+
+    while (tokenizer.next(line))
     {
-        line = trim(line);
-        if (line.empty() || line[0] == '#')
+        if (line.isUri())
         {
-            // Process HLS tags
-            if (line.rfind(EXTM3U, 0) == 0)
+            if (pendingVariant)
             {
-                continue; // Playlist header
+                pendingVariant->uri = resolveUri(line.value);
+                variants.push_back(*pendingVariant);
+                pendingVariant.reset();
             }
-            else if (line.rfind(EXT_X_STREAM_INF, 0) == 0)
+            else if (pendingDuration)
             {
-                masterPlaylist = true;
-                HLSVariantStream variantStream;
-                std::istringstream tagStream(line.substr(18)); // Skip "#EXT-X-STREAM-INF:"
-                std::string token;
-                while (std::getline(tagStream, token, ','))
+                double declared_duration = *pendingDuration;
+                pendingDuration.reset();
+                bool segmentDiscontinuity = discontinuity;
+                discontinuity = false;
+                long sequence_number = hasMediaSequence ? playlistSequence + segmentIndex : parse_uri_sequence_number(line.value);
+                segmentIndex++;
+                if (sequence_number < 0)
                 {
-                    auto pos = token.find('=');
-                    if (pos != std::string::npos)
-                    {
-                        std::string key = trim(token.substr(0, pos));
-                        std::string value = trim(token.substr(pos + 1));
-
-                        if (key == "BANDWIDTH")
-                        {
-                            variantStream.bandwidth = std::stoi(value);
-                        }
-                        else if (key == "RESOLUTION")
-                        {
-                            // TODO: Parse resolution
-                            // variantStream.resolution = value;
-                        }
-                    }
+                    throw std::runtime_error("Failed to find sequence number in segment uri: " + std::string(line.value));
                 }
-                variantStream.uri = resolveUri(stream);
-                std::lock_guard<std::mutex> lock(dataMutex);
-                variantStreams.push_back(variantStream);
+                // The segment was assembled from parts, submit the last ones and close it
+                if (partialSegment && partialSegment->getSequenceNumber() == sequence_number)
+                {
+                    submitParts(partialSegment, parts);
+                    partialSegment->setUri(resolveUri(line.value));
+                    partialSegment->closeParts(declared_duration);
+                    partialSegment.reset();
+                    parts.clear();
+                    continue;
+                }
+                parts.clear();
+                // Segments that are already known are skipped before their uri is resolved
+                if (sequence_number <= last_sequence_number)
+                {
+                    skippedSegments++;
+                    continue;
+                }
+                auto segment = std::make_shared<HLSSegment>();
+                segment->setDeclaredDuration(declared_duration);
+                segment->setSequenceNumber(sequence_number);
+                segment->setDiscontinuity(segmentDiscontinuity);
+                segment->setUri(resolveUri(line.value));
+                addSegment(segment);
+                {
+                    std::lock_guard<std::mutex> lock(dataMutex);
+                    last_sequence_number = sequence_number;
+                }
+                // Never blocks, the segment is fetched and decoded asynchronously
+                submitSegment(segment);
+                newSegments++;
             }
-            else if (line.rfind(EXT_X_TARGETDURATION, 0) == 0)
+            continue;
+        }
+
+        if (line.tag == EXTINF)
+        {
+            double duration = 0;
+            if (!parse_double(line.value, duration))
             {
-                Logger::getInstance().log("Extractng duration from " + line, Logger::Severity::DEBUG, MP_TAG);
-                std::lock_guard<std::mutex> lock(dataMutex);
-                target_duration = std::stol(line.substr(EXT_X_TARGETDURATION.length())); // Skip "#EXT-X-TARGETDURATION:"
-                refresh_interval = target_duration / 2;
+                throw std::runtime_error("Invalid #EXTINF duration: " + std::string(line.value));
+            }
+            pendingDuration = duration;
+        }
+        else if (line.tag == EXT_X_PART)
+        {
+            PendingPart part;
+            bool gap = false;
+            AttributeList attributes(line.value);
+            std::string_view key, value;
+            while (attributes.next(key, value))
+            {
+                if (key == "DURATION")
+                {
+                    parse_double(value, part.duration);
+                }
+                else if (key == "URI")
+                {
+                    part.uri = value;
+                }
+                else if (key == "GAP")
+                {
+                    gap = value == "YES";
+                }
+                else if (key == "INDEPENDENT")
+                {
+                    part.independent = value == "YES";
+                }
             }
-            else if (line.rfind(EXT_X_MEDIA_SEQUENCE, 0) == 0)
+            if (!part.uri.empty() && !gap)
             {
-                Logger::getInstance().log("Extractng media sequence from " + line, Logger::Severity::DEBUG, MP_TAG);
+                parts.push_back(part);
+            }
+        }
+        else if (line.tag == EXT_X_PRELOAD_HINT)
+        {
+            std::string_view type, hintUri;
+            AttributeList attributes(line.value);
+            std::string_view key, value;
+            while (attributes.next(key, value))
+            {
+                if (key == "TYPE")
+                {
+                    type = value;
+                }
+                else if (key == "URI")
+                {
+                    hintUri = value;
+                }
+            }
+            if (type == "PART")
+            {
+                preloadHint = hintUri;
+            }
+        }
+        else if (line.tag == EXT_X_MEDIA_SEQUENCE)
+        {
+            if (parse_long(line.value, playlistSequence))
+            {
+                hasMediaSequence = true;
                 std::lock_guard<std::mutex> lock(dataMutex);
-                media_sequence = std::stoi(line.substr(EXT_X_MEDIA_SEQUENCE.length())); // Skip "#EXT-X-MEDIA-SEQUENCE:"
+                media_sequence = playlistSequence;
             }
-            else if (line.rfind(EXT_X_DISCONTINUITY, 0) == 0)
+        }
+        else if (line.tag == EXT_X_TARGETDURATION)
+        {
+            long duration = 0;
+            if (parse_long(line.value, duration))
             {
-                discontinuetym = true;
-                masterPlaylist = true;
+                std::lock_guard<std::mutex> lock(dataMutex);
+                target_duration = duration;
+                refresh_interval = target_duration / 2;
             }
-            else if (line.rfind(EXTINF, 0) == 0)
+        }
+        else if (line.tag == EXT_X_SERVER_CONTROL)
+        {
+            AttributeList attributes(line.value);
+            std::string_view key, value;
+            while (attributes.next(key, value))
             {
-                Logger::getInstance().log("Extractng #EXTINF from " + line, Logger::Severity::DEBUG, MP_TAG);
-                currentSegment->setDeclaredDuration(std::stod(line.substr(EXTINF.length())));
-                currentSegment->setUri(resolveUri(stream));
-                if (currentSegment->getUri() == baseUri)
+                if (key == "CAN-BLOCK-RELOAD")
                 {
-                    continue;
+                    can_block_reload = value == "YES";
                 }
-                else
+                else if (key == "PART-HOLD-BACK")
                 {
-                    int sequence_number = extract_sequence_number(currentSegment->getUri());
-                    std::lock_guard<std::mutex> lock(dataMutex);
-                    Logger::getInstance().log("Looking for latest doqnloaded sequence ...", Logger::Severity::DEBUG, MP_TAG);
-                    int last_sequence_number = -1;
-                    if (segments.size() > 0) {
-                        last_sequence_number = segments.back()->getSequenceNumber();
-                    }
-                    Logger::getInstance().log("Checking already downloaded segments for sequence num: " + std::to_string(sequence_number) 
-                            + ", latest: " + std::to_string(last_sequence_number), Logger::Severity::DEBUG, MP_TAG);
-                    if (last_sequence_number < sequence_number)
-                    {
-                        Logger::getInstance().log("Adding segment to segments ...", Logger::Severity::DEBUG, MP_TAG);
-                        segments.push_back(currentSegment);
-                        Logger::getInstance().log("Creating decoder ...", Logger::Severity::DEBUG, MP_TAG);
-                        std::unique_ptr<Decoder> dec = std::make_unique<Decoder>(currentSegment);
-                        Logger::getInstance().log("Pushing decoder to segments_decoders ...", Logger::Severity::DEBUG, MP_TAG);
-                        segments_decoders.push_back(std::move(dec));
-                        Logger::getInstance().log("Making new current segment shared pointer ...", Logger::Severity::DEBUG, MP_TAG);
-                        currentSegment = std::make_shared<HLSSegment>(); // Reset for the next segment
-                    }
-                    else
-                    {
-                        Logger::getInstance().log("Skipping already parsed segment: " + currentSegment->getUri() + ", with sequence number: " + std::to_string(sequence_number) + ", lates seq num: " + std::to_string(segments.back()->getSequenceNumber()),
-                                                  Logger::Severity::DEBUG, MP_TAG);
-                        continue;
-                    }
+                    parse_double(value, part_hold_back);
                 }
             }
         }
-        // else
-        // {
-        //     // Process segment URI
-        // }
+        else if (line.tag == EXT_X_PART_INF)
+        {
+            AttributeList attributes(line.value);
+            std::string_view key, value;
+            while (attributes.next(key, value))
+            {
+                if (key == "PART-TARGET")
+                {
+                    parse_double(value, part_target);
+                }
+            }
+        }
+        else if (line.tag == EXT_X_DISCONTINUITY)
+        {
+            discontinuity = true;
+        }
+        else if (line.tag == EXT_X_STREAM_INF)
+        {
+            masterPlaylist = true;
+            pendingVariant = parseStreamInf(line.value);
+        }
     }
+
+    // Parts after the last #EXTINF belong to the segment that is still being published
+    long trailing_sequence = playlistSequence + segmentIndex;
+    if (hasMediaSequence)
+    {
+        playlist_last_sequence = trailing_sequence - 1;
+    }
+    else if (last_sequence_number >= 0)
+    {
+        playlist_last_sequence = std::max(playlist_last_sequence, last_sequence_number);
+    }
+    if (hasMediaSequence && (!parts.empty() || !preloadHint.empty()))
+    {
+        if (!partialSegment || partialSegment->getSequenceNumber() != trailing_sequence)
+        {
+            if (partialSegment)
+            {
+                // The full segment was never listed, keep what was downloaded from its parts
+                partialSegment->closeParts(partialSegment->getDeclaredDuration());
+                partialSegment.reset();
+            }
+            if (trailing_sequence > last_sequence_number)
+            {
+                partialSegment = std::make_shared<HLSSegment>();
+                partialSegment->setSequenceNumber(trailing_sequence);
+                partialSegment->setDiscontinuity(discontinuity);
+                partialSegment->setUri(resolveUri(!parts.empty() ? parts.front().uri : preloadHint));
+                addSegment(partialSegment);
+                std::lock_guard<std::mutex> lock(dataMutex);
+                last_sequence_number = trailing_sequence;
+                newSegments++;
+            }
+        }
+        if (partialSegment)
+        {
+            submitParts(partialSegment, parts);
+            if (!preloadHint.empty())
+            {
+                // Requested ahead of time, the origin holds the response until the part exists
+                submitPart(partialSegment, preloadHint, 0, false, true);
+            }
+        }
+    }
+
+    // Next blocking reload asks for the playlist that contains the next part (or segment)
+    if (can_block_reload && hasMediaSequence)
+    {
+        next_msn = trailing_sequence;
+        next_part = part_target > 0 ? static_cast<long>(parts.size()) : -1;
+    }
+    else
+    {
+        next_msn = -1;
+        next_part = -1;
+    }
+
+    if (!variants.empty())
+    {
+        std::lock_guard<std::mutex> lock(dataMutex);
+        variantStreams = std::move(variants);
+    }
+    Logger::getInstance().log("Parsed manifest, new segments: " + std::to_string(newSegments) + ", skipped: " + std::to_string(skippedSegments), Logger::Severity::DEBUG, MP_TAG);
 }
 
-// Resolve relative URI to absolute
-std::string HLSManifestParser::resolveUri(std::istringstream &stream)
+void HLSManifestParser::submitParts(const std::shared_ptr<HLSSegment> &segment, const std::vector<PendingPart> &parts)
 {
-    std::string line;
-    // Next line contains the URI for the variant stream
-    if (std::getline(stream, line))
+    for (const auto &part : parts)
     {
-        Logger::getInstance().log("Extractng url from: " + line, Logger::Severity::DEBUG, MP_TAG);
-        std::string relative = trim(line);
+        submitPart(segment, part.uri, part.duration, part.independent, false);
+    }
+}
 
-        // Check if the URI is already absolute
-        if (std::regex_match(relative, std::regex(R"(https?://.*)")))
-        {
-            Logger::getInstance().log("uri: " + relative, Logger::Severity::DEBUG, MP_TAG);
-            return relative;
-        }
-        // Otherwise, combine the base and relative URI
-        if (relative.empty())
+void HLSManifestParser::submitPart(const std::shared_ptr<HLSSegment> &segment, std::string_view part_uri, double duration, bool independent, bool hint)
+{
+    auto known = std::find_if(submittedParts.begin(), submittedParts.end(), [&part_uri](const SubmittedPart &submitted)
+                              { return submitted.uri == part_uri; });
+    if (known != submittedParts.end())
+    {
+        // Requested from a preload hint, its duration is only known now
+        if (known->hinted && !hint)
         {
-            Logger::getInstance().log("uri: " + baseUri, Logger::Severity::DEBUG, MP_TAG);
-            return baseUri; // Handle edge case
+            segment->addPartDuration(duration);
+            known->hinted = false;
         }
-        if (baseUri.back() == '/' || relative.front() == '/')
+        return;
+    }
+    submittedParts.push_back({std::string(part_uri), hint});
+    if (submittedParts.size() > MAX_TRACKED_PARTS)
+    {
+        submittedParts.pop_front();
+    }
+    std::string resolved = resolveUri(part_uri);
+    segment->addPart(resolved, duration, independent);
+    submitSegment(segment, resolved);
+}
+
+void HLSManifestParser::addSegment(const std::shared_ptr<HLSSegment> &segment)
+{
+    std::weak_ptr<SegmentHistory> weakHistory = history;
+    std::weak_ptr<SegmentPublisher> weakPublisher = publisher;
+    std::weak_ptr<PlayerBufferModel> weakBuffer = playerBuffer;
+    std::weak_ptr<ContinuityMonitor> weakContinuity = continuityMonitor;
+    segment->setCompletionCallback([weakHistory, weakPublisher, weakBuffer, weakContinuity](HLSSegment &finished)
+                                   {
+                                       // One copy serves the totals and every subscriber
+                                       auto snapshot = finished.snapshot();
+                                       if (auto history = weakHistory.lock())
+                                       {
+                                           history->onFinished(*snapshot);
+                                       }
+                                       if (auto buffer = weakBuffer.lock())
+                                       {
+                                           buffer->onSegmentFinished(*snapshot);
+                                       }
+                                       if (auto continuity = weakContinuity.lock())
+                                       {
+                                           continuity->onSegmentFinished(snapshot);
+                                       }
+                                       if (auto publisher = weakPublisher.lock())
+                                       {
+                                           publisher->publish(snapshot);
+                                       } });
+    if (declared_bandwidth > 0)
+    {
+        segment->setDeclaredBandwidth(declared_bandwidth);
+    }
+    playerBuffer->onSegmentAdded(segment->getSequenceNumber());
+    continuityMonitor->onSegmentAdded(segment->getSequenceNumber());
+    segment->setLatencyRecorder(latencyRecorder);
+    if (!segment->isDiscontinuity())
+    {
+        segment->setExpectedFrameInterval(continuityMonitor->getFrameInterval());
+    }
+    history->add(segment);
+}
+
+void HLSManifestParser::setDeclaredBandwidth(long bandwidth)
+{
+    declared_bandwidth = bandwidth;
+}
+
+void HLSManifestParser::onSegmentTransfer(const std::shared_ptr<HLSSegment> &segment, const HttpTransferInfo &info)
+{
+    segment->addTransfer(info);
+    std::lock_guard<std::mutex> lock(transferThroughput->mutex);
+    transferThroughput->estimator.add(info.bytes, info.total_time);
+}
+
+void HLSManifestParser::setPlayerBufferOptions(const PlayerBufferOptions &options)
+{
+    playerBuffer->setOptions(options);
+}
+
+PlayerBufferReport HLSManifestParser::getPlayerBuffer()
+{
+    return playerBuffer->getReport();
+}
+
+void HLSManifestParser::setAnomalyListener(ContinuityMonitor::Listener listener)
+{
+    continuityMonitor->setListener(std::move(listener));
+}
+
+ContinuityReport HLSManifestParser::getContinuityReport()
+{
+    return continuityMonitor->getReport();
+}
+
+LatencyStats HLSManifestParser::getGlassToGlassLatency()
+{
+    return latencyRecorder->get();
+}
+
+ThroughputEstimator HLSManifestParser::getThroughputEstimator()
+{
+    std::lock_guard<std::mutex> lock(transferThroughput->mutex);
+    return transferThroughput->estimator;
+}
+
+void HLSManifestParser::submitSegment(const std::shared_ptr<HLSSegment> &segment, const std::string &part_uri)
+{
+    if (segmentFetcher)
+    {
+        segmentFetcher(segment, part_uri);
+        return;
+    }
+    // submit() never blocks, the segment is fetched through our client and decoded on a pool worker
+    SegmentFetch fetch;
+    fetch.client = httpClient;
+    std::weak_ptr<TransferThroughput> weakThroughput = transferThroughput;
+    fetch.on_transfer = [weakThroughput](const std::shared_ptr<HLSSegment> &fetched, const HttpTransferInfo &info)
+    {
+        fetched->addTransfer(info);
+        if (auto throughput = weakThroughput.lock())
         {
-            Logger::getInstance().log("uri: " + baseUri + relative, Logger::Severity::DEBUG, MP_TAG);
-            return baseUri + relative;
+            std::lock_guard<std::mutex> lock(throughput->mutex);
+            throughput->estimator.add(info.bytes, info.total_time);
         }
-        Logger::getInstance().log("uri: " + baseUri + "/" + relative, Logger::Severity::DEBUG, MP_TAG);
-        return baseUri + "/" + relative;
+    };
+    downloadPool->submit(segment, part_uri, nullptr, std::move(fetch));
+}
+
+std::string HLSManifestParser::getPlaylistRequestUri() const
+{
+    return blockingReloadUri(uri);
+}
+
+std::string HLSManifestParser::blockingReloadUri(const std::string &uri) const
+{
+    if (next_msn < 0)
+    {
+        return uri;
     }
-    else
+    std::string request = uri + (uri.find('?') == std::string::npos ? "?" : "&") + "_HLS_msn=" + std::to_string(next_msn);
+    if (next_part >= 0)
+    {
+        request += "&_HLS_part=" + std::to_string(next_part);
+    }
+    return request;
+}
+
+std::chrono::milliseconds HLSManifestParser::refreshDelay() const
+{
+    // Without blocking reload poll LL-HLS playlists once per part
+    if (part_target > 0)
     {
-        Logger::getInstance().log("uri: nullptr", Logger::Severity::ERROR, MP_TAG);
-        return nullptr;
+        return std::chrono::milliseconds(static_cast<long>(part_target * 1000));
     }
+    // Wake up just after the next segment is expected on the origin
+    return refreshScheduler.nextDelay(get_utc());
 }
 
-// Helper function to trim whitespace
-std::string HLSManifestParser::trim(const std::string &str)
+// Resolve relative URI to absolute
+std::string HLSManifestParser::resolveUri(std::string_view relative)
 {
-    size_t start = str.find_first_not_of(" \t\r\n");
-    size_t end = str.find_last_not_of(" \t\r\n");
-    return (start == std::string::npos || end == std::string::npos) ? "" : str.substr(start, end - start + 1);
+    return resolveAgainst(baseUri, relative);
+}
+
+std::vector<HLSVariantStream> HLSManifestParser::parseMasterPlaylist(std::string_view manifest, const std::string &uri)
+{
+    std::string base = baseOf(uri);
+    std::vector<HLSVariantStream> variants;
+    std::optional<HLSVariantStream> pendingVariant;
+    PlaylistTokenizer tokenizer(manifest);
+    PlaylistTokenizer::Line line;
+    while (tokenizer.next(line))
+    {
+        if (line.tag == EXT_X_STREAM_INF)
+        {
+            pendingVariant = parseStreamInf(line.value);
+        }
+        else if (line.isUri() && pendingVariant)
+        {
+            pendingVariant->uri = resolveAgainst(base, line.value);
+            variants.push_back(*pendingVariant);
+            pendingVariant.reset();
+        }
+    }
+    return variants;
 }
 
-// Get the list of media segments
+// Get the most recent media segments
 std::vector<std::shared_ptr<HLSSegment>> HLSManifestParser::getSegments()
 {
-    std::lock_guard<std::mutex> lock(dataMutex);
-    return segments;
+    return history->getSegments();
+}
+
+SegmentSummary HLSManifestParser::getEvictedSegments()
+{
+    return history->getEvicted();
+}
+
+size_t HLSManifestParser::getDownloadedSegments()
+{
+    return history->getDownloaded();
+}
+
+size_t HLSManifestParser::getFailedSegments()
+{
+    return history->getFailed();
+}
+
+void HLSManifestParser::subscribe(const std::shared_ptr<SegmentSubscription> &subscription)
+{
+    publisher->subscribe(subscription);
+}
+
+void HLSManifestParser::unsubscribe(const std::shared_ptr<SegmentSubscription> &subscription)
+{
+    publisher->unsubscribe(subscription);
 }
 
 // Get the list of variant streams
@@ -307,37 +736,72 @@ bool HLSManifestParser::isMasterPlaylist()
 }
 
 long HLSManifestParser::getTotalRunningTime() {
-    std::lock_guard<std::mutex> lock(dataMutex);
-    long total_runtime = 0;
-    for (auto segment : segments) {
-        if (segment->getStatus() == SegmentStatus::DOWNLOADED) {
-            // Logger::getInstance().log("Segment used to calculate runtime, seq name: " + std::to_string(segment->getSequenceNumber()), Logger::Severity::DEBUG, HLS_TAG);
-            total_runtime = get_utc() - segment->getStartedTimstamp();
-            break;
-        }
-    }
-    return total_runtime;
+    return history->getRunningTime();
 }
 
 long HLSManifestParser::getTotalDecodeTime() {
-    std::lock_guard<std::mutex> lock(dataMutex);
-    long total_decode_time = 0;
-    for (auto segment : segments) {
-        total_decode_time += segment->getDecodeDuration();
-    }
-    return total_decode_time;
+    return history->getDecodeTime();
 }
 
 long HLSManifestParser::getTotalDeclaredTime() {
-    std::lock_guard<std::mutex> lock(dataMutex);
-    long total_declared_time = 0;
-    for (auto segment : segments) {
-        total_declared_time += static_cast<long>(segment->getDeclaredTime() * 1000);
-    }
-    return total_declared_time;
+    return history->getDeclaredTime();
 }
 
 long HLSManifestParser::getTargetDuration() {
     std::lock_guard<std::mutex> lock(dataMutex);
     return target_duration;
-}
\ No newline at end of file
+}
+
+size_t HLSManifestParser::getDownloadQueueDepth() {
+    return downloadPool->getQueueDepth();
+}
+
+size_t HLSManifestParser::getActiveDownloads() {
+    return downloadPool->getActiveDownloads();
+}
+
+size_t HLSManifestParser::getDroppedDownloads() {
+    return downloadPool->getDroppedSegments();
+}
+
+size_t HLSManifestParser::getReusedConnections() {
+    return httpClient->getReusedConnections();
+}
+
+size_t HLSManifestParser::getNewConnections() {
+    return httpClient->getNewConnections();
+}
+
+Histogram HLSManifestParser::getSegmentDiscoveryDelay() {
+    std::lock_guard<std::mutex> lock(dataMutex);
+    return refreshScheduler.getDiscoveryDelay();
+}
+
+double HLSManifestParser::getPublicationCadence() {
+    std::lock_guard<std::mutex> lock(dataMutex);
+    return refreshScheduler.getCadence();
+}
+
+size_t HLSManifestParser::getCodecOpens() {
+    return downloadPool->getCodecOpens();
+}
+
+size_t HLSManifestParser::getCodecReuses() {
+    return downloadPool->getCodecReuses();
+}
+
+size_t HLSManifestParser::getAVAllocations() {
+    return downloadPool->getAVAllocations();
+}
+
+size_t HLSManifestParser::getAVReuses() {
+    return downloadPool->getAVReuses();
+}
+
+size_t HLSManifestParser::getBufferAllocations() {
+    return downloadPool->getBufferAllocations();
+}
+
+size_t HLSManifestParser::getBufferReuses() {
+    return downloadPool->getBufferReuses();
+}
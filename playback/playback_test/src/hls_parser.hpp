@@ -7,17 +7,28 @@ extern "C"
 }
 
 #include "hls_segment.hpp"
-#include "decoder.hpp"
+#include "download_pool.hpp"
+#include "http_client.hpp"
+#include "refresh_scheduler.hpp"
+#include "segment_history.hpp"
+#include "segment_subscription.hpp"
+#include "throughput_estimator.hpp"
+#include "player_buffer.hpp"
+#include "continuity_monitor.hpp"
+#include "archive.hpp"
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <optional>
+#include <deque>
+#include <chrono>
 #include <thread>
 #include <mutex>
 #include <memory>
+#include <functional>
 #include <condition_variable>
-
-#include <curl/curl.h>
+#include <atomic>
 
 namespace playback
 {
@@ -35,24 +46,115 @@ namespace playback
     {
     public:
         // Constructor and Destructor
-        HLSManifestParser(const std::string uri, int refresh_interval = 3);
+        HLSManifestParser(const std::string uri, int refresh_interval = 3,
+                          size_t max_concurrent_downloads = DEFAULT_DOWNLOAD_WORKERS,
+                          DecoderOptions decoder_options = DecoderOptions(),
+                          size_t history_size = DEFAULT_SEGMENT_HISTORY_SIZE);
+        /**
+         * Passive parser, the owner fetches the playlist and feeds it with onPlaylist() and the
+         * segments are handed to the segment fetcher (or decoded by the shared `pool`). Used to
+         * drive many streams from one event loop, startParsing() must not be called.
+         */
+        HLSManifestParser(const std::string uri, std::shared_ptr<SegmentDownloadPool> pool, int refresh_interval = 3,
+                          size_t history_size = DEFAULT_SEGMENT_HISTORY_SIZE);
         ~HLSManifestParser();
 
+        // Receives new segments (part_uri empty) and LL-HLS parts instead of the download pool
+        using SegmentFetcher = std::function<void(const std::shared_ptr<HLSSegment> &segment, const std::string &part_uri)>;
+        void setSegmentFetcher(SegmentFetcher fetcher);
+
+        // Uri of the next playlist request, carries _HLS_msn/_HLS_part for a blocking reload
+        std::string getPlaylistRequestUri() const;
+
+        /**
+         * @brief Parses a fetched playlist and queues its new segments.
+         *
+         * @param manifest Playlist body.
+         * @param fetch_time UTC time in ms when the playlist was received.
+         * @param info Metadata of the playlist transfer.
+         * @return Delay until the next refresh, zero when the next request is a blocking reload.
+         *
+         * @throws std::runtime_error if the playlist is malformed.
+         */
+        std::chrono::milliseconds onPlaylist(std::string_view manifest, long fetch_time, const HttpTransferInfo &info);
+
+        // The playlist could not be fetched, returns the delay until the next attempt
+        std::chrono::milliseconds onPlaylistError();
+
+        const std::string &getUri() const;
+
+        // BANDWIDTH of this stream from the master playlist in bps, stamped on new segments
+        void setDeclaredBandwidth(long bandwidth);
+
+        // A segment (or part) transfer completed, feeds the segment and the throughput estimate
+        void onSegmentTransfer(const std::shared_ptr<HLSSegment> &segment, const HttpTransferInfo &info);
+
+        // Throughput estimate from the segment transfers, empty when FFmpeg fetches the segments
+        ThroughputEstimator getThroughputEstimator();
+
+        // Startup and rebuffer thresholds of the virtual player following this stream
+        void setPlayerBufferOptions(const PlayerBufferOptions &options);
+
+        // Stalls and buffer level a player would have seen with the segments as they arrived
+        PlayerBufferReport getPlayerBuffer();
+
+        // Receives the PTS gaps, rewinds, cadence drops and duplicates of the stream, within and between segments
+        void setAnomalyListener(ContinuityMonitor::Listener listener);
+
+        // Anomaly totals and the most recent events
+        ContinuityReport getContinuityReport();
+
+        // Publish to decode latency of the frames carrying a wall clock SEI, empty if the stream has none
+        LatencyStats getGlassToGlassLatency();
+
+        /**
+         * @brief Records every playlist and segment body this parser receives, with its arrival
+         * time, for a later ArchiveReplayer run. Call before startParsing().
+         *
+         * Segments are recorded from the download pool, a pool shared between parsers records
+         * the segments of all of them.
+         */
+        void setRecorder(std::shared_ptr<ArchiveWriter> recorder);
+
         // Start parsing in a separate thread
         void startParsing();
 
         // Wait for the parsing thread to complete
         void waitForCompletion();
 
-        // Get the list of media segments
+        // Get the most recent media segments, at most history_size, oldest first
         std::vector<std::shared_ptr<HLSSegment>> getSegments();
 
+        // Compacted statistics of the segments that dropped out of the history
+        SegmentSummary getEvictedSegments();
+
+        // Segments downloaded / failed since start
+        size_t getDownloadedSegments();
+        size_t getFailedSegments();
+
+        /**
+         * @brief Delivers a snapshot of every segment of this stream as soon as it is
+         * downloaded or failed, from the thread that finished it.
+         */
+        void subscribe(const std::shared_ptr<SegmentSubscription> &subscription);
+        void unsubscribe(const std::shared_ptr<SegmentSubscription> &subscription);
+
         // Get the list of variant streams (if any)
         std::vector<HLSVariantStream> getVariantStreams();
 
+        /**
+         * @brief Reads the variant streams of a master playlist without creating a parser.
+         *
+         * @param manifest Master playlist body.
+         * @param uri Uri the playlist was fetched from, relative variant uris are resolved against it.
+         * @return The variants in playlist order, empty for a media playlist.
+         */
+        static std::vector<HLSVariantStream> parseMasterPlaylist(std::string_view manifest, const std::string &uri);
+
         // Check if the manifest is a master playlist
         bool isMasterPlaylist();
 
+        // Totals over every finished segment since start, constant time
         long getTotalRunningTime();
 
         long getTotalDecodeTime();
@@ -60,23 +162,107 @@ namespace playback
         long getTotalDeclaredTime();
 
         long getTargetDuration();
+
+        // Number of new segments waiting for a free download worker
+        size_t getDownloadQueueDepth();
+
+        // Number of segments currently being downloaded/decoded
+        size_t getActiveDownloads();
+
+        // Number of segments dropped because the download queue overflowed
+        size_t getDroppedDownloads();
+
+        // Number of codec contexts opened by the decoder workers
+        size_t getCodecOpens();
+
+        // Number of segments decoded with an already open codec context
+        size_t getCodecReuses();
+
+        // Packets and frames allocated by the decoder workers
+        size_t getAVAllocations();
+
+        // Packet and frame allocations avoided by recycling them
+        size_t getAVReuses();
+
+        // Segment download buffers allocated / served recycled
+        size_t getBufferAllocations();
+        size_t getBufferReuses();
+
+        // How long new segments sat on the origin before a refresh noticed them, in ms
+        Histogram getSegmentDiscoveryDelay();
+
+        // Learned interval between segment publications in ms
+        double getPublicationCadence();
+
+        // Number of HTTP requests that reused a kept-alive connection
+        size_t getReusedConnections();
+
+        // Number of HTTP requests that had to open a new connection
+        size_t getNewConnections();
     private:
         void parseFromURI(const std::string &uri); // Fetch and parse manifest from URI
-        std::string fetchContentFromURI(const std::string &uri);
-        void parse(const std::string &manifest);
+        std::string fetchContentFromURI(const std::string &uri, HttpTransferInfo *info = nullptr);
+        void parse(std::string_view manifest);
+
+        // LL-HLS part listed in the playlist, views point into the manifest buffer
+        struct PendingPart
+        {
+            std::string_view uri;
+            double duration = 0;
+            bool independent = false; // INDEPENDENT=YES, starts with a keyframe
+        };
+        struct SubmittedPart
+        {
+            std::string uri; // Uri as listed in the playlist
+            bool hinted;     // Submitted from #EXT-X-PRELOAD-HINT, duration not yet known
+        };
+        // Retains a new segment and registers it for the running totals
+        void addSegment(const std::shared_ptr<HLSSegment> &segment);
+        // Hands a segment or part to the segment fetcher, or to the download pool without one
+        void submitSegment(const std::shared_ptr<HLSSegment> &segment, const std::string &part_uri = "");
+        void submitParts(const std::shared_ptr<HLSSegment> &segment, const std::vector<PendingPart> &parts);
+        void submitPart(const std::shared_ptr<HLSSegment> &segment, std::string_view part_uri, double duration, bool independent, bool hint);
+        // Playlist uri with _HLS_msn/_HLS_part when the origin supports blocking reload
+        std::string blockingReloadUri(const std::string &uri) const;
+        std::chrono::milliseconds refreshDelay() const;
 
     private:
-        std::vector<std::unique_ptr<Decoder>> segments_decoders;
-        std::vector<std::shared_ptr<HLSSegment>> segments;
+        // Shared with the completion callbacks, which may outlive the parser on a shared pool
+        std::shared_ptr<SegmentHistory> history;
+        std::shared_ptr<SegmentPublisher> publisher;
+        std::shared_ptr<PlayerBufferModel> playerBuffer;
+        std::shared_ptr<ContinuityMonitor> continuityMonitor;
+        std::shared_ptr<LatencyRecorder> latencyRecorder;
+        // Shared with the pool jobs, which may outlive the parser on a shared pool
+        std::shared_ptr<HttpClient> httpClient;
+        struct TransferThroughput
+        {
+            std::mutex mutex;
+            ThroughputEstimator estimator;
+        };
+        std::shared_ptr<TransferThroughput> transferThroughput;
         std::vector<HLSVariantStream> variantStreams;
         const std::string uri;
         std::string baseUri;
         bool masterPlaylist = true;
         bool isLive = false;
         int protocol_version = 3;
-        int media_sequence = 0;
+        long media_sequence = 0;
+        // Highest sequence number handed to the download pool
+        long last_sequence_number = -1;
+        // Sequence number of the newest complete segment in the last parsed playlist
+        long playlist_last_sequence = -1;
+        RefreshScheduler refreshScheduler;
+        std::atomic<long> declared_bandwidth{0};
         long target_duration = 0;
-        bool discontinuetym = false;
+        // LL-HLS state, only used by the parsing thread
+        bool can_block_reload = false;
+        double part_target = 0;
+        double part_hold_back = 0;
+        long next_msn = -1;  // _HLS_msn of the next blocking reload, -1 when not blocking
+        long next_part = -1; // _HLS_part of the next blocking reload, -1 when not used
+        std::shared_ptr<HLSSegment> partialSegment; // Segment being assembled from parts
+        std::deque<SubmittedPart> submittedParts;
         // TS when master playlist was pooled first time
         long started_timestamp = -1;
 
@@ -85,12 +271,16 @@ namespace playback
         std::condition_variable parsingComplete;
         bool isParsingDone = false;
         int refresh_interval = 0;
-        CURL *curl = nullptr;
+        SegmentFetcher segmentFetcher;
+        std::shared_ptr<ArchiveWriter> recorder;
+        // Stopped by its owner, the parser owns only the pool it created (declared last, so that one
+        // is stopped first). A shared pool may run jobs of the parser after it is destroyed, they
+        // hold `httpClient` and `transferThroughput` weakly and are dropped once those are gone.
+        std::shared_ptr<SegmentDownloadPool> downloadPool;
 
     private:
-        // Helper function to trim whitespace from a string
-        std::string resolveUri(std::istringstream &stream);
-        std::string trim(const std::string &str);
+        // Resolve a playlist uri line against the uri of the playlist
+        std::string resolveUri(std::string_view relative);
     };
 } // namespace playback
 
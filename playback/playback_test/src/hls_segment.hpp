@@ -7,6 +7,12 @@ extern "C"
 }
 
 #include "constants.hpp"
+#include "frame_stats.hpp"
+#include "frame_analyzer.hpp"
+#include "http_client.hpp"
+#include "ts_validator.hpp"
+#include "cadence_detector.hpp"
+#include "pts_sequence.hpp"
 #include "logger.hpp"
 
 #include <vector>
@@ -14,6 +20,9 @@ extern "C"
 #include <algorithm>
 #include <thread>
 #include <mutex>
+#include <functional>
+#include <memory>
+#include <string>
 
 namespace playback
 {
@@ -26,9 +35,118 @@ namespace playback
         DOWNLOAD_FAILED
     };
 
+    inline const char *segmentStatusToString(SegmentStatus status)
+    {
+        switch (status)
+        {
+        case IN_PROGRESS:
+            return "IN_PROGRESS";
+        case DOWNLOADED:
+            return "DOWNLOADED";
+        case DOWNLOAD_FAILED:
+            return "DOWNLOAD_FAILED";
+        default:
+            return "UNKNOWN";
+        }
+    }
+
+    /**
+     * @brief Immutable copy of the state of a segment, taken when it finished.
+     *
+     * Shared as std::shared_ptr<const SegmentSnapshot>, so any number of consumers can read
+     * it from any thread without locking and without touching the live segment.
+     */
+    struct SegmentSnapshot
+    {
+        std::string uri;
+        long sequence_number = -1;
+        SegmentStatus status = SegmentStatus::IN_PROGRESS;
+        long created_at = 0;   // UTC ms
+        long completed_at = 0; // UTC ms
+        double declared_duration = 0; // s
+        long decode_duration = 0;     // ms
+        int num_frames = 0;
+        int num_keyframes = 0;
+        double average_fps = 0;
+        double pts_average_diff = 0;
+        long first_pts = -1;
+        long last_pts = -1;          // Highest PTS, where the next segment should continue, ms
+        FrameIntervalStats interval_stats;
+        bool discontinuity = false;  // Preceded by #EXT-X-DISCONTINUITY
+        double frame_interval = 0;   // Nominal frame interval learned by the cadence detector, ms
+        AnomalyCounts anomaly_counts;
+        std::vector<AnomalyEvent> anomalies; // The first MAX_SEGMENT_ANOMALIES, all of them are counted
+        LatencyStats latency_stats;          // Publish (SEI wall clock) to decode, frames without a timestamp are not counted
+        bool partial = false;
+        int num_parts = 0;
+        int parts_failed = 0;
+        size_t transferred_bytes = 0;
+        long transfer_time = 0; // ms
+        TransferPhases transfer_phases;  // Summed over the transfers, us
+        long ttfb = -1;                  // Time to first byte of the first transfer, us
+        long longest_transfer_stall = 0; // us
+        std::vector<TransferSample> transfer_progress; // Transfers laid end to end
+        long declared_bandwidth = 0;     // BANDWIDTH of the variant in bps, 0 if unknown
+        VideoAnalysisStats video_stats;
+        TsStats ts_stats;                // Transport stream checks, packets == 0 if not checked
+
+        // Bytes over transfer time, what a player fetching the segment would see
+        double getGoodputKbps() const
+        {
+            return transfer_time > 0 ? transferred_bytes * 8.0 / transfer_time : 0;
+        }
+
+        // Bitrate the segment needs for real-time playback
+        double getSegmentBitrateKbps() const
+        {
+            return declared_duration > 0 ? transferred_bytes * 8.0 / (declared_duration * 1000) : 0;
+        }
+
+        inline void print(const std::string &prefix = "") const
+        {
+            Logger::getInstance().log(prefix + "Segment: " + uri, Logger::Severity::INFO, HLS_TAG);
+            Logger::getInstance().log(prefix + "  Status: " + segmentStatusToString(status), Logger::Severity::INFO, HLS_TAG);
+            Logger::getInstance().log(prefix + "  Created at: " + std::to_string(created_at), Logger::Severity::INFO, HLS_TAG);
+            Logger::getInstance().log(prefix + "  Number of frames: " + std::to_string(num_frames) + ", keyframes: " + std::to_string(num_keyframes), Logger::Severity::INFO, HLS_TAG);
+            if (partial)
+            {
+                Logger::getInstance().log(prefix + "  Parts: " + std::to_string(num_parts) + ", failed: " + std::to_string(parts_failed), Logger::Severity::INFO, HLS_TAG);
+            }
+            Logger::getInstance().log(prefix + "  Average FPS: " + std::to_string(average_fps), Logger::Severity::INFO, HLS_TAG);
+            Logger::getInstance().log(prefix + "  PTS average diff: " + std::to_string(pts_average_diff) + " ms", Logger::Severity::INFO, HLS_TAG);
+            Logger::getInstance().log(prefix + "  PTS diff stddev: " + std::to_string(interval_stats.getStdDev()) + " ms, min: " + std::to_string(interval_stats.getMin()) + " ms, max: " + std::to_string(interval_stats.getMax()) + " ms", Logger::Severity::INFO, HLS_TAG);
+            Logger::getInstance().log(prefix + "  Frame interval p50/p95/p99: " + std::to_string(interval_stats.getP50()) + "/" + std::to_string(interval_stats.getP95()) + "/" + std::to_string(interval_stats.getP99()) + " ms", Logger::Severity::INFO, HLS_TAG);
+            if (transferred_bytes > 0)
+            {
+                Logger::getInstance().log(prefix + "  Transfer: " + std::to_string(transferred_bytes) + " bytes in " + std::to_string(transfer_time) + " ms, dns: " + std::to_string(transfer_phases.dns / 1000) + " ms, connect: " + std::to_string(transfer_phases.connect / 1000) + " ms, tls: " + std::to_string(transfer_phases.tls / 1000) + " ms, ttfb: " + std::to_string(ttfb / 1000) + " ms, longest stall: " + std::to_string(longest_transfer_stall / 1000) + " ms", Logger::Severity::INFO, HLS_TAG);
+                Logger::getInstance().log(prefix + "  Goodput: " + std::to_string(getGoodputKbps()) + " kbps, segment bitrate: " + std::to_string(getSegmentBitrateKbps()) + " kbps, declared BANDWIDTH: " + std::to_string(declared_bandwidth / 1000) + " kbps, download/duration: " + std::to_string(declared_duration > 0 ? transfer_time / (declared_duration * 1000) : 0), Logger::Severity::INFO, HLS_TAG);
+            }
+            if (video_stats.getFrames() > 0)
+            {
+                Logger::getInstance().log(prefix + "  Luma mean: " + std::to_string(video_stats.getMeanLuma()) + ", SI: " + std::to_string(video_stats.getSpatialInfo()) + ", TI: " + std::to_string(video_stats.getTemporalInfo()), Logger::Severity::INFO, HLS_TAG);
+                Logger::getInstance().log(prefix + "  Frozen frames: " + std::to_string(video_stats.getFrozenFrames()) + ", black frames: " + std::to_string(video_stats.getBlackFrames()), Logger::Severity::INFO, HLS_TAG);
+            }
+            if (ts_stats.packets > 0)
+            {
+                Logger::getInstance().log(prefix + "  TS packets: " + std::to_string(ts_stats.packets) + ", CC errors: " + std::to_string(ts_stats.cc_errors) + ", max PCR interval: " + std::to_string(ts_stats.max_pcr_interval) + " ms, PCR jitter: " + std::to_string(ts_stats.max_pcr_jitter) + " us", Logger::Severity::INFO, HLS_TAG);
+                Logger::getInstance().log(prefix + "  PCR to PTS offset: " + std::to_string(ts_stats.min_pcr_pts_offset) + " - " + std::to_string(ts_stats.max_pcr_pts_offset) + " ms, late PTS: " + std::to_string(ts_stats.late_pts), Logger::Severity::INFO, HLS_TAG);
+            }
+            if (latency_stats.getCount() > 0)
+            {
+                Logger::getInstance().log(prefix + "  Glass-to-glass latency p50/p95/p99: " + std::to_string(latency_stats.getP50()) + "/" + std::to_string(latency_stats.getP95()) + "/" + std::to_string(latency_stats.getP99()) + " ms, max: " + std::to_string(latency_stats.getMax()) + " ms", Logger::Severity::INFO, HLS_TAG);
+            }
+            Logger::getInstance().log(prefix + "  Decode time: " + std::to_string(decode_duration) + " ms", Logger::Severity::INFO, HLS_TAG);
+            Logger::getInstance().log(prefix + "  Declared time: " + std::to_string(static_cast<long>(declared_duration * 1000)) + " ms", Logger::Severity::INFO, HLS_TAG);
+        }
+    };
+
     // Represents a media segment in the HLS manifest
     class HLSSegment
     {
+    public:
+        // Invoked once, outside the segment lock, when the segment is downloaded or failed
+        using CompletionCallback = std::function<void(HLSSegment &segment)>;
+
     private:
         std::mutex dataMutex;
         std::string uri;
@@ -43,75 +161,432 @@ namespace playback
         // total segment playback duration
         long decode_duration = 0;
         int num_frames = 0;
-        std::vector<long> pts_list;
+        int num_keyframes = 0;
+        // Timestamps of the frames, shared read-only with the views handed out by getPts()
+        std::shared_ptr<PtsSequence> pts_list = std::make_shared<PtsSequence>();
+        // A view of `pts_list` was handed out, it is never written again (copied on the next frame)
+        bool pts_shared = false;
+        // Running statistics of the PTS deltas, updated per frame in O(1)
+        FrameIntervalStats interval_stats;
+        // Timeline anomalies within the segment, classified per frame
+        CadenceDetector cadence;
+        AnomalyCounts anomaly_counts;
+        std::vector<AnomalyEvent> anomalies;
+        bool discontinuity = false;
+        // Glass-to-glass latency of the frames carrying a wall clock SEI, also fed to the stream
+        LatencyStats latency_stats;
+        std::shared_ptr<LatencyRecorder> stream_latency;
+        // Freeze/black detection and SI/TI of the decoded pictures
+        VideoAnalysisStats video_stats;
+        // Transport stream checks of the received bytes, one stream over all the parts
+        TsStats ts_stats;
+        TsValidator ts_validator; // State the previous parts left, kept until the last one
         SegmentStatus status = SegmentStatus::IN_PROGRESS;
 
+        // LL-HLS: segment assembled from #EXT-X-PART downloads
+        bool partial = false;
+        bool parts_closed = false;
+        int num_parts = 0;
+        int parts_pending = 0;
+        int parts_failed = 0;
+        // Parts in playlist order, dependent parts are decoded after the bodies of the parts
+        // since the last independent one so the decoder starts from a keyframe
+        struct PartEntry
+        {
+            std::string uri;
+            bool independent = false; // Starts with a keyframe
+            std::shared_ptr<const std::string> payload; // Kept until the segment finishes
+        };
+        std::vector<PartEntry> part_entries;
+        // Previous frame of the last decoded part, the next part may be decoded by another worker
+        FrameAnalyzer part_analyzer;
+
+        // Bytes received and time spent on the transfers of this segment (or its parts)
+        size_t transferred_bytes = 0;
+        long transfer_time = 0; // ms
+        TransferPhases transfer_phases;
+        long ttfb = -1;
+        long longest_transfer_stall = 0;
+        std::vector<TransferSample> transfer_progress;
+        long transfer_time_us = 0; // Offset of the next transfer in `transfer_progress`
+        long transfer_started_at = -1;  // UTC ms, start of the first transfer
+        long transfer_finished_at = -1; // UTC ms, end of the last transfer
+        long declared_bandwidth = 0;
+
+        CompletionCallback completionCallback;
+        bool completion_notified = false;
+
+        inline void addPartDurationLocked(double duration)
+        {
+            if (!parts_closed)
+            {
+                declared_duration += duration;
+            }
+        }
+        inline void updatePartsStatus()
+        {
+            if (!parts_closed || parts_pending > 0)
+            {
+                return;
+            }
+            status = parts_failed == num_parts ? SegmentStatus::DOWNLOAD_FAILED : SegmentStatus::DOWNLOADED;
+            // No more parts to prime, give the buffers back
+            for (PartEntry &part : part_entries)
+            {
+                part.payload.reset();
+            }
+            part_analyzer = FrameAnalyzer();
+            ts_validator = TsValidator();
+        }
+        // Returns the completion callback the first time the segment is found finished
+        inline CompletionCallback takeCompletionCallbackLocked()
+        {
+            if (status == SegmentStatus::IN_PROGRESS || completion_notified)
+            {
+                return nullptr;
+            }
+            completion_notified = true;
+            return completionCallback;
+        }
+
     public:
         HLSSegment()
         {
             started_timestamp = get_utc();
         }
         inline void calculateStatistics(AVFrame *frame, AVRational time_base)
+        {
+            if (frame->pts == AV_NOPTS_VALUE)
+            {
+                std::lock_guard<std::mutex> lock(dataMutex);
+                num_frames++;
+                Logger::getInstance().log("Failed to obtain pts for frame", Logger::Severity::ERROR, HLS_TAG);
+                return;
+            }
+            addFrame(pts_to_ms(frame, time_base), frame->key_frame);
+        }
+        // Statistics from a frame timestamp in ms, frames have to be added in presentation order
+        inline void addFrame(long pts, bool keyframe)
         {
             std::lock_guard<std::mutex> lock(dataMutex);
-            if (frame->pts != AV_NOPTS_VALUE)
+            if (pts_shared)
             {
-                pts_list.push_back(pts_to_ms(frame, time_base));
+                // A view may still be read on another thread, it keeps the timestamps it was given.
+                // use_count() cannot tell: a view released elsewhere is not ordered before our writes.
+                pts_list = std::make_shared<PtsSequence>(*pts_list);
+                pts_shared = false;
             }
-            else
+            if (!pts_list->empty())
             {
-                Logger::getInstance().log("Failed to obtain pts for frame", Logger::Severity::ERROR, HLS_TAG);
+                interval_stats.add(pts - pts_list->back());
             }
-            decode_duration = pts_list.back() - pts_list.front();
+            pts_list->push_back(pts);
             num_frames++;
-            if (pts_list.size() > 1)
+            if (keyframe)
+            {
+                num_keyframes++;
+            }
+            decode_duration = pts_list->back() - pts_list->front();
+            pts_average_diff = interval_stats.getMean();
+            average_fps = (double)num_frames / (double)decode_duration;
+            AnomalyEvent event;
+            if (cadence.add(pts, event))
             {
-                std::vector<int64_t> diffs(pts_list.size() - 1);
-                for (size_t i = 1; i < pts_list.size(); ++i)
+                event.sequence = sequence_number;
+                anomaly_counts.add(event.type);
+                if (anomalies.size() < MAX_SEGMENT_ANOMALIES)
                 {
-                    diffs[i - 1] = pts_list[i] - pts_list[i - 1];
+                    anomalies.push_back(event);
                 }
-                pts_average_diff = std::accumulate(diffs.begin(), diffs.end(), 0.0) / diffs.size();
             }
-
-            average_fps = (double)num_frames / (double)decode_duration;
         }
-        inline void download_complete()
+        // Publish to decode latency of a frame, ms
+        inline void addLatency(double latency)
+        {
+            std::shared_ptr<LatencyRecorder> recorder;
+            {
+                std::lock_guard<std::mutex> lock(dataMutex);
+                latency_stats.add(latency);
+                recorder = stream_latency;
+            }
+            if (recorder)
+            {
+                recorder->add(latency);
+            }
+        }
+        // Content metrics of a decoded frame, added after the frame's addFrame/calculateStatistics
+        inline void addFrameAnalysis(const FrameMetrics &metrics)
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            video_stats.add(metrics);
+        }
+        /**
+         * @brief Continues the frame analysis of a partial segment on the worker decoding its next part.
+         *
+         * Called before a part is decoded, `analyzer` is swapped with the state the previous part
+         * left, and again after it, when the state is kept only while more parts are to come.
+         */
+        inline void swapPartAnalyzer(FrameAnalyzer &analyzer)
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            if (status == SegmentStatus::IN_PROGRESS)
+            {
+                std::swap(part_analyzer, analyzer);
+            }
+        }
+        /**
+         * @brief Transport stream check of the segment, continued from part to part.
+         *
+         * The bytes of one transfer (the segment or its next part, in part order) are fed to the
+         * validator taken before it and it is handed back after it, so continuity counters and
+         * PCRs are followed across part boundaries. One transfer of a segment at a time.
+         */
+        inline TsValidator takeTsValidator()
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            TsValidator validator = std::move(ts_validator);
+            ts_validator = TsValidator();
+            return validator;
+        }
+        inline void putTsValidator(TsValidator validator)
         {
             std::lock_guard<std::mutex> lock(dataMutex);
-            status = SegmentStatus::DOWNLOADED;
+            ts_stats = validator.isTransportStream() ? validator.getStats() : TsStats();
+            if (partial && status == SegmentStatus::IN_PROGRESS)
+            {
+                ts_validator = std::move(validator);
+            }
+        }
+        // For partial segments each call finishes one part, the segment
+        // is complete once it has been closed and all parts are done
+        inline void download_complete()
+        {
+            CompletionCallback callback;
+            {
+                std::lock_guard<std::mutex> lock(dataMutex);
+                if (!partial)
+                {
+                    status = SegmentStatus::DOWNLOADED;
+                }
+                else
+                {
+                    parts_pending--;
+                    updatePartsStatus();
+                }
+                callback = takeCompletionCallbackLocked();
+            }
+            if (callback)
+            {
+                callback(*this);
+            }
         }
         inline void download_failed()
+        {
+            CompletionCallback callback;
+            {
+                std::lock_guard<std::mutex> lock(dataMutex);
+                if (!partial)
+                {
+                    status = SegmentStatus::DOWNLOAD_FAILED;
+                }
+                else
+                {
+                    parts_pending--;
+                    parts_failed++;
+                    updatePartsStatus();
+                }
+                callback = takeCompletionCallbackLocked();
+            }
+            if (callback)
+            {
+                callback(*this);
+            }
+        }
+        inline void setCompletionCallback(CompletionCallback callback)
         {
             std::lock_guard<std::mutex> lock(dataMutex);
-            status = SegmentStatus::DOWNLOAD_FAILED;
+            completionCallback = std::move(callback);
         }
-        inline void print(std::string prefix = "")
+        // Accounts one completed HTTP transfer of the segment or of one of its parts
+        inline void addTransfer(const HttpTransferInfo &info)
         {
+            long now = get_utc();
             std::lock_guard<std::mutex> lock(dataMutex);
-            Logger::getInstance().log(prefix + "Segment: " + uri, Logger::Severity::INFO, HLS_TAG);
-            Logger::getInstance().log(prefix + "  Status: " + segmentStatusToString(status), Logger::Severity::INFO, HLS_TAG);
-            Logger::getInstance().log(prefix + "  Created at: " + std::to_string(started_timestamp), Logger::Severity::INFO, HLS_TAG);
-            Logger::getInstance().log(prefix + "  Number of frames: " + std::to_string(num_frames), Logger::Severity::INFO, HLS_TAG);
-            Logger::getInstance().log(prefix + "  Average FPS: " + std::to_string(average_fps), Logger::Severity::INFO, HLS_TAG);
-            Logger::getInstance().log(prefix + "  PTS average diff: " + std::to_string(pts_average_diff) + " ms", Logger::Severity::INFO, HLS_TAG);
-            Logger::getInstance().log(prefix + "  Decode time: " + std::to_string(decode_duration) + " ms", Logger::Severity::INFO, HLS_TAG);
-            Logger::getInstance().log(prefix + "  Declared time: " + std::to_string(static_cast<long>(declared_duration * 1000)) + " ms", Logger::Severity::INFO, HLS_TAG);
-            printed = true;
+            long started_at = now - info.total_time / 1000;
+            transfer_started_at = transfer_started_at < 0 ? started_at : std::min(transfer_started_at, started_at);
+            transfer_finished_at = now;
+            for (const TransferSample &sample : info.progress)
+            {
+                transfer_progress.push_back({transfer_time_us + sample.time, transferred_bytes + sample.bytes});
+            }
+            transferred_bytes += info.bytes;
+            transfer_time_us += info.total_time;
+            transfer_time = transfer_time_us / 1000;
+            transfer_phases += info.getPhases();
+            if (ttfb < 0)
+            {
+                ttfb = info.starttransfer_time;
+            }
+            longest_transfer_stall = std::max(longest_transfer_stall, info.getLongestStall());
+        }
+        // BANDWIDTH attribute of the variant the segment belongs to, in bps
+        inline void setDeclaredBandwidth(long bandwidth)
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            declared_bandwidth = bandwidth;
+        }
+        // The segment follows #EXT-X-DISCONTINUITY, its timeline does not continue the previous one
+        inline void setDiscontinuity(bool value)
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            discontinuity = value;
+        }
+        inline bool isDiscontinuity()
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return discontinuity;
+        }
+        inline void setLatencyRecorder(std::shared_ptr<LatencyRecorder> recorder)
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            stream_latency = std::move(recorder);
         }
-        inline const char *segmentStatusToString(SegmentStatus status)
+        // Frame interval of the stream so far (ms), lets the first frames of the segment be classified
+        inline void setExpectedFrameInterval(double frame_interval)
         {
-            switch (status)
+            std::lock_guard<std::mutex> lock(dataMutex);
+            if (cadence.getFrames() == 0)
+            {
+                cadence = CadenceDetector(frame_interval);
+            }
+        }
+        /**
+         * @brief Registers an LL-HLS part that will be decoded into this segment.
+         *
+         * @param uri Uri the part is decoded from.
+         * @param independent The part starts with a keyframe (INDEPENDENT=YES), the first
+         *                    part of a segment is always treated as independent.
+         */
+        inline void addPart(const std::string &uri, double duration, bool independent)
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            partial = true;
+            num_parts++;
+            parts_pending++;
+            addPartDurationLocked(duration);
+            part_entries.push_back({uri, independent || part_entries.empty(), nullptr});
+        }
+        /**
+         * @brief Keeps the body of a part that is about to be decoded.
+         *
+         * @return The bodies of the earlier parts back to the last independent one, in order,
+         *         which have to be decoded first. Empty for an independent part.
+         */
+        inline std::vector<std::shared_ptr<const std::string>> addPartPayload(const std::string &uri, const std::shared_ptr<const std::string> &payload)
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            std::vector<std::shared_ptr<const std::string>> priming;
+            auto part = std::find_if(part_entries.begin(), part_entries.end(), [&uri](const PartEntry &entry)
+                                     { return entry.uri == uri; });
+            if (part == part_entries.end())
+            {
+                return priming;
+            }
+            part->payload = payload;
+            auto first = part;
+            while (first != part_entries.begin() && !first->independent)
             {
-            case IN_PROGRESS:
-                return "IN_PROGRESS";
-            case DOWNLOADED:
-                return "DOWNLOADED";
-            case DOWNLOAD_FAILED:
-                return "DOWNLOAD_FAILED";
-            default:
-                return "UNKNOWN";
+                --first;
             }
+            // Nothing before the last independent part is needed again
+            for (auto it = part_entries.begin(); it != first; ++it)
+            {
+                it->payload.reset();
+            }
+            for (auto it = first; it != part; ++it)
+            {
+                if (it->payload)
+                {
+                    priming.push_back(it->payload);
+                }
+            }
+            return priming;
+        }
+        // Adds the declared duration of a part registered before it was listed (preload hint)
+        inline void addPartDuration(double duration)
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            addPartDurationLocked(duration);
+        }
+        // Called once the playlist lists the full segment, no more parts will be added
+        inline void closeParts(double segment_duration)
+        {
+            CompletionCallback callback;
+            {
+                std::lock_guard<std::mutex> lock(dataMutex);
+                parts_closed = true;
+                declared_duration = segment_duration;
+                updatePartsStatus();
+                callback = takeCompletionCallbackLocked();
+            }
+            if (callback)
+            {
+                callback(*this);
+            }
+        }
+        inline bool isPartial()
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return partial;
+        }
+        inline int getNumParts()
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return num_parts;
+        }
+        // Copy of the current state, readable without locks
+        inline std::shared_ptr<const SegmentSnapshot> snapshot()
+        {
+            auto copy = std::make_shared<SegmentSnapshot>();
+            std::lock_guard<std::mutex> lock(dataMutex);
+            copy->uri = uri;
+            copy->sequence_number = sequence_number;
+            copy->status = status;
+            copy->created_at = started_timestamp;
+            copy->completed_at = get_utc();
+            copy->declared_duration = declared_duration;
+            copy->decode_duration = decode_duration;
+            copy->num_frames = num_frames;
+            copy->num_keyframes = num_keyframes;
+            copy->average_fps = average_fps;
+            copy->pts_average_diff = pts_average_diff;
+            copy->first_pts = pts_list->empty() ? -1 : pts_list->front();
+            copy->last_pts = cadence.getHighestPts();
+            copy->interval_stats = interval_stats;
+            copy->discontinuity = discontinuity;
+            copy->frame_interval = cadence.getFrameInterval();
+            copy->anomaly_counts = anomaly_counts;
+            copy->anomalies = anomalies;
+            copy->latency_stats = latency_stats;
+            copy->partial = partial;
+            copy->num_parts = num_parts;
+            copy->parts_failed = parts_failed;
+            copy->transferred_bytes = transferred_bytes;
+            copy->transfer_time = transfer_time;
+            copy->transfer_phases = transfer_phases;
+            copy->ttfb = ttfb;
+            copy->longest_transfer_stall = longest_transfer_stall;
+            copy->transfer_progress = transfer_progress;
+            copy->declared_bandwidth = declared_bandwidth;
+            copy->video_stats = video_stats;
+            copy->ts_stats = ts_stats;
+            return copy;
+        }
+        inline void print(std::string prefix = "")
+        {
+            snapshot()->print(prefix);
+            std::lock_guard<std::mutex> lock(dataMutex);
+            printed = true;
         }
         inline SegmentStatus getStatus()
         {
@@ -123,9 +598,11 @@ namespace playback
             std::lock_guard<std::mutex> lock(dataMutex);
             return printed;
         }
-        inline std::vector<long> getPtsList()
+        // Timestamps of the frames decoded so far, later frames do not change the returned view
+        inline PtsView getPts()
         {
             std::lock_guard<std::mutex> lock(dataMutex);
+            pts_shared = true;
             return pts_list;
         }
         inline double getAveragePtsDiff()
@@ -133,6 +610,52 @@ namespace playback
             std::lock_guard<std::mutex> lock(dataMutex);
             return pts_average_diff;
         }
+        inline FrameIntervalStats getIntervalStats()
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return interval_stats;
+        }
+        inline VideoAnalysisStats getVideoStats()
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return video_stats;
+        }
+        inline TsStats getTsStats()
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return ts_stats;
+        }
+        inline double getPtsDiffVariance()
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return interval_stats.getVariance();
+        }
+        inline double getMinPtsGap()
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return interval_stats.getMin();
+        }
+        inline double getMaxPtsGap()
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return interval_stats.getMax();
+        }
+        inline double getFrameIntervalP95()
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return interval_stats.getP95();
+        }
+        inline double getFrameIntervalP99()
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return interval_stats.getP99();
+        }
+        // Number of frames whose PTS is lower than the PTS of the previous frame
+        inline size_t getPtsRewinds()
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return interval_stats.getRewinds();
+        }
         inline std::string getUri()
         {
             std::lock_guard<std::mutex> lock(dataMutex);
@@ -141,7 +664,6 @@ namespace playback
         inline void setUri(std::string val)
         {
             std::lock_guard<std::mutex> lock(dataMutex);
-            sequence_number = extract_sequence_number(val);
             uri = val;
         }
         inline double getDeclaredDuration()
@@ -178,10 +700,41 @@ namespace playback
             std::lock_guard<std::mutex> lock(dataMutex);
             return started_timestamp;
         }
+        inline int getNumKeyframes() {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return num_keyframes;
+        }
         inline int getNumFrames() {
             std::lock_guard<std::mutex> lock(dataMutex);
             return num_frames;
         }
+        // Pts of the first frame in ms, -1 before the first frame is decoded
+        inline long getFirstPts() {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return pts_list->empty() ? -1 : pts_list->front();
+        }
+        inline size_t getTransferredBytes() {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return transferred_bytes;
+        }
+        inline long getTransferTime() {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return transfer_time;
+        }
+        // Time to first byte of the first transfer in us, -1 before any transfer
+        inline long getTtfb() {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return ttfb;
+        }
+        // Wall clock span of the transfers in UTC ms, -1 before any transfer
+        inline long getTransferStartedAt() {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return transfer_started_at;
+        }
+        inline long getTransferFinishedAt() {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return transfer_finished_at;
+        }
         inline void updateStartedTimestamp() {
             std::lock_guard<std::mutex> lock(dataMutex);
             started_timestamp = get_utc();
@@ -0,0 +1,241 @@
+#include "http_client.hpp"
+#include "constants.hpp"
+#include "logger.hpp"
+
+#include <stdexcept>
+
+using namespace playback;
+
+constexpr const char *HTTP_TAG = "HttpClient";
+
+// Keep-alive probes so idle connections survive between playlist refreshes
+constexpr long KEEPALIVE_IDLE_S = 30;
+constexpr long KEEPALIVE_INTERVAL_S = 10;
+// Minimum spacing of the progress samples and how many a transfer keeps
+constexpr long PROGRESS_SAMPLE_INTERVAL_US = 50000;
+constexpr size_t MAX_PROGRESS_SAMPLES = 512;
+
+// Callback function for libcurl to write data into a string
+static size_t writeCallback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+    ((std::string *)userp)->append((char *)contents, size * nmemb);
+    return size * nmemb;
+}
+
+// Body and chunk consumer of a fetch() with a DataCallback
+struct ForwardingTarget
+{
+    std::string *body;
+    const DataCallback *on_data;
+};
+
+static size_t forwardingWriteCallback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+    auto *target = static_cast<ForwardingTarget *>(userp);
+    target->body->append(static_cast<char *>(contents), size * nmemb);
+    (*target->on_data)(static_cast<const uint8_t *>(contents), size * nmemb);
+    return size * nmemb;
+}
+
+// Called by libcurl while a transfer runs, samples the bytes received so far
+static int progressCallback(void *clientp, curl_off_t, curl_off_t dlnow, curl_off_t, curl_off_t)
+{
+    auto *info = static_cast<HttpTransferInfo *>(clientp);
+    if (!info || dlnow <= 0 || info->progress.size() >= MAX_PROGRESS_SAMPLES)
+    {
+        return 0;
+    }
+    size_t bytes = static_cast<size_t>(dlnow);
+    long now = static_cast<long>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - info->started).count());
+    if (info->progress.empty() ||
+        (bytes > info->progress.back().bytes && now - info->progress.back().time >= PROGRESS_SAMPLE_INTERVAL_US))
+    {
+        info->progress.push_back({now, bytes});
+    }
+    return 0;
+}
+
+HttpClient::HttpClient()
+{
+    curl_global_init(CURL_GLOBAL_DEFAULT); // Initialize global state for libcurl
+    share = curl_share_init();
+    if (!share)
+    {
+        throw std::runtime_error("Failed to initialize CURL share");
+    }
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, &HttpClient::lockShare);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, &HttpClient::unlockShare);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    // Not CURL_LOCK_DATA_CONNECT: libcurl does not support one connection cache used by
+    // transfers running on several threads, every handle keeps its own connections
+}
+
+HttpClient::~HttpClient()
+{
+    std::lock_guard<std::mutex> lock(handlesMutex);
+    for (CURL *handle : idleHandles)
+    {
+        curl_easy_cleanup(handle);
+    }
+    idleHandles.clear();
+    curl_share_cleanup(share);
+}
+
+void HttpClient::lockShare(CURL *, curl_lock_data data, curl_lock_access, void *userptr)
+{
+    static_cast<HttpClient *>(userptr)->shareLocks[data].lock();
+}
+
+void HttpClient::unlockShare(CURL *, curl_lock_data data, void *userptr)
+{
+    static_cast<HttpClient *>(userptr)->shareLocks[data].unlock();
+}
+
+CURL *HttpClient::acquireHandle()
+{
+    {
+        std::lock_guard<std::mutex> lock(handlesMutex);
+        if (!idleHandles.empty())
+        {
+            CURL *handle = idleHandles.back();
+            idleHandles.pop_back();
+            return handle;
+        }
+    }
+    CURL *handle = curl_easy_init();
+    if (!handle)
+    {
+        throw std::runtime_error("Failed to initialize CURL");
+    }
+    curl_easy_setopt(handle, CURLOPT_SHARE, share);
+    configureHandle(handle);
+    return handle;
+}
+
+void HttpClient::configureHandle(CURL *handle)
+{
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, writeCallback);
+    curl_easy_setopt(handle, CURLOPT_HTTPAUTH, CURLAUTH_NONE); // Ensure no auth is used
+    curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPIDLE, KEEPALIVE_IDLE_S);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPINTVL, KEEPALIVE_INTERVAL_S);
+    curl_easy_setopt(handle, CURLOPT_FILETIME, 1L); // Ask for Last-Modified
+    curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, progressCallback);
+    curl_easy_setopt(handle, CURLOPT_XFERINFODATA, nullptr);
+    curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+}
+
+void HttpClient::trackProgress(CURL *handle, HttpTransferInfo *info)
+{
+    if (info)
+    {
+        info->progress.clear();
+        info->started = std::chrono::steady_clock::now();
+    }
+    curl_easy_setopt(handle, CURLOPT_XFERINFODATA, info);
+}
+
+void HttpClient::readTransferInfo(CURL *handle, HttpTransferInfo &info)
+{
+    curl_off_t filetime = -1;
+    curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &info.response_code);
+    curl_easy_getinfo(handle, CURLINFO_FILETIME_T, &filetime);
+    info.last_modified = filetime >= 0 ? static_cast<long>(filetime) * 1000 : -1;
+
+    curl_off_t value = 0;
+    curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME_T, &value);
+    info.namelookup_time = static_cast<long>(value);
+    curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &value);
+    info.connect_time = static_cast<long>(value);
+    curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &value);
+    info.appconnect_time = static_cast<long>(value);
+    curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &value);
+    info.starttransfer_time = static_cast<long>(value);
+    curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &value);
+    info.total_time = static_cast<long>(value);
+    value = 0;
+    curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &value);
+    info.bytes = static_cast<size_t>(value);
+    // Close the curve with the final byte count, the callback may have skipped the last chunk
+    if (!info.progress.empty() && info.progress.back().bytes < info.bytes)
+    {
+        info.progress.push_back({std::max(info.progress.back().time, info.total_time), info.bytes});
+    }
+}
+
+void HttpClient::releaseHandle(CURL *handle)
+{
+    std::lock_guard<std::mutex> lock(handlesMutex);
+    idleHandles.push_back(handle);
+}
+
+CURLcode HttpClient::fetch(const std::string &uri, std::string &body, HttpTransferInfo *info, const DataCallback &on_data)
+{
+    CURL *handle = acquireHandle();
+    curl_easy_setopt(handle, CURLOPT_URL, uri.c_str());
+    ForwardingTarget target{&body, &on_data};
+    if (on_data)
+    {
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, forwardingWriteCallback);
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, &target);
+    }
+    else
+    {
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, &body);
+    }
+    // Timings are read even without `info` so a failure can tell where the time went
+    HttpTransferInfo local;
+    HttpTransferInfo &transfer = info ? *info : local;
+    trackProgress(handle, &transfer);
+    CURLcode res = curl_easy_perform(handle);
+    requests++;
+
+    long connects = 0;
+    curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects);
+    if (res == CURLE_OK && connects == 0)
+    {
+        reused_connections++;
+    }
+    else if (connects > 0)
+    {
+        new_connections++;
+    }
+    readTransferInfo(handle, transfer);
+    trackProgress(handle, nullptr);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, writeCallback);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, nullptr);
+    releaseHandle(handle);
+
+    TransferPhases phases = transfer.getPhases();
+    std::string timing = "dns: " + std::to_string(phases.dns / 1000) + " ms, connect: " + std::to_string(phases.connect / 1000) +
+                         " ms, tls: " + std::to_string(phases.tls / 1000) + " ms, ttfb: " + std::to_string(transfer.starttransfer_time / 1000) +
+                         " ms, total: " + std::to_string(transfer.total_time / 1000) + " ms, " + std::to_string(transfer.bytes) + " bytes";
+    if (res != CURLE_OK)
+    {
+        Logger::getInstance().log("We got error: " + std::string(curl_easy_strerror(res)) + ", fetching: " + uri + " (" + timing + ")", Logger::Severity::ERROR, HTTP_TAG);
+    }
+    else
+    {
+        Logger::getInstance().log("Fetched: " + uri + " (" + timing + ")", Logger::Severity::DEBUG, HTTP_TAG);
+    }
+    return res;
+}
+
+size_t HttpClient::getRequests() const
+{
+    return requests;
+}
+
+size_t HttpClient::getReusedConnections() const
+{
+    return reused_connections;
+}
+
+size_t HttpClient::getNewConnections() const
+{
+    return new_connections;
+}
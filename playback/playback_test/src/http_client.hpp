@@ -0,0 +1,178 @@
+#ifndef HTTP_CLIENT_HPP
+#define HTTP_CLIENT_HPP
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#include <curl/curl.h>
+
+namespace playback
+{
+
+    // Bytes received so far at a point of a transfer
+    struct TransferSample
+    {
+        long time = 0; // us since the request started
+        size_t bytes = 0;
+    };
+
+    // Time spent in each phase of one or more requests, in us
+    struct TransferPhases
+    {
+        long dns = 0;
+        long connect = 0;
+        long tls = 0;      // 0 for plain HTTP and reused connections
+        long wait = 0;     // Request sent until the first byte (server latency)
+        long download = 0; // First byte until the last byte
+
+        TransferPhases &operator+=(const TransferPhases &other)
+        {
+            dns += other.dns;
+            connect += other.connect;
+            tls += other.tls;
+            wait += other.wait;
+            download += other.download;
+            return *this;
+        }
+    };
+
+    // Metadata of a completed transfer
+    struct HttpTransferInfo
+    {
+        long response_code = 0;
+        long last_modified = -1; // Last-Modified header as UTC ms, -1 if not sent
+
+        // Cumulative CURLINFO_*_TIME_T timings, us since the request started
+        long namelookup_time = 0;
+        long connect_time = 0;
+        long appconnect_time = 0;
+        long starttransfer_time = 0; // Time to first byte
+        long total_time = 0;
+        size_t bytes = 0; // Body bytes received
+
+        // Progress curve, recorded only on handles passed to HttpClient::trackProgress()
+        std::vector<TransferSample> progress;
+        std::chrono::steady_clock::time_point started;
+
+        TransferPhases getPhases() const
+        {
+            TransferPhases phases;
+            phases.dns = namelookup_time;
+            phases.connect = std::max(0L, connect_time - namelookup_time);
+            long connected = connect_time;
+            if (appconnect_time > 0)
+            {
+                phases.tls = std::max(0L, appconnect_time - connect_time);
+                connected = appconnect_time;
+            }
+            phases.wait = std::max(0L, starttransfer_time - connected);
+            phases.download = std::max(0L, total_time - starttransfer_time);
+            return phases;
+        }
+
+        // Bytes over the whole request time, what a player fetching this segment would see
+        double getGoodputKbps() const
+        {
+            return total_time > 0 ? bytes * 8000.0 / total_time : 0;
+        }
+
+        // Longest time the transfer received nothing after the first byte, in us
+        long getLongestStall() const
+        {
+            long longest = 0;
+            for (size_t i = 1; i < progress.size(); i++)
+            {
+                longest = std::max(longest, progress[i].time - progress[i - 1].time);
+            }
+            return longest;
+        }
+    };
+
+    // Receives the body of a response chunk by chunk, as libcurl hands it over
+    using DataCallback = std::function<void(const uint8_t *data, size_t size)>;
+
+    /**
+     * @brief Thread safe HTTP client that keeps connections alive between requests.
+     *
+     * Easy handles are kept in an idle list and reused instead of being created per request.
+     * Concurrent fetch() calls each run on their own handle, and every handle keeps its
+     * keep-alive connections in its own connection cache, so a request reuses the connection
+     * of an earlier request made on the same handle. Only the DNS cache and the TLS sessions
+     * are shared between the handles through one CURLSH, which lets a new connection skip
+     * the lookup and resume the TLS session.
+     */
+    class HttpClient
+    {
+    public:
+        HttpClient();
+        ~HttpClient();
+
+        /**
+         * @brief Performs a GET request and appends the response body to `body`.
+         *
+         * @param uri The uri to fetch.
+         * @param body Receives the response body.
+         * @param info Optional, receives the transfer metadata.
+         * @param on_data Optional, called with every chunk right after it is appended to `body`,
+         *                lets a consumer inspect the bytes while they arrive without a copy.
+         * @return CURLE_OK on success, the curl error code otherwise.
+         */
+        CURLcode fetch(const std::string &uri, std::string &body, HttpTransferInfo *info = nullptr,
+                       const DataCallback &on_data = nullptr);
+
+        /**
+         * @brief Applies the transfer options used for every request to a new easy handle.
+         *
+         * The response body is appended to the std::string set with CURLOPT_WRITEDATA.
+         * Shared with callers that drive their own handles, e.g. from a curl_multi loop.
+         */
+        static void configureHandle(CURL *handle);
+
+        // Reads the metadata of the transfer that just completed on `handle`
+        static void readTransferInfo(CURL *handle, HttpTransferInfo &info);
+
+        /**
+         * @brief Records the progress curve of the next transfer on `handle` into `info`.
+         *
+         * `info` must outlive the transfer, nullptr stops recording.
+         */
+        static void trackProgress(CURL *handle, HttpTransferInfo *info);
+
+        // Number of requests performed
+        size_t getRequests() const;
+
+        // Number of requests that reused an already open connection
+        size_t getReusedConnections() const;
+
+        // Number of requests that had to open a new connection
+        size_t getNewConnections() const;
+
+        // Disable copy constructor and assignment operator
+        HttpClient(const HttpClient &) = delete;
+        HttpClient &operator=(const HttpClient &) = delete;
+
+    private:
+        CURL *acquireHandle();
+        void releaseHandle(CURL *handle);
+
+        static void lockShare(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr);
+        static void unlockShare(CURL *handle, curl_lock_data data, void *userptr);
+
+    private:
+        CURLSH *share = nullptr;
+        std::mutex shareLocks[CURL_LOCK_DATA_LAST];
+        std::mutex handlesMutex;
+        std::vector<CURL *> idleHandles;
+        std::atomic<size_t> requests{0};
+        std::atomic<size_t> reused_connections{0};
+        std::atomic<size_t> new_connections{0};
+    };
+
+} // namespace playback
+
+#endif // HTTP_CLIENT_HPP
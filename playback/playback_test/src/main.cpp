@@ -12,65 +12,727 @@ extern "C"
 #include <sstream> 
 #include <vector>
 #include <thread>
+#include <fstream>
+#include <algorithm>
+#include <future>
+#include <type_traits>
 
 #include "constants.hpp"
 #include "hls_parser.hpp"
+#include "multi_stream.hpp"
+#include "variant_monitor.hpp"
+#include "abr_simulator.hpp"
+#include "archive_replay.hpp"
+#include "synthetic_origin.hpp"
+#include "sei_injector.hpp"
 #include "logger.hpp"
 
 using namespace playback;
 
 constexpr const char* MAIN_TAG = "Main Thread";
+// Media sequences compared across renditions in --variants mode
+constexpr size_t VARIANT_REPORT_WINDOW = 10;
+// Finished segments buffered for the report loop before the oldest are dropped
+constexpr size_t SUBSCRIPTION_CAPACITY = 1024;
+// Sequences recorded from every rendition before the ABR policies are simulated
+constexpr size_t ABR_MIN_SEGMENTS = 3;
+// Interval of the summary reports
+constexpr std::chrono::seconds REPORT_INTERVAL(3);
 
-void check_non_increasing_pts(const std::vector<long> &pts_list)
+// Parses a whole command line value as a number, false if it is not one or out of range
+template <typename T>
+bool parse_number(const std::string &text, T &value)
 {
-  if (!std::is_sorted(pts_list.begin(), pts_list.end()))
+  try
   {
-
-    std::ostringstream msg;
-    msg << "ERROR: non-increasing pts: ";
-    for (auto pts : pts_list)
+    size_t used = 0;
+    if constexpr (std::is_floating_point<T>::value)
+    {
+      value = static_cast<T>(std::stod(text, &used));
+    }
+    else if constexpr (std::is_unsigned<T>::value)
+    {
+      // stoull accepts and wraps negative numbers
+      if (text.find('-') != std::string::npos)
+      {
+        return false;
+      }
+      value = static_cast<T>(std::stoull(text, &used));
+    }
+    else
     {
-      msg << pts << ", ";
+      value = static_cast<T>(std::stoll(text, &used));
     }
+    return used == text.size();
+  }
+  catch (const std::exception &)
+  {
+    return false;
+  }
+}
+
+// Parses the value of the option at argv[i] and moves past it, the first invalid one is kept in `invalid`
+template <typename T>
+void parse_option(char *argv[], int &i, T &value, std::string &invalid)
+{
+  std::string option = argv[i];
+  std::string text = argv[++i];
+  if (!parse_number(text, value) && invalid.empty())
+  {
+    invalid = option + " " + text;
+  }
+}
+
+void check_video_content(const SegmentSnapshot &segment)
+{
+  const VideoAnalysisStats &video = segment.video_stats;
+  if (video.getFreezeEvents() > 0)
+  {
+    std::ostringstream msg;
+    msg << "frozen picture: " << video.getFreezeEvents() << " freeze(s), longest: " << video.getLongestFreeze()
+        << " ms, frozen frames: " << video.getFrozenFrames() << "/" << video.getFrames() << ", segment: " << segment.uri;
+    Logger::getInstance().log(msg, Logger::Severity::ERROR, MAIN_TAG);
+  }
+  if (video.getBlackEvents() > 0)
+  {
+    std::ostringstream msg;
+    msg << "black screen: " << video.getBlackEvents() << " event(s), longest: " << video.getLongestBlack()
+        << " ms, black frames: " << video.getBlackFrames() << "/" << video.getFrames() << ", segment: " << segment.uri;
     Logger::getInstance().log(msg, Logger::Severity::ERROR, MAIN_TAG);
   }
 }
 
-void check_pts_gaps(const std::vector<long> &pts_list, int max_allowed)
+void check_transport_stream(const SegmentSnapshot &segment)
+{
+  std::string errors = segment.ts_stats.describeErrors();
+  if (!errors.empty())
+  {
+    Logger::getInstance().log("transport stream errors: " + errors + ", segment: " + segment.uri, Logger::Severity::ERROR, MAIN_TAG);
+  }
+}
+
+void check_transfer(const SegmentSnapshot &segment)
 {
-  if (pts_list.size() < 2)
+  long duration_ms = static_cast<long>(segment.declared_duration * 1000);
+  if (segment.transferred_bytes == 0 || duration_ms <= 0 || segment.transfer_time <= duration_ms)
   {
     return;
   }
-  long prev_pts = pts_list[0];
   std::ostringstream msg;
-  for (size_t i = 1; i < pts_list.size(); i++)
+  msg << "slow transfer: " << segment.transfer_time << " ms for " << duration_ms << " ms of media, goodput: "
+      << static_cast<long>(segment.getGoodputKbps()) << " kbps";
+  if (segment.declared_bandwidth > 0)
+  {
+    msg << " (BANDWIDTH: " << segment.declared_bandwidth / 1000 << " kbps)";
+  }
+  msg << ", ttfb: " << segment.ttfb / 1000 << " ms, segment: " << segment.uri;
+  Logger::getInstance().log(msg, Logger::Severity::ERROR, MAIN_TAG);
+}
+
+// Runs the per segment checks, returns false if the segment failed. PTS timeline anomalies
+// are reported by log_anomaly() from the continuity monitor.
+bool check_segment(const SegmentSnapshot &segment)
+{
+  if (segment.status != SegmentStatus::DOWNLOADED)
+  {
+    Logger::getInstance().log("Segment failed: " + segment.uri, Logger::Severity::ERROR, MAIN_TAG);
+    return false;
+  }
+  check_video_content(segment);
+  check_transport_stream(segment);
+  check_transfer(segment);
+  return true;
+}
+
+// Logs a PTS anomaly once its segment is checked in media sequence order
+void log_anomaly(const AnomalyEvent &event, const SegmentSnapshot &segment)
+{
+  std::ostringstream msg;
+  msg << "timeline " << anomalyTypeToString(event.type) << ": " << event.delta << " ms step to pts " << event.pts
+      << " ms, frame interval: " << static_cast<long>(event.expected) << " ms"
+      << (event.boundary ? ", from the last frame of the previous segment" : "") << ", segment: " << segment.uri;
+  Logger::getInstance().log(msg, Logger::Severity::ERROR, MAIN_TAG);
+}
+
+// One line summary of the timeline anomalies of a stream
+std::string format_anomalies(const ContinuityReport &report)
+{
+  std::ostringstream msg;
+  msg << "timeline anomalies: " << report.counts.total() << " (gaps: " << report.counts.gaps << ", rewinds: " << report.counts.rewinds
+      << ", cadence drops: " << report.counts.cadence_drops << ", duplicate pts: " << report.counts.duplicates
+      << ", between segments: " << report.boundary_anomalies << "), discontinuities: " << report.discontinuities;
+  return msg.str();
+}
+
+// Publish to decode latency of the frames carrying a wall clock SEI
+std::string format_latency(const LatencyStats &latency)
+{
+  if (latency.getCount() == 0)
+  {
+    return "glass-to-glass latency: - (no timestamp SEI)";
+  }
+  std::ostringstream msg;
+  msg << "glass-to-glass latency p50/p95/p99: " << static_cast<long>(latency.getP50()) << "/" << static_cast<long>(latency.getP95())
+      << "/" << static_cast<long>(latency.getP99()) << " ms (" << latency.getCount() << " frames, max: " << static_cast<long>(latency.getMax()) << " ms)";
+  return msg.str();
+}
+
+// One line summary of the virtual player of a stream
+std::string format_player_buffer(const PlayerBufferReport &player)
+{
+  std::ostringstream msg;
+  msg << "player: " << playerStateToString(player.state) << ", startup: ";
+  if (player.startup_delay >= 0)
+  {
+    msg << player.startup_delay << "ms";
+  }
+  else
+  {
+    msg << "-";
+  }
+  msg << ", stalls: " << player.stalls << " (" << player.stall_time << "ms, longest: " << player.longest_stall << "ms)"
+      << ", buffer: " << player.buffer_level << "ms, skipped segments: " << player.skipped;
+  return msg.str();
+}
+
+AbrSimulationOptions make_abr_options(const PlayerBufferOptions &player_options)
+{
+  AbrSimulationOptions options;
+  options.startup_buffer = player_options.startup_buffer / 1000.0;
+  options.rebuffer_buffer = player_options.rebuffer_threshold / 1000.0;
+  return options;
+}
+
+void print_abr_results(const std::string &title, const std::vector<AbrResult> &results)
+{
+  std::ostringstream msg;
+  msg << title << "\n";
+  for (const AbrResult &result : results)
+  {
+    msg << "  " << result.policy << ": QoE " << result.qoe
+        << ", bitrate: " << static_cast<long>(result.average_bitrate) << " kbps"
+        << ", switches: " << result.switches << " (avg " << static_cast<long>(result.average_switch) << " kbps)"
+        << ", stalls: " << result.stalls << " (" << result.stall_time << "s)"
+        << ", startup: " << result.startup_delay << "s"
+        << ", segments: " << result.segments << "\n";
+  }
+  Logger::getInstance().log(msg, Logger::Severity::INFO, MAIN_TAG);
+}
+
+// Simulates the ABR policies over recorded traces, one task per trace
+int run_abr_replay(const std::vector<std::string> &paths, const PlayerBufferOptions &player_options)
+{
+  AbrSimulator simulator(make_abr_options(player_options));
+  std::vector<std::future<std::vector<AbrResult>>> runs;
+  for (const std::string &path : paths)
+  {
+    runs.push_back(std::async(std::launch::async, [&simulator, path]()
+                              {
+                                AbrTrace trace = AbrTrace::load(path);
+                                auto policies = AbrSimulator::makeDefaultPolicies();
+                                return simulator.run(trace, policies); }));
+  }
+  for (size_t i = 0; i < runs.size(); i++)
+  {
+    print_abr_results("ABR policies over " + paths[i] + ":", runs[i].get());
+  }
+  return 0;
+}
+
+// Runs the segment checks over a recorded archive, prints a summary when it is replayed
+int run_archive_replay(const std::string &path, double speed, size_t max_concurrent_downloads, DecoderOptions decoder_options,
+                       const PlayerBufferOptions &player_options, size_t history_size)
+{
+  ArchiveReplayOptions options;
+  options.speed = speed;
+  options.max_concurrent_decodes = max_concurrent_downloads;
+  options.decoder_options = decoder_options;
+  options.history_size = history_size;
+  ArchiveReplayer replayer(path, options);
+  HLSManifestParser &parser = replayer.getParser();
+  parser.setPlayerBufferOptions(player_options);
+  parser.setAnomalyListener(log_anomaly);
+  auto subscription = std::make_shared<SegmentSubscription>(SUBSCRIPTION_CAPACITY);
+  parser.subscribe(subscription);
+
+  Logger::getInstance().log("Replaying " + path + " (" + (speed > 0 ? "x" + std::to_string(speed) : std::string("as fast as possible")) + ")", Logger::Severity::INFO, MAIN_TAG);
+  auto started = std::chrono::steady_clock::now();
+  auto replay = std::async(std::launch::async, [&replayer]()
+                           { replayer.run(); });
+  size_t checked = 0;
+  size_t failed = 0;
+  bool done = false;
+  while (!done)
+  {
+    // Drain what is left once the replay returned, every segment is finished by then
+    done = replay.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    while (auto snapshot = subscription->next(done ? std::chrono::milliseconds(0) : REPORT_INTERVAL))
+    {
+      checked++;
+      failed += check_segment(*snapshot) ? 0 : 1;
+      if (!done)
+      {
+        break;
+      }
+    }
+  }
+  replay.get();
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+
+  std::ostringstream msg;
+  msg << "Replayed " << path << " in " << elapsed << "ms\n"
+      << " playlists: " << replayer.getPlaylists() << ", segments: " << replayer.getSegments()
+      << ", missing from the archive: " << replayer.getMissingSegments() << "\n"
+      << " segments checked: " << checked << ", failed: " << failed << ", unreported: " << subscription->getDropped() << "\n"
+      << " decoded: " << parser.getTotalDecodeTime() << "ms of media, "
+      << (elapsed > 0 ? checked * 1000.0 / elapsed : 0) << " segments/s\n"
+      << " " << format_anomalies(parser.getContinuityReport()) << "\n"
+      << " virtual " << format_player_buffer(parser.getPlayerBuffer());
+  Logger::getInstance().log(msg, Logger::Severity::INFO, MAIN_TAG);
+  return 0;
+}
+
+// Serves synthetic live streams until the process is stopped, optionally writes their playlist uris for --streams
+int run_synthetic_origin(const SyntheticOriginOptions &options, const std::string &list_path)
+{
+  SyntheticOrigin origin(options);
+  if (!list_path.empty())
   {
-    if (pts_list[i] - prev_pts > max_allowed)
+    std::ofstream list(list_path);
+    for (size_t i = 0; i < options.streams; i++)
+    {
+      list << origin.getStreamUri(i) << "\n";
+    }
+    if (!list)
     {
-      msg << "pts gap: " << pts_list[i] - prev_pts << " ms, is larger than: " << max_allowed << "this will cause a playback freeze";
-      Logger::getInstance().log(msg, Logger::Severity::ERROR, MAIN_TAG);
+      throw std::runtime_error("Failed to write stream list: " + list_path);
     }
-    prev_pts = pts_list[i];
   }
+  origin.start();
+  Logger::getInstance().log("Synthetic origin ready, first stream: " + origin.getStreamUri(0), Logger::Severity::INFO, MAIN_TAG);
+  size_t last_requests = 0;
+  while (true)
+  {
+    std::this_thread::sleep_for(REPORT_INTERVAL);
+    size_t requests = origin.getRequests();
+    std::ostringstream msg;
+    msg << "Origin: " << (requests - last_requests) * 1000 / std::chrono::duration_cast<std::chrono::milliseconds>(REPORT_INTERVAL).count()
+        << " requests/s, " << requests << " requests, " << origin.getBytesSent() / (1024 * 1024) << " MiB sent, "
+        << origin.getOpenConnections() << " open connections, " << origin.getFaultsServed() << " faulty segments served";
+    Logger::getInstance().log(msg, Logger::Severity::INFO, MAIN_TAG);
+    last_requests = requests;
+  }
+  return 0;
+}
+
+// Copies a stream to the publishing output with a wall clock SEI in every H.264 frame
+int run_sei_injector(const SeiInjectorOptions &options)
+{
+  SeiInjector injector(options);
+  Logger::getInstance().log("Stamping " + options.input + " -> " + options.output, Logger::Severity::INFO, MAIN_TAG);
+  injector.run();
+  Logger::getInstance().log("Copied " + std::to_string(injector.getPackets()) + " packets, stamped " + std::to_string(injector.getStampedFrames()) + " frames",
+                            Logger::Severity::INFO, MAIN_TAG);
+  return 0;
+}
+
+// Reads one playlist uri per line, empty lines and lines starting with '#' are skipped
+std::vector<std::string> read_stream_list(const std::string &path)
+{
+  std::ifstream file(path);
+  if (!file)
+  {
+    throw std::runtime_error("Failed to open stream list: " + path);
+  }
+  std::vector<std::string> uris;
+  std::string line;
+  while (std::getline(file, line))
+  {
+    line.erase(line.find_last_not_of(" \t\r") + 1);
+    if (!line.empty() && line[0] != '#')
+    {
+      uris.push_back(line);
+    }
+  }
+  return uris;
+}
+
+// Monitors every stream from one event loop, prints a summary line per stream
+int run_multi_stream(const std::vector<std::string> &uris, size_t max_concurrent_downloads, DecoderOptions decoder_options,
+                     const PlayerBufferOptions &player_options)
+{
+  MultiStreamMonitor monitor(uris, max_concurrent_downloads, decoder_options);
+  // One subscription collects the finished segments of every stream
+  auto subscription = std::make_shared<SegmentSubscription>(SUBSCRIPTION_CAPACITY);
+  for (size_t i = 0; i < monitor.getStreamCount(); i++)
+  {
+    monitor.getStream(i).setPlayerBufferOptions(player_options);
+    monitor.getStream(i).setAnomalyListener(log_anomaly);
+    monitor.getStream(i).subscribe(subscription);
+  }
+  monitor.start();
+  auto next_report = std::chrono::steady_clock::now() + REPORT_INTERVAL;
+  while (true)
+  {
+    // The report is due on time however many segments keep arriving
+    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next_report - std::chrono::steady_clock::now());
+    if (wait > std::chrono::milliseconds(0))
+    {
+      if (auto snapshot = subscription->next(wait))
+      {
+        check_segment(*snapshot);
+      }
+      continue;
+    }
+    next_report = std::chrono::steady_clock::now() + REPORT_INTERVAL;
+    for (size_t i = 0; i < monitor.getStreamCount(); i++)
+    {
+      HLSManifestParser &stream = monitor.getStream(i);
+      long runtime = stream.getTotalRunningTime();
+      long decode_time = stream.getTotalDecodeTime();
+      std::ostringstream msg;
+      msg << "[" << i << "] " << stream.getUri() << " segments: " << stream.getDownloadedSegments() << " ok, "
+          << stream.getFailedSegments() << " failed"
+          << ", runtime: " << runtime << "ms, decoded: " << decode_time << "ms"
+          << ", cadence: " << stream.getPublicationCadence() << "ms";
+      ThroughputEstimator throughput = stream.getThroughputEstimator();
+      if (throughput.getSamples() > 0)
+      {
+        msg << ", throughput estimate: " << static_cast<long>(throughput.getEstimateKbps()) << " kbps (harmonic mean: "
+            << static_cast<long>(throughput.getHarmonicMeanKbps()) << " kbps)";
+      }
+      PlayerBufferReport player = stream.getPlayerBuffer();
+      msg << ", " << format_player_buffer(player) << ", " << format_anomalies(stream.getContinuityReport())
+          << ", " << format_latency(stream.getGlassToGlassLatency());
+      bool failing = runtime > decode_time || player.state == PlayerState::STALLED;
+      Logger::getInstance().log(msg, failing ? Logger::Severity::ERROR : Logger::Severity::INFO, HLS_TAG);
+    }
+    std::ostringstream msg;
+    msg << "Streams: " << monitor.getStreamCount() << "\n"
+        << " active transfers: " << monitor.getActiveTransfers()
+        << ", failed: " << monitor.getFailedTransfers() << "\n"
+        << " decode queue depth: " << monitor.getDecodeQueueDepth()
+        << ", active decodes: " << monitor.getActiveDecodes()
+        << ", dropped: " << monitor.getDroppedDecodes() << "\n"
+        << " codec contexts opened: " << monitor.getCodecOpens()
+        << ", reused: " << monitor.getCodecReuses() << "\n"
+        << " packets/frames allocated: " << monitor.getAVAllocations()
+        << ", allocations avoided: " << monitor.getAVReuses() << "\n"
+        << " segment buffers allocated: " << monitor.getBufferAllocations()
+        << ", recycled: " << monitor.getBufferReuses() << "\n"
+        << " http connections reused: " << monitor.getReusedConnections()
+        << ", opened: " << monitor.getNewConnections() << "\n"
+        << " unreported segments dropped: " << subscription->getDropped();
+    Logger::getInstance().log(msg, Logger::Severity::INFO, HLS_TAG);
+  }
+  return 0;
+}
+
+// Follows every rendition of a master playlist, prints which ladder rungs keep up
+int run_variants(const std::string &master_uri, size_t max_concurrent_downloads, DecoderOptions decoder_options,
+                 const PlayerBufferOptions &player_options, const std::string &abr_trace_path)
+{
+  AbrSimulator simulator(make_abr_options(player_options));
+  VariantMonitor monitor(master_uri, max_concurrent_downloads, decoder_options);
+  for (size_t i = 0; i < monitor.getMonitor().getStreamCount(); i++)
+  {
+    monitor.getMonitor().getStream(i).setPlayerBufferOptions(player_options);
+  }
+  monitor.start();
+  while (true)
+  {
+    std::this_thread::sleep_for(std::chrono::seconds(3));
+    std::ostringstream msg;
+    msg << "Renditions, last " << VARIANT_REPORT_WINDOW << " sequences:\n";
+    for (const RenditionReport &report : monitor.getReport(VARIANT_REPORT_WINDOW))
+    {
+      msg << "  " << report.variant.res_width << "x" << report.variant.res_height
+          << " @ " << report.variant.bandwidth / 1000 << " kbps: " << (report.viable ? "VIABLE" : "NOT VIABLE")
+          << ", throughput: " << static_cast<long>(report.throughput_kbps) << " kbps"
+          << " (estimate: " << static_cast<long>(report.estimate_kbps) << " kbps)"
+          << ", media bitrate: " << static_cast<long>(report.segment_bitrate_kbps) << " kbps"
+          << ", download/real time: " << report.download_ratio
+          << ", downloaded: " << report.downloaded << ", failed: " << report.failed
+          << ", missing: " << report.missing << ", misaligned: " << report.misaligned
+          << ", lag: " << report.lag << "\n"
+          << "    " << format_player_buffer(report.player) << "\n";
+    }
+    Logger::getInstance().log(msg, Logger::Severity::INFO, HLS_TAG);
+
+    // What a player switching between the renditions would have done on this link
+    AbrTrace trace = monitor.getTrace();
+    if (trace.segments.size() < ABR_MIN_SEGMENTS || trace.network.empty())
+    {
+      continue;
+    }
+    if (!abr_trace_path.empty())
+    {
+      trace.save(abr_trace_path);
+    }
+    auto policies = AbrSimulator::makeDefaultPolicies();
+    print_abr_results("ABR policies over the last " + std::to_string(trace.segments.size()) + " sequences:", simulator.run(trace, policies));
+  }
+  return 0;
 }
 
 int main(int argc, char *argv[])
 {
   Logger::getInstance().log("\n\n====== PLAYBACK PARSER ======\n\n", Logger::Severity::INFO, MAIN_TAG);
-  if (argc < 2)
+  std::vector<std::string> positional;
+  DecoderOptions decoder_options;
+  PlayerBufferOptions player_options;
+  std::string stream_list;
+  bool variants = false;
+  std::string abr_trace_path;
+  std::vector<std::string> abr_replays;
+  std::string record_path;
+  std::string replay_path;
+  double replay_speed = 1;
+  SyntheticOriginOptions origin_options;
+  bool origin = false;
+  std::string origin_list;
+  SeiInjectorOptions injector_options;
+  size_t history_size = DEFAULT_SEGMENT_HISTORY_SIZE;
+  std::string invalid_option;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--demux-only")
+    {
+      decoder_options.mode = DecodeMode::DEMUX_ONLY;
+    }
+    else if (arg == "--no-frame-analysis")
+    {
+      decoder_options.analyze_frames = false;
+    }
+    else if (arg == "--startup-buffer" && i + 1 < argc)
+    {
+      parse_option(argv, i, player_options.startup_buffer, invalid_option);
+    }
+    else if (arg == "--rebuffer" && i + 1 < argc)
+    {
+      parse_option(argv, i, player_options.rebuffer_threshold, invalid_option);
+    }
+    else if (arg == "--history" && i + 1 < argc)
+    {
+      parse_option(argv, i, history_size, invalid_option);
+    }
+    else if (arg == "--spot-check" && i + 1 < argc)
+    {
+      parse_option(argv, i, decoder_options.spot_check_interval, invalid_option);
+    }
+    else if (arg == "--variants")
+    {
+      variants = true;
+    }
+    else if (arg == "--abr-trace" && i + 1 < argc)
+    {
+      abr_trace_path = argv[++i];
+    }
+    else if (arg == "--abr-replay" && i + 1 < argc)
+    {
+      abr_replays.push_back(argv[++i]);
+    }
+    else if (arg == "--record" && i + 1 < argc)
+    {
+      record_path = argv[++i];
+    }
+    else if (arg == "--replay" && i + 1 < argc)
+    {
+      replay_path = argv[++i];
+    }
+    else if (arg == "--replay-speed" && i + 1 < argc)
+    {
+      parse_option(argv, i, replay_speed, invalid_option);
+    }
+    else if (arg == "--origin" && i + 1 < argc)
+    {
+      origin = true;
+      parse_option(argv, i, origin_options.port, invalid_option);
+    }
+    else if (arg == "--origin-streams" && i + 1 < argc)
+    {
+      parse_option(argv, i, origin_options.streams, invalid_option);
+    }
+    else if (arg == "--origin-list" && i + 1 < argc)
+    {
+      origin_list = argv[++i];
+    }
+    else if (arg == "--origin-threads" && i + 1 < argc)
+    {
+      parse_option(argv, i, origin_options.threads, invalid_option);
+    }
+    else if (arg == "--segment-duration" && i + 1 < argc)
+    {
+      parse_option(argv, i, origin_options.segment_duration, invalid_option);
+    }
+    else if (arg == "--fault-rate" && i + 1 < argc)
+    {
+      parse_option(argv, i, origin_options.fault_rate, invalid_option);
+    }
+    else if (arg == "--publish-jitter" && i + 1 < argc)
+    {
+      parse_option(argv, i, origin_options.publish_jitter, invalid_option);
+    }
+    else if (arg == "--response-delay" && i + 1 < argc)
+    {
+      parse_option(argv, i, origin_options.response_delay, invalid_option);
+    }
+    else if (arg == "--throughput" && i + 1 < argc)
+    {
+      parse_option(argv, i, origin_options.throughput_kbps, invalid_option);
+    }
+    else if (arg == "--inject-sei" && i + 1 < argc)
+    {
+      injector_options.input = argv[++i];
+    }
+    else if (arg == "--inject-output" && i + 1 < argc)
+    {
+      injector_options.output = argv[++i];
+    }
+    else if (arg == "--inject-format" && i + 1 < argc)
+    {
+      injector_options.output_format = argv[++i];
+    }
+    else if (arg == "--realtime")
+    {
+      injector_options.realtime = true;
+    }
+    else if (arg == "--streams" && i + 1 < argc)
+    {
+      stream_list = argv[++i];
+    }
+    else
+    {
+      positional.push_back(arg);
+    }
+  }
+  if (!invalid_option.empty())
+  {
+    Logger::getInstance().log("ERROR: not a number: " + invalid_option + ", run without arguments for the usage", Logger::Severity::ERROR, MAIN_TAG);
+    return -1;
+  }
+  if (!abr_replays.empty())
+  {
+    try
+    {
+      return run_abr_replay(abr_replays, player_options);
+    }
+    catch (std::exception &e)
+    {
+      Logger::getInstance().log("ERROR: " + std::string(e.what()), Logger::Severity::ERROR, MAIN_TAG);
+      return -1;
+    }
+  }
+  if (!injector_options.input.empty() && !injector_options.output.empty())
+  {
+    av_log_set_level(AV_LOG_QUIET);
+    try
+    {
+      return run_sei_injector(injector_options);
+    }
+    catch (std::exception &e)
+    {
+      Logger::getInstance().log("ERROR: " + std::string(e.what()), Logger::Severity::ERROR, MAIN_TAG);
+      return -1;
+    }
+  }
+  if (positional.empty() && stream_list.empty() && replay_path.empty() && !origin)
   {
     std::ostringstream msg;
-    msg << "Usage: " << argv[0] << " <video_file/uri>";
+    msg << "Usage: " << argv[0] << " <video_file/uri> [max_concurrent_downloads] [--variants [--abr-trace <file>]] [--record <archive>] [--history <segments>] [--no-frame-analysis] [--startup-buffer <ms>] [--rebuffer <ms>] [--demux-only [--spot-check <every_n_segments>]]\n"
+        << "       " << argv[0] << " --streams <uri_list_file> [max_concurrent_downloads] [--no-frame-analysis] [--startup-buffer <ms>] [--rebuffer <ms>] [--demux-only [--spot-check <every_n_segments>]]\n"
+        << "       " << argv[0] << " --replay <archive> [max_concurrent_downloads] [--replay-speed <factor, 0 = as fast as possible>] [--history <segments>] [--no-frame-analysis] [--demux-only [--spot-check <every_n_segments>]]\n"
+        << "       " << argv[0] << " --origin <port> [--origin-streams <n>] [--origin-list <uri_list_file>] [--origin-threads <n>] [--segment-duration <s>] [--fault-rate <0-1>] [--publish-jitter <ms>] [--response-delay <ms>] [--throughput <kbps per connection>]\n"
+        << "       " << argv[0] << " --inject-sei <input, - for stdin> --inject-output <output, - for stdout> [--inject-format <muxer, e.g. flv>] [--realtime]\n"
+        << "       " << argv[0] << " --abr-replay <trace_file> [--abr-replay <trace_file> ...] [--startup-buffer <ms>] [--rebuffer <ms>]";
     Logger::getInstance().log(msg, Logger::Severity::INFO, MAIN_TAG);
     return -1;
   }
   av_log_set_level(AV_LOG_QUIET);
   Logger::getInstance().setLogFile("playback.log");
   // Logger::getInstance().setLogLevel(Logger::Severity::DEBUG);
-  const char *uri = argv[1];
+  size_t max_concurrent_downloads = DEFAULT_DOWNLOAD_WORKERS;
+  size_t workers_arg = stream_list.empty() && replay_path.empty() ? 1 : 0;
+  if (positional.size() > workers_arg && (!parse_number(positional[workers_arg], max_concurrent_downloads) || max_concurrent_downloads == 0))
+  {
+    Logger::getInstance().log("ERROR: invalid max_concurrent_downloads: " + positional[workers_arg], Logger::Severity::ERROR, MAIN_TAG);
+    return -1;
+  }
+  if (decoder_options.mode == DecodeMode::DEMUX_ONLY)
+  {
+    Logger::getInstance().log("Demux-only mode, full decode every " + std::to_string(decoder_options.spot_check_interval) + " segment(s) (0 = never)", Logger::Severity::INFO, MAIN_TAG);
+  }
+  if (origin)
+  {
+    try
+    {
+      return run_synthetic_origin(origin_options, origin_list);
+    }
+    catch (std::exception &e)
+    {
+      Logger::getInstance().log("ERROR: " + std::string(e.what()), Logger::Severity::ERROR, MAIN_TAG);
+      return -1;
+    }
+  }
+  if (!replay_path.empty())
+  {
+    try
+    {
+      return run_archive_replay(replay_path, replay_speed, max_concurrent_downloads, decoder_options, player_options, history_size);
+    }
+    catch (std::exception &e)
+    {
+      Logger::getInstance().log("ERROR: " + std::string(e.what()), Logger::Severity::ERROR, MAIN_TAG);
+      return -1;
+    }
+  }
+  if (!stream_list.empty())
+  {
+    try
+    {
+      return run_multi_stream(read_stream_list(stream_list), max_concurrent_downloads, decoder_options, player_options);
+    }
+    catch (std::exception &e)
+    {
+      Logger::getInstance().log("ERROR: " + std::string(e.what()), Logger::Severity::ERROR, MAIN_TAG);
+      return -1;
+    }
+  }
+  const std::string uri = positional[0];
+  if (variants)
+  {
+    try
+    {
+      return run_variants(uri, max_concurrent_downloads, decoder_options, player_options, abr_trace_path);
+    }
+    catch (std::exception &e)
+    {
+      Logger::getInstance().log("ERROR: " + std::string(e.what()), Logger::Severity::ERROR, MAIN_TAG);
+      return -1;
+    }
+  }
+
+  HLSManifestParser parser(uri, 3, max_concurrent_downloads, decoder_options, history_size);
+  parser.setPlayerBufferOptions(player_options);
+  parser.setAnomalyListener(log_anomaly);
+  if (!record_path.empty())
+  {
+    try
+    {
+      parser.setRecorder(std::make_shared<ArchiveWriter>(record_path));
+    }
+    catch (std::exception &e)
+    {
+      Logger::getInstance().log("ERROR: " + std::string(e.what()), Logger::Severity::ERROR, MAIN_TAG);
+      return -1;
+    }
+    Logger::getInstance().log("Recording to " + record_path, Logger::Severity::INFO, MAIN_TAG);
+  }
+  long last_buffer_sample = 0;
 
-  HLSManifestParser parser(uri);
+  auto subscription = std::make_shared<SegmentSubscription>(SUBSCRIPTION_CAPACITY);
+  parser.subscribe(subscription);
 
   // Decode frames
   Logger::getInstance().log("Decoding stream.", Logger::Severity::INFO, HLS_TAG);
@@ -79,14 +741,14 @@ int main(int argc, char *argv[])
   {
     while (true)
     {
-      std::this_thread::sleep_for(std::chrono::seconds(3));
-      Logger::getInstance().log("Received segments:", Logger::Severity::INFO, HLS_TAG);
-      for(std::shared_ptr<HLSSegment> segment : parser.getSegments())
+      // Report as soon as a segment finishes
+      std::shared_ptr<const SegmentSnapshot> snapshot = subscription->next(REPORT_INTERVAL);
+      if (snapshot)
       {
-        if (segment->getStatus() == SegmentStatus::DOWNLOADED && !segment->isPrinted()) {
-          segment->print("  ");
-          check_non_increasing_pts(segment->getPtsList());
-          check_pts_gaps(segment->getPtsList(), segment->getAveragePtsDiff() * 3);
+        Logger::getInstance().log("Received segment:", Logger::Severity::INFO, HLS_TAG);
+        if (check_segment(*snapshot))
+        {
+          snapshot->print("  ");
         }
       }
       long runtime = parser.getTotalRunningTime();
@@ -99,12 +761,45 @@ int main(int argc, char *argv[])
         Logger::getInstance().log(msg, Logger::Severity::INFO, HLS_TAG);
         continue;
       } 
+      if (!snapshot) {
+        Logger::getInstance().log("No segment finished in the last " + std::to_string(REPORT_INTERVAL.count()) + "s", Logger::Severity::WARNING, HLS_TAG);
+      }
       msg << "Latency check:\n"
           << " Runtime: " << runtime << "ms\n" 
           << " total buffered(decoded time): " << decode_time << "ms\n"
           << " total declared time(from manifest): " << declared_time << "ms\n"
-          << " real to dec time diff: " << (decode_time - runtime);
+          << " real to dec time diff: " << (decode_time - runtime) << "\n"
+          << " download queue depth: " << parser.getDownloadQueueDepth()
+          << ", active downloads: " << parser.getActiveDownloads()
+          << ", dropped: " << parser.getDroppedDownloads() << "\n"
+          << " codec contexts opened: " << parser.getCodecOpens()
+          << ", reused: " << parser.getCodecReuses() << "\n"
+          << " packets/frames allocated: " << parser.getAVAllocations()
+          << ", allocations avoided: " << parser.getAVReuses() << "\n"
+          << " segment buffers allocated: " << parser.getBufferAllocations()
+          << ", recycled: " << parser.getBufferReuses() << "\n"
+          << " http connections reused: " << parser.getReusedConnections()
+          << ", opened: " << parser.getNewConnections() << "\n"
+          << " segment publication cadence: " << parser.getPublicationCadence() << "ms\n"
+          << " segment discovery delay: " << parser.getSegmentDiscoveryDelay().toString("ms") << "\n"
+          << " " << format_anomalies(parser.getContinuityReport()) << "\n"
+          << " " << format_latency(parser.getGlassToGlassLatency()) << "\n";
+      PlayerBufferReport player = parser.getPlayerBuffer();
+      msg << " virtual " << format_player_buffer(player) << "\n"
+          << " buffer level (utc ms: ms):";
+      // Only the samples added since the last report
+      for (const BufferSample &sample : player.series)
+      {
+        if (sample.time > last_buffer_sample)
+        {
+          msg << " " << sample.time << ": " << sample.level;
+          last_buffer_sample = sample.time;
+        }
+      }
       Logger::getInstance().log(msg, Logger::Severity::INFO, HLS_TAG);
+      if (player.state == PlayerState::STALLED) {
+        Logger::getInstance().log("Virtual player is stalled, total stall time: " + std::to_string(player.stall_time) + "ms", Logger::Severity::ERROR, HLS_TAG);
+      }
       if (runtime > decode_time) {
         Logger::getInstance().log("Missing playback time: " + std::to_string(decode_time - runtime), Logger::Severity::ERROR, HLS_TAG);
       }
@@ -0,0 +1,420 @@
+#include "multi_stream.hpp"
+#include "constants.hpp"
+#include "logger.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+
+using namespace playback;
+
+constexpr const char *MS_TAG = "MultiStreamMonitor";
+
+// Longest the event loop sleeps without checking the refresh queue
+constexpr long MAX_POLL_INTERVAL_MS = 1000;
+// Decode queue entries reserved per stream, a stream rarely has more than two segments in flight
+constexpr size_t DECODE_QUEUE_PER_STREAM = 2;
+
+MultiStreamMonitor::MultiStreamMonitor(const std::vector<std::string> &uris, size_t max_concurrent_decodes,
+                                       DecoderOptions decoder_options, size_t max_connections)
+{
+    if (uris.empty())
+    {
+        throw std::invalid_argument("No streams to monitor.");
+    }
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    multi = curl_multi_init();
+    if (!multi)
+    {
+        throw std::runtime_error("Failed to initialize CURL multi handle");
+    }
+    curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, static_cast<long>(max_connections));
+    curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, static_cast<long>(max_connections));
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, static_cast<long>(CURLPIPE_MULTIPLEX));
+
+    size_t max_pending = std::max(DEFAULT_DOWNLOAD_QUEUE_SIZE, uris.size() * DECODE_QUEUE_PER_STREAM);
+    decodePool = std::make_shared<SegmentDownloadPool>(max_concurrent_decodes, max_pending, decoder_options);
+    for (size_t i = 0; i < uris.size(); i++)
+    {
+        auto parser = std::make_unique<HLSManifestParser>(uris[i], decodePool);
+        // Called from parser->onPlaylist(), which runs on the event loop thread
+        parser->setSegmentFetcher([this, i](const std::shared_ptr<HLSSegment> &segment, const std::string &part_uri)
+                                  {
+                                      auto transfer = std::make_unique<Transfer>();
+                                      transfer->stream = i;
+                                      transfer->segment = segment;
+                                      transfer->part_uri = part_uri;
+                                      startTransfer(std::move(transfer), part_uri.empty() ? segment->getUri() : part_uri); });
+        streams.push_back(std::move(parser));
+    }
+}
+
+MultiStreamMonitor::~MultiStreamMonitor()
+{
+    stop();
+    abortTransfers();
+    for (CURL *handle : idleHandles)
+    {
+        curl_easy_cleanup(handle);
+    }
+    idleHandles.clear();
+    curl_multi_cleanup(multi);
+}
+
+void MultiStreamMonitor::start()
+{
+    auto now = Clock::now();
+    for (size_t i = 0; i < streams.size(); i++)
+    {
+        refreshQueue.emplace(now, i);
+    }
+    loopThread = std::thread(&MultiStreamMonitor::run, this);
+}
+
+void MultiStreamMonitor::stop()
+{
+    stopping = true;
+    curl_multi_wakeup(multi);
+    if (loopThread.joinable())
+    {
+        loopThread.join();
+    }
+}
+
+void MultiStreamMonitor::run()
+{
+    Logger::getInstance().log("Monitoring " + std::to_string(streams.size()) + " streams", Logger::Severity::INFO, MS_TAG);
+    while (!stopping)
+    {
+        auto now = Clock::now();
+        while (!refreshQueue.empty() && refreshQueue.top().first <= now)
+        {
+            size_t stream = refreshQueue.top().second;
+            refreshQueue.pop();
+            startRefresh(stream);
+        }
+
+        int running = 0;
+        curl_multi_perform(multi, &running);
+        int remaining = 0;
+        while (CURLMsg *msg = curl_multi_info_read(multi, &remaining))
+        {
+            if (msg->msg == CURLMSG_DONE)
+            {
+                finishTransfer(msg->easy_handle, msg->data.result);
+            }
+        }
+
+        // Sleep until a socket is ready, the next refresh is due or stop() wakes us up
+        auto wake = Clock::now() + std::chrono::milliseconds(MAX_POLL_INTERVAL_MS);
+        if (!refreshQueue.empty())
+        {
+            wake = std::min(wake, refreshQueue.top().first);
+        }
+        long timeout = std::chrono::duration_cast<std::chrono::milliseconds>(wake - Clock::now()).count();
+        curl_multi_poll(multi, nullptr, 0, static_cast<int>(std::max(0L, timeout)), nullptr);
+    }
+}
+
+void MultiStreamMonitor::startRefresh(size_t stream)
+{
+    auto transfer = std::make_unique<Transfer>();
+    transfer->stream = stream;
+    std::string request_uri = streams[stream]->getPlaylistRequestUri();
+    Logger::getInstance().log("Fetching manifest: " + request_uri, Logger::Severity::DEBUG, MS_TAG);
+    startTransfer(std::move(transfer), request_uri);
+}
+
+void MultiStreamMonitor::startTransfer(std::unique_ptr<Transfer> transfer, const std::string &uri)
+{
+    CURL *handle = acquireHandle();
+    curl_easy_setopt(handle, CURLOPT_URL, uri.c_str());
+    if (transfer->segment)
+    {
+        transfer->payload = decodePool->acquireBuffer();
+        // Parts may finish out of order, they are checked once delivered in part order
+        if (transfer->part_uri.empty())
+        {
+            transfer->validator = std::make_unique<TsValidator>(transfer->segment->takeTsValidator());
+        }
+    }
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, onData);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, transfer.get());
+    HttpClient::trackProgress(handle, &transfer->info);
+    if (curl_multi_add_handle(multi, handle) != CURLM_OK)
+    {
+        Logger::getInstance().log("Failed to start transfer: " + uri, Logger::Severity::ERROR, MS_TAG);
+        releaseHandle(handle);
+        failed_transfers++;
+        if (transfer->segment)
+        {
+            transfer->segment->download_failed();
+        }
+        else
+        {
+            scheduleRefresh(transfer->stream, streams[transfer->stream]->onPlaylistError());
+        }
+        return;
+    }
+    if (!transfer->part_uri.empty())
+    {
+        transfer->part_index = partOrders[transfer->segment.get()].started++;
+    }
+    transfers[handle] = std::move(transfer);
+    active_transfers++;
+}
+
+size_t MultiStreamMonitor::onData(char *data, size_t size, size_t nmemb, void *userp)
+{
+    auto *transfer = static_cast<Transfer *>(userp);
+    size_t length = size * nmemb;
+    (transfer->payload ? *transfer->payload : transfer->body).append(data, length);
+    // Checked on the buffer libcurl hands over, before it is copied anywhere else
+    if (transfer->validator)
+    {
+        transfer->validator->feed(reinterpret_cast<const uint8_t *>(data), length);
+    }
+    return length;
+}
+
+void MultiStreamMonitor::finishTransfer(CURL *handle, CURLcode result)
+{
+    auto it = transfers.find(handle);
+    if (it == transfers.end())
+    {
+        return;
+    }
+    std::unique_ptr<Transfer> transfer = std::move(it->second);
+    transfers.erase(it);
+    active_transfers--;
+
+    HttpTransferInfo &info = transfer->info;
+    HttpClient::readTransferInfo(handle, info);
+    long connects = 0;
+    curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects);
+    if (result == CURLE_OK && connects == 0)
+    {
+        reused_connections++;
+    }
+    else if (connects > 0)
+    {
+        new_connections++;
+    }
+    curl_multi_remove_handle(multi, handle);
+    releaseHandle(handle);
+
+    bool ok = result == CURLE_OK && info.response_code < 400;
+    if (!ok)
+    {
+        failed_transfers++;
+        Logger::getInstance().log("Transfer failed, stream: " + streams[transfer->stream]->getUri() + ", error: " +
+                                      (result != CURLE_OK ? std::string(curl_easy_strerror(result)) : "HTTP " + std::to_string(info.response_code)) +
+                                      ", after " + std::to_string(info.total_time / 1000) + " ms (ttfb: " + std::to_string(info.starttransfer_time / 1000) + " ms)",
+                                  Logger::Severity::ERROR, MS_TAG);
+    }
+
+    HLSManifestParser &parser = *streams[transfer->stream];
+    if (transfer->segment)
+    {
+        transfer->ok = ok;
+        if (ok)
+        {
+            parser.onSegmentTransfer(transfer->segment, info);
+            if (transfer->validator)
+            {
+                transfer->segment->putTsValidator(std::move(*transfer->validator));
+            }
+        }
+        if (transfer->part_uri.empty())
+        {
+            deliverSegment(std::move(transfer));
+        }
+        else
+        {
+            deliverParts(std::move(transfer));
+        }
+        return;
+    }
+
+    std::chrono::milliseconds delay;
+    try
+    {
+        delay = ok && transfer->body.length() > 10 ? parser.onPlaylist(transfer->body, get_utc(), info) : parser.onPlaylistError();
+    }
+    catch (const std::exception &ex)
+    {
+        Logger::getInstance().log("Error: " + std::string(ex.what()) + ", stream: " + parser.getUri(), Logger::Severity::ERROR, MS_TAG);
+        delay = parser.onPlaylistError();
+    }
+    scheduleRefresh(transfer->stream, delay);
+}
+
+void MultiStreamMonitor::deliverSegment(std::unique_ptr<Transfer> transfer)
+{
+    if (transfer->ok)
+    {
+        if (!transfer->part_uri.empty())
+        {
+            TsValidator validator = transfer->segment->takeTsValidator();
+            validator.feed(reinterpret_cast<const uint8_t *>(transfer->payload->data()), transfer->payload->size());
+            transfer->segment->putTsValidator(std::move(validator));
+        }
+        // Decoded from memory by the shared pool, submit() never blocks the loop
+        decodePool->submit(transfer->segment, transfer->part_uri, std::move(transfer->payload));
+    }
+    else
+    {
+        transfer->segment->download_failed();
+    }
+}
+
+void MultiStreamMonitor::deliverParts(std::unique_ptr<Transfer> transfer)
+{
+    auto it = partOrders.find(transfer->segment.get());
+    if (it == partOrders.end())
+    {
+        deliverSegment(std::move(transfer));
+        return;
+    }
+    // The pool decodes the parts of a segment in submission order, which has to be part order
+    // or the frame analysis and cadence of the segment see time jump back and forth
+    PartOrder &order = it->second;
+    order.completed[transfer->part_index] = std::move(transfer);
+    while (!order.completed.empty() && order.completed.begin()->first == order.submitted)
+    {
+        deliverSegment(std::move(order.completed.begin()->second));
+        order.completed.erase(order.completed.begin());
+        order.submitted++;
+    }
+    if (order.submitted == order.started)
+    {
+        partOrders.erase(it);
+    }
+}
+
+void MultiStreamMonitor::scheduleRefresh(size_t stream, std::chrono::milliseconds delay)
+{
+    refreshQueue.emplace(Clock::now() + delay, stream);
+}
+
+void MultiStreamMonitor::abortTransfers()
+{
+    for (auto &entry : transfers)
+    {
+        curl_multi_remove_handle(multi, entry.first);
+        curl_easy_cleanup(entry.first);
+        if (entry.second->segment)
+        {
+            entry.second->segment->download_failed();
+        }
+    }
+    transfers.clear();
+    active_transfers = 0;
+    for (auto &entry : partOrders)
+    {
+        for (auto &part : entry.second.completed)
+        {
+            part.second->segment->download_failed();
+        }
+    }
+    partOrders.clear();
+}
+
+CURL *MultiStreamMonitor::acquireHandle()
+{
+    if (!idleHandles.empty())
+    {
+        CURL *handle = idleHandles.back();
+        idleHandles.pop_back();
+        return handle;
+    }
+    CURL *handle = curl_easy_init();
+    if (!handle)
+    {
+        throw std::runtime_error("Failed to initialize CURL");
+    }
+    // Connections are cached by the multi handle, no share needed
+    HttpClient::configureHandle(handle);
+    return handle;
+}
+
+void MultiStreamMonitor::releaseHandle(CURL *handle)
+{
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, nullptr);
+    HttpClient::trackProgress(handle, nullptr);
+    idleHandles.push_back(handle);
+}
+
+size_t MultiStreamMonitor::getStreamCount() const
+{
+    return streams.size();
+}
+
+HLSManifestParser &MultiStreamMonitor::getStream(size_t index)
+{
+    return *streams.at(index);
+}
+
+size_t MultiStreamMonitor::getActiveTransfers() const
+{
+    return active_transfers;
+}
+
+size_t MultiStreamMonitor::getFailedTransfers() const
+{
+    return failed_transfers;
+}
+
+size_t MultiStreamMonitor::getDecodeQueueDepth()
+{
+    return decodePool->getQueueDepth();
+}
+
+size_t MultiStreamMonitor::getActiveDecodes() const
+{
+    return decodePool->getActiveDownloads();
+}
+
+size_t MultiStreamMonitor::getDroppedDecodes() const
+{
+    return decodePool->getDroppedSegments();
+}
+
+size_t MultiStreamMonitor::getCodecOpens() const
+{
+    return decodePool->getCodecOpens();
+}
+
+size_t MultiStreamMonitor::getCodecReuses() const
+{
+    return decodePool->getCodecReuses();
+}
+
+size_t MultiStreamMonitor::getAVAllocations() const
+{
+    return decodePool->getAVAllocations();
+}
+
+size_t MultiStreamMonitor::getAVReuses() const
+{
+    return decodePool->getAVReuses();
+}
+
+size_t MultiStreamMonitor::getBufferAllocations() const
+{
+    return decodePool->getBufferAllocations();
+}
+
+size_t MultiStreamMonitor::getBufferReuses() const
+{
+    return decodePool->getBufferReuses();
+}
+
+size_t MultiStreamMonitor::getReusedConnections() const
+{
+    return reused_connections;
+}
+
+size_t MultiStreamMonitor::getNewConnections() const
+{
+    return new_connections;
+}
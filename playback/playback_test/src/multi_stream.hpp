@@ -0,0 +1,169 @@
+#ifndef MULTI_STREAM_HPP
+#define MULTI_STREAM_HPP
+
+#include "hls_parser.hpp"
+#include "download_pool.hpp"
+#include "http_client.hpp"
+#include "ts_validator.hpp"
+#include "constants.hpp"
+
+#include <curl/curl.h>
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <map>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <chrono>
+
+namespace playback
+{
+
+    /**
+     * @brief Monitors many HLS streams from a single event loop thread.
+     *
+     * Every playlist refresh and every segment (or LL-HLS part) fetch of every stream is a
+     * transfer on one curl_multi handle, so the number of threads does not grow with the number
+     * of streams. Fetched segments are decoded from memory by one download pool shared by all
+     * streams, LL-HLS parts in part order whatever order their transfers finish in. Each stream
+     * keeps its own passive HLSManifestParser, so segment lists, timing and refresh scheduling
+     * stay separate per stream.
+     */
+    class MultiStreamMonitor
+    {
+    public:
+        /**
+         * @brief Constructor for MultiStreamMonitor.
+         *
+         * @param uris Playlist uris of the streams to monitor.
+         * @param max_concurrent_decodes Segments decoded in parallel across all streams.
+         * @param decoder_options How the shared workers decode the segments.
+         * @param max_connections Open HTTP connections across all streams.
+         *
+         * @throws std::runtime_error if the curl multi handle cannot be created.
+         */
+        MultiStreamMonitor(const std::vector<std::string> &uris,
+                           size_t max_concurrent_decodes = DEFAULT_DOWNLOAD_WORKERS,
+                           DecoderOptions decoder_options = DecoderOptions(),
+                           size_t max_connections = DEFAULT_MAX_CONNECTIONS);
+
+        /**
+         * @brief Destructor for MultiStreamMonitor.
+         *
+         * Stops the event loop, transfers in flight are aborted.
+         */
+        ~MultiStreamMonitor();
+
+        // Start the event loop in a separate thread
+        void start();
+
+        // Stop the event loop and wait for it
+        void stop();
+
+        size_t getStreamCount() const;
+
+        // Parser holding the segments and statistics of one stream
+        HLSManifestParser &getStream(size_t index);
+
+        // Number of HTTP transfers in flight
+        size_t getActiveTransfers() const;
+
+        // Number of transfers that failed or returned an HTTP error
+        size_t getFailedTransfers() const;
+
+        // Number of fetched segments waiting for a free decode worker
+        size_t getDecodeQueueDepth();
+
+        // Number of segments currently being decoded
+        size_t getActiveDecodes() const;
+
+        // Number of segments dropped because the decode queue overflowed
+        size_t getDroppedDecodes() const;
+
+        size_t getCodecOpens() const;
+
+        size_t getCodecReuses() const;
+
+        // Packets and frames allocated / recycled by the shared decode workers
+        size_t getAVAllocations() const;
+        size_t getAVReuses() const;
+
+        // Segment download buffers allocated / served recycled
+        size_t getBufferAllocations() const;
+        size_t getBufferReuses() const;
+
+        // Number of transfers that reused a kept-alive connection
+        size_t getReusedConnections() const;
+
+        // Number of transfers that had to open a new connection
+        size_t getNewConnections() const;
+
+        // Disable copy constructor and assignment operator
+        MultiStreamMonitor(const MultiStreamMonitor &) = delete;
+        MultiStreamMonitor &operator=(const MultiStreamMonitor &) = delete;
+
+    private:
+        struct Transfer
+        {
+            size_t stream;                       // Index in `streams`
+            std::shared_ptr<HLSSegment> segment; // Null for a playlist refresh
+            std::string part_uri;                // LL-HLS part of `segment`, empty for the whole segment
+            std::string body;                     // Playlist body
+            std::shared_ptr<std::string> payload; // Segment body, a recycled buffer of the decode pool
+            HttpTransferInfo info; // Filled by the progress callback and when the transfer completes
+            std::unique_ptr<TsValidator> validator; // Whole segments only, fed as the bytes arrive
+            size_t part_index = 0; // Start order among the parts of `segment`
+            bool ok = false;       // Set when the transfer completes
+        };
+        // Parts of one segment finish in any order, they are handed to the decoder in start order
+        struct PartOrder
+        {
+            size_t started = 0;   // Parts started so far
+            size_t submitted = 0; // Parts handed to the decode pool (or failed) so far
+            std::map<size_t, std::unique_ptr<Transfer>> completed; // Finished, waiting for earlier parts
+        };
+        using Clock = std::chrono::steady_clock;
+        using Refresh = std::pair<Clock::time_point, size_t>; // (due time, stream index)
+
+        void run();
+        void startRefresh(size_t stream);
+        void startTransfer(std::unique_ptr<Transfer> transfer, const std::string &uri);
+        // CURLOPT_WRITEFUNCTION of the transfers, userp is the Transfer
+        static size_t onData(char *data, size_t size, size_t nmemb, void *userp);
+        void finishTransfer(CURL *handle, CURLcode result);
+        void scheduleRefresh(size_t stream, std::chrono::milliseconds delay);
+        void abortTransfers();
+        // Submits a finished segment or part for decoding, or fails it
+        void deliverSegment(std::unique_ptr<Transfer> transfer);
+        // Delivers the finished parts of a segment whose earlier parts are all delivered
+        void deliverParts(std::unique_ptr<Transfer> transfer);
+
+        CURL *acquireHandle();
+        void releaseHandle(CURL *handle);
+
+    private:
+        CURLM *multi = nullptr;
+        std::vector<CURL *> idleHandles;
+        // Transfers in flight, owned by the event loop thread
+        std::unordered_map<CURL *, std::unique_ptr<Transfer>> transfers;
+        // Segments with part transfers in flight or waiting to be delivered
+        std::unordered_map<HLSSegment *, PartOrder> partOrders;
+        std::priority_queue<Refresh, std::vector<Refresh>, std::greater<Refresh>> refreshQueue;
+
+        std::thread loopThread;
+        std::atomic<bool> stopping{false};
+        std::atomic<size_t> active_transfers{0};
+        std::atomic<size_t> failed_transfers{0};
+        std::atomic<size_t> reused_connections{0};
+        std::atomic<size_t> new_connections{0};
+
+        std::shared_ptr<SegmentDownloadPool> decodePool;
+        std::vector<std::unique_ptr<HLSManifestParser>> streams;
+    };
+
+} // namespace playback
+
+#endif // MULTI_STREAM_HPP
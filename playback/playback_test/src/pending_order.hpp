@@ -0,0 +1,102 @@
+#ifndef PENDING_ORDER_HPP
+#define PENDING_ORDER_HPP
+
+#include "constants.hpp"
+
+#include <map>
+#include <utility>
+
+namespace playback
+{
+
+    /**
+     * @brief Puts segments that finish out of order back in media sequence order.
+     *
+     * A listed segment holds back every later one until it finishes. A segment that never
+     * does (abandoned, lost to a stop) would block the rest of the stream and let the map
+     * grow without bound, so a head older than `timeout` ms is given up on, as is the oldest
+     * entry whenever more than `max_size` are waiting. Given up entries are released as failed
+     * and a late finish for them is ignored.
+     *
+     * Not thread safe, the owner serializes the calls.
+     */
+    template <typename T>
+    class PendingOrder
+    {
+    public:
+        PendingOrder(long timeout = DEFAULT_PENDING_SEGMENT_TIMEOUT_MS, size_t max_size = DEFAULT_MAX_PENDING_SEGMENTS)
+            : timeout(timeout), max_size(max_size)
+        {
+        }
+
+        // Applies from the next pop()
+        void setLimits(long timeout, size_t max_size)
+        {
+            this->timeout = timeout;
+            this->max_size = max_size;
+        }
+
+        // A segment was listed at `now` (UTC ms), listing it again keeps the first time
+        void add(long sequence_number, long now)
+        {
+            entries.emplace(sequence_number, Entry{now, false, T()});
+        }
+
+        // The segment finished, false if it is not waiting (never listed or given up)
+        bool finish(long sequence_number, T value)
+        {
+            auto it = entries.find(sequence_number);
+            if (it == entries.end() || it->second.finished)
+            {
+                return false;
+            }
+            it->second.finished = true;
+            it->second.value = std::move(value);
+            return true;
+        }
+
+        /**
+         * @brief Releases the next entry in sequence order, if it may go as of `now`.
+         *
+         * @param finished Set to false when the entry was given up on, `value` is then T().
+         * @return false while the head is still within its timeout.
+         */
+        bool pop(long now, long &sequence_number, bool &finished, T &value)
+        {
+            if (entries.empty())
+            {
+                return false;
+            }
+            auto head = entries.begin();
+            if (!head->second.finished && now - head->second.listed_at < timeout && entries.size() <= max_size)
+            {
+                return false;
+            }
+            sequence_number = head->first;
+            finished = head->second.finished;
+            value = std::move(head->second.value);
+            entries.erase(head);
+            return true;
+        }
+
+        size_t size() const
+        {
+            return entries.size();
+        }
+
+    private:
+        struct Entry
+        {
+            long listed_at;
+            bool finished;
+            T value;
+        };
+
+        long timeout;
+        size_t max_size;
+        std::map<long, Entry> entries;
+    };
+
+} // namespace playback
+
+#endif // PENDING_ORDER_HPP
@@ -0,0 +1,177 @@
+#include "player_buffer.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace playback;
+
+const char *playback::playerStateToString(PlayerState state)
+{
+    switch (state)
+    {
+    case PlayerState::STARTUP:
+        return "STARTUP";
+    case PlayerState::PLAYING:
+        return "PLAYING";
+    case PlayerState::STALLED:
+        return "STALLED";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+PlayerBufferModel::PlayerBufferModel(PlayerBufferOptions options)
+    : options(options), pending(options.pending_timeout, options.max_pending)
+{
+}
+
+void PlayerBufferModel::setOptions(const PlayerBufferOptions &options)
+{
+    std::lock_guard<std::mutex> lock(dataMutex);
+    this->options = options;
+    pending.setLimits(options.pending_timeout, options.max_pending);
+    while (series.size() > options.max_samples)
+    {
+        series.pop_front();
+    }
+}
+
+void PlayerBufferModel::onSegmentAdded(long sequence_number)
+{
+    std::lock_guard<std::mutex> lock(dataMutex);
+    if (session_start < 0)
+    {
+        session_start = get_utc();
+        clock = session_start;
+    }
+    long now = get_utc();
+    pending.add(sequence_number, now);
+    release(std::max(now, clock));
+}
+
+void PlayerBufferModel::onSegmentFinished(const SegmentSnapshot &segment)
+{
+    std::lock_guard<std::mutex> lock(dataMutex);
+    bool downloaded = segment.status == SegmentStatus::DOWNLOADED;
+    if (!pending.finish(segment.sequence_number, downloaded ? mediaDuration(segment) : 0))
+    {
+        return;
+    }
+    if (!downloaded)
+    {
+        skipped++;
+    }
+    // Callbacks run on different workers, never move the clock backwards
+    release(std::max(segment.completed_at, clock));
+}
+
+PlayerBufferReport PlayerBufferModel::getReport(long now)
+{
+    std::lock_guard<std::mutex> lock(dataMutex);
+    if (clock >= 0)
+    {
+        release(std::max(now, clock));
+    }
+    advance(now);
+
+    PlayerBufferReport report;
+    report.state = state;
+    report.startup_delay = startup_delay;
+    report.stalls = stalls;
+    report.stall_time = stall_time;
+    report.longest_stall = longest_stall;
+    if (state == PlayerState::STALLED)
+    {
+        long ongoing = clock - stall_start;
+        report.stall_time += ongoing;
+        report.longest_stall = std::max(longest_stall, ongoing);
+    }
+    report.buffer_level = level;
+    report.played = played;
+    report.skipped = skipped;
+    report.series.assign(series.begin(), series.end());
+    return report;
+}
+
+long PlayerBufferModel::mediaDuration(const SegmentSnapshot &segment)
+{
+    // The pts span misses the duration of the last frame
+    if (segment.num_frames > 1 && segment.decode_duration > 0)
+    {
+        return segment.decode_duration + std::lround(segment.pts_average_diff);
+    }
+    return std::lround(segment.declared_duration * 1000);
+}
+
+void PlayerBufferModel::advance(long time)
+{
+    if (clock < 0 || time <= clock)
+    {
+        return;
+    }
+    if (state == PlayerState::PLAYING)
+    {
+        long elapsed = time - clock;
+        if (level >= elapsed)
+        {
+            level -= elapsed;
+            played += elapsed;
+        }
+        else
+        {
+            played += level;
+            stall_start = clock + level;
+            level = 0;
+            state = PlayerState::STALLED;
+            stalls++;
+            addSample(stall_start);
+        }
+    }
+    clock = time;
+}
+
+void PlayerBufferModel::release(long time)
+{
+    advance(time);
+    // Segments finished ahead of an earlier one wait for it, like in a player
+    long sequence_number;
+    bool finished;
+    long media;
+    while (pending.pop(time, sequence_number, finished, media))
+    {
+        if (!finished)
+        {
+            skipped++;
+        }
+        append(time, media);
+    }
+}
+
+void PlayerBufferModel::append(long time, long media)
+{
+    advance(time);
+    level += media;
+    if (state == PlayerState::STARTUP && level >= options.startup_buffer)
+    {
+        state = PlayerState::PLAYING;
+        startup_delay = time - session_start;
+    }
+    else if (state == PlayerState::STALLED && level >= options.rebuffer_threshold)
+    {
+        long duration = time - stall_start;
+        stall_time += duration;
+        longest_stall = std::max(longest_stall, duration);
+        stall_start = -1;
+        state = PlayerState::PLAYING;
+    }
+    addSample(time);
+}
+
+void PlayerBufferModel::addSample(long time)
+{
+    series.push_back({time, level});
+    while (series.size() > options.max_samples)
+    {
+        series.pop_front();
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef PLAYER_BUFFER_HPP
+#define PLAYER_BUFFER_HPP
+
+#include "hls_segment.hpp"
+#include "constants.hpp"
+#include "pending_order.hpp"
+
+#include <deque>
+#include <vector>
+#include <mutex>
+
+namespace playback
+{
+
+    struct PlayerBufferOptions
+    {
+        long startup_buffer = DEFAULT_STARTUP_BUFFER_MS;         // Media buffered before playback starts, ms
+        long rebuffer_threshold = DEFAULT_REBUFFER_THRESHOLD_MS; // Media buffered before a stall ends, ms
+        size_t max_samples = DEFAULT_BUFFER_SERIES_SIZE;         // Buffer level samples retained
+        long pending_timeout = DEFAULT_PENDING_SEGMENT_TIMEOUT_MS; // Unfinished segment skipped after, ms
+        size_t max_pending = DEFAULT_MAX_PENDING_SEGMENTS;         // Segments waiting for an earlier one
+    };
+
+    enum class PlayerState
+    {
+        STARTUP, // Filling the startup buffer
+        PLAYING,
+        STALLED // Buffer ran dry, refilling up to the rebuffer threshold
+    };
+
+    const char *playerStateToString(PlayerState state);
+
+    // Buffer level at a point in time
+    struct BufferSample
+    {
+        long time = 0;  // UTC ms
+        long level = 0; // ms of media
+    };
+
+    struct PlayerBufferReport
+    {
+        PlayerState state = PlayerState::STARTUP;
+        long startup_delay = -1; // First segment listed until playback started, -1 while starting, ms
+        size_t stalls = 0;       // Rebuffering events after startup, including an ongoing one
+        long stall_time = 0;     // Total time spent rebuffering, ms
+        long longest_stall = 0;  // ms
+        long buffer_level = 0;   // ms of media
+        long played = 0;         // Media played, ms
+        long skipped = 0;        // Segments that failed or never finished and were skipped over
+        std::vector<BufferSample> series; // Oldest first
+    };
+
+    /**
+     * @brief Simulates the buffer of a player consuming the stream in real time.
+     *
+     * Segments enter the buffer in media sequence order, at the wall clock time they finished,
+     * with their decoded media duration. Playback starts once `startup_buffer` ms are buffered,
+     * drains the buffer in real time, stalls when it runs dry and resumes once
+     * `rebuffer_threshold` ms are buffered again. A failed segment is skipped over without
+     * adding media, the way a player would after a 404, and so is one that has not finished
+     * `pending_timeout` ms after it was listed.
+     *
+     * Updated incrementally from the segment completion callbacks, so a report costs the same
+     * no matter how long the stream has been running and memory is bounded by `max_samples`.
+     */
+    class PlayerBufferModel
+    {
+    public:
+        explicit PlayerBufferModel(PlayerBufferOptions options = PlayerBufferOptions());
+
+        // Thresholds apply from the next state change, the series is trimmed to the new size
+        void setOptions(const PlayerBufferOptions &options);
+
+        // A segment was listed, the player will need it before any later one
+        void onSegmentAdded(long sequence_number);
+
+        // A segment finished downloading or failed, called once per segment
+        void onSegmentFinished(const SegmentSnapshot &segment);
+
+        // State as of `now` (UTC ms), an ongoing stall is included in the totals
+        PlayerBufferReport getReport(long now = get_utc());
+
+    private:
+        // Media time a finished segment adds to the buffer, ms
+        static long mediaDuration(const SegmentSnapshot &segment);
+        // Plays the buffer up to `time`
+        void advance(long time);
+        // Moves the segments that may go as of `time` into the buffer, in sequence order
+        void release(long time);
+        void append(long time, long media);
+        void addSample(long time);
+
+    private:
+        std::mutex dataMutex;
+        PlayerBufferOptions options;
+        // Listed segments not yet in the buffer: sequence -> media ms once finished
+        PendingOrder<long> pending;
+        std::deque<BufferSample> series;
+
+        PlayerState state = PlayerState::STARTUP;
+        long session_start = -1; // UTC ms when the first segment was listed
+        long clock = -1;         // UTC ms the model has been played to
+        long level = 0;
+        long played = 0;
+        long startup_delay = -1;
+        size_t stalls = 0;
+        long stall_time = 0;
+        long longest_stall = 0;
+        long stall_start = -1;
+        long skipped = 0;
+    };
+
+} // namespace playback
+
+#endif // PLAYER_BUFFER_HPP
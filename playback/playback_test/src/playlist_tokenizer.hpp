@@ -0,0 +1,195 @@
+#ifndef PLAYLIST_TOKENIZER_HPP
+#define PLAYLIST_TOKENIZER_HPP
+
+#include <string_view>
+#include <cstdlib>
+#include <cstring>
+#include <charconv>
+#include <algorithm>
+
+namespace playback
+{
+
+    /**
+     * @brief Strips leading and trailing whitespace without copying.
+     */
+    inline std::string_view trim_view(std::string_view str)
+    {
+        const char *whitespace = " \t\r\n";
+        size_t start = str.find_first_not_of(whitespace);
+        if (start == std::string_view::npos)
+        {
+            return std::string_view();
+        }
+        size_t end = str.find_last_not_of(whitespace);
+        return str.substr(start, end - start + 1);
+    }
+
+    inline bool starts_with(std::string_view str, std::string_view prefix)
+    {
+        return str.size() >= prefix.size() && str.compare(0, prefix.size(), prefix) == 0;
+    }
+
+    /**
+     * @brief Parses a leading integer, returns false if there is none.
+     */
+    inline bool parse_long(std::string_view str, long &out)
+    {
+        str = trim_view(str);
+        auto result = std::from_chars(str.data(), str.data() + str.size(), out);
+        return result.ec == std::errc();
+    }
+
+    /**
+     * @brief Parses a leading decimal number, returns false if there is none.
+     *
+     * Copies at most 63 characters to a stack buffer because strtod needs a terminated string.
+     */
+    inline bool parse_double(std::string_view str, double &out)
+    {
+        char buffer[64];
+        str = trim_view(str);
+        size_t length = std::min(str.size(), sizeof(buffer) - 1);
+        std::memcpy(buffer, str.data(), length);
+        buffer[length] = '\0';
+        char *end = nullptr;
+        out = std::strtod(buffer, &end);
+        return end != buffer;
+    }
+
+    /**
+     * @brief Extracts the number from a '<name>-<number>.ts' segment uri.
+     *
+     * @return The number, or -1 if the uri does not follow the pattern.
+     */
+    inline long parse_uri_sequence_number(std::string_view uri)
+    {
+        auto query = uri.find_first_of("?#");
+        if (query != std::string_view::npos)
+        {
+            uri = uri.substr(0, query);
+        }
+        if (uri.size() < 3 || uri.substr(uri.size() - 3) != ".ts")
+        {
+            return -1;
+        }
+        uri.remove_suffix(3);
+        size_t dash = uri.find_last_of('-');
+        if (dash == std::string_view::npos || dash + 1 == uri.size())
+        {
+            return -1;
+        }
+        long number = -1;
+        auto digits = uri.substr(dash + 1);
+        auto result = std::from_chars(digits.data(), digits.data() + digits.size(), number);
+        if (result.ec != std::errc() || result.ptr != digits.data() + digits.size())
+        {
+            return -1;
+        }
+        return number;
+    }
+
+    /**
+     * @brief Iterates over KEY=VALUE pairs of an HLS attribute list.
+     *
+     * Quoted values may contain commas, the quotes are stripped from the returned value.
+     */
+    class AttributeList
+    {
+    public:
+        explicit AttributeList(std::string_view attributes) : remaining(attributes) {}
+
+        bool next(std::string_view &key, std::string_view &value)
+        {
+            while (!remaining.empty())
+            {
+                size_t eq = remaining.find('=');
+                if (eq == std::string_view::npos)
+                {
+                    remaining = std::string_view();
+                    return false;
+                }
+                key = trim_view(remaining.substr(0, eq));
+                remaining.remove_prefix(eq + 1);
+
+                size_t end;
+                if (!remaining.empty() && remaining.front() == '"')
+                {
+                    size_t close = remaining.find('"', 1);
+                    close = close == std::string_view::npos ? remaining.size() : close;
+                    value = remaining.substr(1, close - 1);
+                    end = remaining.find(',', close);
+                }
+                else
+                {
+                    end = remaining.find(',');
+                    value = trim_view(remaining.substr(0, end));
+                }
+                remaining = end == std::string_view::npos ? std::string_view() : remaining.substr(end + 1);
+                if (!key.empty())
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        std::string_view remaining;
+    };
+
+    /**
+     * @brief Single pass, allocation free tokenizer over an m3u8 buffer.
+     *
+     * Each non empty line is returned either as a tag ("#EXTINF" with value "6.000,")
+     * or as a uri line. All views point into the buffer passed to the constructor,
+     * which has to outlive the tokenizer.
+     */
+    class PlaylistTokenizer
+    {
+    public:
+        struct Line
+        {
+            std::string_view tag;   // Tag name including '#', empty for uri lines
+            std::string_view value; // Text after ':' for tags, the uri itself for uri lines
+            bool isUri() const { return tag.empty(); }
+        };
+
+        explicit PlaylistTokenizer(std::string_view buffer) : remaining(buffer) {}
+
+        bool next(Line &line)
+        {
+            while (!remaining.empty())
+            {
+                size_t eol = remaining.find('\n');
+                std::string_view raw = remaining.substr(0, eol);
+                remaining = eol == std::string_view::npos ? std::string_view() : remaining.substr(eol + 1);
+
+                std::string_view text = trim_view(raw);
+                if (text.empty())
+                {
+                    continue;
+                }
+                if (text.front() == '#')
+                {
+                    size_t colon = text.find(':');
+                    line.tag = text.substr(0, colon);
+                    line.value = colon == std::string_view::npos ? std::string_view() : text.substr(colon + 1);
+                }
+                else
+                {
+                    line.tag = std::string_view();
+                    line.value = text;
+                }
+                return true;
+            }
+            return false;
+        }
+
+    private:
+        std::string_view remaining;
+    };
+
+} // namespace playback
+
+#endif // PLAYLIST_TOKENIZER_HPP
@@ -0,0 +1,179 @@
+#ifndef PTS_SEQUENCE_HPP
+#define PTS_SEQUENCE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+namespace playback
+{
+
+    /**
+     * @brief Append-only list of frame timestamps, delta encoded.
+     *
+     * Keeps the first timestamp and, for each following frame, the change of the PTS delta
+     * (delta of deltas) as a zigzag varint. Constant frame rate video alternates between
+     * deltas like 33/34 ms, which makes every frame after the first take one byte instead
+     * of sizeof(long). Values are decoded in order by the iterator, there is no random access.
+     */
+    class PtsSequence
+    {
+    public:
+        class Iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = long;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const long *;
+            using reference = const long &;
+
+            Iterator() = default;
+
+            reference operator*() const
+            {
+                return value;
+            }
+            pointer operator->() const
+            {
+                return &value;
+            }
+            Iterator &operator++()
+            {
+                if (++index < count)
+                {
+                    delta += unzigzag(readVarint(position));
+                    value += delta;
+                }
+                return *this;
+            }
+            Iterator operator++(int)
+            {
+                Iterator previous = *this;
+                ++*this;
+                return previous;
+            }
+            bool operator==(const Iterator &other) const
+            {
+                return index == other.index;
+            }
+            bool operator!=(const Iterator &other) const
+            {
+                return index != other.index;
+            }
+
+        private:
+            friend class PtsSequence;
+            Iterator(const uint8_t *position, long value, size_t index, size_t count)
+                : position(position), value(value), index(index), count(count)
+            {
+            }
+
+            const uint8_t *position = nullptr;
+            long value = 0;
+            long delta = 0;
+            size_t index = 0;
+            size_t count = 0;
+        };
+
+        void push_back(long pts)
+        {
+            if (count > 0)
+            {
+                long delta = pts - last;
+                writeVarint(zigzag(delta - last_delta));
+                last_delta = delta;
+            }
+            else
+            {
+                first = pts;
+            }
+            last = pts;
+            count++;
+        }
+
+        Iterator begin() const
+        {
+            return Iterator(encoded.data(), first, 0, count);
+        }
+        Iterator end() const
+        {
+            return Iterator(nullptr, 0, count, count);
+        }
+
+        bool empty() const
+        {
+            return count == 0;
+        }
+        size_t size() const
+        {
+            return count;
+        }
+        // Only valid when not empty, like std::vector
+        long front() const
+        {
+            return first;
+        }
+        long back() const
+        {
+            return last;
+        }
+        // Bytes used by the deltas
+        size_t getEncodedSize() const
+        {
+            return encoded.size();
+        }
+        std::vector<long> toVector() const
+        {
+            return std::vector<long>(begin(), end());
+        }
+
+    private:
+        static uint64_t zigzag(long value)
+        {
+            int64_t v = static_cast<int64_t>(value);
+            return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+        }
+        static long unzigzag(uint64_t value)
+        {
+            return static_cast<long>(static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1));
+        }
+        void writeVarint(uint64_t value)
+        {
+            while (value >= 0x80)
+            {
+                encoded.push_back(static_cast<uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+            encoded.push_back(static_cast<uint8_t>(value));
+        }
+        static uint64_t readVarint(const uint8_t *&position)
+        {
+            uint64_t value = 0;
+            for (int shift = 0;; shift += 7)
+            {
+                uint8_t byte = *position++;
+                value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                if (!(byte & 0x80))
+                {
+                    return value;
+                }
+            }
+        }
+
+    private:
+        std::vector<uint8_t> encoded;
+        long first = 0;
+        long last = 0;
+        long last_delta = 0;
+        size_t count = 0;
+    };
+
+    // Read-only view of the timestamps of a segment, shared with the segment instead of copied
+    using PtsView = std::shared_ptr<const PtsSequence>;
+
+} // namespace playback
+
+#endif // PTS_SEQUENCE_HPP
@@ -0,0 +1,114 @@
+#include "refresh_scheduler.hpp"
+
+#include <algorithm>
+
+using namespace playback;
+
+// Smoothing factor of the publication cadence EWMA
+constexpr double CADENCE_ALPHA = 0.2;
+// Shortest delay between two refreshes
+constexpr long MIN_REFRESH_DELAY_MS = 100;
+// Wake up this long after the predicted publication (at least), to not arrive just before it
+constexpr long MIN_WAKEUP_MARGIN_MS = 50;
+constexpr double WAKEUP_MARGIN_RATIO = 0.05;
+// First retry after a stale refresh, as a fraction of the cadence, doubled on every further miss
+constexpr double STALE_RETRY_RATIO = 0.03;
+// Delay used before the target duration is known
+constexpr long DEFAULT_REFRESH_DELAY_MS = 1000;
+
+RefreshScheduler::RefreshScheduler()
+    : discovery_delay({50, 100, 200, 300, 500, 750, 1000, 1500, 2000, 3000, 5000})
+{
+}
+
+void RefreshScheduler::setTargetDuration(double seconds)
+{
+    target_duration_ms = seconds * 1000;
+}
+
+void RefreshScheduler::onPlaylist(long sequence, long fetch_time, long last_modified)
+{
+    if (last_sequence < 0)
+    {
+        // First refresh, nothing to learn from yet
+        last_sequence = sequence;
+        last_published = last_modified > 0 ? std::min(last_modified, fetch_time) : fetch_time;
+        last_fetch = fetch_time;
+        return;
+    }
+
+    if (sequence > last_sequence)
+    {
+        long advanced = sequence - last_sequence;
+        // Publication time of the newest segment, it was not there at the previous refresh.
+        // After stale retries the window is short and its midpoint is used, after a single
+        // predicted wake up the prediction itself is the best guess inside the window.
+        long published = last_fetch + (fetch_time - last_fetch) / 2;
+        if (last_modified > 0)
+        {
+            published = std::clamp(last_modified, last_fetch, fetch_time);
+        }
+        else if (stale_refreshes == 0 && cadence_ms > 0)
+        {
+            long predicted = last_published + static_cast<long>(advanced * cadence_ms);
+            published = std::clamp(predicted, last_fetch, fetch_time);
+        }
+
+        double sample = (double)(published - last_published) / advanced;
+        if (sample > 0)
+        {
+            cadence_ms = cadence_ms == 0 ? sample : (1 - CADENCE_ALPHA) * cadence_ms + CADENCE_ALPHA * sample;
+        }
+
+        // Older segments of the same batch were published one cadence apart
+        for (long i = 0; i < advanced; i++)
+        {
+            long segment_published = std::max(last_fetch, published - static_cast<long>(i * cadence_ms));
+            discovery_delay.record(std::max(0L, fetch_time - segment_published));
+        }
+
+        last_sequence = sequence;
+        last_published = published;
+        stale_refreshes = 0;
+    }
+    else
+    {
+        stale_refreshes++;
+    }
+    last_fetch = fetch_time;
+}
+
+std::chrono::milliseconds RefreshScheduler::nextDelay(long now) const
+{
+    double cadence = cadence_ms > 0 ? cadence_ms : target_duration_ms;
+    if (cadence <= 0 || last_published < 0)
+    {
+        return std::chrono::milliseconds(DEFAULT_REFRESH_DELAY_MS);
+    }
+
+    long delay;
+    if (stale_refreshes == 0)
+    {
+        long margin = std::max(MIN_WAKEUP_MARGIN_MS, static_cast<long>(cadence * WAKEUP_MARGIN_RATIO));
+        delay = last_published + static_cast<long>(cadence) + margin - now;
+    }
+    else
+    {
+        // Segment is late, retry with exponential backoff
+        long base = std::max(MIN_REFRESH_DELAY_MS, static_cast<long>(cadence * STALE_RETRY_RATIO));
+        long cap = static_cast<long>(target_duration_ms > 0 ? target_duration_ms : cadence);
+        int shift = std::min(stale_refreshes - 1, 16);
+        delay = std::min(base << shift, cap);
+    }
+    return std::chrono::milliseconds(std::max(delay, MIN_REFRESH_DELAY_MS));
+}
+
+double RefreshScheduler::getCadence() const
+{
+    return cadence_ms;
+}
+
+const Histogram &RefreshScheduler::getDiscoveryDelay() const
+{
+    return discovery_delay;
+}
@@ -0,0 +1,64 @@
+#ifndef REFRESH_SCHEDULER_HPP
+#define REFRESH_SCHEDULER_HPP
+
+#include "histogram.hpp"
+
+#include <chrono>
+
+namespace playback
+{
+
+    /**
+     * @brief Predicts when the next segment is published and schedules playlist refreshes around it.
+     *
+     * The publication cadence is learned from EXT-X-MEDIA-SEQUENCE advances between refreshes
+     * (EWMA of the interval between publications). The publication time of a new segment is taken
+     * from the playlist Last-Modified header when the origin sends one, otherwise it is assumed
+     * to be halfway between the refresh that missed it and the one that found it.
+     *
+     * After a refresh the scheduler wakes up shortly after the predicted publication of the next
+     * segment. If the playlist is stale (no new segment although one was expected) the retry
+     * delay grows exponentially, capped at the target duration.
+     */
+    class RefreshScheduler
+    {
+    public:
+        RefreshScheduler();
+
+        void setTargetDuration(double seconds);
+
+        /**
+         * @brief Feeds the result of a playlist refresh.
+         *
+         * @param last_sequence Sequence number of the newest complete segment in the playlist.
+         * @param fetch_time UTC time in ms when the playlist was received.
+         * @param last_modified Playlist Last-Modified in UTC ms, -1 if unknown.
+         */
+        void onPlaylist(long last_sequence, long fetch_time, long last_modified = -1);
+
+        /**
+         * @brief Delay until the next refresh should be issued.
+         *
+         * @param now Current UTC time in ms.
+         */
+        std::chrono::milliseconds nextDelay(long now) const;
+
+        // Learned interval between segment publications in ms, 0 before the first advance
+        double getCadence() const;
+
+        // How long each new segment was available on the origin before it was noticed, in ms
+        const Histogram &getDiscoveryDelay() const;
+
+    private:
+        double target_duration_ms = 0;
+        double cadence_ms = 0;
+        long last_sequence = -1;
+        long last_published = -1; // Estimated publication time of the newest segment
+        long last_fetch = -1;
+        int stale_refreshes = 0;
+        Histogram discovery_delay;
+    };
+
+} // namespace playback
+
+#endif // REFRESH_SCHEDULER_HPP
@@ -0,0 +1,351 @@
+#ifndef PLAYBACK_RING_QUEUE_HPP
+#define PLAYBACK_RING_QUEUE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#else
+#include <mutex>
+#include <condition_variable>
+#endif
+
+namespace playback
+{
+
+    /**
+     * @brief Wait/notify on a 32-bit counter, a futex on Linux.
+     *
+     * notify() costs one atomic increment and no syscall unless a thread is sleeping.
+     * Waiters read the counter with prepareWait(), re-check their condition and then sleep in
+     * wait() only if the counter did not move, so a notify between the check and the sleep is
+     * never lost.
+     */
+    class FutexEvent
+    {
+    public:
+        uint32_t prepareWait()
+        {
+            waiters.fetch_add(1);
+            return counter.load();
+        }
+
+        void cancelWait()
+        {
+            waiters.fetch_sub(1);
+        }
+
+        // Sleeps until notified or `timeout` expires, must follow prepareWait()
+        void wait(uint32_t seen, std::chrono::nanoseconds timeout)
+        {
+#ifdef __linux__
+            struct timespec ts;
+            ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+            ts.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+            // Woken by wake(), which already took this waiter off the count
+            if (syscall(SYS_futex, reinterpret_cast<uint32_t *>(&counter), FUTEX_WAIT_PRIVATE, seen, &ts, nullptr, 0) == 0)
+            {
+                return;
+            }
+#else
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait_for(lock, timeout, [this, seen]()
+                               { return counter.load() != seen; });
+#endif
+            waiters.fetch_sub(1);
+        }
+
+        void notifyOne()
+        {
+            counter.fetch_add(1);
+            if (waiters.load() > 0)
+            {
+                wake(1);
+            }
+        }
+
+        void notifyAll()
+        {
+            counter.fetch_add(1);
+            if (waiters.load() > 0)
+            {
+                wake(INT32_MAX);
+            }
+        }
+
+    private:
+        void wake(int count)
+        {
+#ifdef __linux__
+            // A woken thread stops counting as a waiter right away, not when it gets to run,
+            // otherwise every notify until then would be another syscall
+            long woken = syscall(SYS_futex, reinterpret_cast<uint32_t *>(&counter), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+            if (woken > 0)
+            {
+                waiters.fetch_sub(static_cast<int>(woken));
+            }
+#else
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+            }
+            if (count == 1)
+            {
+                condition.notify_one();
+            }
+            else
+            {
+                condition.notify_all();
+            }
+#endif
+        }
+
+    private:
+        static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex needs a plain 32-bit word");
+        std::atomic<uint32_t> counter{0};
+        std::atomic<int> waiters{0};
+#ifndef __linux__
+        std::mutex mutex;
+        std::condition_variable condition;
+#endif
+    };
+
+    /**
+     * @brief Bounded lock-free MPMC queue (Vyukov ring buffer), drop-in for Queue.
+     *
+     * Producers and consumers claim slots with one CAS on their own cursor, each slot carries a
+     * sequence number telling whether it is free or full, so there is no shared lock and no
+     * allocation after construction. try_push()/try_pop() never block; push(), pop() and
+     * pop_for() sleep on a futex only when the queue is full/empty, and a push wakes at most one
+     * consumer.
+     */
+    template <typename T>
+    class RingQueue
+    {
+    public:
+        explicit RingQueue(size_t maxSize) : maxSize(maxSize)
+        {
+            if (maxSize == 0)
+            {
+                throw std::invalid_argument("Queue size must be greater than zero.");
+            }
+            cells = std::unique_ptr<Cell[]>(new Cell[maxSize]);
+            for (size_t i = 0; i < maxSize; i++)
+            {
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        ~RingQueue() = default;
+
+        bool try_push(const T &item)
+        {
+            checkItem(item);
+            return emplace(item);
+        }
+
+        bool try_push(T &&item)
+        {
+            checkItem(item);
+            return emplace(std::move(item));
+        }
+
+        bool try_pop(T &item)
+        {
+            size_t position = dequeuePosition.load(std::memory_order_relaxed);
+            while (true)
+            {
+                Cell &cell = cells[position % maxSize];
+                size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+                if (diff == 0)
+                {
+                    if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        item = std::move(cell.value);
+                        cell.sequence.store(position + maxSize, std::memory_order_release);
+                        notFull.notifyOne();
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false; // Empty
+                }
+                else
+                {
+                    position = dequeuePosition.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Blocks while the queue is full
+        void push(const T &item)
+        {
+            while (!try_push(item))
+            {
+                uint32_t seen = notFull.prepareWait();
+                if (try_push(item))
+                {
+                    notFull.cancelWait();
+                    return;
+                }
+                notFull.wait(seen, std::chrono::milliseconds(100));
+            }
+        }
+
+        // Blocks while the queue is empty
+        T pop()
+        {
+            T item;
+            while (!pop_for(item, std::chrono::milliseconds(100)))
+            {
+            }
+            return item;
+        }
+
+        /**
+         * @brief Pops an item, waiting at most `timeout` for one to arrive.
+         *
+         * @return false if the queue stayed empty.
+         */
+        template <typename Rep, typename Period>
+        bool pop_for(T &item, std::chrono::duration<Rep, Period> timeout)
+        {
+            if (try_pop(item))
+            {
+                return true;
+            }
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            while (true)
+            {
+                uint32_t seen = notEmpty.prepareWait();
+                if (try_pop(item))
+                {
+                    notEmpty.cancelWait();
+                    return true;
+                }
+                auto remaining = deadline - std::chrono::steady_clock::now();
+                if (remaining <= std::chrono::steady_clock::duration::zero())
+                {
+                    notEmpty.cancelWait();
+                    return false;
+                }
+                notEmpty.wait(seen, std::chrono::duration_cast<std::chrono::nanoseconds>(remaining));
+                if (try_pop(item))
+                {
+                    return true;
+                }
+            }
+        }
+
+        /**
+         * @brief Pops up to `max_items` items without blocking.
+         *
+         * @return Number of items appended to `out`.
+         */
+        size_t pop_batch(std::vector<T> &out, size_t max_items)
+        {
+            size_t popped = 0;
+            T item;
+            while (popped < max_items && try_pop(item))
+            {
+                out.push_back(std::move(item));
+                popped++;
+            }
+            return popped;
+        }
+
+        bool empty() const
+        {
+            return size() == 0;
+        }
+
+        // Approximate while producers/consumers are running
+        size_t size() const
+        {
+            size_t enqueued = enqueuePosition.load(std::memory_order_relaxed);
+            size_t dequeued = dequeuePosition.load(std::memory_order_relaxed);
+            return enqueued > dequeued ? enqueued - dequeued : 0;
+        }
+
+        size_t getMaxSize() const
+        {
+            return maxSize;
+        }
+
+        // Disable copy constructor and assignment operator
+        RingQueue(const RingQueue &) = delete;
+        RingQueue &operator=(const RingQueue &) = delete;
+
+    private:
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+
+        template <typename U>
+        bool emplace(U &&item)
+        {
+            size_t position = enqueuePosition.load(std::memory_order_relaxed);
+            while (true)
+            {
+                Cell &cell = cells[position % maxSize];
+                size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+                if (diff == 0)
+                {
+                    if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        cell.value = std::forward<U>(item);
+                        cell.sequence.store(position + 1, std::memory_order_release);
+                        notEmpty.notifyOne();
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false; // Full
+                }
+                else
+                {
+                    position = enqueuePosition.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Same contract as Queue, null pointers are rejected
+        static void checkItem(const T &item)
+        {
+            if constexpr (std::is_pointer_v<T>)
+            {
+                if (!item)
+                {
+                    throw std::invalid_argument("Cannot push a null item.");
+                }
+            }
+        }
+
+    private:
+        const size_t maxSize;
+        std::unique_ptr<Cell[]> cells;
+        // Producer and consumer cursors on separate cache lines
+        alignas(64) std::atomic<size_t> enqueuePosition{0};
+        alignas(64) std::atomic<size_t> dequeuePosition{0};
+        FutexEvent notEmpty;
+        FutexEvent notFull;
+    };
+
+} // namespace playback
+
+#endif // PLAYBACK_RING_QUEUE_HPP
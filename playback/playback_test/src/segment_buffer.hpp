@@ -0,0 +1,108 @@
+#ifndef SEGMENT_BUFFER_HPP
+#define SEGMENT_BUFFER_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+namespace playback
+{
+
+    /**
+     * @brief Recycles the memory segment bodies are downloaded into.
+     *
+     * acquire() hands out an empty string whose capacity is kept from a previous segment, the
+     * shared_ptr returns it to the pool when the last owner (the HTTP transfer, the decoder's
+     * AVIOContext or any other consumer of the bytes) lets go of it. After the first segments
+     * of a stream a download no longer grows or allocates its buffer. At most `max_idle`
+     * buffers are kept, buffers released after the pool is destroyed are simply freed.
+     */
+    class SegmentBufferPool
+    {
+    public:
+        explicit SegmentBufferPool(size_t max_idle = 16, size_t initial_capacity = 1024 * 1024)
+            : state(std::make_shared<State>()), initial_capacity(initial_capacity)
+        {
+            state->max_idle = max_idle;
+        }
+
+        // Returns an empty buffer, recycled when possible
+        std::shared_ptr<std::string> acquire()
+        {
+            std::string *buffer = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(state->poolMutex);
+                if (!state->idle.empty())
+                {
+                    buffer = state->idle.back().release();
+                    state->idle.pop_back();
+                }
+            }
+            if (buffer)
+            {
+                reuses++;
+            }
+            else
+            {
+                allocations++;
+                buffer = new std::string();
+                buffer->reserve(initial_capacity);
+            }
+            std::weak_ptr<State> owner = state;
+            return std::shared_ptr<std::string>(buffer, [owner](std::string *released)
+                                                { release(owner, released); });
+        }
+
+        // Number of buffers allocated by the pool
+        size_t getAllocations() const
+        {
+            return allocations;
+        }
+
+        // Number of acquire() calls served with a recycled buffer
+        size_t getReuses() const
+        {
+            return reuses;
+        }
+
+        // Disable copy constructor and assignment operator
+        SegmentBufferPool(const SegmentBufferPool &) = delete;
+        SegmentBufferPool &operator=(const SegmentBufferPool &) = delete;
+
+    private:
+        // Outlives the pool while buffers are handed out
+        struct State
+        {
+            std::mutex poolMutex;
+            std::vector<std::unique_ptr<std::string>> idle;
+            size_t max_idle = 0;
+        };
+
+        static void release(const std::weak_ptr<State> &owner, std::string *buffer)
+        {
+            std::unique_ptr<std::string> recycled(buffer);
+            std::shared_ptr<State> pool = owner.lock();
+            if (!pool)
+            {
+                return;
+            }
+            recycled->clear(); // Keeps the capacity
+            std::lock_guard<std::mutex> lock(pool->poolMutex);
+            if (pool->idle.size() < pool->max_idle)
+            {
+                pool->idle.push_back(std::move(recycled));
+            }
+        }
+
+    private:
+        std::shared_ptr<State> state;
+        size_t initial_capacity;
+        std::atomic<size_t> allocations{0};
+        std::atomic<size_t> reuses{0};
+    };
+
+} // namespace playback
+
+#endif // SEGMENT_BUFFER_HPP
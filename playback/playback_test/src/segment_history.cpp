@@ -0,0 +1,139 @@
+#include "segment_history.hpp"
+
+#include <stdexcept>
+
+using namespace playback;
+
+SegmentHistory::SegmentHistory(size_t capacity)
+    : ring(capacity)
+{
+    if (capacity == 0)
+    {
+        throw std::invalid_argument("Segment history capacity must be greater than zero.");
+    }
+}
+
+void SegmentHistory::add(std::shared_ptr<HLSSegment> segment)
+{
+    std::shared_ptr<HLSSegment> oldest;
+    {
+        std::lock_guard<std::mutex> lock(dataMutex);
+        if (count == ring.size())
+        {
+            oldest = std::move(ring[head]);
+            ring[head] = std::move(segment);
+            head = (head + 1) % ring.size();
+        }
+        else
+        {
+            ring[(head + count) % ring.size()] = std::move(segment);
+            count++;
+        }
+    }
+    if (!oldest)
+    {
+        return;
+    }
+
+    // Read outside our lock, the segment locks its own mutex
+    SegmentStatus status = oldest->getStatus();
+    long sequence = oldest->getSequenceNumber();
+    size_t frames = oldest->getNumFrames();
+    long decode = oldest->getDecodeDuration();
+    long declared = static_cast<long>(oldest->getDeclaredTime() * 1000);
+
+    std::lock_guard<std::mutex> lock(dataMutex);
+    evicted.segments++;
+    if (status == SegmentStatus::DOWNLOADED)
+    {
+        evicted.downloaded++;
+    }
+    else if (status == SegmentStatus::DOWNLOAD_FAILED)
+    {
+        evicted.failed++;
+    }
+    else
+    {
+        evicted.in_progress++;
+    }
+    if (evicted.first_sequence < 0)
+    {
+        evicted.first_sequence = sequence;
+    }
+    evicted.last_sequence = sequence;
+    evicted.frames += frames;
+    evicted.decode_time += decode;
+    evicted.declared_time += declared;
+}
+
+void SegmentHistory::onFinished(const SegmentSnapshot &segment)
+{
+    std::lock_guard<std::mutex> lock(dataMutex);
+    decode_time += segment.decode_duration;
+    declared_time += static_cast<long>(segment.declared_duration * 1000);
+    if (segment.status == SegmentStatus::DOWNLOADED)
+    {
+        downloaded++;
+        if (first_downloaded_at < 0 || segment.created_at < first_downloaded_at)
+        {
+            first_downloaded_at = segment.created_at;
+        }
+    }
+    else
+    {
+        failed++;
+    }
+}
+
+std::vector<std::shared_ptr<HLSSegment>> SegmentHistory::getSegments()
+{
+    std::lock_guard<std::mutex> lock(dataMutex);
+    std::vector<std::shared_ptr<HLSSegment>> segments;
+    segments.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        segments.push_back(ring[(head + i) % ring.size()]);
+    }
+    return segments;
+}
+
+long SegmentHistory::getDecodeTime()
+{
+    std::lock_guard<std::mutex> lock(dataMutex);
+    return decode_time;
+}
+
+long SegmentHistory::getDeclaredTime()
+{
+    std::lock_guard<std::mutex> lock(dataMutex);
+    return declared_time;
+}
+
+long SegmentHistory::getRunningTime()
+{
+    std::lock_guard<std::mutex> lock(dataMutex);
+    return first_downloaded_at < 0 ? 0 : get_utc() - first_downloaded_at;
+}
+
+size_t SegmentHistory::getDownloaded()
+{
+    std::lock_guard<std::mutex> lock(dataMutex);
+    return downloaded;
+}
+
+size_t SegmentHistory::getFailed()
+{
+    std::lock_guard<std::mutex> lock(dataMutex);
+    return failed;
+}
+
+SegmentSummary SegmentHistory::getEvicted()
+{
+    std::lock_guard<std::mutex> lock(dataMutex);
+    return evicted;
+}
+
+size_t SegmentHistory::getCapacity() const
+{
+    return ring.size();
+}
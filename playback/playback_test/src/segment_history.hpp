@@ -0,0 +1,89 @@
+#ifndef SEGMENT_HISTORY_HPP
+#define SEGMENT_HISTORY_HPP
+
+#include "hls_segment.hpp"
+
+#include <vector>
+#include <memory>
+#include <mutex>
+
+namespace playback
+{
+
+    // Compacted record of the segments that dropped out of the history window
+    struct SegmentSummary
+    {
+        size_t segments = 0;
+        size_t downloaded = 0;
+        size_t failed = 0;
+        size_t in_progress = 0; // Still running when evicted, their totals arrive on completion
+        long first_sequence = -1;
+        long last_sequence = -1;
+        size_t frames = 0;
+        long decode_time = 0;   // ms
+        long declared_time = 0; // ms
+    };
+
+    /**
+     * @brief Fixed size ring of the most recent segments of a stream with running totals.
+     *
+     * Totals cover every segment ever finished, not only the retained ones. They are updated once
+     * per segment from its completion callback, so a query costs the same no matter how long the
+     * stream has been running. The oldest segment is released when a new one is added to a full
+     * ring, keeping memory flat over long runs.
+     */
+    class SegmentHistory
+    {
+    public:
+        /**
+         * @brief Constructor for SegmentHistory.
+         *
+         * @param capacity Number of recent segments retained.
+         *
+         * @throws std::invalid_argument if capacity is zero.
+         */
+        explicit SegmentHistory(size_t capacity);
+
+        // Retains a new segment, evicts the oldest one when the ring is full
+        void add(std::shared_ptr<HLSSegment> segment);
+
+        // Accounts a finished segment in the running totals, called once per segment
+        void onFinished(const SegmentSnapshot &segment);
+
+        // Retained segments, oldest first
+        std::vector<std::shared_ptr<HLSSegment>> getSegments();
+
+        // Sum of decoded media time of all finished segments, in ms
+        long getDecodeTime();
+
+        // Sum of declared (#EXTINF) time of all finished segments, in ms
+        long getDeclaredTime();
+
+        // Time since the earliest created segment that was downloaded, 0 before the first one, in ms
+        long getRunningTime();
+
+        size_t getDownloaded();
+
+        size_t getFailed();
+
+        SegmentSummary getEvicted();
+
+        size_t getCapacity() const;
+
+    private:
+        std::mutex dataMutex;
+        std::vector<std::shared_ptr<HLSSegment>> ring;
+        size_t head = 0; // Index of the oldest retained segment
+        size_t count = 0;
+        SegmentSummary evicted;
+
+        long decode_time = 0;
+        long declared_time = 0;
+        size_t downloaded = 0;
+        size_t failed = 0;
+        long first_downloaded_at = -1; // Creation time of the earliest downloaded segment
+    };
+
+} // namespace playback
+
+#endif // SEGMENT_HISTORY_HPP
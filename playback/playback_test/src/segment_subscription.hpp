@@ -0,0 +1,122 @@
+#ifndef SEGMENT_SUBSCRIPTION_HPP
+#define SEGMENT_SUBSCRIPTION_HPP
+
+#include "hls_segment.hpp"
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <condition_variable>
+
+namespace playback
+{
+
+    /**
+     * @brief Receives a snapshot of every segment that finishes on the subscribed streams.
+     *
+     * Snapshots are pushed by the decoder worker that completed the segment, publish() never
+     * blocks it: when the consumer falls behind by more than `capacity` snapshots the oldest one
+     * is dropped and counted. One subscription may be attached to several parsers.
+     */
+    class SegmentSubscription
+    {
+    public:
+        explicit SegmentSubscription(size_t capacity) : capacity(capacity)
+        {
+            if (capacity == 0)
+            {
+                throw std::invalid_argument("Subscription capacity must be greater than zero.");
+            }
+        }
+
+        void publish(std::shared_ptr<const SegmentSnapshot> snapshot)
+        {
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                if (pending.size() >= capacity)
+                {
+                    pending.pop_front();
+                    dropped++;
+                }
+                pending.push_back(std::move(snapshot));
+            }
+            queueCondition.notify_one();
+        }
+
+        /**
+         * @brief Waits for the next finished segment.
+         *
+         * @param timeout Maximum time to wait.
+         * @return The snapshot, or nullptr if none arrived within `timeout`.
+         */
+        std::shared_ptr<const SegmentSnapshot> next(std::chrono::milliseconds timeout)
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            if (!queueCondition.wait_for(lock, timeout, [this]()
+                                         { return !pending.empty(); }))
+            {
+                return nullptr;
+            }
+            std::shared_ptr<const SegmentSnapshot> snapshot = std::move(pending.front());
+            pending.pop_front();
+            return snapshot;
+        }
+
+        // Number of snapshots dropped because the consumer fell behind
+        size_t getDropped()
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            return dropped;
+        }
+
+    private:
+        std::deque<std::shared_ptr<const SegmentSnapshot>> pending;
+        std::mutex queueMutex;
+        std::condition_variable queueCondition;
+        size_t capacity;
+        size_t dropped = 0;
+    };
+
+    // Fans finished segments out to the subscriptions of one parser
+    class SegmentPublisher
+    {
+    public:
+        void subscribe(const std::shared_ptr<SegmentSubscription> &subscription)
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            subscriptions.push_back(subscription);
+        }
+
+        void unsubscribe(const std::shared_ptr<SegmentSubscription> &subscription)
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            subscriptions.erase(std::remove(subscriptions.begin(), subscriptions.end(), subscription), subscriptions.end());
+        }
+
+        bool hasSubscribers()
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            return !subscriptions.empty();
+        }
+
+        void publish(const std::shared_ptr<const SegmentSnapshot> &snapshot)
+        {
+            std::lock_guard<std::mutex> lock(dataMutex);
+            for (const auto &subscription : subscriptions)
+            {
+                subscription->publish(snapshot);
+            }
+        }
+
+    private:
+        std::mutex dataMutex;
+        std::vector<std::shared_ptr<SegmentSubscription>> subscriptions;
+    };
+
+} // namespace playback
+
+#endif // SEGMENT_SUBSCRIPTION_HPP
@@ -0,0 +1,163 @@
+#include "sei_injector.hpp"
+#include "sei_timestamp.hpp"
+#include "constants.hpp"
+#include "logger.hpp"
+
+#include <chrono>
+#include <thread>
+#include <stdexcept>
+
+using namespace playback;
+
+constexpr const char *INJECTOR_TAG = "SeiInjector";
+
+namespace
+{
+    std::string ffmpegUri(const std::string &uri, const char *pipe)
+    {
+        return uri == "-" ? pipe : uri;
+    }
+} // namespace
+
+SeiInjector::SeiInjector(const SeiInjectorOptions &options) : options(options)
+{
+    std::string input = ffmpegUri(options.input, "pipe:0");
+    std::string output = ffmpegUri(options.output, "pipe:1");
+    if (avformat_open_input(&inputContext, input.c_str(), nullptr, nullptr) < 0)
+    {
+        throw std::runtime_error("Failed to open input: " + options.input);
+    }
+    if (avformat_find_stream_info(inputContext, nullptr) < 0)
+    {
+        close();
+        throw std::runtime_error("Failed to retrieve stream information: " + options.input);
+    }
+    const char *format = options.output_format.empty() ? nullptr : options.output_format.c_str();
+    if (avformat_alloc_output_context2(&outputContext, nullptr, format, output.c_str()) < 0 || !outputContext)
+    {
+        close();
+        throw std::runtime_error("Failed to create output: " + options.output);
+    }
+
+    // Every stream is copied, only the first H.264 stream is stamped
+    for (unsigned int i = 0; i < inputContext->nb_streams; i++)
+    {
+        AVCodecParameters *parameters = inputContext->streams[i]->codecpar;
+        AVStream *stream = avformat_new_stream(outputContext, nullptr);
+        if (!stream || avcodec_parameters_copy(stream->codecpar, parameters) < 0)
+        {
+            close();
+            throw std::runtime_error("Failed to copy stream parameters: " + options.input);
+        }
+        stream->codecpar->codec_tag = 0;
+        stream->time_base = inputContext->streams[i]->time_base;
+        if (videoStream < 0 && parameters->codec_type == AVMEDIA_TYPE_VIDEO && parameters->codec_id == AV_CODEC_ID_H264)
+        {
+            videoStream = static_cast<int>(i);
+            lengthSize = nalLengthSize(parameters->extradata, static_cast<size_t>(parameters->extradata_size));
+        }
+    }
+    if (videoStream < 0)
+    {
+        close();
+        throw std::runtime_error("No H.264 video stream in: " + options.input);
+    }
+    if (!(outputContext->oformat->flags & AVFMT_NOFILE) && avio_open(&outputContext->pb, output.c_str(), AVIO_FLAG_WRITE) < 0)
+    {
+        close();
+        throw std::runtime_error("Failed to open output: " + options.output);
+    }
+    if (avformat_write_header(outputContext, nullptr) < 0)
+    {
+        close();
+        throw std::runtime_error("Failed to write the output header: " + options.output);
+    }
+}
+
+SeiInjector::~SeiInjector()
+{
+    close();
+}
+
+void SeiInjector::run()
+{
+    using Clock = std::chrono::steady_clock;
+    AVPacket *packet = av_packet_alloc();
+    AVPacket *stamped = av_packet_alloc();
+    if (!packet || !stamped)
+    {
+        av_packet_free(&packet);
+        av_packet_free(&stamped);
+        throw std::runtime_error("Failed to allocate packets");
+    }
+    std::string access_unit;
+    Clock::time_point started = Clock::now();
+    int64_t first_dts = AV_NOPTS_VALUE;
+    while (!stopping && av_read_frame(inputContext, packet) >= 0)
+    {
+        AVStream *input = inputContext->streams[packet->stream_index];
+        AVStream *output = outputContext->streams[packet->stream_index];
+        if (options.realtime && packet->dts != AV_NOPTS_VALUE)
+        {
+            int64_t dts_us = av_rescale_q(packet->dts, input->time_base, AVRational{1, 1000000});
+            first_dts = first_dts == AV_NOPTS_VALUE ? dts_us : first_dts;
+            std::this_thread::sleep_until(started + std::chrono::microseconds(dts_us - first_dts));
+        }
+
+        AVPacket *written = packet;
+        // Stamped as late as possible, right before the packet leaves
+        if (packet->stream_index == videoStream &&
+            insertTimestampSei(packet->data, static_cast<size_t>(packet->size), lengthSize, get_utc_us(), access_unit) &&
+            av_new_packet(stamped, static_cast<int>(access_unit.size())) >= 0)
+        {
+            std::copy(access_unit.begin(), access_unit.end(), stamped->data);
+            av_packet_copy_props(stamped, packet);
+            written = stamped;
+            stamped_frames++;
+        }
+        av_packet_rescale_ts(written, input->time_base, output->time_base);
+        written->pos = -1;
+        if (av_interleaved_write_frame(outputContext, written) < 0)
+        {
+            Logger::getInstance().log("Failed to write packet to " + options.output, Logger::Severity::ERROR, INJECTOR_TAG);
+        }
+        packets++;
+        av_packet_unref(stamped);
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+    av_packet_free(&stamped);
+    av_write_trailer(outputContext);
+}
+
+void SeiInjector::stop()
+{
+    stopping = true;
+}
+
+size_t SeiInjector::getPackets() const
+{
+    return packets;
+}
+
+size_t SeiInjector::getStampedFrames() const
+{
+    return stamped_frames;
+}
+
+void SeiInjector::close()
+{
+    if (outputContext)
+    {
+        if (!(outputContext->oformat->flags & AVFMT_NOFILE))
+        {
+            avio_closep(&outputContext->pb);
+        }
+        avformat_free_context(outputContext);
+        outputContext = nullptr;
+    }
+    if (inputContext)
+    {
+        avformat_close_input(&inputContext);
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef SEI_INJECTOR_HPP
+#define SEI_INJECTOR_HPP
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+#include <string>
+#include <atomic>
+
+namespace playback
+{
+
+    struct SeiInjectorOptions
+    {
+        std::string input;         // File, url or "-" for stdin
+        std::string output;        // File, url (e.g. rtmp://) or "-" for stdout
+        std::string output_format; // Guessed from the output when empty, required for stdout
+        bool realtime = false;     // Pace the packets by their timestamps, like ffmpeg -re
+    };
+
+    /**
+     * @brief Remuxes a stream and stamps every H.264 frame with the wall clock time it is published at.
+     *
+     * Sits in the publishing path (e.g. `ffmpeg ... -f mpegts - | PlaybackVerifier --inject-sei - ...`),
+     * the packets are copied without re-encoding and each video access unit gets a timestamp
+     * SEI in front of its first slice (see sei_timestamp.hpp). The verifier reads it back after
+     * decoding, which gives the publish to playback latency of every frame.
+     */
+    class SeiInjector
+    {
+    public:
+        /**
+         * @brief Opens the input and the output.
+         *
+         * @throws std::runtime_error if either cannot be opened or the input has no H.264 stream.
+         */
+        explicit SeiInjector(const SeiInjectorOptions &options);
+        ~SeiInjector();
+
+        // Copies the stream until the input ends or stop() is called, then finishes the output
+        void run();
+
+        // Makes run() return after the current packet, callable from any thread
+        void stop();
+
+        size_t getPackets() const;
+        size_t getStampedFrames() const;
+
+        // Disable copy constructor and assignment operator
+        SeiInjector(const SeiInjector &) = delete;
+        SeiInjector &operator=(const SeiInjector &) = delete;
+
+    private:
+        void close();
+
+    private:
+        SeiInjectorOptions options;
+        AVFormatContext *inputContext = nullptr;
+        AVFormatContext *outputContext = nullptr;
+        int videoStream = -1;
+        int lengthSize = 0; // NAL length prefix size of the video stream, 0 for Annex B
+        std::atomic<bool> stopping{false};
+        std::atomic<size_t> packets{0};
+        std::atomic<size_t> stamped_frames{0};
+    };
+
+} // namespace playback
+
+#endif // SEI_INJECTOR_HPP
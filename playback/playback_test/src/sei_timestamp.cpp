@@ -0,0 +1,245 @@
+#include "sei_timestamp.hpp"
+
+#include <cstring>
+
+using namespace playback;
+
+// Random UUID identifying the timestamps of this tool
+const uint8_t playback::SEI_TIMESTAMP_UUID[16] = {0x7a, 0x3c, 0x41, 0x0e, 0x5b, 0x92, 0x4d, 0x1f,
+                                                  0xa8, 0x66, 0x2d, 0xc4, 0x19, 0xe7, 0x50, 0xb3};
+
+constexpr uint8_t NAL_TYPE_SEI = 6;
+constexpr uint8_t SEI_TYPE_USER_DATA_UNREGISTERED = 5;
+
+namespace
+{
+    bool isSlice(uint8_t header)
+    {
+        uint8_t type = header & 0x1F;
+        return type >= 1 && type <= 5;
+    }
+
+    // Offset of the next 00 00 01 start code at or after `from`, `size` if there is none
+    size_t findStartCode(const uint8_t *data, size_t size, size_t from)
+    {
+        for (size_t i = from; i + 2 < size; i++)
+        {
+            if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1)
+            {
+                return i;
+            }
+        }
+        return size;
+    }
+
+    // SEI NAL unit with one timestamp message, emulation prevention applied
+    std::string makeSeiNal(int64_t utc_us)
+    {
+        uint8_t rbsp[3 + SEI_TIMESTAMP_PAYLOAD_SIZE];
+        rbsp[0] = SEI_TYPE_USER_DATA_UNREGISTERED;
+        rbsp[1] = static_cast<uint8_t>(SEI_TIMESTAMP_PAYLOAD_SIZE);
+        std::memcpy(rbsp + 2, SEI_TIMESTAMP_UUID, sizeof(SEI_TIMESTAMP_UUID));
+        uint64_t value = static_cast<uint64_t>(utc_us);
+        for (int i = 0; i < 8; i++)
+        {
+            rbsp[2 + 16 + i] = static_cast<uint8_t>(value >> (56 - 8 * i));
+        }
+        rbsp[sizeof(rbsp) - 1] = 0x80; // rbsp_trailing_bits
+
+        std::string nal(1, static_cast<char>(NAL_TYPE_SEI));
+        int zeros = 0;
+        for (uint8_t byte : rbsp)
+        {
+            if (zeros >= 2 && byte <= 3)
+            {
+                nal += '\x03';
+                zeros = 0;
+            }
+            nal += static_cast<char>(byte);
+            zeros = byte == 0 ? zeros + 1 : 0;
+        }
+        return nal;
+    }
+
+    // Walks the messages of an SEI NAL unit, without its header byte
+    bool parseSeiNal(const uint8_t *data, size_t size, int64_t &utc_us)
+    {
+        // Remove emulation prevention bytes
+        std::string rbsp;
+        rbsp.reserve(size);
+        int zeros = 0;
+        for (size_t i = 0; i < size; i++)
+        {
+            if (zeros >= 2 && data[i] == 3)
+            {
+                zeros = 0;
+                continue;
+            }
+            rbsp += static_cast<char>(data[i]);
+            zeros = data[i] == 0 ? zeros + 1 : 0;
+        }
+
+        const uint8_t *message = reinterpret_cast<const uint8_t *>(rbsp.data());
+        size_t position = 0;
+        while (position + 2 <= rbsp.size() && message[position] != 0x80)
+        {
+            size_t type = 0;
+            size_t payload_size = 0;
+            for (size_t *field : {&type, &payload_size})
+            {
+                while (position < rbsp.size() && message[position] == 0xFF)
+                {
+                    *field += 255;
+                    position++;
+                }
+                *field += position < rbsp.size() ? message[position++] : 0;
+            }
+            if (position + payload_size > rbsp.size())
+            {
+                return false;
+            }
+            if (type == SEI_TYPE_USER_DATA_UNREGISTERED && parseTimestampPayload(message + position, payload_size, utc_us))
+            {
+                return true;
+            }
+            position += payload_size;
+        }
+        return false;
+    }
+} // namespace
+
+bool playback::insertTimestampSei(const uint8_t *access_unit, size_t size, int length_size, int64_t utc_us, std::string &out)
+{
+    std::string sei = makeSeiNal(utc_us);
+    size_t insert_at = size;
+    if (length_size == 0)
+    {
+        for (size_t start = findStartCode(access_unit, size, 0); start < size; start = findStartCode(access_unit, size, start + 3))
+        {
+            if (start + 3 < size && isSlice(access_unit[start + 3]))
+            {
+                // A zero in front of the start code belongs to it
+                insert_at = start > 0 && access_unit[start - 1] == 0 ? start - 1 : start;
+                break;
+            }
+        }
+        sei.insert(0, "\x00\x00\x00\x01", 4);
+    }
+    else
+    {
+        for (size_t position = 0; position + length_size < size;)
+        {
+            size_t nal_size = 0;
+            for (int i = 0; i < length_size; i++)
+            {
+                nal_size = (nal_size << 8) | access_unit[position + i];
+            }
+            if (isSlice(access_unit[position + length_size]))
+            {
+                insert_at = position;
+                break;
+            }
+            position += length_size + nal_size;
+        }
+        std::string prefix;
+        for (int i = length_size - 1; i >= 0; i--)
+        {
+            prefix += static_cast<char>((sei.size() >> (8 * i)) & 0xFF);
+        }
+        sei.insert(0, prefix);
+    }
+
+    out.clear();
+    out.reserve(size + sei.size());
+    out.append(reinterpret_cast<const char *>(access_unit), insert_at);
+    if (insert_at < size)
+    {
+        out += sei;
+    }
+    out.append(reinterpret_cast<const char *>(access_unit) + insert_at, size - insert_at);
+    return insert_at < size;
+}
+
+bool playback::parseTimestampPayload(const uint8_t *payload, size_t size, int64_t &utc_us)
+{
+    if (size < SEI_TIMESTAMP_PAYLOAD_SIZE || std::memcmp(payload, SEI_TIMESTAMP_UUID, sizeof(SEI_TIMESTAMP_UUID)) != 0)
+    {
+        return false;
+    }
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        value = (value << 8) | payload[16 + i];
+    }
+    utc_us = static_cast<int64_t>(value);
+    return true;
+}
+
+bool playback::findTimestampSei(const AVFrame *frame, int64_t &utc_us)
+{
+    for (int i = 0; i < frame->nb_side_data; i++)
+    {
+        const AVFrameSideData *side_data = frame->side_data[i];
+        // x264 and other encoders add their own unregistered SEI, look at all of them
+        if (side_data->type == AV_FRAME_DATA_SEI_UNREGISTERED && parseTimestampPayload(side_data->data, side_data->size, utc_us))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool playback::findTimestampSei(const uint8_t *access_unit, size_t size, int length_size, int64_t &utc_us)
+{
+    if (length_size > 0)
+    {
+        for (size_t position = 0; position + length_size < size;)
+        {
+            size_t nal_size = 0;
+            for (int i = 0; i < length_size; i++)
+            {
+                nal_size = (nal_size << 8) | access_unit[position + i];
+            }
+            size_t nal = position + length_size;
+            if (nal_size == 0 || nal_size > size - nal)
+            {
+                return false; // Not a length prefixed access unit after all
+            }
+            if ((access_unit[nal] & 0x1F) == NAL_TYPE_SEI && parseSeiNal(access_unit + nal + 1, nal_size - 1, utc_us))
+            {
+                return true;
+            }
+            if (isSlice(access_unit[nal]))
+            {
+                return false;
+            }
+            position = nal + nal_size;
+        }
+        return false;
+    }
+    for (size_t start = findStartCode(access_unit, size, 0); start < size;)
+    {
+        size_t nal = start + 3;
+        size_t next = findStartCode(access_unit, size, nal);
+        if (nal < next && (access_unit[nal] & 0x1F) == NAL_TYPE_SEI && parseSeiNal(access_unit + nal + 1, next - nal - 1, utc_us))
+        {
+            return true;
+        }
+        if (nal < next && isSlice(access_unit[nal]))
+        {
+            return false; // SEI comes before the first slice
+        }
+        start = next;
+    }
+    return false;
+}
+
+int playback::nalLengthSize(const uint8_t *extradata, size_t size)
+{
+    // avcC starts with configurationVersion 1, Annex B extradata with a start code
+    if (size >= 7 && extradata[0] == 1)
+    {
+        return (extradata[4] & 0x03) + 1;
+    }
+    return 0;
+}
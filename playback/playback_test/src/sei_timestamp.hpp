@@ -0,0 +1,54 @@
+#ifndef SEI_TIMESTAMP_HPP
+#define SEI_TIMESTAMP_HPP
+
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace playback
+{
+
+    /**
+     * Wall clock timestamps carried in H.264 SEI user_data_unregistered messages.
+     *
+     * The payload is SEI_TIMESTAMP_UUID followed by the UTC time in microseconds since the
+     * epoch as a big endian 64 bit integer, taken when the frame was published. Decoders that
+     * do not know the UUID ignore the message.
+     */
+    extern const uint8_t SEI_TIMESTAMP_UUID[16];
+    constexpr size_t SEI_TIMESTAMP_PAYLOAD_SIZE = 16 + 8;
+
+    /**
+     * @brief Copies an H.264 access unit to `out` with a timestamp SEI NAL unit in front of its first slice.
+     *
+     * @param length_size 0 for Annex B (start codes), otherwise the NAL length prefix size of
+     *                    avcC streams (1, 2 or 4).
+     * @return false if the access unit has no slice, `out` is then a plain copy.
+     */
+    bool insertTimestampSei(const uint8_t *access_unit, size_t size, int length_size, int64_t utc_us, std::string &out);
+
+    // Timestamp of a user_data_unregistered payload (UUID and data), as exported in AV_FRAME_DATA_SEI_UNREGISTERED
+    bool parseTimestampPayload(const uint8_t *payload, size_t size, int64_t &utc_us);
+
+    // Timestamp from the SEI side data of a decoded frame
+    bool findTimestampSei(const AVFrame *frame, int64_t &utc_us);
+
+    /**
+     * @brief Timestamp from the SEI NAL units of an access unit, for packets that are not decoded.
+     *
+     * @param length_size 0 for Annex B (start codes), otherwise the NAL length prefix size of
+     *                    avcC streams (1, 2 or 4), see nalLengthSize().
+     */
+    bool findTimestampSei(const uint8_t *access_unit, size_t size, int length_size, int64_t &utc_us);
+
+    // NAL length prefix size of an H.264 stream from its extradata, 0 for Annex B
+    int nalLengthSize(const uint8_t *extradata, size_t size);
+
+} // namespace playback
+
+#endif // SEI_TIMESTAMP_HPP
@@ -0,0 +1,900 @@
+#include "synthetic_origin.hpp"
+#include "ts_muxer.hpp"
+#include "sei_timestamp.hpp"
+#include "constants.hpp"
+#include "logger.hpp"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+}
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <charconv>
+#include <string_view>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <chrono>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+using namespace playback;
+
+constexpr const char *ORIGIN_TAG = "SyntheticOrigin";
+
+constexpr int64_t TIMELINE_START = 10 * 90000; // 90 kHz timestamp of sequence 0
+constexpr int64_t PCR_DELAY = 9000;            // The PCR runs 100 ms ahead of the decode time
+constexpr int64_t PTS_GAP_DURATION = 45000;    // 500 ms
+constexpr size_t MAX_REQUEST_SIZE = 16 * 1024;
+constexpr size_t MAX_PIPELINED_INPUT = 4 * MAX_REQUEST_SIZE; // Requests waiting behind a response
+constexpr long GAP_CHECKPOINT_INTERVAL = 256;                // Sequences between cumulative gap counts
+constexpr size_t READ_CHUNK_SIZE = 4096;
+constexpr int MAX_EVENTS = 256;
+constexpr long THROTTLE_BURST_MS = 20; // Data a capped connection may send at once
+constexpr size_t MIN_THROTTLE_BURST = 1500;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    // splitmix64, spreads (stream, sequence) pairs over the whole range
+    uint64_t mix(uint64_t value)
+    {
+        value += 0x9E3779B97F4A7C15ULL;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+        return value ^ (value >> 31);
+    }
+
+    uint64_t mix(uint64_t stream, uint64_t sequence, uint64_t salt)
+    {
+        return mix(mix(stream ^ salt) + sequence);
+    }
+
+    // Uniform in [0, 1)
+    double unit(uint64_t value)
+    {
+        return static_cast<double>(value >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    std::string http_date(long utc_ms)
+    {
+        std::time_t seconds = static_cast<std::time_t>(utc_ms / 1000);
+        std::tm parts;
+        gmtime_r(&seconds, &parts);
+        char buffer[64];
+        size_t size = std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &parts);
+        return std::string(buffer, size);
+    }
+
+    const char *status_text(int status)
+    {
+        switch (status)
+        {
+        case 200:
+            return "OK";
+        case 400:
+            return "Bad Request";
+        case 404:
+            return "Not Found";
+        case 405:
+            return "Method Not Allowed";
+        default:
+            return "Internal Server Error";
+        }
+    }
+
+    // Moving diagonal gradient with a vertical bar, mid gray so it is neither black nor frozen
+    void draw_pattern(AVFrame *frame, size_t index, size_t count)
+    {
+        int bar = static_cast<int>(index * frame->width / count);
+        for (int y = 0; y < frame->height; y++)
+        {
+            uint8_t *row = frame->data[0] + y * frame->linesize[0];
+            for (int x = 0; x < frame->width; x++)
+            {
+                row[x] = static_cast<uint8_t>(std::abs(x - bar) < 8 ? 200 : 80 + ((x + y + 4 * static_cast<int>(index)) & 63));
+            }
+        }
+        for (int plane = 1; plane < 3; plane++)
+        {
+            for (int y = 0; y < frame->height / 2; y++)
+            {
+                std::memset(frame->data[plane] + y * frame->linesize[plane], 128, frame->width / 2);
+            }
+        }
+    }
+} // namespace
+
+// ---- SyntheticMedia ----
+
+SyntheticMedia::SyntheticMedia(int width, int height, int fps, size_t count, long bitrate)
+    : frame_duration(90000 / fps), stream_type(TS_STREAM_TYPE_H264), codec_name("h264")
+{
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    if (!codec)
+    {
+        codec = avcodec_find_encoder(AV_CODEC_ID_MPEG2VIDEO);
+        stream_type = TS_STREAM_TYPE_MPEG2_VIDEO;
+        codec_name = "mpeg2video";
+        Logger::getInstance().log("No H.264 encoder, serving MPEG-2 video without timestamp SEI, clients will not measure latency",
+                                  Logger::Severity::WARNING, ORIGIN_TAG);
+    }
+    AVCodecContext *context = codec ? avcodec_alloc_context3(codec) : nullptr;
+    if (!context)
+    {
+        throw std::runtime_error("No H.264 or MPEG-2 video encoder available");
+    }
+    context->width = width;
+    context->height = height;
+    context->pix_fmt = AV_PIX_FMT_YUV420P;
+    context->time_base = AVRational{1, fps};
+    context->framerate = AVRational{fps, 1};
+    context->gop_size = static_cast<int>(count); // One keyframe at the start of every segment
+    context->max_b_frames = 0;                   // Decode order is presentation order
+    context->bit_rate = bitrate;
+    if (stream_type == TS_STREAM_TYPE_H264)
+    {
+        av_opt_set(context->priv_data, "preset", "ultrafast", 0);
+        av_opt_set(context->priv_data, "tune", "zerolatency", 0);
+    }
+
+    AVFrame *frame = av_frame_alloc();
+    AVPacket *packet = av_packet_alloc();
+    bool opened = frame && packet && avcodec_open2(context, codec, nullptr) >= 0;
+    if (opened)
+    {
+        frame->format = context->pix_fmt;
+        frame->width = width;
+        frame->height = height;
+        opened = av_frame_get_buffer(frame, 0) >= 0;
+    }
+    for (size_t i = 0; opened && i <= count; i++)
+    {
+        // The last round flushes the encoder
+        bool flushing = i == count;
+        if (!flushing)
+        {
+            av_frame_make_writable(frame);
+            draw_pattern(frame, i, count);
+            frame->pts = static_cast<int64_t>(i);
+        }
+        if (avcodec_send_frame(context, flushing ? nullptr : frame) < 0)
+        {
+            opened = false;
+            break;
+        }
+        while (avcodec_receive_packet(context, packet) >= 0)
+        {
+            frames.push_back({std::string(reinterpret_cast<const char *>(packet->data), packet->size), (packet->flags & AV_PKT_FLAG_KEY) != 0});
+            av_packet_unref(packet);
+        }
+    }
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    avcodec_free_context(&context);
+    if (!opened || frames.size() != count)
+    {
+        throw std::runtime_error("Failed to encode the synthetic " + codec_name + " segment");
+    }
+}
+
+void SyntheticMedia::writeSegment(std::string &out, long sequence, TimestampFault fault, int64_t timeline_offset, int64_t capture_us) const
+{
+    std::string access_unit;
+    TsMuxer muxer(stream_type);
+    muxer.writeTables(out);
+    int64_t start = TIMELINE_START + timeline_offset + static_cast<int64_t>(sequence) * static_cast<int64_t>(frames.size()) * frame_duration;
+    size_t middle = frames.size() / 2;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        int64_t dts = start + static_cast<int64_t>(i) * frame_duration;
+        if (fault == TimestampFault::PTS_GAP && i >= middle)
+        {
+            dts += PTS_GAP_DURATION;
+        }
+        int64_t pcr = dts - PCR_DELAY - 2 * frame_duration; // Also ahead of a backwards frame
+        if (fault == TimestampFault::PTS_BACKWARDS && i == middle && i > 0)
+        {
+            dts -= 2 * frame_duration;
+        }
+        const std::string *data = &frames[i].data;
+        if (capture_us > 0 && stream_type == TS_STREAM_TYPE_H264)
+        {
+            int64_t frame_capture_us = capture_us + static_cast<int64_t>(i) * frame_duration * 100 / 9;
+            insertTimestampSei(reinterpret_cast<const uint8_t *>(data->data()), data->size(), 0, frame_capture_us, access_unit);
+            data = &access_unit;
+        }
+        muxer.writeFrame(out, reinterpret_cast<const uint8_t *>(data->data()), data->size(), dts, dts, pcr, frames[i].keyframe);
+    }
+}
+
+int64_t SyntheticMedia::getGapDuration() const
+{
+    return PTS_GAP_DURATION;
+}
+
+const std::string &SyntheticMedia::getCodecName() const
+{
+    return codec_name;
+}
+
+// ---- EventLoop ----
+
+class SyntheticOrigin::EventLoop
+{
+public:
+    EventLoop(SyntheticOrigin &origin, int &port) : origin(origin)
+    {
+        listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int enable = 1;
+        struct sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        bool bound = listen_fd >= 0 &&
+                     ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) == 0 &&
+                     ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == 0 &&
+                     ::bind(listen_fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) == 0 &&
+                     ::listen(listen_fd, SOMAXCONN) == 0;
+        socklen_t length = sizeof(address);
+        // Port 0 binds an ephemeral port, the other loops join it
+        bound = bound && ::getsockname(listen_fd, reinterpret_cast<struct sockaddr *>(&address), &length) == 0;
+        epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+        wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (!bound || epoll_fd < 0 || wake_fd < 0)
+        {
+            std::string error = std::strerror(errno);
+            closeDescriptors();
+            throw std::runtime_error("Failed to listen on port " + std::to_string(port) + ": " + error);
+        }
+        port = ntohs(address.sin_port);
+        watch(listen_fd, EPOLLIN, EPOLL_CTL_ADD);
+        watch(wake_fd, EPOLLIN, EPOLL_CTL_ADD);
+    }
+
+    ~EventLoop()
+    {
+        stop();
+        for (auto &entry : connections)
+        {
+            ::close(entry.first);
+        }
+        closeDescriptors();
+    }
+
+    void start()
+    {
+        stopping = false;
+        thread = std::thread(&EventLoop::run, this);
+    }
+
+    void stop()
+    {
+        stopping = true;
+        uint64_t one = 1;
+        if (::write(wake_fd, &one, sizeof(one)) < 0)
+        {
+            // The loop is already woken up
+        }
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+    std::atomic<size_t> requests{0};
+    std::atomic<size_t> bytes_sent{0};
+    std::atomic<size_t> open_connections{0};
+
+private:
+    struct Connection
+    {
+        std::string input;
+        std::string head;
+        std::shared_ptr<std::string> body;
+        size_t sent = 0; // Bytes of head and body written
+        bool responding = false;
+        bool close_after = false;
+        bool writable_watched = false;
+        Clock::time_point ready_at;
+        double allowance = 0; // Bytes the throughput cap lets through
+        Clock::time_point refilled_at;
+    };
+
+    void run()
+    {
+        struct epoll_event events[MAX_EVENTS];
+        while (!stopping)
+        {
+            int timeout = -1;
+            if (!timers.empty())
+            {
+                auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(timers.top().first - Clock::now()).count();
+                timeout = static_cast<int>(std::max<long>(0, wait + 1));
+            }
+            int count = ::epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+            if (count < 0 && errno != EINTR)
+            {
+                Logger::getInstance().log("epoll_wait failed: " + std::string(std::strerror(errno)), Logger::Severity::ERROR, ORIGIN_TAG);
+                break;
+            }
+            for (int i = 0; i < count; i++)
+            {
+                int fd = events[i].data.fd;
+                if (fd == listen_fd)
+                {
+                    acceptConnections();
+                }
+                else if (fd == wake_fd)
+                {
+                    uint64_t value;
+                    if (::read(wake_fd, &value, sizeof(value)) < 0)
+                    {
+                        // Drained by an earlier wake up
+                    }
+                }
+                else
+                {
+                    onEvent(fd, events[i].events);
+                }
+            }
+            // Responses whose delay or throughput cap expired
+            Clock::time_point now = Clock::now();
+            while (!timers.empty() && timers.top().first <= now)
+            {
+                int fd = timers.top().second;
+                timers.pop();
+                // A closed connection leaves its timer behind, flushing its successor is harmless
+                auto it = connections.find(fd);
+                if (it != connections.end() && flush(fd, it->second))
+                {
+                    respond(fd, it->second);
+                }
+            }
+        }
+    }
+
+    void acceptConnections()
+    {
+        while (true)
+        {
+            int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                {
+                    Logger::getInstance().log("accept failed: " + std::string(std::strerror(errno)), Logger::Severity::WARNING, ORIGIN_TAG);
+                }
+                return;
+            }
+            int enable = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+            connections[fd] = Connection();
+            open_connections++;
+            watch(fd, EPOLLIN, EPOLL_CTL_ADD);
+        }
+    }
+
+    void onEvent(int fd, uint32_t events)
+    {
+        auto it = connections.find(fd);
+        if (it == connections.end())
+        {
+            return;
+        }
+        Connection &connection = it->second;
+        if (events & (EPOLLERR | EPOLLHUP))
+        {
+            closeConnection(fd);
+            return;
+        }
+        bool finished = false;
+        if (events & EPOLLOUT)
+        {
+            finished = flush(fd, connection);
+            if (connections.count(fd) == 0)
+            {
+                return;
+            }
+        }
+        if (events & EPOLLIN)
+        {
+            char chunk[READ_CHUNK_SIZE];
+            while (true)
+            {
+                ssize_t received = ::recv(fd, chunk, sizeof(chunk), 0);
+                if (received > 0)
+                {
+                    connection.input.append(chunk, static_cast<size_t>(received));
+                    // Pipelined requests are only parsed once the current response is sent
+                    if (connection.input.size() > MAX_PIPELINED_INPUT)
+                    {
+                        closeConnection(fd);
+                        return;
+                    }
+                    continue;
+                }
+                if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                {
+                    closeConnection(fd);
+                    return;
+                }
+                break;
+            }
+        }
+        if (finished || (events & EPOLLIN))
+        {
+            respond(fd, connection);
+        }
+    }
+
+    // Answers the complete requests in turn until one has to wait for the socket, its delay or
+    // the throughput cap, pipelined requests wait for the current response
+    void respond(int fd, Connection &connection)
+    {
+        while (!connection.responding)
+        {
+            if (!startResponse(fd, connection))
+            {
+                return;
+            }
+            if (!flush(fd, connection))
+            {
+                return;
+            }
+        }
+    }
+
+    // Builds the response to the next complete request, false if there is none (or the
+    // connection was closed) or it waits for the response delay
+    bool startResponse(int fd, Connection &connection)
+    {
+        size_t end = connection.input.find("\r\n\r\n");
+        if (end == std::string::npos)
+        {
+            if (connection.input.size() > MAX_REQUEST_SIZE)
+            {
+                closeConnection(fd);
+            }
+            return false;
+        }
+        std::string request = connection.input.substr(0, end);
+        connection.input.erase(0, end + 4);
+        requests++;
+
+        size_t line_end = request.find("\r\n");
+        std::string line = request.substr(0, line_end);
+        std::string headers = line_end == std::string::npos ? std::string() : request.substr(line_end);
+        std::transform(headers.begin(), headers.end(), headers.begin(), [](unsigned char c)
+                       { return static_cast<char>(std::tolower(c)); });
+        size_t method_end = line.find(' ');
+        size_t target_end = method_end == std::string::npos ? std::string::npos : line.find(' ', method_end + 1);
+        Response response;
+        if (target_end == std::string::npos)
+        {
+            response.status = 400;
+            connection.close_after = true;
+        }
+        else
+        {
+            std::string method = line.substr(0, method_end);
+            std::string target = line.substr(method_end + 1, target_end - method_end - 1);
+            connection.close_after = line.compare(target_end + 1, std::string::npos, "HTTP/1.0") == 0 ||
+                                     headers.find("\nconnection: close") != std::string::npos;
+            target = target.substr(0, target.find_first_of("?#"));
+            response = method == "GET" ? origin.handle(target, get_utc()) : Response{405};
+        }
+
+        size_t body_size = response.body ? response.body->size() : 0;
+        connection.head = "HTTP/1.1 " + std::to_string(response.status) + " " + status_text(response.status) + "\r\n" +
+                          "Content-Type: " + response.content_type + "\r\n" +
+                          "Content-Length: " + std::to_string(body_size) + "\r\n" +
+                          "Cache-Control: no-cache\r\n";
+        if (response.last_modified > 0)
+        {
+            connection.head += "Last-Modified: " + http_date(response.last_modified) + "\r\n";
+        }
+        connection.head += connection.close_after ? "Connection: close\r\n\r\n" : "\r\n";
+        connection.body = std::move(response.body);
+        connection.sent = 0;
+        connection.responding = true;
+        Clock::time_point now = Clock::now();
+        connection.ready_at = now + std::chrono::milliseconds(origin.options.response_delay);
+        if (origin.options.response_delay > 0)
+        {
+            timers.emplace(connection.ready_at, fd);
+            return false;
+        }
+        return true;
+    }
+
+    // Writes as much of the response as the socket, the delay and the throughput cap allow,
+    // true once it is complete and the connection stays open for the next request
+    bool flush(int fd, Connection &connection)
+    {
+        if (!connection.responding)
+        {
+            return false;
+        }
+        Clock::time_point now = Clock::now();
+        if (now < connection.ready_at)
+        {
+            return false; // Its timer is pending
+        }
+        size_t body_size = connection.body ? connection.body->size() : 0;
+        size_t total = connection.head.size() + body_size;
+        size_t budget = total - connection.sent;
+        double rate = origin.options.throughput_kbps / 8.0; // Bytes per ms
+        if (rate > 0)
+        {
+            double burst = std::max<double>(MIN_THROTTLE_BURST, rate * THROTTLE_BURST_MS);
+            double elapsed = std::chrono::duration<double, std::milli>(now - connection.refilled_at).count();
+            connection.allowance = std::min(burst, connection.allowance + rate * elapsed);
+            connection.refilled_at = now;
+            double wanted = std::min<double>(burst, static_cast<double>(budget));
+            if (connection.allowance < wanted)
+            {
+                setWritableWatched(fd, connection, false);
+                auto wait = std::chrono::duration<double, std::milli>((wanted - connection.allowance) / rate);
+                timers.emplace(now + std::chrono::duration_cast<Clock::duration>(wait), fd);
+                return false;
+            }
+            budget = std::min(budget, static_cast<size_t>(connection.allowance));
+        }
+
+        while (budget > 0)
+        {
+            struct iovec parts[2];
+            size_t count = 0;
+            size_t limit = budget;
+            if (connection.sent < connection.head.size())
+            {
+                size_t size = std::min(limit, connection.head.size() - connection.sent);
+                parts[count++] = {&connection.head[connection.sent], size};
+                limit -= size;
+            }
+            size_t body_sent = connection.sent > connection.head.size() ? connection.sent - connection.head.size() : 0;
+            if (limit > 0 && body_sent < body_size)
+            {
+                parts[count++] = {&(*connection.body)[body_sent], std::min(limit, body_size - body_sent)};
+            }
+            struct msghdr message{};
+            message.msg_iov = parts;
+            message.msg_iovlen = count;
+            ssize_t written = ::sendmsg(fd, &message, MSG_NOSIGNAL);
+            if (written < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    break;
+                }
+                if (errno != EINTR)
+                {
+                    closeConnection(fd);
+                    return false;
+                }
+                continue;
+            }
+            connection.sent += static_cast<size_t>(written);
+            connection.allowance -= static_cast<double>(written);
+            bytes_sent += static_cast<size_t>(written);
+            budget -= static_cast<size_t>(written);
+        }
+
+        if (connection.sent < total)
+        {
+            // Blocked by the socket: wait for EPOLLOUT, by the cap: wait for the allowance to refill
+            bool blocked = budget > 0;
+            setWritableWatched(fd, connection, blocked);
+            if (!blocked)
+            {
+                timers.emplace(now + std::chrono::milliseconds(1), fd);
+            }
+            return false;
+        }
+
+        connection.responding = false;
+        connection.body.reset(); // Back to the buffer pool
+        setWritableWatched(fd, connection, false);
+        if (connection.close_after)
+        {
+            closeConnection(fd);
+            return false;
+        }
+        return true;
+    }
+
+    // EPOLLOUT is level triggered, only watched while the socket buffer is full
+    void setWritableWatched(int fd, Connection &connection, bool watched)
+    {
+        if (connection.writable_watched != watched)
+        {
+            connection.writable_watched = watched;
+            watch(fd, watched ? EPOLLIN | EPOLLOUT : EPOLLIN, EPOLL_CTL_MOD);
+        }
+    }
+
+    void closeConnection(int fd)
+    {
+        ::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        connections.erase(fd);
+        open_connections--;
+    }
+
+    void watch(int fd, uint32_t events, int operation)
+    {
+        struct epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        ::epoll_ctl(epoll_fd, operation, fd, &event);
+    }
+
+    void closeDescriptors()
+    {
+        for (int fd : {listen_fd, epoll_fd, wake_fd})
+        {
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+        }
+        listen_fd = epoll_fd = wake_fd = -1;
+    }
+
+private:
+    SyntheticOrigin &origin;
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+    std::unordered_map<int, Connection> connections;
+    // (due time, fd) of delayed and throttled responses
+    std::priority_queue<std::pair<Clock::time_point, int>, std::vector<std::pair<Clock::time_point, int>>, std::greater<>> timers;
+};
+
+// ---- SyntheticOrigin ----
+
+SyntheticOrigin::SyntheticOrigin(SyntheticOriginOptions options)
+    : options(options), segment_duration_ms(std::lround(options.segment_duration * 1000)), buffers(256, 256 * 1024)
+{
+    if (options.streams == 0 || options.window == 0 || options.threads == 0 || options.fps <= 0 || segment_duration_ms <= 0)
+    {
+        throw std::invalid_argument("Synthetic origin needs at least one stream, thread, segment in the window and frame per segment");
+    }
+    if (options.fault_rate < 0 || options.fault_rate > 1)
+    {
+        throw std::invalid_argument("Fault rate must be between 0 and 1");
+    }
+    size_t frames = static_cast<size_t>(std::max(1L, std::lround(options.segment_duration * options.fps)));
+    // The segment duration the playlists advertise is what the frames actually last
+    segment_duration_ms = static_cast<long>(frames * 1000 / options.fps);
+    // A late segment is still published before the next one is due
+    this->options.publish_jitter = std::clamp(options.publish_jitter, 0L, segment_duration_ms - 1);
+    media = std::make_unique<SyntheticMedia>(options.width, options.height, options.fps, frames, options.bitrate);
+    gapCheckpoints.assign(options.streams, std::vector<long>(1, 0));
+    // Start with full windows
+    epoch = get_utc() - static_cast<long>(options.window + 1) * segment_duration_ms;
+
+    int port = options.port;
+    for (size_t i = 0; i < options.threads; i++)
+    {
+        loops.push_back(std::make_unique<EventLoop>(*this, port));
+    }
+    this->options.port = port;
+    Logger::getInstance().log("Serving " + std::to_string(options.streams) + " synthetic " + media->getCodecName() + " stream(s) of " +
+                                  std::to_string(frames) + " frame segments on port " + std::to_string(port),
+                              Logger::Severity::INFO, ORIGIN_TAG);
+}
+
+SyntheticOrigin::~SyntheticOrigin()
+{
+    stop();
+}
+
+void SyntheticOrigin::start()
+{
+    for (auto &loop : loops)
+    {
+        loop->start();
+    }
+}
+
+void SyntheticOrigin::stop()
+{
+    for (auto &loop : loops)
+    {
+        loop->stop();
+    }
+}
+
+std::string SyntheticOrigin::getStreamUri(size_t stream) const
+{
+    return "http://127.0.0.1:" + std::to_string(options.port) + "/stream/" + std::to_string(stream) + "/index.m3u8";
+}
+
+size_t SyntheticOrigin::getRequests() const
+{
+    size_t total = 0;
+    for (const auto &loop : loops)
+    {
+        total += loop->requests;
+    }
+    return total;
+}
+
+size_t SyntheticOrigin::getBytesSent() const
+{
+    size_t total = 0;
+    for (const auto &loop : loops)
+    {
+        total += loop->bytes_sent;
+    }
+    return total;
+}
+
+size_t SyntheticOrigin::getOpenConnections() const
+{
+    size_t total = 0;
+    for (const auto &loop : loops)
+    {
+        total += loop->open_connections;
+    }
+    return total;
+}
+
+size_t SyntheticOrigin::getFaultsServed() const
+{
+    return faults_served;
+}
+
+SyntheticOrigin::Response SyntheticOrigin::handle(const std::string &path, long now)
+{
+    constexpr std::string_view prefix = "/stream/";
+    Response response;
+    response.status = 404;
+    if (path.compare(0, prefix.size(), prefix) != 0)
+    {
+        return response;
+    }
+    size_t slash = path.find('/', prefix.size());
+    size_t stream = 0;
+    auto result = std::from_chars(path.data() + prefix.size(), path.data() + std::min(slash, path.size()), stream);
+    if (slash == std::string::npos || result.ptr != path.data() + slash || result.ec != std::errc() || stream >= options.streams)
+    {
+        return response;
+    }
+    std::string file = path.substr(slash + 1);
+    long edge = getLiveEdge(stream, now);
+    if (file == "index.m3u8" && edge >= 0)
+    {
+        response.status = 200;
+        response.content_type = "application/vnd.apple.mpegurl";
+        response.last_modified = getAvailableAt(stream, edge);
+        response.body = buffers.acquire();
+        *response.body = renderPlaylist(edge);
+        return response;
+    }
+    long sequence = parse_uri_sequence_number(file);
+    if (file.compare(0, 8, "segment-") != 0 || sequence < 0 || sequence > edge)
+    {
+        return response;
+    }
+
+    int64_t timeline_offset = getTimelineOffset(stream, sequence);
+    TimestampFault fault = getFault(stream, sequence);
+    faults_served += fault != TimestampFault::NONE ? 1 : 0;
+    response.status = 200;
+    response.content_type = "video/mp2t";
+    response.last_modified = getAvailableAt(stream, sequence);
+    response.body = buffers.acquire();
+    media->writeSegment(*response.body, sequence, fault, timeline_offset, static_cast<int64_t>(getSegmentStart(stream, sequence)) * 1000);
+    return response;
+}
+
+long SyntheticOrigin::getLiveEdge(size_t stream, long now) const
+{
+    // Streams publish at different phases of the segment duration
+    long elapsed = now - getSegmentStart(stream, 0);
+    if (elapsed < segment_duration_ms)
+    {
+        return -1;
+    }
+    // Nominally published once it ended, the jitter only delays the newest one
+    long sequence = elapsed / segment_duration_ms - 1;
+    return getAvailableAt(stream, sequence) > now ? sequence - 1 : sequence;
+}
+
+long SyntheticOrigin::getSegmentStart(size_t stream, long sequence) const
+{
+    long offset = static_cast<long>(mix(stream) % static_cast<uint64_t>(segment_duration_ms));
+    return epoch + offset + sequence * segment_duration_ms;
+}
+
+long SyntheticOrigin::getAvailableAt(size_t stream, long sequence) const
+{
+    long jitter = options.publish_jitter > 0 ? static_cast<long>(mix(stream, sequence, 0x6A) % static_cast<uint64_t>(options.publish_jitter + 1)) : 0;
+    return getSegmentStart(stream, sequence) + segment_duration_ms + jitter;
+}
+
+TimestampFault SyntheticOrigin::getFault(size_t stream, long sequence) const
+{
+    if (options.fault_rate <= 0)
+    {
+        return TimestampFault::NONE;
+    }
+    uint64_t value = mix(stream, sequence, 0xFA);
+    if (unit(value) >= options.fault_rate)
+    {
+        return TimestampFault::NONE;
+    }
+    return mix(value) & 1 ? TimestampFault::PTS_GAP : TimestampFault::PTS_BACKWARDS;
+}
+
+long SyntheticOrigin::countGaps(size_t stream, long first, long sequence) const
+{
+    long gaps = 0;
+    for (long earlier = first; earlier < sequence; earlier++)
+    {
+        gaps += getFault(stream, earlier) == TimestampFault::PTS_GAP ? 1 : 0;
+    }
+    return gaps;
+}
+
+int64_t SyntheticOrigin::getTimelineOffset(size_t stream, long sequence)
+{
+    // Every earlier gap moves the rest of the stream forward. Faults are drawn per sequence,
+    // so the count is kept at checkpoints and only the sequences after the last one are checked.
+    if (options.fault_rate <= 0)
+    {
+        return 0;
+    }
+    size_t checkpoint = static_cast<size_t>(sequence / GAP_CHECKPOINT_INTERVAL);
+    long first = static_cast<long>(checkpoint) * GAP_CHECKPOINT_INTERVAL;
+    long gaps;
+    {
+        std::lock_guard<std::mutex> lock(gapMutex);
+        std::vector<long> &counts = gapCheckpoints[stream];
+        while (counts.size() <= checkpoint)
+        {
+            long start = static_cast<long>(counts.size() - 1) * GAP_CHECKPOINT_INTERVAL;
+            counts.push_back(counts.back() + countGaps(stream, start, start + GAP_CHECKPOINT_INTERVAL));
+        }
+        gaps = counts[checkpoint];
+    }
+    gaps += countGaps(stream, first, sequence);
+    return static_cast<int64_t>(gaps) * media->getGapDuration();
+}
+
+std::string SyntheticOrigin::renderPlaylist(long edge) const
+{
+    long first = std::max(0L, edge - static_cast<long>(options.window) + 1);
+    char duration[32];
+    std::snprintf(duration, sizeof(duration), "%.3f", segment_duration_ms / 1000.0);
+    std::string playlist = "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:" + std::to_string((segment_duration_ms + 999) / 1000) +
+                           "\n#EXT-X-MEDIA-SEQUENCE:" + std::to_string(first) + "\n";
+    for (long sequence = first; sequence <= edge; sequence++)
+    {
+        playlist += "#EXTINF:";
+        playlist += duration;
+        playlist += ",\nsegment-" + std::to_string(sequence) + ".ts\n";
+    }
+    return playlist;
+}
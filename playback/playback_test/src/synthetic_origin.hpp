@@ -0,0 +1,167 @@
+#ifndef SYNTHETIC_ORIGIN_HPP
+#define SYNTHETIC_ORIGIN_HPP
+
+#include "segment_buffer.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+
+namespace playback
+{
+
+    struct SyntheticOriginOptions
+    {
+        int port = 8081;
+        size_t streams = 1;           // Virtual streams served, /stream/0 .. /stream/<streams - 1>
+        double segment_duration = 2;  // Seconds
+        size_t window = 6;            // Segments listed in the live playlists
+        int fps = 25;
+        int width = 320;
+        int height = 240;
+        long bitrate = 400000;        // Encoder target, bits per second
+        double fault_rate = 0;        // Share of segments with a PTS gap or backwards PTS, 0 - 1
+        long publish_jitter = 0;      // Upper bound of the random delay a segment is published with, ms
+        long response_delay = 0;      // Added before every response, ms
+        long throughput_kbps = 0;     // Send rate cap per connection, 0 = uncapped
+        size_t threads = 1;           // Event loops, each accepting on its own SO_REUSEPORT socket
+    };
+
+    enum class TimestampFault
+    {
+        NONE,
+        PTS_GAP,      // Frames from the middle of the segment on are shifted forward, the stream continues after the gap
+        PTS_BACKWARDS // One frame in the middle of the segment goes back in time
+    };
+
+    /**
+     * @brief One GOP of encoded test pattern, muxed into MPEG-TS segments on demand.
+     *
+     * The frames are encoded once (H.264 when an encoder is available, MPEG-2 video otherwise),
+     * every segment repeats them with the timestamps of its media sequence, so serving a segment
+     * costs a copy into a transport stream instead of an encode.
+     */
+    class SyntheticMedia
+    {
+    public:
+        /**
+         * @throws std::runtime_error if no encoder can be opened.
+         */
+        SyntheticMedia(int width, int height, int fps, size_t frames, long bitrate);
+
+        /**
+         * @brief Appends the transport stream of one segment to `out`.
+         *
+         * @param timeline_offset 90 kHz offset added to every timestamp, the sum of the earlier gaps of the stream.
+         * @param capture_us UTC us at which the first frame was captured, H.264 frames carry their
+         *                   capture time in a timestamp SEI (see sei_timestamp.hpp), 0 for none.
+         */
+        void writeSegment(std::string &out, long sequence, TimestampFault fault, int64_t timeline_offset = 0, int64_t capture_us = 0) const;
+
+        // 90 kHz forward jump of a PTS_GAP fault
+        int64_t getGapDuration() const;
+
+        const std::string &getCodecName() const;
+
+    private:
+        struct Frame
+        {
+            std::string data;
+            bool keyframe;
+        };
+
+        std::vector<Frame> frames;
+        int64_t frame_duration;
+        uint8_t stream_type;
+        std::string codec_name;
+    };
+
+    /**
+     * @brief Local HTTP origin serving generated live HLS streams for load tests.
+     *
+     * Every virtual stream advances a live playlist in real time. Segment publication, PTS
+     * faults and publish jitter are derived from a hash of (stream, sequence), so they are
+     * reproducible across runs and need almost no per stream state (a cumulative gap count every
+     * few hundred sequences), which lets one origin serve thousands of streams. Connections are HTTP/1.1 keep-alive, handled by non-blocking epoll
+     * loops that also apply the configured response delay and per connection throughput cap.
+     *
+     * Playlists: http://<host>:<port>/stream/<id>/index.m3u8
+     * Segments:  http://<host>:<port>/stream/<id>/segment-<sequence>.ts
+     */
+    class SyntheticOrigin
+    {
+    public:
+        /**
+         * @brief Encodes the media and binds the listening sockets.
+         *
+         * @throws std::invalid_argument on inconsistent options, std::runtime_error if encoding or binding fails.
+         */
+        explicit SyntheticOrigin(SyntheticOriginOptions options);
+        ~SyntheticOrigin();
+
+        // Starts the event loops, returns immediately
+        void start();
+
+        // Stops and joins the event loops, open connections are closed
+        void stop();
+
+        // Playlist uri of a virtual stream
+        std::string getStreamUri(size_t stream) const;
+
+        // Totals across the event loops
+        size_t getRequests() const;
+        size_t getBytesSent() const;
+        size_t getOpenConnections() const;
+        size_t getFaultsServed() const;
+
+        // Disable copy constructor and assignment operator
+        SyntheticOrigin(const SyntheticOrigin &) = delete;
+        SyntheticOrigin &operator=(const SyntheticOrigin &) = delete;
+
+    private:
+        class EventLoop;
+        friend class EventLoop;
+
+        struct Response
+        {
+            int status = 200;
+            const char *content_type = "text/plain";
+            long last_modified = 0;
+            std::shared_ptr<std::string> body;
+        };
+
+        // Routes a GET request, called from the event loops
+        Response handle(const std::string &path, long now);
+
+        // Last published sequence of a stream at `now`, -1 before the first one
+        long getLiveEdge(size_t stream, long now) const;
+        // UTC ms at which the first frame of a segment is captured
+        long getSegmentStart(size_t stream, long sequence) const;
+        long getAvailableAt(size_t stream, long sequence) const;
+        TimestampFault getFault(size_t stream, long sequence) const;
+        // PTS_GAP faults among the sequences [first, sequence)
+        long countGaps(size_t stream, long first, long sequence) const;
+        // 90 kHz shift of a segment by the PTS gaps of every earlier one
+        int64_t getTimelineOffset(size_t stream, long sequence);
+        std::string renderPlaylist(long edge) const;
+
+    private:
+        SyntheticOriginOptions options;
+        long segment_duration_ms;
+        long epoch; // UTC ms at which sequence 0 of a stream with no offset starts
+        std::unique_ptr<SyntheticMedia> media;
+        SegmentBufferPool buffers;
+        std::vector<std::unique_ptr<EventLoop>> loops;
+        std::atomic<size_t> faults_served{0};
+        // Per stream, gaps before every GAP_CHECKPOINT_INTERVAL-th sequence, grown on demand
+        std::mutex gapMutex;
+        std::vector<std::vector<long>> gapCheckpoints;
+    };
+
+} // namespace playback
+
+#endif // SYNTHETIC_ORIGIN_HPP
@@ -0,0 +1,114 @@
+#ifndef THROUGHPUT_ESTIMATOR_HPP
+#define THROUGHPUT_ESTIMATOR_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <deque>
+
+namespace playback
+{
+
+    // Transfers smaller than this mostly measure latency, they do not update the estimate
+    constexpr size_t MIN_THROUGHPUT_SAMPLE_BYTES = 16000;
+    // Half-lives of the fast and slow averages, in seconds of transfer time
+    constexpr double THROUGHPUT_FAST_HALF_LIFE_S = 2;
+    constexpr double THROUGHPUT_SLOW_HALF_LIFE_S = 5;
+    // Samples in the harmonic mean
+    constexpr size_t THROUGHPUT_HARMONIC_WINDOW = 5;
+
+    /**
+     * @brief Throughput estimate of one stream from its segment transfers, the way players do it.
+     *
+     * Two exponentially weighted averages weighted by transfer time (a fast and a slow one, the
+     * estimate is the lower of the two, as in Shaka/hls.js) react quickly to drops and slowly to
+     * recoveries. The harmonic mean of the last THROUGHPUT_HARMONIC_WINDOW samples (as in
+     * dash.js/FESTIVE) is kept next to it, it is dominated by the slowest transfers.
+     */
+    class ThroughputEstimator
+    {
+    public:
+        /**
+         * @brief Adds a completed transfer.
+         *
+         * @param bytes Body bytes received.
+         * @param duration Transfer time in us.
+         */
+        void add(size_t bytes, long duration)
+        {
+            if (bytes < MIN_THROUGHPUT_SAMPLE_BYTES || duration <= 0)
+            {
+                return;
+            }
+            double kbps = bytes * 8000.0 / duration;
+            double seconds = duration / 1e6;
+            fast.add(kbps, seconds, THROUGHPUT_FAST_HALF_LIFE_S);
+            slow.add(kbps, seconds, THROUGHPUT_SLOW_HALF_LIFE_S);
+
+            window.push_back(kbps);
+            if (window.size() > THROUGHPUT_HARMONIC_WINDOW)
+            {
+                window.pop_front();
+            }
+            samples++;
+            last_kbps = kbps;
+        }
+
+        // Conservative estimate, min of the fast and slow averages, 0 before the first sample
+        double getEstimateKbps() const
+        {
+            return samples > 0 ? std::min(fast.get(), slow.get()) : 0;
+        }
+
+        double getHarmonicMeanKbps() const
+        {
+            double inverse_sum = 0;
+            for (double kbps : window)
+            {
+                inverse_sum += 1 / kbps;
+            }
+            return window.empty() ? 0 : window.size() / inverse_sum;
+        }
+
+        double getLastKbps() const
+        {
+            return last_kbps;
+        }
+
+        size_t getSamples() const
+        {
+            return samples;
+        }
+
+    private:
+        // EWMA with a weight per sample, zero-bias corrected like the Shaka estimator
+        struct Ewma
+        {
+            double estimate = 0;
+            double total_weight = 0;
+            double correction = 0;
+
+            void add(double value, double weight, double half_life)
+            {
+                double alpha = std::pow(0.5, weight / half_life);
+                estimate = alpha * estimate + (1 - alpha) * value;
+                total_weight += weight;
+                correction = 1 - std::pow(0.5, total_weight / half_life);
+            }
+
+            double get() const
+            {
+                return correction > 0 ? estimate / correction : 0;
+            }
+        };
+
+        Ewma fast;
+        Ewma slow;
+        std::deque<double> window;
+        size_t samples = 0;
+        double last_kbps = 0;
+    };
+
+} // namespace playback
+
+#endif // THROUGHPUT_ESTIMATOR_HPP
@@ -0,0 +1,163 @@
+#include "ts_muxer.hpp"
+
+#include <algorithm>
+
+using namespace playback;
+
+constexpr uint16_t PMT_PID = 0x1000;
+constexpr uint16_t VIDEO_PID = 0x0100;
+constexpr uint16_t PROGRAM_NUMBER = 1;
+constexpr uint8_t VIDEO_STREAM_ID = 0xE0;
+constexpr size_t TS_PAYLOAD_SIZE = TS_PACKET_SIZE - 4;
+constexpr int64_t TIMESTAMP_MASK = (int64_t(1) << 33) - 1;
+
+namespace
+{
+    // CRC-32/MPEG-2 of the PSI sections
+    uint32_t crc32(const uint8_t *data, size_t size)
+    {
+        uint32_t crc = 0xFFFFFFFF;
+        for (size_t i = 0; i < size; i++)
+        {
+            crc ^= uint32_t(data[i]) << 24;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                crc = crc & 0x80000000 ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+            }
+        }
+        return crc;
+    }
+
+    void putCrc(uint8_t *section, size_t size)
+    {
+        uint32_t crc = crc32(section, size);
+        section[size] = crc >> 24;
+        section[size + 1] = (crc >> 16) & 0xFF;
+        section[size + 2] = (crc >> 8) & 0xFF;
+        section[size + 3] = crc & 0xFF;
+    }
+
+    // 5 byte PTS/DTS field with its 4 bit prefix
+    uint8_t *putTimestamp(uint8_t *out, uint8_t prefix, int64_t timestamp)
+    {
+        uint64_t value = static_cast<uint64_t>(timestamp & TIMESTAMP_MASK);
+        out[0] = static_cast<uint8_t>((prefix << 4) | ((value >> 29) & 0x0E) | 0x01);
+        out[1] = static_cast<uint8_t>(value >> 22);
+        out[2] = static_cast<uint8_t>(((value >> 14) & 0xFE) | 0x01);
+        out[3] = static_cast<uint8_t>(value >> 7);
+        out[4] = static_cast<uint8_t>(((value << 1) & 0xFE) | 0x01);
+        return out + 5;
+    }
+
+    void putHeader(std::string &out, uint16_t pid, bool unit_start, bool adaptation, uint8_t &continuity)
+    {
+        out += static_cast<char>(TS_SYNC_BYTE);
+        out += static_cast<char>((unit_start ? 0x40 : 0x00) | (pid >> 8));
+        out += static_cast<char>(pid & 0xFF);
+        out += static_cast<char>((adaptation ? 0x30 : 0x10) | continuity);
+        continuity = (continuity + 1) & 0x0F;
+    }
+} // namespace
+
+TsMuxer::TsMuxer(uint8_t stream_type) : stream_type(stream_type)
+{
+}
+
+void TsMuxer::writeTables(std::string &out)
+{
+    uint8_t pat[16] = {
+        0x00, 0xB0, 13,                                      // table_id, section_length
+        0x00, 0x01, 0xC1, 0x00, 0x00,                        // transport_stream_id, version, section numbers
+        PROGRAM_NUMBER >> 8, PROGRAM_NUMBER & 0xFF, 0xE0 | (PMT_PID >> 8), PMT_PID & 0xFF};
+    putCrc(pat, 12);
+    uint8_t pmt[21] = {
+        0x02, 0xB0, 18,
+        PROGRAM_NUMBER >> 8, PROGRAM_NUMBER & 0xFF, 0xC1, 0x00, 0x00,
+        0xE0 | (VIDEO_PID >> 8), VIDEO_PID & 0xFF, 0xF0, 0x00,                       // PCR_PID, no program info
+        stream_type, 0xE0 | (VIDEO_PID >> 8), VIDEO_PID & 0xFF, 0xF0, 0x00}; // one video stream
+    putCrc(pmt, 17);
+    putHeader(out, 0x0000, true, false, pat_continuity);
+    writeSection(out, pat, sizeof(pat));
+    putHeader(out, PMT_PID, true, false, pmt_continuity);
+    writeSection(out, pmt, sizeof(pmt));
+}
+
+void TsMuxer::writeSection(std::string &out, const uint8_t *section, size_t size)
+{
+    out += '\0'; // pointer_field
+    out.append(reinterpret_cast<const char *>(section), size);
+    out.append(TS_PAYLOAD_SIZE - 1 - size, static_cast<char>(0xFF));
+}
+
+void TsMuxer::writeFrame(std::string &out, const uint8_t *data, size_t size, int64_t pts, int64_t dts, int64_t pcr, bool keyframe)
+{
+    uint8_t pes[19] = {0x00, 0x00, 0x01, VIDEO_STREAM_ID};
+    bool has_dts = pts != dts;
+    size_t pes_header_size = has_dts ? 19 : 14;
+    size_t pes_length = pes_header_size - 6 + size;
+    // 0 (unbounded) is allowed for video when the length does not fit
+    pes_length = pes_length > 0xFFFF ? 0 : pes_length;
+    pes[4] = static_cast<uint8_t>(pes_length >> 8);
+    pes[5] = static_cast<uint8_t>(pes_length & 0xFF);
+    pes[6] = 0x80;
+    pes[7] = has_dts ? 0xC0 : 0x80;
+    pes[8] = has_dts ? 10 : 5;
+    uint8_t *field = putTimestamp(pes + 9, has_dts ? 0x3 : 0x2, pts);
+    if (has_dts)
+    {
+        putTimestamp(field, 0x1, dts);
+    }
+
+    size_t total = pes_header_size + size;
+    size_t offset = 0;
+    out.reserve(out.size() + (total / TS_PAYLOAD_SIZE + 2) * TS_PACKET_SIZE);
+    for (bool first = true; offset < total; first = false)
+    {
+        // The first packet carries the PCR, the last one is padded with adaptation field stuffing
+        bool adaptation = first;
+        size_t adaptation_size = first ? 7 : 0; // flags and PCR, without the length byte
+        size_t capacity = TS_PAYLOAD_SIZE - (adaptation ? 1 + adaptation_size : 0);
+        size_t remaining = total - offset;
+        if (remaining < capacity)
+        {
+            adaptation_size = adaptation ? adaptation_size + capacity - remaining : TS_PAYLOAD_SIZE - remaining - 1;
+            adaptation = true;
+            capacity = remaining;
+        }
+
+        putHeader(out, VIDEO_PID, first, adaptation, video_continuity);
+        if (adaptation)
+        {
+            out += static_cast<char>(adaptation_size);
+            size_t written = 0;
+            if (adaptation_size > 0)
+            {
+                out += static_cast<char>(first ? 0x10 | (keyframe ? 0x40 : 0x00) : 0x00);
+                written++;
+            }
+            if (first)
+            {
+                uint64_t base = static_cast<uint64_t>(pcr & TIMESTAMP_MASK);
+                char clock[6] = {static_cast<char>(base >> 25), static_cast<char>(base >> 17), static_cast<char>(base >> 9),
+                                 static_cast<char>(base >> 1), static_cast<char>(((base & 1) << 7) | 0x7E), 0x00};
+                out.append(clock, sizeof(clock));
+                written += sizeof(clock);
+            }
+            out.append(adaptation_size - written, static_cast<char>(0xFF));
+        }
+
+        // Payload from the PES header, then the access unit
+        size_t end = offset + capacity;
+        if (offset < pes_header_size)
+        {
+            size_t header_end = std::min(end, pes_header_size);
+            out.append(reinterpret_cast<const char *>(pes + offset), header_end - offset);
+            offset = header_end;
+        }
+        if (offset < end)
+        {
+            out.append(reinterpret_cast<const char *>(data + offset - pes_header_size), end - offset);
+            offset = end;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef TS_MUXER_HPP
+#define TS_MUXER_HPP
+
+#include "ts_validator.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace playback
+{
+
+    // MPEG-TS stream_type of the video elementary stream
+    constexpr uint8_t TS_STREAM_TYPE_MPEG2_VIDEO = 0x02;
+    constexpr uint8_t TS_STREAM_TYPE_H264 = 0x1B;
+
+    /**
+     * @brief Minimal single program MPEG-TS writer for one video elementary stream.
+     *
+     * Writes PAT/PMT and one PES per access unit straight into the output string, with a PCR
+     * on the first packet of every PES and per PID continuity counters carried across calls,
+     * so consecutive segments of one stream form a continuous transport stream.
+     */
+    class TsMuxer
+    {
+    public:
+        explicit TsMuxer(uint8_t stream_type);
+
+        // PAT and PMT, written at the start of every segment
+        void writeTables(std::string &out);
+
+        /**
+         * @brief Writes one access unit as a PES packet.
+         *
+         * @param pts, dts 90 kHz timestamps.
+         * @param pcr 90 kHz program clock of the first packet, must not be after `dts`.
+         * @param keyframe Sets the random access indicator.
+         */
+        void writeFrame(std::string &out, const uint8_t *data, size_t size, int64_t pts, int64_t dts, int64_t pcr, bool keyframe);
+
+    private:
+        void writeSection(std::string &out, const uint8_t *section, size_t size);
+
+    private:
+        uint8_t stream_type;
+        uint8_t pat_continuity = 0;
+        uint8_t pmt_continuity = 0;
+        uint8_t video_continuity = 0;
+    };
+
+} // namespace playback
+
+#endif // TS_MUXER_HPP
@@ -0,0 +1,393 @@
+#include "ts_validator.hpp"
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+using namespace playback;
+
+constexpr uint16_t TS_PAT_PID = 0x0000;
+constexpr uint16_t TS_NULL_PID = 0x1FFF;
+constexpr uint8_t TS_PAT_TABLE_ID = 0x00;
+constexpr uint8_t TS_PMT_TABLE_ID = 0x02;
+// PTS/PCR base are 33-bit 90 kHz counters, the PCR extension makes the PCR a 27 MHz counter
+constexpr int64_t PTS_MODULUS = int64_t(1) << 33;
+constexpr int64_t PCR_MODULUS = PTS_MODULUS * 300;
+
+namespace
+{
+    // Difference a - b of two wrapping counters, in (-modulus / 2, modulus / 2]
+    int64_t wrappedDiff(uint64_t a, uint64_t b, int64_t modulus)
+    {
+        int64_t diff = static_cast<int64_t>(a % modulus) - static_cast<int64_t>(b % modulus);
+        if (diff < 0)
+        {
+            diff += modulus;
+        }
+        return diff > modulus / 2 ? diff - modulus : diff;
+    }
+
+    void addUnique(std::vector<uint16_t> &pids, uint16_t pid)
+    {
+        if (std::find(pids.begin(), pids.end(), pid) == pids.end())
+        {
+            pids.push_back(pid);
+        }
+    }
+} // namespace
+
+// ---- TsStats ----
+
+bool TsStats::hasErrors() const
+{
+    return !describeErrors().empty();
+}
+
+std::string TsStats::describeErrors() const
+{
+    if (packets == 0)
+    {
+        return "";
+    }
+    std::string errors;
+    auto add = [&errors](const std::string &error)
+    {
+        errors += (errors.empty() ? "" : ", ") + error;
+    };
+    if (sync_losses > 0)
+    {
+        add("sync lost " + std::to_string(sync_losses) + " time(s), " + std::to_string(skipped_bytes) + " bytes skipped");
+    }
+    if (transport_errors > 0)
+    {
+        add(std::to_string(transport_errors) + " transport error(s)");
+    }
+    if (cc_errors > 0)
+    {
+        add(std::to_string(cc_errors) + " continuity counter error(s)");
+    }
+    if (pat_count == 0)
+    {
+        add("no PAT");
+    }
+    if (pmt_count == 0)
+    {
+        add("no PMT");
+    }
+    if (pcr_interval_errors > 0)
+    {
+        add(std::to_string(pcr_interval_errors) + " PCR interval(s) over " + std::to_string(static_cast<int>(TS_MAX_PCR_INTERVAL_MS)) +
+            " ms, max: " + std::to_string(std::lround(max_pcr_interval)) + " ms");
+    }
+    if (late_pts > 0)
+    {
+        add(std::to_string(late_pts) + " PTS behind the PCR");
+    }
+    return errors;
+}
+
+// ---- TsValidator ----
+
+bool TsValidator::isTransportStream() const
+{
+    return transport_stream;
+}
+
+void TsValidator::feed(const uint8_t *data, size_t size)
+{
+    if (!transport_stream || size == 0)
+    {
+        return;
+    }
+    if (!checked_format)
+    {
+        checked_format = true;
+        if (data[0] != TS_SYNC_BYTE)
+        {
+            transport_stream = false;
+            return;
+        }
+    }
+    const uint8_t *end = data + size;
+    const uint8_t *p = data;
+
+    // Complete the packet split across the previous buffer and this one
+    if (carry_size > 0)
+    {
+        size_t take = std::min(TS_PACKET_SIZE - carry_size, size);
+        std::memcpy(carry + carry_size, p, take);
+        carry_size += take;
+        p += take;
+        if (carry_size < TS_PACKET_SIZE)
+        {
+            return;
+        }
+        carry_size = 0;
+        parsePacket(carry);
+    }
+
+    while (p < end)
+    {
+        size_t available = static_cast<size_t>(end - p);
+        // Out of sync a 0x47 only counts if the next packet starts with one too, when visible
+        bool sync = *p == TS_SYNC_BYTE && (in_sync || available <= TS_PACKET_SIZE || p[TS_PACKET_SIZE] == TS_SYNC_BYTE);
+        if (!sync)
+        {
+            if (in_sync)
+            {
+                in_sync = false;
+                stats.sync_losses++;
+            }
+            stats.skipped_bytes++;
+            offset++;
+            p++;
+            continue;
+        }
+        in_sync = true;
+        if (available < TS_PACKET_SIZE)
+        {
+            std::memcpy(carry, p, available);
+            carry_size = available;
+            return;
+        }
+        parsePacket(p);
+        p += TS_PACKET_SIZE;
+    }
+}
+
+TsStats TsValidator::getStats() const
+{
+    TsStats current = stats;
+    current.skipped_bytes += carry_size;
+    return current;
+}
+
+void TsValidator::parsePacket(const uint8_t *packet)
+{
+    uint64_t packet_offset = offset;
+    offset += TS_PACKET_SIZE;
+    stats.packets++;
+
+    bool transport_error = (packet[1] & 0x80) != 0;
+    if (transport_error)
+    {
+        // Nothing in a packet flagged as corrupted can be trusted
+        stats.transport_errors++;
+        return;
+    }
+    bool unit_start = (packet[1] & 0x40) != 0;
+    uint16_t pid = static_cast<uint16_t>(((packet[1] & 0x1F) << 8) | packet[2]);
+    uint8_t adaptation_control = (packet[3] >> 4) & 0x3;
+    uint8_t continuity = packet[3] & 0x0F;
+    if (pid == TS_NULL_PID)
+    {
+        return;
+    }
+
+    size_t payload_start = 4;
+    bool discontinuity = false;
+    if (adaptation_control & 0x2)
+    {
+        size_t length = packet[4];
+        payload_start = 5 + length;
+        if (payload_start > TS_PACKET_SIZE)
+        {
+            return; // Malformed adaptation field
+        }
+        if (length > 0)
+        {
+            uint8_t flags = packet[5];
+            discontinuity = (flags & 0x80) != 0;
+            if ((flags & 0x10) && length >= 7 && (stats.pcr_pid < 0 || pid == stats.pcr_pid))
+            {
+                const uint8_t *field = packet + 6;
+                uint64_t base = (uint64_t(field[0]) << 25) | (uint64_t(field[1]) << 17) | (uint64_t(field[2]) << 9) |
+                                (uint64_t(field[3]) << 1) | (field[4] >> 7);
+                uint64_t extension = (uint64_t(field[4] & 0x1) << 8) | field[5];
+                onPcr(base * 300 + extension, packet_offset);
+            }
+        }
+    }
+    if (!(adaptation_control & 0x1))
+    {
+        return; // No payload, the continuity counter does not advance
+    }
+
+    PidState &state = getPid(pid);
+    if (state.continuity >= 0 && !discontinuity)
+    {
+        if (continuity == state.continuity)
+        {
+            // One repetition is allowed, a second one is an error
+            if (!state.duplicate)
+            {
+                state.duplicate = true;
+                stats.duplicates++;
+                return;
+            }
+            stats.cc_errors++;
+        }
+        else if (continuity != ((state.continuity + 1) & 0x0F))
+        {
+            stats.cc_errors++;
+        }
+    }
+    state.duplicate = false;
+    state.continuity = static_cast<int8_t>(continuity);
+
+    if (!unit_start)
+    {
+        return;
+    }
+    const uint8_t *payload = packet + payload_start;
+    size_t size = TS_PACKET_SIZE - payload_start;
+    if (pid == TS_PAT_PID)
+    {
+        parsePat(payload, size);
+    }
+    else if (isPmtPid(pid))
+    {
+        parsePmt(payload, size);
+    }
+    else if (isEsPid(pid))
+    {
+        parsePes(payload, size);
+    }
+}
+
+TsValidator::PidState &TsValidator::getPid(uint16_t pid)
+{
+    for (PidState &state : pids)
+    {
+        if (state.pid == pid)
+        {
+            return state;
+        }
+    }
+    pids.push_back(PidState{pid});
+    return pids.back();
+}
+
+bool TsValidator::isPmtPid(uint16_t pid) const
+{
+    return std::find(pmtPids.begin(), pmtPids.end(), pid) != pmtPids.end();
+}
+
+bool TsValidator::isEsPid(uint16_t pid) const
+{
+    return std::find(esPids.begin(), esPids.end(), pid) != esPids.end();
+}
+
+// Sections are only parsed when they fit the first packet, which PAT and PMT in HLS always do
+void TsValidator::parsePat(const uint8_t *payload, size_t size)
+{
+    size_t pointer = payload[0];
+    if (1 + pointer + 8 > size)
+    {
+        return;
+    }
+    const uint8_t *section = payload + 1 + pointer;
+    if (section[0] != TS_PAT_TABLE_ID)
+    {
+        return;
+    }
+    size_t section_length = ((section[1] & 0x0F) << 8) | section[2];
+    // Program loop between the 8 byte header and the CRC
+    size_t loop_end = std::min(3 + section_length - 4, size - 1 - pointer);
+    for (size_t i = 8; i + 4 <= loop_end; i += 4)
+    {
+        uint16_t program = static_cast<uint16_t>((section[i] << 8) | section[i + 1]);
+        uint16_t pmt_pid = static_cast<uint16_t>(((section[i + 2] & 0x1F) << 8) | section[i + 3]);
+        if (program != 0)
+        {
+            addUnique(pmtPids, pmt_pid);
+        }
+    }
+    stats.pat_count++;
+}
+
+void TsValidator::parsePmt(const uint8_t *payload, size_t size)
+{
+    size_t pointer = payload[0];
+    if (1 + pointer + 12 > size)
+    {
+        return;
+    }
+    const uint8_t *section = payload + 1 + pointer;
+    if (section[0] != TS_PMT_TABLE_ID)
+    {
+        return;
+    }
+    size_t section_length = ((section[1] & 0x0F) << 8) | section[2];
+    stats.pcr_pid = ((section[8] & 0x1F) << 8) | section[9];
+    size_t program_info_length = ((section[10] & 0x0F) << 8) | section[11];
+    size_t loop_end = std::min(3 + section_length - 4, size - 1 - pointer);
+    for (size_t i = 12 + program_info_length; i + 5 <= loop_end;)
+    {
+        uint16_t es_pid = static_cast<uint16_t>(((section[i + 1] & 0x1F) << 8) | section[i + 2]);
+        size_t es_info_length = ((section[i + 3] & 0x0F) << 8) | section[i + 4];
+        addUnique(esPids, es_pid);
+        i += 5 + es_info_length;
+    }
+    stats.pmt_count++;
+}
+
+void TsValidator::parsePes(const uint8_t *payload, size_t size)
+{
+    if (size < 14 || payload[0] != 0x00 || payload[1] != 0x00 || payload[2] != 0x01)
+    {
+        return;
+    }
+    bool has_pts = (payload[7] & 0x80) != 0;
+    if (!has_pts || pcrs_seen == 0)
+    {
+        return;
+    }
+    uint64_t pts = (uint64_t((payload[9] >> 1) & 0x07) << 30) | (uint64_t(payload[10]) << 22) |
+                   (uint64_t(payload[11] >> 1) << 15) | (uint64_t(payload[12]) << 7) | (payload[13] >> 1);
+    // The PCR base runs at 90 kHz like the PTS
+    double offset_ms = wrappedDiff(pts, pcr[2] / 300, PTS_MODULUS) / 90.0;
+    if (stats.pts_count == 0)
+    {
+        stats.min_pcr_pts_offset = offset_ms;
+        stats.max_pcr_pts_offset = offset_ms;
+    }
+    stats.min_pcr_pts_offset = std::min(stats.min_pcr_pts_offset, offset_ms);
+    stats.max_pcr_pts_offset = std::max(stats.max_pcr_pts_offset, offset_ms);
+    stats.pts_count++;
+    if (offset_ms < 0)
+    {
+        stats.late_pts++;
+    }
+}
+
+void TsValidator::onPcr(uint64_t value, uint64_t packet_offset)
+{
+    stats.pcr_count++;
+    if (pcrs_seen > 0)
+    {
+        double interval = wrappedDiff(value, pcr[2], PCR_MODULUS) / 27000.0;
+        stats.max_pcr_interval = std::max(stats.max_pcr_interval, interval);
+        if (interval > TS_MAX_PCR_INTERVAL_MS)
+        {
+            stats.pcr_interval_errors++;
+        }
+    }
+    pcr[0] = pcr[1];
+    pcr[1] = pcr[2];
+    pcr[2] = value;
+    pcr_offset[0] = pcr_offset[1];
+    pcr_offset[1] = pcr_offset[2];
+    pcr_offset[2] = packet_offset;
+    pcrs_seen++;
+
+    // Middle PCR against the one interpolated from its neighbours at a constant bitrate
+    if (pcrs_seen >= 3 && pcr_offset[2] > pcr_offset[0])
+    {
+        double span = static_cast<double>(wrappedDiff(pcr[2], pcr[0], PCR_MODULUS));
+        double position = static_cast<double>(pcr_offset[1] - pcr_offset[0]) / (pcr_offset[2] - pcr_offset[0]);
+        double expected = span * position;
+        double actual = static_cast<double>(wrappedDiff(pcr[1], pcr[0], PCR_MODULUS));
+        stats.max_pcr_jitter = std::max(stats.max_pcr_jitter, std::fabs(actual - expected) / 27.0);
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef TS_VALIDATOR_HPP
+#define TS_VALIDATOR_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <string>
+
+namespace playback
+{
+
+    constexpr size_t TS_PACKET_SIZE = 188;
+    constexpr uint8_t TS_SYNC_BYTE = 0x47;
+    // ISO/IEC 13818-1 requires a PCR at least every 100 ms
+    constexpr double TS_MAX_PCR_INTERVAL_MS = 100;
+
+    // Transport level health of a segment, TR 101 290 style counters
+    struct TsStats
+    {
+        size_t packets = 0;
+        size_t sync_losses = 0;   // Times the 0x47 sync had to be searched for again
+        size_t skipped_bytes = 0; // Bytes dropped while out of sync
+        size_t transport_errors = 0; // Packets with transport_error_indicator set
+        size_t cc_errors = 0;     // Continuity counter jumps without a discontinuity flag
+        size_t duplicates = 0;    // Repeated packets (same continuity counter)
+        size_t pat_count = 0;
+        size_t pmt_count = 0;
+        size_t pcr_count = 0;
+        int pcr_pid = -1;                // From the PMT, -1 if no PMT was seen
+        double max_pcr_interval = 0;     // ms
+        size_t pcr_interval_errors = 0;  // Intervals over TS_MAX_PCR_INTERVAL_MS
+        double max_pcr_jitter = 0;       // PCR deviation from a constant bitrate, us, informative for VBR muxes
+        size_t pts_count = 0;            // PES headers carrying a PTS, after the first PCR
+        double min_pcr_pts_offset = 0;   // PTS minus the last PCR, ms, how early a frame arrives
+        double max_pcr_pts_offset = 0;   // ms
+        size_t late_pts = 0;             // PTS already behind the PCR, the decoder would underflow
+
+        // At least one TR 101 290 first or second priority error
+        bool hasErrors() const;
+
+        // Short description of the errors, empty if none
+        std::string describeErrors() const;
+    };
+
+    /**
+     * @brief Streaming MPEG-TS checker fed with raw segment bytes as they are received.
+     *
+     * Packets are parsed in place from the buffers passed to feed(), only a packet split across
+     * two buffers is assembled in a 188 byte carry buffer. Tracks per PID continuity counters,
+     * PAT/PMT presence, PCR intervals and accuracy, and the PCR to PTS offset of the PES headers.
+     * Input that does not start with a sync byte (e.g. fMP4) is not TS and is ignored.
+     *
+     * PCR jitter is measured against the byte position (the PCR expected from a constant bitrate
+     * between its neighbours), as segments are delivered over HTTP the arrival time carries no
+     * meaning.
+     */
+    class TsValidator
+    {
+    public:
+        TsValidator() = default;
+
+        // Parses the complete packets in `data`, keeps a trailing partial packet
+        void feed(const uint8_t *data, size_t size);
+
+        // Stats of everything fed so far, a trailing partial packet counts as skipped until a
+        // later feed() completes it, so the bytes of one stream may arrive in several transfers
+        TsStats getStats() const;
+
+        // false once the input is known not to be a transport stream
+        bool isTransportStream() const;
+
+    private:
+        struct PidState
+        {
+            uint16_t pid;
+            int8_t continuity = -1; // Last continuity counter, -1 before the first payload
+            bool duplicate = false; // Last packet already was a duplicate
+        };
+
+        void parsePacket(const uint8_t *packet);
+        PidState &getPid(uint16_t pid);
+        void parsePat(const uint8_t *payload, size_t size);
+        void parsePmt(const uint8_t *payload, size_t size);
+        void parsePes(const uint8_t *payload, size_t size);
+        void onPcr(uint64_t pcr, uint64_t packet_offset);
+        bool isPmtPid(uint16_t pid) const;
+        bool isEsPid(uint16_t pid) const;
+
+    private:
+        TsStats stats;
+        uint8_t carry[TS_PACKET_SIZE];
+        size_t carry_size = 0;
+        bool in_sync = true;
+        bool checked_format = false;
+        bool transport_stream = true;
+        uint64_t offset = 0; // Bytes consumed, position of the current packet
+
+        std::vector<PidState> pids; // Few PIDs per stream, linear search beats a map
+        std::vector<uint16_t> pmtPids;
+        std::vector<uint16_t> esPids;
+
+        // Last three PCRs (27 MHz) and the byte offset they were found at, for the jitter
+        uint64_t pcr[3] = {0, 0, 0};
+        uint64_t pcr_offset[3] = {0, 0, 0};
+        size_t pcrs_seen = 0;
+    };
+
+} // namespace playback
+
+#endif // TS_VALIDATOR_HPP
@@ -0,0 +1,312 @@
+#include "variant_monitor.hpp"
+#include "http_client.hpp"
+#include "constants.hpp"
+#include "logger.hpp"
+
+#include <map>
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#include <iterator>
+
+using namespace playback;
+
+constexpr const char *VM_TAG = "VariantMonitor";
+
+// Renditions of one sequence are aligned if their durations and first pts are this close
+constexpr double ALIGNMENT_TOLERANCE_MS = 100;
+
+VariantMonitor::VariantMonitor(const std::string &master_uri, size_t max_concurrent_decodes, DecoderOptions decoder_options)
+{
+    HttpClient httpClient;
+    std::string manifest;
+    HttpTransferInfo info;
+    if (httpClient.fetch(master_uri, manifest, &info) != CURLE_OK || info.response_code >= 400)
+    {
+        throw std::runtime_error("Failed to fetch master playlist: " + master_uri);
+    }
+
+    variants = HLSManifestParser::parseMasterPlaylist(manifest, master_uri);
+    if (variants.empty())
+    {
+        throw std::runtime_error("No variant streams in master playlist: " + master_uri);
+    }
+
+    std::vector<std::string> uris;
+    for (const auto &variant : variants)
+    {
+        Logger::getInstance().log("Rendition " + std::to_string(variant.res_width) + "x" + std::to_string(variant.res_height) +
+                                      " @ " + std::to_string(variant.bandwidth) + " bps: " + variant.uri,
+                                  Logger::Severity::INFO, VM_TAG);
+        uris.push_back(variant.uri);
+    }
+    sequenceOffsets.assign(variants.size(), 0);
+    monitor = std::make_unique<MultiStreamMonitor>(uris, max_concurrent_decodes, decoder_options);
+    for (size_t i = 0; i < variants.size(); i++)
+    {
+        monitor->getStream(i).setDeclaredBandwidth(variants[i].bandwidth);
+    }
+}
+
+void VariantMonitor::start()
+{
+    monitor->start();
+}
+
+void VariantMonitor::stop()
+{
+    monitor->stop();
+}
+
+const std::vector<HLSVariantStream> &VariantMonitor::getVariants() const
+{
+    return variants;
+}
+
+MultiStreamMonitor &VariantMonitor::getMonitor()
+{
+    return *monitor;
+}
+
+std::vector<VariantMonitor::Timeline> VariantMonitor::getAlignedTimelines()
+{
+    std::vector<Timeline> timelines(variants.size());
+    // First pts -> media sequence of the reference rendition
+    std::map<long, long> reference;
+    for (auto &segment : monitor->getStream(0).getSegments())
+    {
+        long first_pts = segment->getFirstPts();
+        if (first_pts >= 0)
+        {
+            reference[first_pts] = segment->getSequenceNumber();
+        }
+        timelines[0][segment->getSequenceNumber()] = segment;
+    }
+    for (size_t i = 1; i < variants.size(); i++)
+    {
+        std::vector<std::shared_ptr<HLSSegment>> segments = monitor->getStream(i).getSegments();
+        // Every segment votes for the offset to the reference segment starting at the same pts
+        std::map<long, size_t> votes;
+        for (auto &segment : segments)
+        {
+            long first_pts = segment->getFirstPts();
+            if (first_pts < 0 || reference.empty())
+            {
+                continue;
+            }
+            auto match = reference.lower_bound(first_pts);
+            if (match == reference.end() || (match != reference.begin() && first_pts - std::prev(match)->first < match->first - first_pts))
+            {
+                match = std::prev(match);
+            }
+            if (std::labs(match->first - first_pts) <= ALIGNMENT_TOLERANCE_MS)
+            {
+                votes[match->second - segment->getSequenceNumber()]++;
+            }
+        }
+        if (!votes.empty())
+        {
+            long offset = std::max_element(votes.begin(), votes.end(), [](const auto &a, const auto &b)
+                                           { return a.second < b.second; })
+                              ->first;
+            if (offset != sequenceOffsets[i])
+            {
+                Logger::getInstance().log("Rendition " + variants[i].uri + " is " + std::to_string(offset) +
+                                              " media sequence(s) off the first rendition, aligning by pts",
+                                          Logger::Severity::WARNING, VM_TAG);
+                sequenceOffsets[i] = offset;
+            }
+        }
+        for (auto &segment : segments)
+        {
+            timelines[i][segment->getSequenceNumber() + sequenceOffsets[i]] = segment;
+        }
+    }
+    return timelines;
+}
+
+std::vector<RenditionReport> VariantMonitor::getReport(size_t window)
+{
+    // Segments of every rendition keyed by aligned media sequence
+    std::vector<Timeline> timelines = getAlignedTimelines();
+    long newest = -1;
+    for (size_t i = 0; i < variants.size(); i++)
+    {
+        if (!timelines[i].empty())
+        {
+            newest = std::max(newest, timelines[i].rbegin()->first);
+        }
+    }
+
+    std::vector<RenditionReport> reports(variants.size());
+    for (size_t i = 0; i < variants.size(); i++)
+    {
+        reports[i].variant = variants[i];
+        reports[i].lag = timelines[i].empty() ? static_cast<long>(window) : newest - timelines[i].rbegin()->first;
+    }
+    if (newest < 0)
+    {
+        return reports;
+    }
+
+    std::vector<size_t> bytes(variants.size(), 0);
+    std::vector<long> transfer_time(variants.size(), 0);
+    std::vector<double> declared_ms(variants.size(), 0);
+    for (long sequence = std::max(0L, newest - static_cast<long>(window) + 1); sequence <= newest; sequence++)
+    {
+        // First downloaded rendition of this sequence is the reference for the others
+        std::shared_ptr<HLSSegment> reference;
+        for (size_t i = 0; i < variants.size(); i++)
+        {
+            auto it = timelines[i].find(sequence);
+            if (it == timelines[i].end())
+            {
+                if (!timelines[i].empty() && timelines[i].begin()->first < sequence && timelines[i].rbegin()->first > sequence)
+                {
+                    reports[i].missing++;
+                }
+                continue;
+            }
+            std::shared_ptr<HLSSegment> segment = it->second;
+            SegmentStatus status = segment->getStatus();
+            if (status == SegmentStatus::DOWNLOAD_FAILED)
+            {
+                reports[i].failed++;
+                continue;
+            }
+            if (status != SegmentStatus::DOWNLOADED)
+            {
+                continue;
+            }
+            reports[i].downloaded++;
+            bytes[i] += segment->getTransferredBytes();
+            transfer_time[i] += segment->getTransferTime();
+            declared_ms[i] += segment->getDeclaredDuration() * 1000;
+
+            if (!reference)
+            {
+                reference = segment;
+                continue;
+            }
+            bool duration_differs = std::fabs(segment->getDeclaredDuration() - reference->getDeclaredDuration()) * 1000 > ALIGNMENT_TOLERANCE_MS;
+            long first_pts = segment->getFirstPts();
+            long reference_pts = reference->getFirstPts();
+            bool pts_differs = first_pts >= 0 && reference_pts >= 0 && std::labs(first_pts - reference_pts) > ALIGNMENT_TOLERANCE_MS;
+            if (duration_differs || pts_differs)
+            {
+                reports[i].misaligned++;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < variants.size(); i++)
+    {
+        RenditionReport &report = reports[i];
+        report.estimate_kbps = monitor->getStream(i).getThroughputEstimator().getEstimateKbps();
+        report.player = monitor->getStream(i).getPlayerBuffer();
+        report.player.series.clear(); // Summary only, the series stays with the stream
+        if (transfer_time[i] > 0)
+        {
+            report.throughput_kbps = bytes[i] * 8.0 / transfer_time[i];
+        }
+        if (declared_ms[i] > 0)
+        {
+            report.segment_bitrate_kbps = bytes[i] * 8.0 / declared_ms[i];
+            report.download_ratio = transfer_time[i] / declared_ms[i];
+        }
+        report.viable = report.downloaded > 0 && report.failed == 0 && report.download_ratio < 1.0 &&
+                        report.throughput_kbps * 1000 >= report.variant.bandwidth;
+    }
+    return reports;
+}
+
+AbrTrace VariantMonitor::getTrace()
+{
+    // Ladder order, lowest BANDWIDTH first
+    std::vector<size_t> ladder(variants.size());
+    for (size_t i = 0; i < ladder.size(); i++)
+    {
+        ladder[i] = i;
+    }
+    std::stable_sort(ladder.begin(), ladder.end(), [this](size_t a, size_t b)
+                     { return variants[a].bandwidth < variants[b].bandwidth; });
+
+    std::vector<Timeline> timelines = getAlignedTimelines();
+    for (Timeline &timeline : timelines)
+    {
+        for (auto it = timeline.begin(); it != timeline.end();)
+        {
+            bool downloaded = it->second->getStatus() == SegmentStatus::DOWNLOADED && it->second->getTransferredBytes() > 0;
+            it = downloaded ? std::next(it) : timeline.erase(it);
+        }
+    }
+
+    AbrTrace trace;
+    for (size_t index : ladder)
+    {
+        trace.bitrates.push_back(variants[index].bandwidth);
+    }
+    std::vector<long> ttfbs;
+    long previous_finish = -1; // Latest transfer end of the sequences so far
+    double previous_kbps = 0;
+    // Sequences downloaded by every rendition, following the first one
+    for (const auto &entry : timelines[ladder.front()])
+    {
+        long sequence = entry.first;
+        AbrSegment segment;
+        segment.duration = entry.second->getDeclaredDuration();
+        size_t bytes = 0;
+        long started_at = -1;
+        long finished_at = -1;
+        std::vector<long> sequence_ttfbs;
+        for (size_t index : ladder)
+        {
+            auto it = timelines[index].find(sequence);
+            if (it == timelines[index].end())
+            {
+                break;
+            }
+            const std::shared_ptr<HLSSegment> &rendition = it->second;
+            segment.sizes.push_back(rendition->getTransferredBytes());
+            bytes += rendition->getTransferredBytes();
+            long start = rendition->getTransferStartedAt();
+            started_at = started_at < 0 ? start : std::min(started_at, start);
+            finished_at = std::max(finished_at, rendition->getTransferFinishedAt());
+            sequence_ttfbs.push_back(rendition->getTtfb());
+        }
+        if (segment.sizes.size() != ladder.size() || segment.duration <= 0)
+        {
+            continue;
+        }
+        trace.segments.push_back(segment);
+        ttfbs.insert(ttfbs.end(), sequence_ttfbs.begin(), sequence_ttfbs.end());
+
+        // The samples tile the recording: the link idles between segment fetches of a live
+        // stream, the idle stretch keeps the last measured rate so the replay keeps real time.
+        // A fetch overlapping the previous one only counts from where that one ended.
+        long begin = started_at;
+        if (previous_finish >= 0)
+        {
+            if (started_at > previous_finish && previous_kbps > 0)
+            {
+                trace.network.push_back({static_cast<double>(started_at - previous_finish), previous_kbps});
+            }
+            begin = std::max(started_at, previous_finish);
+        }
+        if (finished_at > begin)
+        {
+            NetworkSample sample;
+            sample.duration = static_cast<double>(finished_at - begin);
+            sample.kbps = bytes * 8.0 / sample.duration;
+            trace.network.push_back(sample);
+            previous_kbps = sample.kbps;
+        }
+        previous_finish = std::max(previous_finish, finished_at);
+    }
+    if (!ttfbs.empty())
+    {
+        std::nth_element(ttfbs.begin(), ttfbs.begin() + ttfbs.size() / 2, ttfbs.end());
+        trace.latency = ttfbs[ttfbs.size() / 2] / 1000.0;
+    }
+    return trace;
+}
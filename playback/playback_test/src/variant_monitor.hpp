@@ -0,0 +1,107 @@
+#ifndef VARIANT_MONITOR_HPP
+#define VARIANT_MONITOR_HPP
+
+#include "multi_stream.hpp"
+#include "abr_simulator.hpp"
+#include "hls_parser.hpp"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+namespace playback
+{
+
+    // Health of one rendition over the most recent media sequences
+    struct RenditionReport
+    {
+        HLSVariantStream variant;
+        size_t downloaded = 0;  // Segments downloaded in the window
+        size_t failed = 0;      // Segments that failed in the window
+        size_t missing = 0;     // Sequences other renditions have, missing here although newer ones exist
+        size_t misaligned = 0;  // Segments whose duration or first pts differs from the other renditions
+        long lag = 0;           // Sequences behind the most advanced rendition
+        double throughput_kbps = 0;      // Bytes received over time spent receiving them
+        double estimate_kbps = 0;        // Throughput estimate of the stream a player would use
+        double segment_bitrate_kbps = 0; // Bytes received over declared media duration
+        double download_ratio = 0;       // Transfer time over declared media duration, < 1 keeps up
+        bool viable = false;             // Keeps up with its declared BANDWIDTH on the current link
+        PlayerBufferReport player;       // Virtual player following this rendition alone
+    };
+
+    /**
+     * @brief Monitors every rendition of a master playlist in parallel.
+     *
+     * The master playlist is fetched once, then all variant media playlists are driven from a
+     * MultiStreamMonitor. Segments of different renditions are matched by the pts of their first
+     * frame, so the report compares the same stretch of content across the ladder even when the
+     * packager numbers the renditions differently. Media sequence numbers are only trusted until
+     * frames were decoded, and a rendition found offset from the first one is logged.
+     *
+     * A rendition is viable when its segments were fetched at least as fast as its declared
+     * BANDWIDTH and faster than real time, i.e. a player could sustain it on the current link.
+     * All renditions share the link while monitored, so the figures are a lower bound of what a
+     * player fetching a single rendition would see.
+     */
+    class VariantMonitor
+    {
+    public:
+        /**
+         * @brief Constructor for VariantMonitor, fetches the master playlist.
+         *
+         * @param master_uri Uri of the master playlist.
+         * @param max_concurrent_decodes Segments decoded in parallel across all renditions.
+         * @param decoder_options How the shared workers decode the segments.
+         *
+         * @throws std::runtime_error if the master playlist cannot be fetched or lists no variants.
+         */
+        VariantMonitor(const std::string &master_uri, size_t max_concurrent_decodes = DEFAULT_DOWNLOAD_WORKERS,
+                       DecoderOptions decoder_options = DecoderOptions());
+
+        void start();
+
+        void stop();
+
+        const std::vector<HLSVariantStream> &getVariants() const;
+
+        /**
+         * @brief Compares the renditions over the last `window` media sequences.
+         *
+         * @param window Number of most recent media sequences to compare.
+         * @return One report per variant, in master playlist order.
+         */
+        std::vector<RenditionReport> getReport(size_t window);
+
+        /**
+         * @brief Records the retained sequences every rendition downloaded as an ABR trace.
+         *
+         * The link throughput of a sequence is the bytes of all its renditions over the wall
+         * time they were fetched in, as they are fetched together this is the capacity of the
+         * link rather than the share of one rendition.
+         */
+        AbrTrace getTrace();
+
+        // Underlying event loop, gives access to the per-rendition parsers
+        MultiStreamMonitor &getMonitor();
+
+    private:
+        using Timeline = std::map<long, std::shared_ptr<HLSSegment>>;
+
+        /**
+         * @brief Segments of every rendition keyed by the media sequence of the first rendition.
+         *
+         * Each rendition is shifted by the sequence offset most of its segments have to the
+         * segments of the first rendition with the same first pts.
+         */
+        std::vector<Timeline> getAlignedTimelines();
+
+    private:
+        std::vector<HLSVariantStream> variants;
+        std::vector<long> sequenceOffsets; // Added to a rendition's media sequence, last found
+        std::unique_ptr<MultiStreamMonitor> monitor;
+    };
+
+} // namespace playback
+
+#endif // VARIANT_MONITOR_HPP
@@ -0,0 +1,164 @@
+// ABR simulation over hand-made traces: BOLA decisions against the buffer level, stall and
+// startup accounting of the simulated player, and the text format of recorded traces.
+
+#include "check.hpp"
+
+#include "abr_simulator.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using namespace playback;
+
+namespace
+{
+    constexpr double SEGMENT_S = 2;
+
+    // Three variants, every segment SEGMENT_S long at exactly its declared bitrate
+    AbrTrace makeTrace(size_t segments, double link_kbps)
+    {
+        AbrTrace trace;
+        trace.bitrates = {1000000, 2000000, 4000000};
+        for (size_t i = 0; i < segments; i++)
+        {
+            AbrSegment segment;
+            segment.duration = SEGMENT_S;
+            for (long bitrate : trace.bitrates)
+            {
+                segment.sizes.push_back(static_cast<size_t>(bitrate * SEGMENT_S / 8));
+            }
+            trace.segments.push_back(segment);
+        }
+        trace.network.push_back({1000, link_kbps});
+        return trace;
+    }
+
+    size_t bolaChoice(const AbrTrace &trace, double buffer_level)
+    {
+        ThroughputEstimator throughput;
+        AbrContext context;
+        context.trace = &trace;
+        context.buffer_level = buffer_level;
+        context.throughput = &throughput;
+        BolaPolicy bola;
+        return bola.choose(context);
+    }
+
+    // With the dash.js parameters the lowest variant is chosen on an empty buffer and the top
+    // one from the 12 s buffer target up
+    void testBolaDecisions()
+    {
+        AbrTrace trace = makeTrace(1, 1000);
+        CHECK(bolaChoice(trace, 0) == 0);
+        CHECK(bolaChoice(trace, 2) == 0);
+        CHECK(bolaChoice(trace, 11) == 1);
+        CHECK(bolaChoice(trace, 12) == 2);
+        CHECK(bolaChoice(trace, 30) == 2);
+
+        // Never lower on a fuller buffer
+        size_t previous = 0;
+        for (double level = 0; level <= 30; level += 0.5)
+        {
+            size_t quality = bolaChoice(trace, level);
+            CHECK(quality >= previous);
+            previous = quality;
+        }
+    }
+
+    // A link 10x the top bitrate: BOLA climbs with the buffer, never stalls and ends on top
+    void testBolaFastLink()
+    {
+        AbrTrace trace = makeTrace(40, 40000);
+        BolaPolicy bola;
+        AbrResult result = AbrSimulator().simulate(trace, bola);
+        CHECK(result.segments == 40);
+        CHECK(result.stalls == 0);
+        CHECK_NEAR(result.stall_time, 0, 1e-9);
+        CHECK(result.qualities.front() == 0);
+        CHECK(result.qualities.back() == 2);
+        for (size_t i = 1; i < result.qualities.size(); i++)
+        {
+            CHECK(result.qualities[i] >= result.qualities[i - 1]);
+        }
+        // The first segment (2 Mbit at 40 Mbit/s) is enough to start
+        CHECK_NEAR(result.startup_delay, 0.05, 1e-9);
+    }
+
+    // Half the lowest bitrate: every segment takes 4 s to fetch and plays for 2 s, so after
+    // startup each one ends a 2 s stall. BOLA never sees more than one segment buffered.
+    void testStallAccounting()
+    {
+        const size_t segments = 5;
+        AbrTrace trace = makeTrace(segments, 500);
+        BolaPolicy bola;
+        AbrResult result = AbrSimulator().simulate(trace, bola);
+        for (size_t quality : result.qualities)
+        {
+            CHECK(quality == 0);
+        }
+        CHECK_NEAR(result.startup_delay, 4, 1e-9);
+        CHECK(result.stalls == segments - 1);
+        CHECK_NEAR(result.stall_time, 2.0 * (segments - 1), 1e-9);
+        CHECK_NEAR(result.duration, 4.0 * segments + SEGMENT_S, 1e-9);
+        CHECK(result.switches == 0);
+
+        // Request latency is spent before every download
+        trace.latency = 500;
+        result = AbrSimulator().simulate(trace, bola);
+        CHECK(result.stalls == segments - 1);
+        CHECK_NEAR(result.startup_delay, 4.5, 1e-9);
+        CHECK_NEAR(result.stall_time, 2.5 * (segments - 1), 1e-9);
+    }
+
+    // A slow stretch early in the recording: 3 s buffered by the time it starts, the next
+    // segment takes 8 s, the stall lasts from 7 s until the segment arrives at 11 s
+    void testRecordedDip()
+    {
+        AbrTrace trace = makeTrace(10, 0);
+        trace.network = {{3000, 2000}, {8000, 250}, {100000, 2000}};
+        AbrSimulationOptions options;
+        options.rebuffer_buffer = 2;
+        BolaPolicy bola;
+        AbrResult result = AbrSimulator(options).simulate(trace, bola);
+        CHECK(result.stalls == 1);
+        CHECK_NEAR(result.stall_time, 4, 1e-9);
+        CHECK_NEAR(result.startup_delay, 1, 1e-9);
+        CHECK(result.qualities[3] == 0);
+    }
+
+    void testTraceRoundTrip()
+    {
+        AbrTrace trace = makeTrace(3, 1500);
+        trace.latency = 42.5;
+        trace.network.push_back({250, 800});
+        char path[] = "/tmp/abr_trace_XXXXXX";
+        int fd = mkstemp(path);
+        CHECK(fd >= 0);
+        close(fd);
+        trace.save(path);
+        AbrTrace loaded = AbrTrace::load(path);
+        std::remove(path);
+        CHECK(loaded.bitrates == trace.bitrates);
+        CHECK(loaded.segments.size() == trace.segments.size());
+        CHECK(loaded.segments[2].sizes == trace.segments[2].sizes);
+        CHECK(loaded.network.size() == 2);
+        CHECK_NEAR(loaded.network[1].kbps, 800, 1e-9);
+        CHECK_NEAR(loaded.latency, 42.5, 1e-9);
+    }
+} // namespace
+
+int main()
+{
+    testBolaDecisions();
+    testBolaFastLink();
+    testStallAccounting();
+    testRecordedDip();
+    testTraceRoundTrip();
+    if (checkFailures() == 0)
+    {
+        std::printf("abr_simulator_test: OK\n");
+    }
+    return checkFailures() == 0 ? 0 : 1;
+}
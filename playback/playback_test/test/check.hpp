@@ -0,0 +1,37 @@
+#ifndef PLAYBACK_TEST_CHECK_HPP
+#define PLAYBACK_TEST_CHECK_HPP
+
+#include <cstdio>
+
+// Minimal assertions for the test executables, a failed check is reported and counted
+// but does not stop the test, main() returns checkFailures() != 0
+inline int &checkFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                  \
+    do                                                                                    \
+    {                                                                                     \
+        if (!(condition))                                                                 \
+        {                                                                                 \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            checkFailures()++;                                                            \
+        }                                                                                 \
+    } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance)                                                          \
+    do                                                                                                   \
+    {                                                                                                    \
+        double check_actual = (actual);                                                                  \
+        double check_expected = (expected);                                                              \
+        if (check_actual < check_expected - (tolerance) || check_actual > check_expected + (tolerance)) \
+        {                                                                                                \
+            std::fprintf(stderr, "%s:%d: CHECK_NEAR failed: %s = %f, expected %f\n", __FILE__, __LINE__,  \
+                         #actual, check_actual, check_expected);                                         \
+            checkFailures()++;                                                                           \
+        }                                                                                                \
+    } while (0)
+
+#endif // PLAYBACK_TEST_CHECK_HPP
@@ -0,0 +1,459 @@
+// LL-HLS against a local stand-in origin: blocking playlist reload, parts, preload hints
+// and the assembly of parts into segments, plus the part priming bookkeeping of HLSSegment.
+
+#include "check.hpp"
+
+#include "constants.hpp"
+#include "logger.hpp"
+#include "hls_parser.hpp"
+#include "http_client.hpp"
+#include "segment_subscription.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace playback;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr long PART_MS = 200;
+    constexpr long PARTS_PER_SEGMENT = 4;
+    constexpr long INITIAL_PARTS = 3 * PARTS_PER_SEGMENT;
+    constexpr long WINDOW_SEGMENTS = 6;
+    constexpr std::chrono::milliseconds MAX_BLOCK(3000);
+    constexpr std::chrono::milliseconds RUN_TIME(3000);
+
+    long queryValue(const std::string &query, const std::string &key)
+    {
+        size_t position = query.find(key + "=");
+        return position == std::string::npos ? -1 : std::stol(query.substr(position + key.size() + 1));
+    }
+
+    /**
+     * Publishes one 200 ms part after another, four per segment, and serves them the way an
+     * LL-HLS origin does: playlist and part requests for what is not published yet are held
+     * until it is.
+     */
+    class StandInOrigin
+    {
+    public:
+        StandInOrigin()
+        {
+            listener = socket(AF_INET, SOCK_STREAM, 0);
+            int enable = 1;
+            setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address.sin_port = 0;
+            if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || listen(listener, 64) < 0)
+            {
+                throw std::runtime_error("Failed to listen");
+            }
+            socklen_t length = sizeof(address);
+            getsockname(listener, reinterpret_cast<sockaddr *>(&address), &length);
+            port = ntohs(address.sin_port);
+            started = Clock::now();
+            acceptThread = std::thread(&StandInOrigin::acceptLoop, this);
+        }
+
+        ~StandInOrigin()
+        {
+            stopping = true;
+            shutdown(listener, SHUT_RDWR);
+            close(listener);
+            acceptThread.join();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (int fd : connections)
+                {
+                    shutdown(fd, SHUT_RDWR);
+                }
+            }
+            for (auto &thread : connectionThreads)
+            {
+                thread.join();
+            }
+        }
+
+        std::string getPlaylistUri() const
+        {
+            return "http://127.0.0.1:" + std::to_string(port) + "/live.m3u8";
+        }
+
+        // Number of parts published so far, the first INITIAL_PARTS exist from the start
+        long getPublished() const
+        {
+            return INITIAL_PARTS + std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - started).count() / PART_MS;
+        }
+
+        Clock::time_point getPublishTime(long part) const
+        {
+            return started + std::chrono::milliseconds(std::max(0L, part - INITIAL_PARTS + 1) * PART_MS);
+        }
+
+        std::vector<std::string> getPlaylistRequests()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return playlistRequests;
+        }
+
+        // Part requests that arrived before the part was published (preload hints)
+        size_t getEarlyPartRequests() const
+        {
+            return earlyPartRequests;
+        }
+
+    private:
+        // Waits until `parts` parts are published, false after MAX_BLOCK
+        bool waitPublished(long parts) const
+        {
+            auto deadline = Clock::now() + MAX_BLOCK;
+            while (getPublished() < parts)
+            {
+                if (Clock::now() > deadline || stopping)
+                {
+                    return false;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+            return true;
+        }
+
+        std::string renderPlaylist(long published) const
+        {
+            long complete = published / PARTS_PER_SEGMENT;
+            long first = std::max(0L, complete - WINDOW_SEGMENTS);
+            std::ostringstream playlist;
+            playlist << "#EXTM3U\n#EXT-X-VERSION:9\n#EXT-X-TARGETDURATION:1\n"
+                     << "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=0.6\n"
+                     << "#EXT-X-PART-INF:PART-TARGET=0.2\n#EXT-X-MEDIA-SEQUENCE:" << first << "\n";
+            auto listParts = [&playlist](long segment, long count)
+            {
+                for (long part = 0; part < count; part++)
+                {
+                    playlist << "#EXT-X-PART:DURATION=0.200,URI=\"part-" << segment << "." << part << ".ts\""
+                             << (part == 0 ? ",INDEPENDENT=YES" : "") << "\n";
+                }
+            };
+            for (long segment = first; segment < complete; segment++)
+            {
+                if (segment >= complete - 2)
+                {
+                    listParts(segment, PARTS_PER_SEGMENT);
+                }
+                playlist << "#EXTINF:0.800,\nsegment-" << segment << ".ts\n";
+            }
+            listParts(complete, published % PARTS_PER_SEGMENT);
+            playlist << "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"part-" << complete << "." << published % PARTS_PER_SEGMENT << ".ts\"\n";
+            return playlist.str();
+        }
+
+        // Status line and body for a request path
+        std::pair<int, std::string> handle(const std::string &target)
+        {
+            size_t question = target.find('?');
+            std::string path = target.substr(0, question);
+            std::string query = question == std::string::npos ? "" : target.substr(question + 1);
+            if (path == "/live.m3u8")
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    playlistRequests.push_back(target);
+                }
+                long msn = queryValue(query, "_HLS_msn");
+                long part = queryValue(query, "_HLS_part");
+                if (msn >= 0 && !waitPublished(part >= 0 ? msn * PARTS_PER_SEGMENT + part + 1 : (msn + 1) * PARTS_PER_SEGMENT))
+                {
+                    return {503, ""};
+                }
+                return {200, renderPlaylist(getPublished())};
+            }
+            long segment = -1;
+            long part = -1;
+            if (std::sscanf(path.c_str(), "/part-%ld.%ld.ts", &segment, &part) == 2)
+            {
+                long index = segment * PARTS_PER_SEGMENT + part;
+                if (getPublished() <= index)
+                {
+                    earlyPartRequests++;
+                }
+                if (!waitPublished(index + 1))
+                {
+                    return {404, ""};
+                }
+                return {200, "part " + std::to_string(segment) + "." + std::to_string(part)};
+            }
+            if (std::sscanf(path.c_str(), "/segment-%ld.ts", &segment) == 1 && segment < getPublished() / PARTS_PER_SEGMENT)
+            {
+                return {200, "segment " + std::to_string(segment)};
+            }
+            return {404, ""};
+        }
+
+        void serve(int fd)
+        {
+            std::string buffer;
+            char chunk[4096];
+            while (!stopping)
+            {
+                size_t end = buffer.find("\r\n\r\n");
+                if (end == std::string::npos)
+                {
+                    ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+                    if (received <= 0)
+                    {
+                        break;
+                    }
+                    buffer.append(chunk, static_cast<size_t>(received));
+                    continue;
+                }
+                std::string request = buffer.substr(0, end);
+                buffer.erase(0, end + 4);
+                size_t first_space = request.find(' ');
+                size_t second_space = request.find(' ', first_space + 1);
+                auto response = handle(request.substr(first_space + 1, second_space - first_space - 1));
+                std::string reply = "HTTP/1.1 " + std::to_string(response.first) + (response.first == 200 ? " OK" : " Error") +
+                                    "\r\nContent-Length: " + std::to_string(response.second.size()) + "\r\n\r\n" + response.second;
+                if (send(fd, reply.data(), reply.size(), MSG_NOSIGNAL) < 0)
+                {
+                    break;
+                }
+            }
+            close(fd);
+        }
+
+        void acceptLoop()
+        {
+            while (!stopping)
+            {
+                int fd = accept(listener, nullptr, nullptr);
+                if (fd < 0)
+                {
+                    continue;
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                connections.push_back(fd);
+                connectionThreads.emplace_back(&StandInOrigin::serve, this, fd);
+            }
+        }
+
+        int listener = -1;
+        int port = 0;
+        Clock::time_point started;
+        std::atomic<bool> stopping{false};
+        std::atomic<size_t> earlyPartRequests{0};
+        std::thread acceptThread;
+        std::mutex mutex;
+        std::vector<int> connections;
+        std::vector<std::thread> connectionThreads;
+        std::vector<std::string> playlistRequests;
+    };
+
+    // Global part index of a "part-<segment>.<part>.ts" uri, -1 for anything else
+    long partIndex(const std::string &uri)
+    {
+        size_t slash = uri.find_last_of('/');
+        long segment = -1;
+        long part = -1;
+        if (std::sscanf(uri.c_str() + slash + 1, "part-%ld.%ld.ts", &segment, &part) != 2)
+        {
+            return -1;
+        }
+        return segment * PARTS_PER_SEGMENT + part;
+    }
+
+    void testPartPriming()
+    {
+        auto payload = [](const char *text)
+        { return std::make_shared<const std::string>(text); };
+        HLSSegment segment;
+        segment.addPart("p0", 0.2, false); // First part of a segment, always independent
+        segment.addPart("p1", 0.2, false);
+        segment.addPart("p2", 0.2, true);
+        segment.addPart("p3", 0.2, false);
+
+        CHECK(segment.addPartPayload("p0", payload("0")).empty());
+        auto priming = segment.addPartPayload("p1", payload("1"));
+        CHECK(priming.size() == 1 && *priming[0] == "0");
+        CHECK(segment.addPartPayload("p2", payload("2")).empty());
+        priming = segment.addPartPayload("p3", payload("3"));
+        CHECK(priming.size() == 1 && *priming[0] == "2");
+        CHECK(segment.addPartPayload("unknown", payload("x")).empty());
+    }
+
+    void testStandInOrigin()
+    {
+        StandInOrigin origin;
+        auto pool = std::make_shared<SegmentDownloadPool>(1);
+        HLSManifestParser parser(origin.getPlaylistUri(), pool);
+        auto subscription = std::make_shared<SegmentSubscription>(256);
+        parser.subscribe(subscription);
+
+        // Parts are fetched from the origin by a few threads, like the download pool would
+        struct Submitted
+        {
+            std::shared_ptr<HLSSegment> segment;
+            std::string uri;
+            Clock::time_point at;
+        };
+        std::mutex submittedMutex;
+        std::condition_variable submittedCondition;
+        std::deque<Submitted> queue;
+        std::vector<Submitted> submitted;
+        bool stopping = false;
+        parser.setSegmentFetcher([&](const std::shared_ptr<HLSSegment> &segment, const std::string &part_uri)
+                                 {
+                                     std::lock_guard<std::mutex> lock(submittedMutex);
+                                     Submitted entry{segment, part_uri.empty() ? segment->getUri() : part_uri, Clock::now()};
+                                     queue.push_back(entry);
+                                     submitted.push_back(entry);
+                                     submittedCondition.notify_one(); });
+
+        HttpClient client;
+        std::atomic<size_t> wrongBodies{0};
+        std::vector<std::thread> fetchers;
+        for (int i = 0; i < 4; i++)
+        {
+            fetchers.emplace_back([&]()
+                                  {
+                                      while (true)
+                                      {
+                                          Submitted job;
+                                          {
+                                              std::unique_lock<std::mutex> lock(submittedMutex);
+                                              submittedCondition.wait(lock, [&]() { return stopping || !queue.empty(); });
+                                              if (queue.empty())
+                                              {
+                                                  return;
+                                              }
+                                              job = queue.front();
+                                              queue.pop_front();
+                                          }
+                                          std::string body;
+                                          HttpTransferInfo info;
+                                          long index = partIndex(job.uri);
+                                          std::string expected = index >= 0 ? "part " + std::to_string(index / PARTS_PER_SEGMENT) + "." + std::to_string(index % PARTS_PER_SEGMENT) : "";
+                                          if (client.fetch(job.uri, body, &info) == CURLE_OK && info.response_code == 200)
+                                          {
+                                              if (index >= 0 && body != expected)
+                                              {
+                                                  wrongBodies++;
+                                              }
+                                              job.segment->download_complete();
+                                          }
+                                          else
+                                          {
+                                              job.segment->download_failed();
+                                          }
+                                      } });
+        }
+
+        // The refresh loop of a passive parser, as MultiStreamMonitor runs it
+        HttpClient playlistClient;
+        auto deadline = Clock::now() + RUN_TIME;
+        while (Clock::now() < deadline)
+        {
+            std::string body;
+            HttpTransferInfo info;
+            std::chrono::milliseconds delay;
+            if (playlistClient.fetch(parser.getPlaylistRequestUri(), body, &info) == CURLE_OK && info.response_code == 200)
+            {
+                delay = parser.onPlaylist(body, get_utc(), info);
+            }
+            else
+            {
+                delay = parser.onPlaylistError();
+            }
+            std::this_thread::sleep_for(delay);
+        }
+        {
+            std::lock_guard<std::mutex> lock(submittedMutex);
+            stopping = true;
+        }
+        submittedCondition.notify_all();
+        for (auto &fetcher : fetchers)
+        {
+            fetcher.join();
+        }
+
+        // Blocking reload: every refresh after the first names the next part
+        std::vector<std::string> requests = origin.getPlaylistRequests();
+        CHECK(requests.size() > 5);
+        for (size_t i = 1; i < requests.size(); i++)
+        {
+            CHECK(requests[i].find("_HLS_msn=") != std::string::npos && requests[i].find("_HLS_part=") != std::string::npos);
+        }
+
+        // Every part once, in order, soon after it was published
+        std::set<long> seen;
+        long previous = -1;
+        long max_delay = 0;
+        size_t parts = 0;
+        for (const Submitted &entry : submitted)
+        {
+            long index = partIndex(entry.uri);
+            if (index < 0)
+            {
+                continue;
+            }
+            parts++;
+            CHECK(seen.insert(index).second);
+            CHECK(index > previous);
+            previous = index;
+            max_delay = std::max(max_delay, static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(entry.at - origin.getPublishTime(index)).count()));
+        }
+        CHECK(parts >= static_cast<size_t>(RUN_TIME.count() / PART_MS) - 2);
+        // Polling at half the target duration would lag by up to 500 ms
+        CHECK(max_delay < 2 * PART_MS);
+        CHECK(origin.getEarlyPartRequests() > 0);
+        CHECK(wrongBodies == 0);
+
+        // Segments assembled from their parts complete with the EXTINF duration
+        // Snapshots arrive in completion order, which differs between the fetch threads
+        size_t partial = 0;
+        std::set<long> sequences;
+        while (auto snapshot = subscription->next(std::chrono::milliseconds(0)))
+        {
+            CHECK(snapshot->status == SegmentStatus::DOWNLOADED);
+            CHECK(sequences.insert(snapshot->sequence_number).second);
+            if (snapshot->partial)
+            {
+                partial++;
+                CHECK(snapshot->num_parts == PARTS_PER_SEGMENT);
+                CHECK(snapshot->parts_failed == 0);
+                CHECK_NEAR(snapshot->declared_duration, 0.8, 1e-6);
+            }
+        }
+        CHECK(partial >= 2);
+        CHECK(!sequences.empty() && *sequences.rbegin() - *sequences.begin() + 1 == static_cast<long>(sequences.size()));
+    }
+} // namespace
+
+int main()
+{
+    Logger::getInstance().setLogLevel(Logger::Severity::ERROR);
+    testPartPriming();
+    testStandInOrigin();
+    if (checkFailures() == 0)
+    {
+        std::printf("ll_hls_test: OK\n");
+    }
+    return checkFailures() == 0 ? 0 : 1;
+}